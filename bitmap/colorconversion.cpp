@@ -26,10 +26,17 @@ typedef int32 *DWORD_PTR;
 #endif
 
 #include "bitmap/floatbitmap.h"
+#include "vstdlib/jobthread.h"
+#include "vstdlib/random.h"
 
 #define STB_DXT_IMPLEMENTATION
 #include "bitmap/stb_dxt.h"
 
+#if ( defined( __i386__ ) || defined( __x86_64__ ) || defined( _M_IX86 ) || defined( _M_X64 ) ) && !defined( _X360 ) && !defined( _PS3 )
+#define DXT_DECODE_SSE2
+#include <emmintrin.h>
+#endif
+
 // Should be last include
 #include "tier0/memdbgon.h"
 
@@ -265,6 +272,20 @@ static RGBA8888ToUserFormatFunc_t GetRGBA8888ToUserFormatFunc_t( ImageFormat dst
 }
 
 
+//-----------------------------------------------------------------------------
+// Large images are block compressed and decompressed on this pool, a few rows
+// of blocks at a time. With no pool it all happens on the calling thread.
+//-----------------------------------------------------------------------------
+static IThreadPool *s_pDXTThreadPool = NULL;
+
+#define DXT_PARALLEL_DECODE_BLOCKS	16384		// 512x512
+#define DXT_PARALLEL_ENCODE_BLOCKS	256			// 64x64, encoding is a lot slower than decoding
+
+void SetThreadPool( IThreadPool *pPool )
+{
+	s_pDXTThreadPool = pPool;
+}
+
 
 #pragma pack(1)
 
@@ -285,6 +306,12 @@ struct DXTAlphaBlock3BitLinear
 	uint8 stuff[6];
 };
 
+struct DXTAlphaBlockExplicit
+{
+	// 4 bits per pixel, first pixel in the low bits
+	uint16 row[4];
+};
+
 #pragma pack()
 
 
@@ -444,123 +471,93 @@ static inline void DecodeColorBlock( CDestPixel *pOutputImage, DXTColBlock *pCol
 	}
 }
 
-template <class CDestPixel> 
-static inline void DecodeAlpha3BitLinear( CDestPixel *pImPos, DXTAlphaBlock3BitLinear *pAlphaBlock, int width, int nChannelSelect = 3 )
+//-----------------------------------------------------------------------------
+// Decodes the 16 alphas of a 3 bit linear alpha block, row by row
+//-----------------------------------------------------------------------------
+static inline void GetAlphas3BitLinear( DXTAlphaBlock3BitLinear *pAlphaBlock, uint8 *pAlphas )
 {
-	static BYTE		gBits[4][4];
-	static uint16		gAlphas[8];
-	static BGRA8888_t	gACol[4][4];
+	uint16 alphas[8];
 
-	gAlphas[0] = pAlphaBlock->alpha0;
-	gAlphas[1] = pAlphaBlock->alpha1;
+	alphas[0] = pAlphaBlock->alpha0;
+	alphas[1] = pAlphaBlock->alpha1;
 
 	// 8-alpha or 6-alpha block?    
 
-	if( gAlphas[0] > gAlphas[1] )
+	if( alphas[0] > alphas[1] )
 	{
 		// 8-alpha block:  derive the other 6 alphas.    
 		// 000 = alpha_0, 001 = alpha_1, others are interpolated
 
-		gAlphas[2] = ( 6 * gAlphas[0] +     gAlphas[1]) / 7;	// bit code 010
-		gAlphas[3] = ( 5 * gAlphas[0] + 2 * gAlphas[1]) / 7;	// Bit code 011    
-		gAlphas[4] = ( 4 * gAlphas[0] + 3 * gAlphas[1]) / 7;	// Bit code 100    
-		gAlphas[5] = ( 3 * gAlphas[0] + 4 * gAlphas[1]) / 7;	// Bit code 101
-		gAlphas[6] = ( 2 * gAlphas[0] + 5 * gAlphas[1]) / 7;	// Bit code 110    
-		gAlphas[7] = (     gAlphas[0] + 6 * gAlphas[1]) / 7;	// Bit code 111
+		alphas[2] = ( 6 * alphas[0] +     alphas[1]) / 7;	// bit code 010
+		alphas[3] = ( 5 * alphas[0] + 2 * alphas[1]) / 7;	// Bit code 011    
+		alphas[4] = ( 4 * alphas[0] + 3 * alphas[1]) / 7;	// Bit code 100    
+		alphas[5] = ( 3 * alphas[0] + 4 * alphas[1]) / 7;	// Bit code 101
+		alphas[6] = ( 2 * alphas[0] + 5 * alphas[1]) / 7;	// Bit code 110    
+		alphas[7] = (     alphas[0] + 6 * alphas[1]) / 7;	// Bit code 111
 	}    
 	else
 	{
 		// 6-alpha block:  derive the other alphas.    
 		// 000 = alpha_0, 001 = alpha_1, others are interpolated
 
-		gAlphas[2] = (4 * gAlphas[0] +     gAlphas[1]) / 5;	// Bit code 010
-		gAlphas[3] = (3 * gAlphas[0] + 2 * gAlphas[1]) / 5;	// Bit code 011    
-		gAlphas[4] = (2 * gAlphas[0] + 3 * gAlphas[1]) / 5;	// Bit code 100    
-		gAlphas[5] = (    gAlphas[0] + 4 * gAlphas[1]) / 5;	// Bit code 101
-		gAlphas[6] = 0;										// Bit code 110
-		gAlphas[7] = 255;									// Bit code 111
+		alphas[2] = (4 * alphas[0] +     alphas[1]) / 5;	// Bit code 010
+		alphas[3] = (3 * alphas[0] + 2 * alphas[1]) / 5;	// Bit code 011    
+		alphas[4] = (2 * alphas[0] + 3 * alphas[1]) / 5;	// Bit code 100    
+		alphas[5] = (    alphas[0] + 4 * alphas[1]) / 5;	// Bit code 101
+		alphas[6] = 0;										// Bit code 110
+		alphas[7] = 255;									// Bit code 111
 	}
 
-	// Decode 3-bit fields into array of 16 BYTES with same value
-
-	// first two rows of 4 pixels each:
-	// pRows = (Alpha3BitRows*) & ( pAlphaBlock->stuff[0] );
+	// Decode 3-bit fields into the alpha values, 8 of them in each 3 bytes
 	const uint32 mask = 0x00000007;		// bits = 00 00 01 11
 
+	// first two rows of 4 pixels each:
 	uint32 bits = *( (uint32*) & ( pAlphaBlock->stuff[0] ));
-
-	gBits[0][0] = (BYTE)( bits & mask );
-	bits >>= 3;
-	gBits[0][1] = (BYTE)( bits & mask );
-	bits >>= 3;
-	gBits[0][2] = (BYTE)( bits & mask );
-	bits >>= 3;
-	gBits[0][3] = (BYTE)( bits & mask );
-	bits >>= 3;
-	gBits[1][0] = (BYTE)( bits & mask );
-	bits >>= 3;
-	gBits[1][1] = (BYTE)( bits & mask );
-	bits >>= 3;
-	gBits[1][2] = (BYTE)( bits & mask );
-	bits >>= 3;
-	gBits[1][3] = (BYTE)( bits & mask );
+	for ( int i = 0; i < 8; i++, bits >>= 3 )
+	{
+		pAlphas[i] = (uint8)alphas[ bits & mask ];
+	}
 
 	// now for last two rows:
 	bits = *( (uint32*) & ( pAlphaBlock->stuff[3] ));		// last 3 bytes
-
-	gBits[2][0] = (BYTE)( bits & mask );
-	bits >>= 3;
-	gBits[2][1] = (BYTE)( bits & mask );
-	bits >>= 3;
-	gBits[2][2] = (BYTE)( bits & mask );
-	bits >>= 3;
-	gBits[2][3] = (BYTE)( bits & mask );
-	bits >>= 3;
-	gBits[3][0] = (BYTE)( bits & mask );
-	bits >>= 3;
-	gBits[3][1] = (BYTE)( bits & mask );
-	bits >>= 3;
-	gBits[3][2] = (BYTE)( bits & mask );
-	bits >>= 3;
-	gBits[3][3] = (BYTE)( bits & mask );
-
-	// decode the codes into alpha values
-	int row, pix;
-	for ( row = 0; row < 4; row++ )
+	for ( int i = 8; i < 16; i++, bits >>= 3 )
 	{
-		for ( pix=0; pix < 4; pix++ )
-		{
-			gACol[row][pix].a = (BYTE) gAlphas[ gBits[row][pix] ];
-
-			Assert( gACol[row][pix].r == 0 );
-			Assert( gACol[row][pix].g == 0 );
-			Assert( gACol[row][pix].b == 0 );
-		}
+		pAlphas[i] = (uint8)alphas[ bits & mask ];
 	}
+}
+
+template <class CDestPixel> 
+static inline void DecodeAlpha3BitLinear( CDestPixel *pImPos, DXTAlphaBlock3BitLinear *pAlphaBlock, int width, int nChannelSelect = 3 )
+{
+	// On the stack rather than static, blocks get decoded on several threads at once
+	uint8 alphas[16];
+	GetAlphas3BitLinear( pAlphaBlock, alphas );
 
 	// Write out alpha values to the image bits
+	const uint8 *pAlpha = alphas;
+	int row, pix;
 	for ( row=0; row < 4; row++, pImPos += width-4 )
 	{
-		for ( pix = 0; pix < 4; pix++ )
+		for ( pix = 0; pix < 4; pix++, pAlpha++ )
 		{
 			// zero the alpha bits of image pixel
 			switch ( nChannelSelect )
 			{
 				case 0:
-					pImPos->r = ( *(( BGRA8888_t *) &(gACol[row][pix])) ).a;
+					pImPos->r = *pAlpha;
 					pImPos->g = 0;	// Danger...stepping on the other color channels
 					pImPos->b = 0;
 					pImPos->a = 0;
 					break;
 				case 1:
-					pImPos->g = ( *(( BGRA8888_t *) &(gACol[row][pix])) ).a;
+					pImPos->g = *pAlpha;
 					break;
 				case 2:
-					pImPos->b = ( *(( BGRA8888_t *) &(gACol[row][pix])) ).a;
+					pImPos->b = *pAlpha;
 					break;
 				default:
 				case 3:
-					pImPos->a = ( *(( BGRA8888_t *) &(gACol[row][pix])) ).a;
+					pImPos->a = *pAlpha;
 					break;
 			}
 
@@ -569,6 +566,219 @@ static inline void DecodeAlpha3BitLinear( CDestPixel *pImPos, DXTAlphaBlock3BitL
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Decodes the 16 alphas of a DXT3 explicit alpha block, row by row
+//-----------------------------------------------------------------------------
+static inline void GetAlphas4BitExplicit( DXTAlphaBlockExplicit *pAlphaBlock, uint8 *pAlphas )
+{
+	for ( int row = 0; row < 4; row++ )
+	{
+		unsigned int bits = LittleShort( pAlphaBlock->row[row] );
+		for ( int pix = 0; pix < 4; pix++, bits >>= 4 )
+		{
+			*pAlphas++ = (uint8)RescaleBitNumber( bits, 4, 8 );
+		}
+	}
+}
+
+template <class CDestPixel> 
+static inline void DecodeAlpha4BitExplicit( CDestPixel *pImPos, DXTAlphaBlockExplicit *pAlphaBlock, int width )
+{
+	uint8 alphas[16];
+	GetAlphas4BitExplicit( pAlphaBlock, alphas );
+
+	const uint8 *pAlpha = alphas;
+	for ( int row = 0; row < 4; row++, pImPos += width-4 )
+	{
+		for ( int pix = 0; pix < 4; pix++, pImPos++ )
+		{
+			pImPos->a = *pAlpha++;
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Block decoders for 32 bit destinations (RGBA8888, BGRA8888 and BGRX8888).
+// The four colors of a block go through GetColorBlockColorsBGRA8888 and the
+// pixel type once, then the 16 pixels are picked out of them four at a time,
+// so the results are the same as DecodeColorBlock's.
+//-----------------------------------------------------------------------------
+template <class CDestPixel> 
+static inline void GetColorBlockPalette8888( DXTColBlock *pBlock, uint32 *pPalette )
+{
+	BGRA8888_t col[4];
+	uint16 wrd;
+	GetColorBlockColorsBGRA8888( pBlock, &col[0], &col[1], &col[2], &col[3], wrd );
+
+	for ( int i = 0; i < 4; i++ )
+	{
+		CDestPixel pixel;
+		pixel = col[i];
+		memcpy( &pPalette[i], &pixel, sizeof( uint32 ) );
+	}
+}
+
+// pAlphas is NULL for DXT1, otherwise the 16 alphas that replace the ones in the palette
+static inline void DecodeColorBlock8888( uint32 *pOutputImage, DXTColBlock *pColorBlock, int width,
+									   const uint32 *pPalette, const uint8 *pAlphas )
+{
+#ifdef DXT_DECODE_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i col0 = _mm_set1_epi32( (int)pPalette[0] );
+	const __m128i col1 = _mm_set1_epi32( (int)pPalette[1] );
+	const __m128i col2 = _mm_set1_epi32( (int)pPalette[2] );
+	const __m128i col3 = _mm_set1_epi32( (int)pPalette[3] );
+
+	// Each lane keeps the 2 bit code of its own pixel and compares it in place,
+	// the code 3 comparand is the mask itself
+	const __m128i codeMask = _mm_setr_epi32( 3 << 0, 3 << 2, 3 << 4, 3 << 6 );
+	const __m128i code1 = _mm_setr_epi32( 1 << 0, 1 << 2, 1 << 4, 1 << 6 );
+	const __m128i code2 = _mm_setr_epi32( 2 << 0, 2 << 2, 2 << 4, 2 << 6 );
+
+	// Alpha is the last byte of every destination format
+	const __m128i alphaMask = _mm_set1_epi32( (int)0xff000000 );
+	__m128i alphaRows[4];
+	if ( pAlphas )
+	{
+		__m128i alphas = _mm_loadu_si128( (const __m128i *)pAlphas );
+		__m128i alphasLo = _mm_unpacklo_epi8( zero, alphas );
+		__m128i alphasHi = _mm_unpackhi_epi8( zero, alphas );
+		alphaRows[0] = _mm_unpacklo_epi16( zero, alphasLo );
+		alphaRows[1] = _mm_unpackhi_epi16( zero, alphasLo );
+		alphaRows[2] = _mm_unpacklo_epi16( zero, alphasHi );
+		alphaRows[3] = _mm_unpackhi_epi16( zero, alphasHi );
+	}
+
+	for ( int r = 0; r < 4; r++, pOutputImage += width )
+	{
+		__m128i codes = _mm_and_si128( _mm_set1_epi32( pColorBlock->row[r] ), codeMask );
+		__m128i pixels = _mm_and_si128( _mm_cmpeq_epi32( codes, zero ), col0 );
+		pixels = _mm_or_si128( pixels, _mm_and_si128( _mm_cmpeq_epi32( codes, code1 ), col1 ) );
+		pixels = _mm_or_si128( pixels, _mm_and_si128( _mm_cmpeq_epi32( codes, code2 ), col2 ) );
+		pixels = _mm_or_si128( pixels, _mm_and_si128( _mm_cmpeq_epi32( codes, codeMask ), col3 ) );
+		if ( pAlphas )
+		{
+			pixels = _mm_or_si128( _mm_andnot_si128( alphaMask, pixels ), alphaRows[r] );
+		}
+		_mm_storeu_si128( (__m128i *)pOutputImage, pixels );
+	}
+#else
+	// Alpha is the last byte of every destination format
+	const uint32 alphaMask = LittleDWord( 0xff000000 );
+	for ( int r = 0; r < 4; r++, pOutputImage += width-4 )
+	{
+		for ( int n = 0; n < 4; n++, pOutputImage++ )
+		{
+			uint32 pixel = pPalette[ ( pColorBlock->row[r] >> ( n * 2 ) ) & 3 ];
+			if ( pAlphas )
+			{
+				pixel = ( pixel & ~alphaMask ) | LittleDWord( (uint32)pAlphas[r * 4 + n] << 24 );
+			}
+			*pOutputImage = pixel;
+		}
+	}
+#endif
+}
+
+struct DXTDecodeInfo_t
+{
+	const uint8	*m_pSrc;
+	uint32		*m_pDst;
+	int			m_nWidth;		// multiple of 4
+	int			m_nXBlocks;
+	ImageFormat	m_SrcFormat;	// DXT1, DXT3 or DXT5
+};
+
+template <class CDestPixel> 
+static void DecodeDXTBlockRows8888( DXTDecodeInfo_t *pInfo, int nFirstRow, int nRows )
+{
+	int nBlockBytes = ( pInfo->m_SrcFormat == IMAGE_FORMAT_DXT1 ) ? 8 : 16;
+	uint32 palette[4];
+	uint8 alphas[16];
+
+	for ( int j = nFirstRow; j < nFirstRow + nRows; j++ )
+	{
+		uint8 *pBlock = (uint8 *)pInfo->m_pSrc + j * pInfo->m_nXBlocks * nBlockBytes;
+		uint32 *pDstScan = pInfo->m_pDst + j * 4 * pInfo->m_nWidth;
+		for ( int i = 0; i < pInfo->m_nXBlocks; i++, pBlock += nBlockBytes, pDstScan += 4 )
+		{
+			// The alpha block comes first
+			DXTColBlock *pColorBlock = (DXTColBlock *)( pBlock + nBlockBytes - 8 );
+			GetColorBlockPalette8888<CDestPixel>( pColorBlock, palette );
+
+			switch ( pInfo->m_SrcFormat )
+			{
+			case IMAGE_FORMAT_DXT3:
+				GetAlphas4BitExplicit( (DXTAlphaBlockExplicit *)pBlock, alphas );
+				DecodeColorBlock8888( pDstScan, pColorBlock, pInfo->m_nWidth, palette, alphas );
+				break;
+			case IMAGE_FORMAT_DXT5:
+				GetAlphas3BitLinear( (DXTAlphaBlock3BitLinear *)pBlock, alphas );
+				DecodeColorBlock8888( pDstScan, pColorBlock, pInfo->m_nWidth, palette, alphas );
+				break;
+			default:
+				DecodeColorBlock8888( pDstScan, pColorBlock, pInfo->m_nWidth, palette, NULL );
+				break;
+			}
+		}
+	}
+}
+
+template <class CDestPixel> 
+static void ConvertFromDXTTo8888( const uint8 *src, CDestPixel *dst, int width, int height, ImageFormat srcImageFormat )
+{
+	COMPILE_TIME_ASSERT( sizeof( CDestPixel ) == sizeof( uint32 ) );
+
+	int realWidth = 0;
+	int realHeight = 0;
+	CDestPixel *realDst = NULL;
+
+	// Deal with the case where we have a dimension smaller than 4.
+	if ( width < 4 || height < 4 )
+	{
+		realWidth = width;
+		realHeight = height;
+		// round up to the nearest four
+		width = ( width + 3 ) & ~3;
+		height = ( height + 3 ) & ~3;
+		realDst = dst;
+		dst = ( CDestPixel * )stackalloc( width * height * sizeof( CDestPixel ) );
+		Assert( dst );
+	}
+	Assert( !( width % 4 ) );
+	Assert( !( height % 4 ) );
+
+	DXTDecodeInfo_t info;
+	info.m_pSrc = src;
+	info.m_pDst = ( uint32 * )dst;
+	info.m_nWidth = width;
+	info.m_nXBlocks = width >> 2;
+	info.m_SrcFormat = srcImageFormat;
+
+	int yblocks = height >> 2;
+	if ( s_pDXTThreadPool && info.m_nXBlocks * yblocks >= DXT_PARALLEL_DECODE_BLOCKS )
+	{
+		ParallelLoopProcessChunks( s_pDXTThreadPool, &info, 0, yblocks, yblocks, DecodeDXTBlockRows8888<CDestPixel> );
+	}
+	else
+	{
+		DecodeDXTBlockRows8888<CDestPixel>( &info, 0, yblocks );
+	}
+
+	// Deal with the case where we have a dimension smaller than 4.
+	if ( realDst )
+	{
+		int x, y;
+		for ( y = 0; y < realHeight; y++ )
+		{
+			for ( x = 0; x < realWidth; x++ )
+			{
+				realDst[x+(y*realWidth)] = dst[x+(y*width)];
+			}
+		}
+	}
+}
+
 template <class CDestPixel> 
 static void ConvertFromDXT1( const uint8 *src, CDestPixel *dst, int width, int height )
 {
@@ -719,6 +929,86 @@ static void ConvertFromDXT5( const uint8 *src, CDestPixel *dst, int width, int h
 	}
 }
 
+template <class CDestPixel> 
+static void ConvertFromDXT3( const uint8 *src, CDestPixel *dst, int width, int height )
+{
+	int realWidth = 0;
+	int realHeight = 0;
+	CDestPixel *realDst = NULL;
+
+	// Deal with the case where we have a dimension smaller than 4.
+	if ( width < 4 || height < 4 )
+	{
+		realWidth = width;
+		realHeight = height;
+		// round up to the nearest four
+		width = ( width + 3 ) & ~3;
+		height = ( height + 3 ) & ~3;
+		realDst = dst;
+		dst = ( CDestPixel * )stackalloc( width * height * sizeof( CDestPixel ) );
+		Assert( dst );
+	}
+	Assert( !( width % 4 ) );
+	Assert( !( height % 4 ) );
+
+	int xblocks, yblocks;
+	xblocks = width >> 2;
+	yblocks = height >> 2;
+	
+	CDestPixel *pDstScan = dst;
+	uint32 *pSrcScan = ( uint32 * )src;
+
+	DXTColBlock				*pBlock;
+	DXTAlphaBlockExplicit	*pAlphaBlock;
+
+	BGRA8888_t col_0, col_1, col_2, col_3;
+	uint16 wrd;
+
+	int i,j;
+	for ( j=0; j < yblocks; j++ )
+	{
+		// 8 bytes per block
+		// 1 block for alpha, 1 block for color
+		pBlock = (DXTColBlock*) ( (uint8 *)pSrcScan + j * xblocks * 16 );
+
+		for ( i=0; i < xblocks; i++, pBlock ++ )
+		{
+			// inline
+			// Get alpha block
+			pAlphaBlock = (DXTAlphaBlockExplicit*) pBlock;
+
+			// inline func:
+			// Get color block & colors
+			pBlock++;
+
+			GetColorBlockColorsBGRA8888( pBlock, &col_0, &col_1, &col_2, &col_3, wrd );
+
+			pDstScan = dst + i*4 + j*4*width;
+
+			// Decode the color block into the bitmap bits
+			// inline func:
+			DecodeColorBlock<CDestPixel>( pDstScan, pBlock, width, &col_0, &col_1, &col_2, &col_3 );
+
+			// Overwrite the previous alpha bits with the alpha block
+			//  info
+			DecodeAlpha4BitExplicit( pDstScan, pAlphaBlock, width );
+		}
+	}
+
+	// Deal with the case where we have a dimension smaller than 4.
+	if ( realDst )
+	{
+		int x, y;
+		for( y = 0; y < realHeight; y++ )
+		{
+			for( x = 0; x < realWidth; x++ )
+			{
+				realDst[x+(y*realWidth)] = dst[x+(y*width)];
+			}
+		}
+	}
+}
+
 template <class CDestPixel> 
 static void ConvertFromDXT5IgnoreAlpha( const uint8 *src, CDestPixel *dst, int width, int height )
 {
@@ -885,6 +1175,121 @@ bool ConvertToATIxN(  const uint8 *src, ImageFormat srcImageFormat,
 }
 
 
+struct DXTEncodeInfo_t
+{
+	const uint8	*m_pSrc;
+	ImageFormat	m_SrcFormat;
+	uint8		*m_pDst;
+	ImageFormat	m_DstFormat;
+	int			m_nWidth;
+	int			m_nHeight;
+};
+
+//-----------------------------------------------------------------------------
+// stb_dxt builds its tables on the first block it compresses. Do that before
+// handing rows of blocks to other threads.
+//-----------------------------------------------------------------------------
+static void InitDXTEncoder()
+{
+	uint8 block[16 * 4];
+	uint8 dest[16];
+	memset( block, 0, sizeof( block ) );
+	stb_compress_dxt_block( dest, block, 1, STB_DXT_NORMAL );
+}
+
+#if defined( _X360 ) || defined( POSIX )
+//-----------------------------------------------------------------------------
+// DXT3 alpha, 4 bits per pixel rounded to nearest
+//-----------------------------------------------------------------------------
+static void CompressAlpha4BitExplicit( uint8 *pDest, const uint8 *pRGBA )
+{
+	for ( int i = 0; i < 16; i += 2 )
+	{
+		int a0 = ( pRGBA[i * 4 + 3] * 15 + 127 ) / 255;
+		int a1 = ( pRGBA[i * 4 + 7] * 15 + 127 ) / 255;
+		pDest[i >> 1] = (uint8)( a0 | ( a1 << 4 ) );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Offline DXT1/3/5 compression with stb_dxt where there is no S3TC library.
+// Blocks past the right and bottom edges repeat the last column and row.
+//-----------------------------------------------------------------------------
+static void CompressDXTBlockRows( DXTEncodeInfo_t *pInfo, int nFirstRow, int nRows )
+{
+	UserFormatToRGBA8888Func_t pfnToRGBA8888 = GetUserFormatToRGBA8888Func_t( pInfo->m_SrcFormat );
+	int nSrcLineBytes = pInfo->m_nWidth * SizeInBytes( pInfo->m_SrcFormat );
+	int xblocks = ( pInfo->m_nWidth + 3 ) >> 2;
+	int nLineBytes = xblocks * 4 * 4;
+	int nBlockBytes = ( pInfo->m_DstFormat == IMAGE_FORMAT_DXT1 ) ? 8 : 16;
+
+	// 4 lines of RGBA8888, one row of blocks
+	CUtlMemory< uint8 > lines( 0, 4 * nLineBytes );
+
+	for ( int j = nFirstRow; j < nFirstRow + nRows; j++ )
+	{
+		for ( int y = 0; y < 4; y++ )
+		{
+			int nSrcLine = MIN( j * 4 + y, pInfo->m_nHeight - 1 );
+			uint8 *pLine = lines.Base() + y * nLineBytes;
+			pfnToRGBA8888( pInfo->m_pSrc + nSrcLine * nSrcLineBytes, pLine, pInfo->m_nWidth );
+			for ( int x = pInfo->m_nWidth; x < xblocks * 4; x++ )
+			{
+				memcpy( pLine + x * 4, pLine + ( pInfo->m_nWidth - 1 ) * 4, 4 );
+			}
+		}
+
+		uint8 *pDest = pInfo->m_pDst + j * xblocks * nBlockBytes;
+		for ( int i = 0; i < xblocks; i++, pDest += nBlockBytes )
+		{
+			uint8 pixelBlock[16 * 4];
+			for ( int y = 0; y < 4; y++ )
+			{
+				memcpy( pixelBlock + y * 16, lines.Base() + y * nLineBytes + i * 16, 16 );
+			}
+
+			if ( pInfo->m_DstFormat == IMAGE_FORMAT_DXT3 )
+			{
+				CompressAlpha4BitExplicit( pDest, pixelBlock );
+				stb_compress_dxt_block( pDest + 8, pixelBlock, 0, STB_DXT_HIGHQUAL );
+			}
+			else
+			{
+				stb_compress_dxt_block( pDest, pixelBlock, ( pInfo->m_DstFormat == IMAGE_FORMAT_DXT5 ) ? 1 : 0, STB_DXT_HIGHQUAL );
+			}
+		}
+	}
+}
+
+static bool ConvertToDXTBlocks( const uint8 *src, ImageFormat srcImageFormat,
+								uint8 *dst, ImageFormat dstImageFormat, int width, int height )
+{
+	if ( !GetUserFormatToRGBA8888Func_t( srcImageFormat ) )
+		return false;
+
+	DXTEncodeInfo_t info;
+	info.m_pSrc = src;
+	info.m_SrcFormat = srcImageFormat;
+	info.m_pDst = dst;
+	info.m_DstFormat = dstImageFormat;
+	info.m_nWidth = width;
+	info.m_nHeight = height;
+
+	int yblocks = ( height + 3 ) >> 2;
+	int xblocks = ( width + 3 ) >> 2;
+	if ( s_pDXTThreadPool && xblocks * yblocks >= DXT_PARALLEL_ENCODE_BLOCKS )
+	{
+		InitDXTEncoder();
+		ParallelLoopProcessChunks( s_pDXTThreadPool, &info, 0, yblocks, yblocks, CompressDXTBlockRows );
+	}
+	else
+	{
+		CompressDXTBlockRows( &info, 0, yblocks );
+	}
+	return true;
+}
+#endif
+
 bool ConvertToDXT(  const uint8 *src, ImageFormat srcImageFormat,
  					uint8 *dst, ImageFormat dstImageFormat, 
 					int width, int height, int srcStride, int dstStride )
@@ -958,31 +1363,34 @@ bool ConvertToDXT(  const uint8 *src, ImageFormat srcImageFormat,
 	S3TCencode( &descIn, NULL, &descOut, dst, dwEncodeType, weight );
 	return true;
 #else
-	Assert( 0 );
-	return false;
+	// from rgb(a) to dxtN
+	if( srcStride != 0 || dstStride != 0 )
+		return false;
+
+	return ConvertToDXTBlocks( src, srcImageFormat, dst, dstImageFormat, width, height );
 #endif
 }
 
-bool ConvertToDXTRuntime(	const uint8 *src, ImageFormat srcImageFormat,
- 							uint8 *dst, ImageFormat dstImageFormat, 
-							int width, int height )
+static void CompressDXTRuntimeBlockRows( DXTEncodeInfo_t *pInfo, int nFirstRow, int nRows )
 {
-	// from rgba to dxtN using stb_dxt.h  (source format must always be RGBA8888, dest format must be DXT1_RUNTIME or DXT5_RUNTIME
-	Assert( ( srcImageFormat == IMAGE_FORMAT_RGBA8888 || srcImageFormat == IMAGE_FORMAT_BGRA8888 ) && ( dstImageFormat == IMAGE_FORMAT_DXT1_RUNTIME || dstImageFormat == IMAGE_FORMAT_DXT5_RUNTIME ) );
-
-	const uint64 *sourcePixels = reinterpret_cast<const uint64 *>(src);
-	uint32 *dest32 = reinterpret_cast<uint32 *>(dst);
+	int width = pInfo->m_nWidth;
 	int width64 = width >> 1;
+	int nRowBlocks = ( width <= 2 ) ? 1 : ( width64 + 1 ) >> 1;
+	int nBlockWords = ( pInfo->m_DstFormat == IMAGE_FORMAT_DXT1_RUNTIME ) ? 2 : 4;
+	int nAlpha = ( pInfo->m_DstFormat == IMAGE_FORMAT_DXT5_RUNTIME ) ? 1 : 0;
 
-	if ( srcImageFormat == IMAGE_FORMAT_BGRA8888 )
+	for ( int y = nFirstRow; y < nFirstRow + nRows; y++ )
 	{
-		for ( int y = 0; y < height; y += 4 )
+		const uint64 *sourcePixels = reinterpret_cast<const uint64 *>( pInfo->m_pSrc ) + y * ( width64 << 2 );
+		uint32 *dest32 = reinterpret_cast<uint32 *>( pInfo->m_pDst ) + y * nRowBlocks * nBlockWords;
+
+		if ( pInfo->m_SrcFormat == IMAGE_FORMAT_BGRA8888 )
 		{
 			if ( width == 1 )
 			{
 				uint32 pixelBlock[16];
 
-				const uint32 *sourcePixels32 = reinterpret_cast<const uint32 *>(src);
+				const uint32 *sourcePixels32 = reinterpret_cast<const uint32 *>( pInfo->m_pSrc );
 				pixelBlock[0] = sourcePixels32[0];
 				for ( int i = 1; i < 16; i++ )
 				{
@@ -990,8 +1398,8 @@ bool ConvertToDXTRuntime(	const uint8 *src, ImageFormat srcImageFormat,
 				}
 
 				// compress the pixelBlock into dest32
-				stb_compress_dxt_block( reinterpret_cast<uint8 *>(dest32), reinterpret_cast<uint8 *>(pixelBlock), (dstImageFormat == IMAGE_FORMAT_DXT5_RUNTIME) ? 1 : 0, STB_DXT_NORMAL );
-				dest32 += ( dstImageFormat == IMAGE_FORMAT_DXT1_RUNTIME ) ? 2 : 4;
+				stb_compress_dxt_block( reinterpret_cast<uint8 *>(dest32), reinterpret_cast<uint8 *>(pixelBlock), nAlpha, STB_DXT_NORMAL );
+				dest32 += nBlockWords;
 			}
 			else if ( width == 2 )
 			{
@@ -1003,8 +1411,8 @@ bool ConvertToDXTRuntime(	const uint8 *src, ImageFormat srcImageFormat,
 				pixelBlock[1] = pixelBlock[3] = pixelBlock[4] = pixelBlock[5] = pixelBlock[6] = pixelBlock[7] = sourcePixels[0];
 
 				// compress the pixelBlock into dest32
-				stb_compress_dxt_block( reinterpret_cast<uint8 *>(dest32), reinterpret_cast<uint8 *>(pixelBlock), (dstImageFormat == IMAGE_FORMAT_DXT5_RUNTIME) ? 1 : 0, STB_DXT_NORMAL );
-				dest32 += ( dstImageFormat == IMAGE_FORMAT_DXT1_RUNTIME ) ? 2 : 4;
+				stb_compress_dxt_block( reinterpret_cast<uint8 *>(dest32), reinterpret_cast<uint8 *>(pixelBlock), nAlpha, STB_DXT_NORMAL );
+				dest32 += nBlockWords;
 			}
 			else
 			{
@@ -1023,22 +1431,18 @@ bool ConvertToDXTRuntime(	const uint8 *src, ImageFormat srcImageFormat,
 					pixelBlock[7] = sourcePixels[x + (width64 * 3) + 1];
 
 					// compress the pixelBlock into dest32
-					stb_compress_dxt_block( reinterpret_cast<uint8 *>(dest32), reinterpret_cast<uint8 *>(pixelBlock), (dstImageFormat == IMAGE_FORMAT_DXT5_RUNTIME) ? 1 : 0, STB_DXT_NORMAL );
-					dest32 += ( dstImageFormat == IMAGE_FORMAT_DXT1_RUNTIME ) ? 2 : 4;
+					stb_compress_dxt_block( reinterpret_cast<uint8 *>(dest32), reinterpret_cast<uint8 *>(pixelBlock), nAlpha, STB_DXT_NORMAL );
+					dest32 += nBlockWords;
 				}
 			}
-			sourcePixels += (width64 << 2);
 		}
-	}
-	else if ( srcImageFormat == IMAGE_FORMAT_RGBA8888 )
-	{
-		for ( int y = 0; y < height; y += 4 )
+		else if ( pInfo->m_SrcFormat == IMAGE_FORMAT_RGBA8888 )
 		{
 			if ( width == 1 )
 			{
 				uint32 pixelBlock[16];
 
-				const uint32 *sourcePixels32 = reinterpret_cast<const uint32 *>(src);
+				const uint32 *sourcePixels32 = reinterpret_cast<const uint32 *>( pInfo->m_pSrc );
 				pixelBlock[0] = ( sourcePixels32[0] & 0x00FF00FF ) || ( ( sourcePixels32[0] & 0xFF000000 ) >> 16 ) || ( ( sourcePixels32[0] & 0x0000FF00 ) << 16 );
 				for ( int i = 1; i < 16; i++ )
 				{
@@ -1046,8 +1450,8 @@ bool ConvertToDXTRuntime(	const uint8 *src, ImageFormat srcImageFormat,
 				}
 
 				// compress the pixelBlock into dest32
-				stb_compress_dxt_block( reinterpret_cast<uint8 *>(dest32), reinterpret_cast<uint8 *>(pixelBlock), (dstImageFormat == IMAGE_FORMAT_DXT5_RUNTIME) ? 1 : 0, STB_DXT_NORMAL );
-				dest32 += ( dstImageFormat == IMAGE_FORMAT_DXT1_RUNTIME ) ? 2 : 4;
+				stb_compress_dxt_block( reinterpret_cast<uint8 *>(dest32), reinterpret_cast<uint8 *>(pixelBlock), nAlpha, STB_DXT_NORMAL );
+				dest32 += nBlockWords;
 			}
 			else if ( width == 2 )
 			{
@@ -1059,8 +1463,8 @@ bool ConvertToDXTRuntime(	const uint8 *src, ImageFormat srcImageFormat,
 				pixelBlock[1] = pixelBlock[3] = pixelBlock[4] = pixelBlock[5] = pixelBlock[6] = pixelBlock[7] = pixelBlock[0];
 
 				// compress the pixelBlock into dest32
-				stb_compress_dxt_block( reinterpret_cast<uint8 *>(dest32), reinterpret_cast<uint8 *>(pixelBlock), (dstImageFormat == IMAGE_FORMAT_DXT5_RUNTIME) ? 1 : 0, STB_DXT_NORMAL );
-				dest32 += ( dstImageFormat == IMAGE_FORMAT_DXT1_RUNTIME ) ? 2 : 4;
+				stb_compress_dxt_block( reinterpret_cast<uint8 *>(dest32), reinterpret_cast<uint8 *>(pixelBlock), nAlpha, STB_DXT_NORMAL );
+				dest32 += nBlockWords;
 			}
 			else
 			{
@@ -1079,13 +1483,40 @@ bool ConvertToDXTRuntime(	const uint8 *src, ImageFormat srcImageFormat,
 					pixelBlock[7] = ( sourcePixels[x + (width64 * 3) + 1] & 0xFF00FF00FF00FF00LL ) | ( ( sourcePixels[x + (width64 * 3) + 1] & 0x00FF000000FF0000LL ) >> 16 ) | ( ( sourcePixels[x + (width64 * 3) + 1] & 0x000000FF000000FFLL ) << 16 );
 
 					// compress the pixelBlock into dest32
-					stb_compress_dxt_block( reinterpret_cast<uint8 *>(dest32), reinterpret_cast<uint8 *>(pixelBlock), (dstImageFormat == IMAGE_FORMAT_DXT5_RUNTIME) ? 1 : 0, STB_DXT_NORMAL );
-					dest32 += ( dstImageFormat == IMAGE_FORMAT_DXT1_RUNTIME ) ? 2 : 4;
+					stb_compress_dxt_block( reinterpret_cast<uint8 *>(dest32), reinterpret_cast<uint8 *>(pixelBlock), nAlpha, STB_DXT_NORMAL );
+					dest32 += nBlockWords;
 				}
 			}
-			sourcePixels += (width64 << 2);
 		}
 	}
+}
+
+bool ConvertToDXTRuntime(	const uint8 *src, ImageFormat srcImageFormat,
+ 							uint8 *dst, ImageFormat dstImageFormat, 
+							int width, int height )
+{
+	// from rgba to dxtN using stb_dxt.h  (source format must always be RGBA8888, dest format must be DXT1_RUNTIME or DXT5_RUNTIME
+	Assert( ( srcImageFormat == IMAGE_FORMAT_RGBA8888 || srcImageFormat == IMAGE_FORMAT_BGRA8888 ) && ( dstImageFormat == IMAGE_FORMAT_DXT1_RUNTIME || dstImageFormat == IMAGE_FORMAT_DXT5_RUNTIME ) );
+
+	DXTEncodeInfo_t info;
+	info.m_pSrc = src;
+	info.m_SrcFormat = srcImageFormat;
+	info.m_pDst = dst;
+	info.m_DstFormat = dstImageFormat;
+	info.m_nWidth = width;
+	info.m_nHeight = height;
+
+	int yblocks = ( height + 3 ) >> 2;
+	int xblocks = ( width + 3 ) >> 2;
+	if ( s_pDXTThreadPool && xblocks * yblocks >= DXT_PARALLEL_ENCODE_BLOCKS )
+	{
+		InitDXTEncoder();
+		ParallelLoopProcessChunks( s_pDXTThreadPool, &info, 0, yblocks, yblocks, CompressDXTRuntimeBlockRows );
+	}
+	else
+	{
+		CompressDXTRuntimeBlockRows( &info, 0, yblocks );
+	}
 	return true;
 }
 
@@ -1425,13 +1856,13 @@ bool ConvertImageFormat( const uint8 *src, ImageFormat srcImageFormat,
 		{
 			if ( dstImageFormat == IMAGE_FORMAT_RGBA8888 )
 			{
-				ConvertFromDXT1( src, ( RGBA8888_t * )dst, width, height );
+				ConvertFromDXTTo8888( src, ( RGBA8888_t * )dst, width, height, srcImageFormat );
 				return true;
 			}
 			if ( dstImageFormat == IMAGE_FORMAT_BGRA8888 ||
 			    dstImageFormat == IMAGE_FORMAT_BGRX8888 )
 			{
-				ConvertFromDXT1( src, ( BGRA8888_t * )dst, width, height );
+				ConvertFromDXTTo8888( src, ( BGRA8888_t * )dst, width, height, srcImageFormat );
 				return true;
 			}
 			if ( dstImageFormat == IMAGE_FORMAT_RGB888 )
@@ -1477,17 +1908,58 @@ bool ConvertImageFormat( const uint8 *src, ImageFormat srcImageFormat,
 				return true;
 			}
 		}
+		else if ( srcImageFormat == IMAGE_FORMAT_DXT3 )
+		{
+			if ( dstImageFormat == IMAGE_FORMAT_RGBA8888 )
+			{
+				ConvertFromDXTTo8888( src, ( RGBA8888_t * )dst, width, height, srcImageFormat );
+				return true;
+			}
+			if ( dstImageFormat == IMAGE_FORMAT_BGRA8888 ||
+			    dstImageFormat == IMAGE_FORMAT_BGRX8888 )
+			{
+				ConvertFromDXTTo8888( src, ( BGRA8888_t * )dst, width, height, srcImageFormat );
+				return true;
+			}
+			// The color block sits after the alpha block like in DXT5
+			if ( dstImageFormat == IMAGE_FORMAT_RGB888 )
+			{
+				ConvertFromDXT5IgnoreAlpha( src, ( RGB888_t * )dst, width, height );
+				return true;
+			}
+			if ( dstImageFormat == IMAGE_FORMAT_BGR888 )
+			{
+				ConvertFromDXT5IgnoreAlpha( src, ( BGR888_t * )dst, width, height );
+				return true;
+			}
+			if ( dstImageFormat == IMAGE_FORMAT_BGR565 )
+			{
+				ConvertFromDXT5IgnoreAlpha( src, ( BGR565_t * )dst, width, height );
+				return true;
+			}
+			if ( dstImageFormat == IMAGE_FORMAT_BGRA5551 ||
+				dstImageFormat == IMAGE_FORMAT_BGRX5551 )
+			{
+				ConvertFromDXT3( src, ( BGRA5551_t * )dst, width, height );
+				return true;
+			}
+			if ( dstImageFormat == IMAGE_FORMAT_BGRA4444 )
+			{
+				ConvertFromDXT3( src, ( BGRA4444_t * )dst, width, height );
+				return true;
+			}
+		}
 		else if ( srcImageFormat == IMAGE_FORMAT_DXT5 )
 		{
 			if ( dstImageFormat == IMAGE_FORMAT_RGBA8888 )
 			{
-				ConvertFromDXT5( src, ( RGBA8888_t * )dst, width, height );
+				ConvertFromDXTTo8888( src, ( RGBA8888_t * )dst, width, height, srcImageFormat );
 				return true;
 			}
 			if ( dstImageFormat == IMAGE_FORMAT_BGRA8888 ||
 			    dstImageFormat == IMAGE_FORMAT_BGRX8888 )
 			{
-				ConvertFromDXT5( src, ( BGRA8888_t * )dst, width, height );
+				ConvertFromDXTTo8888( src, ( BGRA8888_t * )dst, width, height, srcImageFormat );
 				return true;
 			}
 			if ( dstImageFormat == IMAGE_FORMAT_RGB888 )
@@ -1604,6 +2076,139 @@ bool ConvertImageFormat( const uint8 *src, ImageFormat srcImageFormat,
 
 
 
+//-----------------------------------------------------------------------------
+// DXT decoder checks and timings
+//-----------------------------------------------------------------------------
+static void FillRandomDXTBlocks( uint8 *pBlocks, int nBlocks, ImageFormat format )
+{
+	int nBlockBytes = ( format == IMAGE_FORMAT_DXT1 ) ? 8 : 16;
+	for ( int i = 0; i < nBlocks * nBlockBytes; i++ )
+	{
+		pBlocks[i] = (uint8)RandomInt( 0, 255 );
+	}
+
+	// Random endpoints come in both orders, make sure equal ones come up too
+	for ( int i = 0; i < nBlocks; i += 8 )
+	{
+		uint8 *pBlock = pBlocks + i * nBlockBytes;
+		DXTColBlock *pColorBlock = (DXTColBlock *)( pBlock + nBlockBytes - 8 );
+		pColorBlock->col1 = pColorBlock->col0;
+		if ( format == IMAGE_FORMAT_DXT5 )
+		{
+			pBlock[1] = pBlock[0];
+		}
+	}
+}
+
+template <class CDestPixel> 
+static void ConvertFromDXTPerPixel( const uint8 *src, CDestPixel *dst, int width, int height, ImageFormat srcImageFormat )
+{
+	switch ( srcImageFormat )
+	{
+	case IMAGE_FORMAT_DXT1:
+		ConvertFromDXT1( src, dst, width, height );
+		break;
+	case IMAGE_FORMAT_DXT3:
+		ConvertFromDXT3( src, dst, width, height );
+		break;
+	default:
+		ConvertFromDXT5( src, dst, width, height );
+		break;
+	}
+}
+
+template <class CDestPixel> 
+static bool CheckDXTBlockDecoder( const uint8 *pBlocks, int width, int height, ImageFormat srcImageFormat )
+{
+	CUtlMemory< CDestPixel > expected( 0, width * height );
+	CUtlMemory< CDestPixel > actual( 0, width * height );
+	ConvertFromDXTPerPixel( pBlocks, expected.Base(), width, height, srcImageFormat );
+	ConvertFromDXTTo8888( pBlocks, actual.Base(), width, height, srcImageFormat );
+	if ( memcmp( expected.Base(), actual.Base(), width * height * sizeof( CDestPixel ) ) )
+	{
+		Warning( "%s %dx%d: block decoder doesn't match the per-pixel decoder\n", GetName( srcImageFormat ), width, height );
+		return false;
+	}
+	return true;
+}
+
+bool BenchmarkDXT( int nMegaPixels )
+{
+	static const ImageFormat s_pFormats[] = { IMAGE_FORMAT_DXT1, IMAGE_FORMAT_DXT3, IMAGE_FORMAT_DXT5 };
+	static const int s_pSizes[][2] = { { 1, 1 }, { 2, 2 }, { 4, 4 }, { 12, 20 }, { 1024, 1024 } };
+
+	int nSide = MAX( 4, (int)sqrtf( nMegaPixels * 1024.0f * 1024.0f ) & ~3 );
+	int nPixels = nSide * nSide;
+	float flMegaPixels = nPixels / ( 1024.0f * 1024.0f );
+
+	// A byte of slack, the alpha decoders read 4 bytes from the last 3 of a block
+	CUtlMemory< uint8 > blocks( 0, MAX( nPixels, 1024 * 1024 ) + 4 );
+	CUtlMemory< BGRA8888_t > pixels( 0, nPixels );
+	RandomSeed( 0 );
+
+	bool bOk = true;
+	for ( int i = 0; i < ARRAYSIZE( s_pFormats ); i++ )
+	{
+		for ( int j = 0; j < ARRAYSIZE( s_pSizes ); j++ )
+		{
+			int width = s_pSizes[j][0];
+			int height = s_pSizes[j][1];
+			FillRandomDXTBlocks( blocks.Base(), ( ( width + 3 ) >> 2 ) * ( ( height + 3 ) >> 2 ), s_pFormats[i] );
+			bOk = CheckDXTBlockDecoder< RGBA8888_t >( blocks.Base(), width, height, s_pFormats[i] ) && bOk;
+			bOk = CheckDXTBlockDecoder< BGRA8888_t >( blocks.Base(), width, height, s_pFormats[i] ) && bOk;
+		}
+	}
+	Msg( "DXT block decoders %s\n", bOk ? "match the per-pixel decoders" : "FAILED" );
+
+	int nThreads = s_pDXTThreadPool ? s_pDXTThreadPool->NumThreads() + 1 : 1;
+	for ( int i = 0; i < ARRAYSIZE( s_pFormats ); i++ )
+	{
+		FillRandomDXTBlocks( blocks.Base(), nPixels >> 4, s_pFormats[i] );
+
+		double flStart = Plat_FloatTime();
+		ConvertFromDXTPerPixel( blocks.Base(), pixels.Base(), nSide, nSide, s_pFormats[i] );
+		double flPerPixel = MAX( Plat_FloatTime() - flStart, 1e-6 );
+
+		flStart = Plat_FloatTime();
+		ConvertImageFormat( blocks.Base(), s_pFormats[i], (uint8 *)pixels.Base(), IMAGE_FORMAT_BGRA8888, nSide, nSide );
+		double flBlock = MAX( Plat_FloatTime() - flStart, 1e-6 );
+
+		Msg( "%s decode %dx%d: per-pixel %.1f Mpixels/s, block (%d threads) %.1f Mpixels/s\n",
+			GetName( s_pFormats[i] ), nSide, nSide, flMegaPixels / flPerPixel, nThreads, flMegaPixels / flBlock );
+	}
+
+	// Compress the last decoded image back, on this thread and then on the pool
+	static const ImageFormat s_pRuntimeFormats[] = { IMAGE_FORMAT_DXT1_RUNTIME, IMAGE_FORMAT_DXT5_RUNTIME };
+	CUtlMemory< uint8 > serialBlocks( 0, nPixels );
+	for ( int i = 0; i < ARRAYSIZE( s_pRuntimeFormats ); i++ )
+	{
+		int nBytes = GetMemRequired( nSide, nSide, 1, s_pRuntimeFormats[i], false );
+
+		IThreadPool *pPool = s_pDXTThreadPool;
+		s_pDXTThreadPool = NULL;
+		double flStart = Plat_FloatTime();
+		ConvertImageFormat( (uint8 *)pixels.Base(), IMAGE_FORMAT_RGBA8888, serialBlocks.Base(), s_pRuntimeFormats[i], nSide, nSide );
+		double flSerial = MAX( Plat_FloatTime() - flStart, 1e-6 );
+		s_pDXTThreadPool = pPool;
+
+		flStart = Plat_FloatTime();
+		ConvertImageFormat( (uint8 *)pixels.Base(), IMAGE_FORMAT_RGBA8888, blocks.Base(), s_pRuntimeFormats[i], nSide, nSide );
+		double flParallel = MAX( Plat_FloatTime() - flStart, 1e-6 );
+
+		if ( memcmp( serialBlocks.Base(), blocks.Base(), nBytes ) )
+		{
+			Warning( "%s encode: threaded result doesn't match\n", GetName( s_pRuntimeFormats[i] ) );
+			bOk = false;
+		}
+
+		Msg( "%s encode %dx%d: 1 thread %.1f Mpixels/s, %d threads %.1f Mpixels/s\n",
+			GetName( s_pRuntimeFormats[i] ), nSide, nSide, flMegaPixels / flSerial, nThreads, flMegaPixels / flParallel );
+	}
+
+	return bOk;
+}
+
+
 //-----------------------------------------------------------------------------
 // Color conversion routines
 //-----------------------------------------------------------------------------
@@ -46,6 +46,7 @@ namespace ResponseRules
 
 		float	maxval;
 		float	minval;
+		float	tokenval;		// token pre-parsed as a number, valid when isnumeric
 
 		bool	valid : 1;      //1
 		bool	isnumeric : 1;  //2
@@ -420,6 +421,12 @@ namespace ResponseRules
 	    ///  criteria are in one of two dictionaries)
 	    void GetDictsForCriteria( CUtlVectorFixed< ResponseRulePartition::tRuleDict *, 2 > *pResult, const CriteriaSet &criteria );
 
+		/// get the elements of the given dict that could possibly score above zero
+		/// against the criteria, in ascending element order. Rules left out are those
+		/// whose required string criterion can't match. Returns false if the dict
+		/// can't be narrowed down, in which case every rule must be scored.
+		bool GetCandidateRules( CResponseSystem *pSystem, tRuleDict *pDict, const CriteriaSet &criteria, CUtlVector< unsigned short > *pResult );
+
 		// dump everything.
 		void RemoveAll();
 
@@ -454,7 +461,30 @@ namespace ResponseRules
 #endif
 
 	private:
+		// A bucket's rules compiled for lookup. Each rule that has a required criterion
+		// doing a plain case-insensitive string compare is filed under the hash of that
+		// criterion's name and value; rules without one are always scored.
+		struct CompiledBucket_t
+		{
+			CompiledBucket_t() : m_bDirty( true ) {}
+
+			struct KeyedRule_t
+			{
+				unsigned int	m_nKeyHash;
+				unsigned short	m_nElem;
+			};
+
+			CUtlVector< CUtlSymbol >		m_KeySymbols;	// distinct criteria names rules are keyed on
+			CUtlVector< KeyedRule_t >		m_KeyedRules;	// sorted by hash, then element
+			CUtlVector< unsigned short >	m_UnkeyedRules;
+			bool							m_bDirty;
+		};
+
+		void CompileBucket( CResponseSystem *pSystem, int bucket );
+		static int __cdecl KeyedRuleSortFunc( const CompiledBucket_t::KeyedRule_t *a, const CompiledBucket_t::KeyedRule_t *b );
+
 		tRuleDict m_RuleParts[N_RESPONSE_PARTITIONS];
+		CompiledBucket_t m_Compiled[N_RESPONSE_PARTITIONS];
 	    unsigned int GetBucketForSpeakerAndConcept( const char *pszSpeaker, const char *pszConcept, const char *pszSubject );
 	};
 
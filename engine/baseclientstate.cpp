@@ -2952,6 +2952,26 @@ bool CBaseClientState::SVCMsg_CreateStringTable( const CSVCMsg_CreateStringTable
 #endif
 
 	COM_TimestampedLog( " CBaseClient::ProcessCreateStringTable(%s)", msg.name().c_str() );
+
+	if ( msg.flags() & NSF_PREFIX_HISTORY )
+	{
+		// Prefix coded tables only exist in demo protocol DEMO_PROTOCOL_PREFIX_HISTORY and later, and live only between
+		// servers and clients of the same version; anything else would be decoded as garbage
+		int nDemoProtocol = DEMO_PROTOCOL;
+#ifndef DEDICATED
+		if ( demoplayer && demoplayer->IsPlayingBack() )
+		{
+			nDemoProtocol = demoplayer->GetDemoStream()->GetDemoProtocol();
+		}
+#endif
+		if ( nDemoProtocol < DEMO_PROTOCOL_PREFIX_HISTORY || ( m_nServerProtocolVersion && m_nServerProtocolVersion != GetHostVersion() ) )
+		{
+			Warning( "String table %s is prefix coded, but demo protocol %d, server version %d, client version %d cannot carry it\n",
+				msg.name().c_str(), nDemoProtocol, m_nServerProtocolVersion, GetHostVersion() );
+			Disconnect();
+			return false;
+		}
+	}
 	m_StringTableContainer->AllowCreation( true );
 
 #ifndef SHARED_NET_STRING_TABLES
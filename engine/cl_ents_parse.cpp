@@ -21,11 +21,14 @@
 #include "ents_shared.h"
 #include "cl_ents_parse.h"
 #include "serializedentity.h"
+#include "vstdlib/jobthread.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
 
 static ConVar cl_flushentitypacket("cl_flushentitypacket", "0", FCVAR_CHEAT, "For debugging. Force the engine to flush an entity packet.");
+static ConVar cl_parallel_entity_unpack( "cl_parallel_entity_unpack", "1", 0, "Decode the entities of large entity updates on the job threads." );
+static ConVar cl_parallel_entity_unpack_min( "cl_parallel_entity_unpack_min", "32", 0, "Minimum number of updated entities in a packet for cl_parallel_entity_unpack." );
 extern ConVar replay_debug;
 // Prints important entity creation/deletion events to console
 #if defined( _DEBUG )
@@ -238,6 +241,97 @@ inline static void CL_AddPostDataUpdateCall( CEntityReadInfo &u, int iEnt, DataU
 
 
 
+//-----------------------------------------------------------------------------
+// Purpose: Returns a decode to fill in if u is deferring decodes into this
+//  entity's RecvTable, NULL if the caller should call PreDataUpdate and decode
+//  right away.
+//-----------------------------------------------------------------------------
+static CDeferredEntityDecode *CL_DeferDecode( CEntityReadInfo &u, RecvTable *pRecvTable, IClientNetworkable *pEnt, DataUpdateType_t updateType )
+{
+	if ( !u.m_bDeferDecodes || !RecvTable_CanPreDecode( pRecvTable ) )
+	{
+		pEnt->PreDataUpdate( updateType );
+		return NULL;
+	}
+
+	CDeferredEntityDecode *pDecode = &u.m_DeferredDecodes[ u.m_DeferredDecodes.AddToTail() ];
+	pDecode->m_nEntity = u.m_nNewEntity;
+	pDecode->m_pEnt = pEnt;
+	pDecode->m_UpdateType = updateType;
+	pDecode->m_pRecvTable = pRecvTable;
+	pDecode->m_pStruct = pEnt->GetDataTableBasePtr();
+	pDecode->m_nStates = 0;
+	return pDecode;
+}
+
+static void CL_PreDecodeEntity( CDeferredEntityDecode &decode )
+{
+	for ( int i = 0; i < decode.m_nStates; ++i )
+	{
+		RecvTable_PreDecode( decode.m_pRecvTable, decode.m_States[i], decode.m_pValues[i] );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Runs the decodes ReadPacketEntities deferred. The field values are
+//  read on the job threads; PreDataUpdate, storing them and calling the proxies
+//  stay on this thread, per entity and in stream order, since neither the
+//  proxies nor the entities are thread safe. Entities that are created or
+//  deleted by the packet still are so while it is parsed, before any deferred
+//  decode is applied.
+//-----------------------------------------------------------------------------
+static void CL_DecodeDeferredEntities( CEntityReadInfo &u )
+{
+	VPROF( "CL_DecodeDeferredEntities" );
+
+	int nDecodes = u.m_DeferredDecodes.Count();
+	if ( !nDecodes )
+		return;
+
+	int nValues = 0;
+	for ( int i = 0; i < nDecodes; ++i )
+	{
+		CDeferredEntityDecode &decode = u.m_DeferredDecodes[i];
+		for ( int j = 0; j < decode.m_nStates; ++j )
+		{
+			nValues += reinterpret_cast< CSerializedEntity * >( decode.m_States[j] )->GetFieldCount();
+		}
+	}
+
+	CUtlVector< DVariant > values;
+	values.SetCount( nValues );
+
+	DVariant *pValues = values.Base();
+	for ( int i = 0; i < nDecodes; ++i )
+	{
+		CDeferredEntityDecode &decode = u.m_DeferredDecodes[i];
+		for ( int j = 0; j < decode.m_nStates; ++j )
+		{
+			decode.m_pValues[j] = pValues;
+			pValues += reinterpret_cast< CSerializedEntity * >( decode.m_States[j] )->GetFieldCount();
+		}
+	}
+
+	ParallelProcess( u.m_DeferredDecodes.Base(), nDecodes, &CL_PreDecodeEntity );
+
+	for ( int i = 0; i < nDecodes; ++i )
+	{
+		CDeferredEntityDecode &decode = u.m_DeferredDecodes[i];
+		decode.m_pEnt->PreDataUpdate( decode.m_UpdateType );
+		for ( int j = 0; j < decode.m_nStates; ++j )
+		{
+			RecvTable_ApplyPreDecoded( decode.m_pRecvTable, decode.m_pStruct, decode.m_States[j], decode.m_pValues[j], decode.m_nEntity );
+
+			if ( decode.m_bOwnsState[j] )
+			{
+				g_pSerializedEntities->ReleaseSerializedEntity( decode.m_States[j] );
+			}
+		}
+	}
+
+	u.m_DeferredDecodes.RemoveAll();
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: Get the receive table for the specified entity
 // Input  : *pEnt - 
@@ -346,7 +440,6 @@ void CL_CopyNewEntity(
 	int start_bit = u.m_pBuf->GetNumBitsRead();
 
 	DataUpdateType_t updateType = bNew ? DATA_UPDATE_CREATED : DATA_UPDATE_DATATABLE_CHANGED;
-	ent->PreDataUpdate( updateType );
 
 	SerializedEntityHandle_t oldbaseline = SERIALIZED_ENTITY_HANDLE_INVALID;
 
@@ -374,6 +467,9 @@ void CL_CopyNewEntity(
 	{
 		RecvTable_ReadFieldList( pRecvTable, *u.m_pBuf, u.m_DecodeEntity, -1, true );
 
+		// Calls PreDataUpdate now unless the decode is deferred
+		CDeferredEntityDecode *pDecode = CL_DeferDecode( u, pRecvTable, ent, updateType );
+
 		if ( u.m_bUpdateBaselines )
 		{
 			// store this baseline in u.m_pUpdateBaselines
@@ -384,9 +480,19 @@ void CL_CopyNewEntity(
 			// set the other baseline
 			GetBaseLocalClient().SetEntityBaseline( (u.m_nBaseline==0)?1:0, pClass, u.m_nNewEntity, newbaseline );
 
-
-			RecvTable_Decode( pRecvTable, ent->GetDataTableBasePtr(), newbaseline, u.m_nNewEntity );
-
+			if ( pDecode )
+			{
+				pDecode->AddState( newbaseline, false );
+			}
+			else
+			{
+				RecvTable_Decode( pRecvTable, ent->GetDataTableBasePtr(), newbaseline, u.m_nNewEntity );
+			}
+		}
+		else if ( pDecode )
+		{
+			pDecode->AddState( oldbaseline, false );
+			pDecode->AddState( u.TakeDecodeEntity(), true );
 		}
 		else
 		{
@@ -452,9 +558,6 @@ void CL_CopyExistingEntity( CEntityReadInfo &u )
 
 	Assert( u.m_pFrom->transmit_entity.Get(u.m_nNewEntity) );
 
-	// Read raw data from the network stream
-	pEnt->PreDataUpdate( DATA_UPDATE_DATATABLE_CHANGED );
-
 	RecvTable *pRecvTable = GetEntRecvTable( u.m_nNewEntity );
 
 	if( !pRecvTable )
@@ -470,7 +573,16 @@ void CL_CopyExistingEntity( CEntityReadInfo &u )
 	CSerializedEntity *pEntity; pEntity = reinterpret_cast< CSerializedEntity * >( u.m_DecodeEntity );
 	//Assert( pEntity->GetFieldCount() > 0 );
 
-	RecvTable_Decode( pRecvTable, pEnt->GetDataTableBasePtr(), u.m_DecodeEntity, u.m_nNewEntity );
+	// Read raw data from the network stream; calls PreDataUpdate now unless the decode is deferred
+	CDeferredEntityDecode *pDecode = CL_DeferDecode( u, pRecvTable, pEnt, DATA_UPDATE_DATATABLE_CHANGED );
+	if ( pDecode )
+	{
+		pDecode->AddState( u.TakeDecodeEntity(), true );
+	}
+	else
+	{
+		RecvTable_Decode( pRecvTable, pEnt->GetDataTableBasePtr(), u.m_DecodeEntity, u.m_nNewEntity );
+	}
 
 	CL_AddPostDataUpdateCall( u, u.m_nNewEntity, DATA_UPDATE_DATATABLE_CHANGED );
 
@@ -657,6 +769,9 @@ bool CL_ProcessPacketEntities( const CSVCMsg_PacketEntities &msg )
 	u.m_nHeaderCount = msg.updated_entries();
 	u.m_nBaseline = msg.baseline();
 	u.m_bUpdateBaselines = msg.update_baseline();
+
+	// Full updates and demo seeks touch most entities, decode those on the job threads
+	u.m_bDeferDecodes = cl_parallel_entity_unpack.GetBool() && u.m_nHeaderCount >= cl_parallel_entity_unpack_min.GetInt();
 	
 	// update the entities
 	{
@@ -665,6 +780,8 @@ bool CL_ProcessPacketEntities( const CSVCMsg_PacketEntities &msg )
 
 		GetBaseLocalClient().ReadPacketEntities( u );
 
+		CL_DecodeDeferredEntities( u );
+
 		splitscreen->SetActiveSplitScreenPlayerSlot( saveSlot );
 		splitscreen->SetLocalPlayerIsResolvable( __FILE__, __LINE__, bSaveResolvable );
 	}
@@ -29,6 +29,7 @@
 #include "cvar.h"
 #include "vstdlib/random.h"
 #include "tier1/utldict.h"
+#include "tier1/utlhashtable.h"
 #include "tier0/etwprof.h"
 #include "tier0/vprof.h"
 
@@ -59,6 +60,7 @@ struct cmdalias_t
 };
 
 static cmdalias_t	*cmd_alias = NULL;
+static int			s_nAliasGeneration = 0;	// bumped when aliases are created or freed
 
 static CCommandBuffer s_CommandBuffer[ CBUF_COUNT ];
 static CThreadFastMutex s_CommandBufferMutex;
@@ -226,16 +228,113 @@ void Cbuf_AddExecutionMarker( ECommandTarget_t eTarget, ECmdExecutionMarker mark
 }
 
 
+//-----------------------------------------------------------------------------
+// Resolved command lines. Configs, binds and alias bodies run the same lines
+// over and over, so the first time a line runs its tokens and what its name
+// resolves to (an alias or a ConCommandBase) are remembered. Later runs
+// restore the tokens and skip the alias scan and FindCommandBase. Lookups
+// are redone once the alias list or the registered commands have changed.
+//-----------------------------------------------------------------------------
+static ConVar cmd_resolve_cache( "cmd_resolve_cache", "1", 0, "Remember the tokens and command lookup of each distinct command line that runs." );
+
+#define MAX_RESOLVED_COMMAND_LINES 4096
+
+struct ResolvedCommandLine_t
+{
+	int						m_nCvarGeneration;
+	int						m_nAliasGeneration;
+	cmdalias_t				*m_pAlias;
+	const ConCommandBase	*m_pCommand;
+	uint8					*m_pTokenized;
+};
+
+static CUtlHashtable< CUtlString, ResolvedCommandLine_t > s_ResolvedCommandLines;
+
+static cmdalias_t *Cmd_FindAlias( const char *pName )
+{
+	for ( cmdalias_t *a = cmd_alias; a; a = a->next )
+	{
+		if ( !Q_strcasecmp( pName, a->name ) )
+			return a;
+	}
+	return NULL;
+}
+
+static void Cmd_ResolveCommandName( const CCommand &command, ResolvedCommandLine_t &resolved )
+{
+	resolved.m_nCvarGeneration = g_pCVar->GetRegistrationGeneration();
+	resolved.m_nAliasGeneration = s_nAliasGeneration;
+	resolved.m_pAlias = Cmd_FindAlias( command[0] );
+	resolved.m_pCommand = resolved.m_pAlias ? NULL : g_pCVar->FindCommandBase( command[0] );
+}
+
+static void Cbuf_FlushResolvedCommandLines()
+{
+	FOR_EACH_HASHTABLE( s_ResolvedCommandLines, i )
+	{
+		delete[] s_ResolvedCommandLines[i].m_pTokenized;
+	}
+	s_ResolvedCommandLines.Purge();
+}
+
+//-----------------------------------------------------------------------------
+// Tokenizes a line from a command buffer, reusing the tokens and lookup from
+// the last time the same line ran. Returns false if the caller must look
+// the command up itself.
+//-----------------------------------------------------------------------------
+static bool Cbuf_TokenizeCommandLine( const char *pText, cmd_source_t source, CCommand &command, ResolvedCommandLine_t &resolved )
+{
+	if ( !cmd_resolve_cache.GetBool() )
+	{
+		command.Tokenize( pText, source );
+		return false;
+	}
+
+	UtlHashHandle_t h = s_ResolvedCommandLines.Find( pText );
+	if ( h != s_ResolvedCommandLines.InvalidHandle() )
+	{
+		ResolvedCommandLine_t &cached = s_ResolvedCommandLines[h];
+		command.RestoreTokenized( cached.m_pTokenized, source );
+		if ( cached.m_nCvarGeneration != g_pCVar->GetRegistrationGeneration() || cached.m_nAliasGeneration != s_nAliasGeneration )
+		{
+			// The tokens are still good, only the lookup is stale
+			Cmd_ResolveCommandName( command, cached );
+		}
+		resolved = cached;
+		return true;
+	}
+
+	if ( !command.Tokenize( pText, source ) || !command.ArgC() )
+		return false;
+
+	// Execution markers carry a one time code, never worth keeping
+	if ( !Q_strcmp( command[0], CMDSTR_ADD_EXECUTION_MARKER ) )
+		return false;
+
+	if ( s_ResolvedCommandLines.Count() >= MAX_RESOLVED_COMMAND_LINES )
+	{
+		Cbuf_FlushResolvedCommandLines();
+	}
+
+	resolved.m_pTokenized = new uint8[ command.GetTokenizedSize() ];
+	command.SaveTokenized( resolved.m_pTokenized );
+	Cmd_ResolveCommandName( command, resolved );
+	s_ResolvedCommandLines.Insert( pText, resolved );
+	return true;
+}
+
+static const ConCommandBase *Cmd_ExecuteCommandInternal( ECommandTarget_t eTarget, const CCommand &command, int nClientSlot, const ResolvedCommandLine_t *pResolved );
+
 //-----------------------------------------------------------------------------
 // Executes commands in the buffer
 //-----------------------------------------------------------------------------
-static void Cbuf_ExecuteCommand( ECommandTarget_t eTarget, const CCommand &args )
+static void Cbuf_ExecuteCommand( ECommandTarget_t eTarget, const CCommand &args, const ResolvedCommandLine_t *pResolved = NULL )
 {
 	// Add the command text to the ETW stream to give better context to traces.
 	ETWMark( args.GetCommandString() );
 
 	// execute the command line
-	const ConCommandBase *pCmd = Cmd_ExecuteCommand( eTarget, args );
+	const ConCommandBase *pCmd = Cmd_ExecuteCommandInternal( eTarget, args, -1, pResolved );
 
 #if !defined(DEDICATED)
 	if ( pCmd && !pCmd->IsFlagSet( FCVAR_DONTRECORD ) )
@@ -245,6 +344,28 @@ static void Cbuf_ExecuteCommand( ECommandTarget_t eTarget, const CCommand &args
 #endif
 }
 
+//-----------------------------------------------------------------------------
+// Runs every command in the buffer that is due this tick
+//-----------------------------------------------------------------------------
+static void Cbuf_ExecuteCommandBuffer( CCommandBuffer &buffer, ECommandTarget_t eTarget )
+{
+	// NOTE: The command buffer knows about execution time related to commands,
+	// but since HL2 doesn't, we're going to spoof the command time to simply
+	// be the the number of times Cbuf_Execute is called.
+	buffer.BeginProcessingCommands( 1 );
+	CCommand nextCommand;
+	ResolvedCommandLine_t resolved;
+	const char *pText;
+	cmd_source_t source;
+
+	while ( buffer.DequeueNextCommandText( &pText, &source ) )
+	{
+		bool bResolved = Cbuf_TokenizeCommandLine( pText, source, nextCommand, resolved );
+		Cbuf_ExecuteCommand( eTarget, nextCommand, bResolved ? &resolved : NULL );
+	}
+	buffer.EndProcessingCommands( );
+}
+
 
 //-----------------------------------------------------------------------------
 // Executes commands in the buffer
@@ -286,17 +407,7 @@ void Cbuf_Execute()
 			SET_LOCAL_PLAYER_RESOLVABLE( __FILE__, __LINE__, bSaveResolvable );
 		}
 
-		// NOTE: The command buffer knows about execution time related to commands,
-		// but since HL2 doesn't, we're going to spoof the command time to simply
-		// be the the number of times Cbuf_Execute is called.
-		s_CommandBuffer[ i ].BeginProcessingCommands( 1 );
-		CCommand nextCommand;
-
-		while ( s_CommandBuffer[ i ].DequeueNextCommand( &nextCommand ) )
-		{
-			Cbuf_ExecuteCommand( ( ECommandTarget_t )i, nextCommand );
-		}
-		s_CommandBuffer[ i ].EndProcessingCommands( );
+		Cbuf_ExecuteCommandBuffer( s_CommandBuffer[ i ], ( ECommandTarget_t )i );
 	}
 
 	SET_ACTIVE_SPLIT_SCREEN_PLAYER_SLOT( nSaveIndex );
@@ -619,17 +730,21 @@ void _Cmd_Exec_f( const CCommand &args, bool bOnlyIfExists, bool bUseWhitelist =
 		while ( rCommandBuffer.GetNextCommandHandle() != hCommand )
 		{
 			CCommand execCommand;
+			ResolvedCommandLine_t resolved;
+			const char *pText;
+			cmd_source_t source;
 
-			if( rCommandBuffer.DequeueNextCommand( &execCommand ) )
+			if( rCommandBuffer.DequeueNextCommandText( &pText, &source ) )
 			{
+				bool bResolved = Cbuf_TokenizeCommandLine( pText, source, execCommand, resolved );
 				bool bFoundConvar = true;
 				if ( bUseWhitelist )
 				{
-					bFoundConvar = IsWhiteListedCmd( *execCommand.ArgV() );
+					bFoundConvar = execCommand.ArgC() && IsWhiteListedCmd( *execCommand.ArgV() );
 				}
 
 				if ( bFoundConvar )
-					Cbuf_ExecuteCommand( eTarget, execCommand );
+					Cbuf_ExecuteCommand( eTarget, execCommand, bResolved ? &resolved : NULL );
 			}
 			else
 			{
@@ -758,6 +873,7 @@ CON_COMMAND( alias, "Alias a command." )
 		a = (cmdalias_t *)new cmdalias_t;
 		a->next = cmd_alias;
 		cmd_alias = a;
+		s_nAliasGeneration++;
 	}
 	V_strcpy_safe ( a->name, s );	
 
@@ -798,6 +914,86 @@ CON_COMMAND_AUTOCOMPLETEFILE( exec, Cmd_Exec_f, "Execute script file.", "cfg", c
 CON_COMMAND_AUTOCOMPLETEFILE( execifexists, Cmd_ExecIfExists_f, "Execute script file if file exists.", "cfg", cfg );
 CON_COMMAND_AUTOCOMPLETEFILE( execwithwhitelist, Cmd_ExecWithWhiteList_f, "Execute script file, only execing convars on a whitelist.", "cfg", cfg );
 
+//-----------------------------------------------------------------------------
+// Measures command buffer throughput with and without cmd_resolve_cache
+//-----------------------------------------------------------------------------
+static int s_nCmdBenchCalls = 0;
+static ConVar _cmd_bench_var( "_cmd_bench_var", "0", FCVAR_HIDDEN | FCVAR_DONTRECORD );
+
+CON_COMMAND_F( _cmd_bench_nop, "Does nothing, used by cmd_exec_bench.", FCVAR_HIDDEN | FCVAR_DONTRECORD )
+{
+	s_nCmdBenchCalls++;
+}
+
+static float Cmd_RunExecBench( ECommandTarget_t eTarget, int nLines )
+{
+	CCommandBuffer buffer;
+	buffer.SetWaitEnabled( false );
+
+	char szText[ 6144 ];
+	int nTextLen = 0;
+	szText[0] = 0;
+
+	double flStart = Plat_FloatTime();
+	for ( int i = 0; i < nLines; ++i )
+	{
+		char szLine[ 128 ];
+		int nVariant = i & 255;
+		if ( nVariant & 1 )
+		{
+			Q_snprintf( szLine, sizeof( szLine ), "_cmd_bench_nop \"arg %d\" %d \"quoted;value\"\n", nVariant, nVariant * 7 );
+		}
+		else
+		{
+			Q_snprintf( szLine, sizeof( szLine ), "_cmd_bench_var %d; _cmd_bench_nop %d\n", nVariant, nVariant );
+		}
+
+		int nLineLen = Q_strlen( szLine );
+		if ( nTextLen + nLineLen >= (int)sizeof( szText ) )
+		{
+			buffer.AddText( szText, kCommandSrcCode );
+			Cbuf_ExecuteCommandBuffer( buffer, eTarget );
+			nTextLen = 0;
+		}
+		Q_memcpy( szText + nTextLen, szLine, nLineLen + 1 );
+		nTextLen += nLineLen;
+	}
+
+	if ( nTextLen )
+	{
+		buffer.AddText( szText, kCommandSrcCode );
+		Cbuf_ExecuteCommandBuffer( buffer, eTarget );
+	}
+	return (float)( Plat_FloatTime() - flStart );
+}
+
+CON_COMMAND( cmd_exec_bench, "Times running generated command lines through a command buffer. Usage: cmd_exec_bench [lines]" )
+{
+	int nLines = ( args.ArgC() > 1 ) ? MAX( atoi( args[1] ), 1 ) : 10000;
+	ECommandTarget_t eTarget = Cbuf_GetCurrentPlayer();
+	bool bWasEnabled = cmd_resolve_cache.GetBool();
+
+	s_nCmdBenchCalls = 0;
+	cmd_resolve_cache.SetValue( 0 );
+	float flUncached = Cmd_RunExecBench( eTarget, nLines );
+
+	cmd_resolve_cache.SetValue( 1 );
+	Cbuf_FlushResolvedCommandLines();
+	float flCold = Cmd_RunExecBench( eTarget, nLines );
+	float flWarm = Cmd_RunExecBench( eTarget, nLines );
+
+	cmd_resolve_cache.SetValue( bWasEnabled ? 1 : 0 );
+
+	ConMsg( "cmd_exec_bench: %d lines, %d distinct\n", nLines, MIN( nLines, 256 ) );
+	ConMsg( "  no cache: %.2f ms\n", flUncached * 1000.0f );
+	ConMsg( "  cold:     %.2f ms\n", flCold * 1000.0f );
+	ConMsg( "  warm:     %.2f ms (%.2fx)\n", flWarm * 1000.0f, flWarm > 0.0f ? flUncached / flWarm : 0.0f );
+	if ( s_nCmdBenchCalls != nLines * 3 )
+	{
+		Warning( "cmd_exec_bench: expected %d commands, ran %d\n", nLines * 3, s_nCmdBenchCalls );
+	}
+}
+
 
 
 
@@ -819,6 +1015,8 @@ void Cmd_Shutdown( void )
 		delete cmd_alias;
 		cmd_alias = next;
 	}
+	s_nAliasGeneration++;
+	Cbuf_FlushResolvedCommandLines();
 }
 
 
@@ -924,9 +1122,9 @@ static bool ShouldPreventClientCommand( const CCommand& args, const ConCommandBa
 
 //-----------------------------------------------------------------------------
 // A complete command line has been parsed, so try to execute it
-// FIXME: lookupnoadd the token to speed search?
+// pResolved, when set, holds the alias/command lookup already done for the line
 //-----------------------------------------------------------------------------
-const ConCommandBase *Cmd_ExecuteCommand( ECommandTarget_t eTarget, const CCommand &command, int nClientSlot )
+static const ConCommandBase *Cmd_ExecuteCommandInternal( ECommandTarget_t eTarget, const CCommand &command, int nClientSlot, const ResolvedCommandLine_t *pResolved )
 {	
 	// execute the command line
 	if ( !command.ArgC() )
@@ -948,20 +1146,17 @@ const ConCommandBase *Cmd_ExecuteCommand( ECommandTarget_t eTarget, const CComma
 	}
 
 	// check alias
-	cmdalias_t *a;
-	for ( a=cmd_alias; a; a=a->next )
+	cmdalias_t *a = pResolved ? pResolved->m_pAlias : Cmd_FindAlias( command[0] );
+	if ( a )
 	{
-		if ( !Q_strcasecmp( command[0], a->name ) )
-		{
-			Cbuf_InsertText( Cbuf_GetCurrentPlayer(), a->value, command.Source() );
-			return NULL;
-		}
+		Cbuf_InsertText( Cbuf_GetCurrentPlayer(), a->value, command.Source() );
+		return NULL;
 	}
 	
 	cmd_clientslot = nClientSlot;
 
 	// check ConCommands
-	const ConCommandBase *pCommand = g_pCVar->FindCommandBase( command[0] );
+	const ConCommandBase *pCommand = pResolved ? pResolved->m_pCommand : g_pCVar->FindCommandBase( command[0] );
 
 	// If we prevent a server command due to FCVAR_SERVER_CAN_EXECUTE not being set, then we get out immediately.
 	if ( ShouldPreventServerCommand( command, pCommand ) )
@@ -1083,6 +1278,11 @@ const ConCommandBase *Cmd_ExecuteCommand( ECommandTarget_t eTarget, const CComma
 	return NULL;
 }
 
+const ConCommandBase *Cmd_ExecuteCommand( ECommandTarget_t eTarget, const CCommand &command, int nClientSlot )
+{
+	return Cmd_ExecuteCommandInternal( eTarget, command, nClientSlot, NULL );
+}
+
 const char* Cmd_AliasToCommandString( const char* szAliasName )
 {
 	if ( !szAliasName )
@@ -13,6 +13,7 @@
 #include "bitvec.h"
 #include "bspfile.h"
 #include "utlbuffer.h"
+#include "tier1/framememory.h"
 
 #include "filesystem.h"
 #include "filesystem_engine.h"
@@ -546,43 +547,43 @@ class CTraceListData : public IPartitionEnumerator, public ITraceListData
 {
 public:
 
-	CTraceListData() 
-	{
-		m_pEngineTrace = NULL;
-		m_bFoundNonSolidLeaf = false;
-		m_mins.Init();
-		m_maxs.Init();
-	}
+	CTraceListData();
 	~CTraceListData() {}
 
+	// Purge rather than RemoveAll, lists that outgrew their inline storage spilled into frame memory
 	void Reset()
 	{
-		m_brushList.RemoveAll();
-		m_dispList.RemoveAll();
-		m_entityList.RemoveAll();
-		m_staticPropList.RemoveAll();
+		m_brushList.Purge();
+		m_dispList.Purge();
+		m_entityList.Purge();
+		m_staticPropList.Purge();
 		m_mins.Init();
 		m_maxs.Init();
 		m_pEngineTrace = NULL;
 		m_bFoundNonSolidLeaf = false;
+		m_bSkipStaticProps = false;
 	}
 
 	bool IsEmpty() { return m_pEngineTrace == NULL ? true : false; }
+	// A list filled in an earlier frame may have spilled into frame memory that has been recycled since
+	bool IsStale() const { return m_brushList.IsStale() || m_dispList.IsStale() || m_entityList.IsStale() || m_staticPropList.IsStale(); }
 	// For entities...
 	IterationRetval_t EnumElement( IHandleEntity *pHandleEntity );
 	bool CanTraceRay( const Ray_t &ray );
+	void RefreshEntityList();
 
 public:
 
-	CUtlVectorFixedGrowable<unsigned short, TLD_DEF_BRUSH_MAX>	m_brushList;
-	CUtlVectorFixedGrowable<unsigned short, TLD_DEF_DISP_MAX>	m_dispList;
-	CUtlVectorFixedGrowable<collideable_handleentity_t, TLD_DEF_ENTITY_MAX>	m_entityList;
-	CUtlVectorFixedGrowable<collideable_handleentity_t, TLD_DEF_ENTITY_MAX>	m_staticPropList;
+	CUtlVectorFixedGrowableFrame<unsigned short, TLD_DEF_BRUSH_MAX>	m_brushList;
+	CUtlVectorFixedGrowableFrame<unsigned short, TLD_DEF_DISP_MAX>	m_dispList;
+	CUtlVectorFixedGrowableFrame<collideable_handleentity_t, TLD_DEF_ENTITY_MAX>	m_entityList;
+	CUtlVectorFixedGrowableFrame<collideable_handleentity_t, TLD_DEF_ENTITY_MAX>	m_staticPropList;
 
 	Vector	m_mins;
 	Vector	m_maxs;
 	class CEngineTrace *m_pEngineTrace;
 	bool	m_bFoundNonSolidLeaf;
+	bool	m_bSkipStaticProps;
 };
 
 
@@ -91,6 +91,7 @@ public:
 	virtual float GetTicksPerSecond() OVERRIDE;
 	virtual float GetTicksPerFrame() OVERRIDE;
 	virtual int	GetTotalTicks( void ) OVERRIDE;
+	virtual int GetDemoProtocol( void ) const OVERRIDE { return m_DemoHeader.demoprotocol; }
 public:
 	char			m_szFileName[MAX_PATH];	//name of current demo file
 	demoheader_t    m_DemoHeader;  //general demo info
@@ -19,6 +19,7 @@ public:
 	virtual float GetTicksPerSecond( void ) { return 64; }
 	virtual float GetTicksPerFrame( void ) { return 1; }
 	virtual int	GetTotalTicks( void ) { return 0; }
+	virtual int GetDemoProtocol( void ) const { return 0; } // 0 = unknown
 };
 
 
@@ -251,6 +251,13 @@ bool CDemoStreamHttp::OnSync( const char *pBuffer, int nBufferSize, int nResync
 		
 		delete pSync; pSync = NULL;
 
+		if ( m_nDemoProtocol > DEMO_PROTOCOL )
+		{
+			Warning( "Broadcast protocol %d is newer than this engine's %d\n", m_nDemoProtocol, DEMO_PROTOCOL );
+			StopStreaming();
+			return false;
+		}
+
 		return OnSync( nResync );
 	}
 	else
@@ -42,7 +42,7 @@ public:
 
 	virtual const char* GetUrl( void ) OVERRIDE { return m_Url.Get(); }
 	virtual float GetTicksPerSecond( void )OVERRIDE { return m_SyncResponse.flTicksPerSecond; }
-	int GetDemoProtocol()const { return m_nDemoProtocol; }
+	virtual int GetDemoProtocol( void ) const OVERRIDE { return m_nDemoProtocol; }
 	virtual float GetTicksPerFrame( void ) OVERRIDE { return 1.0f; } // 1 network frame per 1 tick in broadcast - there's not much reason to do otherwise
 	virtual void Close() OVERRIDE { StopStreaming(); }
 	virtual int GetTotalTicks( void ) { return 0; }
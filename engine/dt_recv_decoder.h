@@ -67,6 +67,71 @@ public:
 };
 
 
+// ------------------------------------------------------------------------------------ //
+// Compiled decode ops. RecvTable_CreateDecoders compiles one op per flattened prop with
+// the SendProp's encoding flags already resolved into an opcode, and the RecvProp's
+// proxy resolved into a direct store when it's one of the standard proxies.
+// ------------------------------------------------------------------------------------ //
+
+enum RecvDecodeOpcode_t
+{
+	RECVOP_INT_UBITS=0,
+	RECVOP_INT_SBITS,
+	RECVOP_INT_UVARINT,
+	RECVOP_INT_SVARINT,
+	RECVOP_FLOAT,
+	RECVOP_VECTOR,
+	RECVOP_VECTOR_NORMAL,		// x and y, plus a sign bit for z
+	RECVOP_VECTORXY,
+	RECVOP_GENERIC				// strings, arrays and int64s go through g_PropTypeFns
+};
+
+// How RECVOP_FLOAT and the vector ops read each component.
+enum RecvDecodeFloatOp_t
+{
+	RECVFLOAT_RANGED=0,
+	RECVFLOAT_COORD,
+	RECVFLOAT_COORD_MP,
+	RECVFLOAT_COORD_MP_LOWPRECISION,
+	RECVFLOAT_COORD_MP_INTEGRAL,
+	RECVFLOAT_NOSCALE,
+	RECVFLOAT_NORMAL,
+	RECVFLOAT_CELL_COORD,
+	RECVFLOAT_CELL_COORD_LOWPRECISION,
+	RECVFLOAT_CELL_COORD_INTEGRAL
+};
+
+// Where the decoded value goes.
+enum RecvDecodeStore_t
+{
+	RECVSTORE_NONE=0,			// no matching RecvProp, the data is ignored
+	RECVSTORE_PROXY,			// call the RecvProp's proxy
+	RECVSTORE_INT8,
+	RECVSTORE_INT16,
+	RECVSTORE_INT32,
+	RECVSTORE_FLOAT,
+	RECVSTORE_VECTOR
+};
+
+class CRecvDecodeOp
+{
+public:
+	unsigned char	m_nOpcode;		// RecvDecodeOpcode_t
+	unsigned char	m_nFloatOp;		// RecvDecodeFloatOp_t
+	unsigned char	m_nStore;		// RecvDecodeStore_t
+	unsigned char	m_nBits;
+	unsigned char	m_iProxy;		// Index into the datatable stack's proxy results.
+	short			m_nSkipBits;	// Encoded size when it doesn't depend on the value, -1 otherwise.
+	int				m_nOffset;		// RecvProp offset from the proxy result.
+	float			m_fLowValue;
+	float			m_fRange;		// High value - low value.
+	float			m_fMaxEncoded;	// ( 1 << m_nBits ) - 1
+
+	const SendProp	*m_pSendProp;
+	const RecvProp	*m_pRecvProp;
+};
+
+
 // ------------------------------------------------------------------------------------ //
 // CRecvDecoder.
 // ------------------------------------------------------------------------------------ //
@@ -101,6 +166,9 @@ public:
 	CUtlVector<const RecvProp*>	m_Props;
 	CUtlVector<const RecvProp*>	m_DatatableProps;
 
+	// One per entry in m_Props, empty if the decoder couldn't be compiled.
+	CUtlVector<CRecvDecodeOp>	m_Ops;
+
 	CDTIRecvTable *m_pDTITable;
 };
 
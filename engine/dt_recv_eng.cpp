@@ -20,6 +20,13 @@
 #include "common.h"
 #include "serializedentity.h"
 #include "netmessages.h"
+#include "convar.h"
+#include "coordsize.h"
+#include "tier0/fasttimer.h"
+#ifndef DEDICATED
+#include "cdll_int.h"
+#include "cdll_engine_int.h"
+#endif
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -67,6 +74,14 @@ CUtlLinkedList< RecvTable*, unsigned short > g_RecvTables;
 CUtlLinkedList< CRecvDecoder *, unsigned short > g_RecvDecoders;
 CUtlLinkedList< CClientSendTable*, unsigned short > g_ClientSendTables;
 
+static ConVar dt_compiled_decoders( "dt_compiled_decoders", "1", 0, "Decode entity data with the decode ops compiled for each RecvTable instead of per-prop dispatch." );
+
+// dt_decode_bench accumulates into these while it's running.
+static bool g_bDecodeBench = false;
+static CCycleCount g_DecodeBenchTime;
+static int g_nDecodeBenchEntities = 0;
+static int g_nDecodeBenchFields = 0;
+
 // ------------------------------------------------------------------------------------ //
 // Static helper functions.
 // ------------------------------------------------------------------------------------ //
@@ -566,6 +581,165 @@ static void CopySendPropsToRecvProps(
 	}
 }
 
+// Returns the encoded size of a float component, or -1 if it depends on the value.
+static int GetFloatOpSkipBits( int nFloatOp, int nBits )
+{
+	switch ( nFloatOp )
+	{
+	case RECVFLOAT_RANGED:		return nBits;
+	case RECVFLOAT_NOSCALE:		return 32;
+	case RECVFLOAT_NORMAL:		return NORMAL_FRACTIONAL_BITS + 1;
+	default:					return -1;
+	}
+}
+
+// Resolves a float SendProp's flags the same way DecodeSpecialFloat tests them.
+static int GetFloatOp( const SendProp *pProp )
+{
+	int flags = pProp->GetFlags();
+
+	if ( flags & SPROP_COORD )
+		return RECVFLOAT_COORD;
+	if ( flags & SPROP_COORD_MP )
+		return RECVFLOAT_COORD_MP;
+	if ( flags & SPROP_COORD_MP_LOWPRECISION )
+		return RECVFLOAT_COORD_MP_LOWPRECISION;
+	if ( flags & SPROP_COORD_MP_INTEGRAL )
+		return RECVFLOAT_COORD_MP_INTEGRAL;
+	if ( flags & SPROP_NOSCALE )
+		return RECVFLOAT_NOSCALE;
+	if ( flags & SPROP_NORMAL )
+		return RECVFLOAT_NORMAL;
+	if ( flags & SPROP_CELL_COORD )
+		return RECVFLOAT_CELL_COORD;
+	if ( flags & SPROP_CELL_COORD_LOWPRECISION )
+		return RECVFLOAT_CELL_COORD_LOWPRECISION;
+	if ( flags & SPROP_CELL_COORD_INTEGRAL )
+		return RECVFLOAT_CELL_COORD_INTEGRAL;
+
+	return RECVFLOAT_RANGED;
+}
+
+static void CompileDecodeOp( CRecvDecodeOp *pOp, const SendProp *pSendProp, const RecvProp *pRecvProp, int iProxy, const CStandardRecvProxies *pRecvProxies )
+{
+	int flags = pSendProp->GetFlags();
+
+	memset( pOp, 0, sizeof( *pOp ) );
+	pOp->m_pSendProp = pSendProp;
+	pOp->m_pRecvProp = pRecvProp;
+	pOp->m_iProxy = iProxy;
+	pOp->m_nBits = pSendProp->m_nBits;
+	pOp->m_nOffset = pRecvProp ? pRecvProp->GetOffset() : 0;
+	pOp->m_nFloatOp = RECVFLOAT_RANGED;
+	pOp->m_nSkipBits = -1;
+
+	switch ( pSendProp->GetType() )
+	{
+	case DPT_Int:
+		if ( flags & SPROP_VARINT )
+		{
+			pOp->m_nOpcode = ( flags & SPROP_UNSIGNED ) ? RECVOP_INT_UVARINT : RECVOP_INT_SVARINT;
+		}
+		else
+		{
+			pOp->m_nOpcode = ( flags & SPROP_UNSIGNED ) ? RECVOP_INT_UBITS : RECVOP_INT_SBITS;
+			pOp->m_nSkipBits = pSendProp->m_nBits;
+		}
+		break;
+
+	case DPT_Float:
+	case DPT_Vector:
+	case DPT_VectorXY:
+		{
+			pOp->m_nFloatOp = GetFloatOp( pSendProp );
+			if ( pOp->m_nFloatOp == RECVFLOAT_RANGED )
+			{
+				pOp->m_fLowValue = pSendProp->m_fLowValue;
+				pOp->m_fRange = pSendProp->m_fHighValue - pSendProp->m_fLowValue;
+				pOp->m_fMaxEncoded = (float)( ( 1 << pSendProp->m_nBits ) - 1 );
+			}
+
+			int nFloatBits = GetFloatOpSkipBits( pOp->m_nFloatOp, pSendProp->m_nBits );
+			if ( pSendProp->GetType() == DPT_Float )
+			{
+				pOp->m_nOpcode = RECVOP_FLOAT;
+				pOp->m_nSkipBits = nFloatBits;
+			}
+			else if ( pSendProp->GetType() == DPT_VectorXY )
+			{
+				pOp->m_nOpcode = RECVOP_VECTORXY;
+				pOp->m_nSkipBits = ( nFloatBits >= 0 ) ? nFloatBits * 2 : -1;
+			}
+			else if ( flags & SPROP_NORMAL )
+			{
+				pOp->m_nOpcode = RECVOP_VECTOR_NORMAL;
+				pOp->m_nSkipBits = ( nFloatBits >= 0 ) ? nFloatBits * 2 + 1 : -1;
+			}
+			else
+			{
+				pOp->m_nOpcode = RECVOP_VECTOR;
+				pOp->m_nSkipBits = ( nFloatBits >= 0 ) ? nFloatBits * 3 : -1;
+			}
+		}
+		break;
+
+	default:
+		pOp->m_nOpcode = RECVOP_GENERIC;
+		break;
+	}
+
+	// Resolve where the value goes.
+	if ( !pRecvProp )
+	{
+		pOp->m_nStore = RECVSTORE_NONE;
+		return;
+	}
+
+	pOp->m_nStore = RECVSTORE_PROXY;
+	if ( !pRecvProxies )
+		return;
+
+	RecvVarProxyFn fn = pRecvProp->GetProxyFn();
+	switch ( pOp->m_nOpcode )
+	{
+	case RECVOP_INT_UBITS:
+	case RECVOP_INT_SBITS:
+	case RECVOP_INT_UVARINT:
+	case RECVOP_INT_SVARINT:
+		if ( fn == pRecvProxies->m_Int32ToInt32 )
+			pOp->m_nStore = RECVSTORE_INT32;
+		else if ( fn == pRecvProxies->m_Int32ToInt16 )
+			pOp->m_nStore = RECVSTORE_INT16;
+		else if ( fn == pRecvProxies->m_Int32ToInt8 )
+			pOp->m_nStore = RECVSTORE_INT8;
+		break;
+
+	case RECVOP_FLOAT:
+		if ( fn == pRecvProxies->m_FloatToFloat )
+			pOp->m_nStore = RECVSTORE_FLOAT;
+		break;
+
+	case RECVOP_VECTOR:
+	case RECVOP_VECTOR_NORMAL:
+		if ( fn == pRecvProxies->m_VectorToVector )
+			pOp->m_nStore = RECVSTORE_VECTOR;
+		break;
+	}
+}
+
+// Flattens the decoder's props into decode ops, see CRecvDecodeOp.
+static void CompileRecvDecoder( CRecvDecoder *pDecoder, const CStandardRecvProxies *pRecvProxies )
+{
+	CSendTablePrecalc *pPrecalc = &pDecoder->m_Precalc;
+	int nProps = pDecoder->GetNumProps();
+
+	pDecoder->m_Ops.SetSize( nProps );
+	for ( int iProp=0; iProp < nProps; iProp++ )
+	{
+		CompileDecodeOp( &pDecoder->m_Ops[iProp], pDecoder->GetSendProp( iProp ), pDecoder->GetProp( iProp ), pPrecalc->m_PropProxyIndices[iProp], pRecvProxies );
+	}
+}
+
 bool RecvTable_CreateDecoders( const CStandardSendProxies *pSendProxies, bool bAllowMismatches, bool *pAnyMismatches )
 {
 	DTI_Init();
@@ -584,6 +758,16 @@ bool RecvTable_CreateDecoders( const CStandardSendProxies *pSendProxies, bool bA
 
 	bool bRet = true;
 
+	// The standard proxies in the client's module, so the decode ops can store
+	// straight into the entity instead of calling them.
+	const CStandardRecvProxies *pRecvProxies = NULL;
+#ifndef DEDICATED
+	if ( g_ClientDLL )
+	{
+		pRecvProxies = g_ClientDLL->GetStandardRecvProxies();
+	}
+#endif
+
 	FOR_EACH_LL( g_RecvDecoders, i )
 	{
 		CRecvDecoder *pDecoder = g_RecvDecoders[i];
@@ -613,6 +797,8 @@ bool RecvTable_CreateDecoders( const CStandardSendProxies *pSendProxies, bool bA
 			CSendTablePrecalc *pPrecalc = &pDecoder->m_Precalc;
 			CopySendPropsToRecvProps( PropLookup, pPrecalc->m_Props, pDecoder->m_Props );
 			CopySendPropsToRecvProps( PropLookup, pPrecalc->m_DatatableProps, pDecoder->m_DatatableProps );
+
+			CompileRecvDecoder( pDecoder, pRecvProxies );
 		
 			DTI_HookRecvDecoder( pDecoder );
 		}
@@ -621,21 +807,179 @@ bool RecvTable_CreateDecoders( const CStandardSendProxies *pSendProxies, bool bA
 	return bRet;
 }
 
-bool RecvTable_Decode( 
-	RecvTable *pTable, 
-	void *pStruct, 
-	SerializedEntityHandle_t dest,
-	int objectID
-	)
+static FORCEINLINE float DecodeOpFloat( const CRecvDecodeOp &op, bf_read &buf )
 {
-	CRecvDecoder *pDecoder = pTable->m_pDecoder;
-	ErrorIfNot( pDecoder,
-		("RecvTable_Decode: table '%s' missing a decoder.", pTable->GetName())
-		);
+	switch ( op.m_nFloatOp )
+	{
+	case RECVFLOAT_COORD:						return buf.ReadBitCoord();
+	case RECVFLOAT_COORD_MP:					return buf.ReadBitCoordMP( kCW_None );
+	case RECVFLOAT_COORD_MP_LOWPRECISION:		return buf.ReadBitCoordMP( kCW_LowPrecision );
+	case RECVFLOAT_COORD_MP_INTEGRAL:			return buf.ReadBitCoordMP( kCW_Integral );
+	case RECVFLOAT_NOSCALE:						return buf.ReadBitFloat();
+	case RECVFLOAT_NORMAL:						return buf.ReadBitNormal();
+	case RECVFLOAT_CELL_COORD:					return buf.ReadBitCellCoord( op.m_nBits, kCW_None );
+	case RECVFLOAT_CELL_COORD_LOWPRECISION:		return buf.ReadBitCellCoord( op.m_nBits, kCW_LowPrecision );
+	case RECVFLOAT_CELL_COORD_INTEGRAL:			return buf.ReadBitCellCoord( op.m_nBits, kCW_Integral );
+	default:
+		{
+			// Same arithmetic as DecodeFloat so the results match bit for bit.
+			float fVal = (float)buf.ReadUBitLong( op.m_nBits ) / op.m_fMaxEncoded;
+			return op.m_fLowValue + op.m_fRange * fVal;
+		}
+	}
+}
 
-	CSerializedEntity *pEntity = reinterpret_cast< CSerializedEntity * >( dest );
-	Assert( pEntity );
+// Reads the value of a field. Returns false for RECVOP_GENERIC ops, which
+// decode and store through g_PropTypeFns in one go.
+static FORCEINLINE bool DecodeOpValue( const CRecvDecodeOp &op, bf_read &buf, DVariant &value )
+{
+	switch ( op.m_nOpcode )
+	{
+	case RECVOP_INT_UBITS:
+		value.m_Int = buf.ReadUBitLong( op.m_nBits );
+		return true;
+
+	case RECVOP_INT_SBITS:
+		value.m_Int = buf.ReadSBitLong( op.m_nBits );
+		return true;
+
+	case RECVOP_INT_UVARINT:
+		value.m_Int = (long)buf.ReadVarInt32();
+		return true;
+
+	case RECVOP_INT_SVARINT:
+		value.m_Int = buf.ReadSignedVarInt32();
+		return true;
+
+	case RECVOP_FLOAT:
+		value.m_Float = DecodeOpFloat( op, buf );
+		return true;
+
+	case RECVOP_VECTOR:
+		value.m_Vector[0] = DecodeOpFloat( op, buf );
+		value.m_Vector[1] = DecodeOpFloat( op, buf );
+		value.m_Vector[2] = DecodeOpFloat( op, buf );
+		return true;
+
+	case RECVOP_VECTOR_NORMAL:
+		{
+			value.m_Vector[0] = DecodeOpFloat( op, buf );
+			value.m_Vector[1] = DecodeOpFloat( op, buf );
+
+			int signbit = buf.ReadOneBit();
+
+			float v0v0v1v1 = value.m_Vector[0] * value.m_Vector[0] + value.m_Vector[1] * value.m_Vector[1];
+			value.m_Vector[2] = ( v0v0v1v1 < 1.0f ) ? sqrtf( 1.0f - v0v0v1v1 ) : 0.0f;
+			if ( signbit )
+				value.m_Vector[2] *= -1.0f;
+		}
+		return true;
+
+	case RECVOP_VECTORXY:
+		value.m_Vector[0] = DecodeOpFloat( op, buf );
+		value.m_Vector[1] = DecodeOpFloat( op, buf );
+		return true;
+	}
+
+	return false;
+}
+
+// Stores pDecodeInfo->m_Value into the field.
+static FORCEINLINE void StoreOpValue( const CRecvDecodeOp &op, unsigned char *pStructBase, DecodeInfo *pDecodeInfo )
+{
+	unsigned char *pData = pStructBase + op.m_nOffset;
+	const DVariant &value = pDecodeInfo->m_Value;
+
+	switch ( op.m_nStore )
+	{
+	case RECVSTORE_INT8:
+		*((unsigned char*)pData) = (unsigned char)value.m_Int;
+		break;
+
+	case RECVSTORE_INT16:
+		*((unsigned short*)pData) = (unsigned short)value.m_Int;
+		break;
+
+	case RECVSTORE_INT32:
+		*((uint32*)pData) = (uint32)value.m_Int;
+		break;
+
+	case RECVSTORE_FLOAT:
+		*((float*)pData) = value.m_Float;
+		break;
+
+	case RECVSTORE_VECTOR:
+		((float*)pData)[0] = value.m_Vector[0];
+		((float*)pData)[1] = value.m_Vector[1];
+		((float*)pData)[2] = value.m_Vector[2];
+		break;
+
+	default:
+		pDecodeInfo->m_pRecvProp = op.m_pRecvProp;
+		op.m_pRecvProp->GetProxyFn()( pDecodeInfo, pStructBase, pData );
+		break;
+	}
+}
+
+// Decodes a RECVOP_GENERIC field through g_PropTypeFns.
+static void DecodeOpGeneric( const CRecvDecodeOp &op, unsigned char *pStructBase, DecodeInfo *pDecodeInfo )
+{
+	pDecodeInfo->m_pStruct = pStructBase;
+	pDecodeInfo->m_pData = pStructBase + op.m_nOffset;
+	pDecodeInfo->m_pRecvProp = op.m_pRecvProp;
+	pDecodeInfo->m_pProp = op.m_pSendProp;
+	pDecodeInfo->m_iElement = 0;
+	g_PropTypeFns[ op.m_pSendProp->GetType() ].Decode( pDecodeInfo );
+}
+
+// RecvTable_Decode using the decoder's compiled ops.
+static bool RecvTable_DecodeCompiled( CRecvDecoder *pDecoder, void *pStruct, CSerializedEntity *pEntity, int objectID )
+{
+	CClientDatatableStack theStack( pDecoder, (unsigned char*)pStruct, objectID );
+	theStack.Init( false, false );
+
+	bf_read buf;
+	buf.SetDebugName( "CFlattenedSerializer::Decode" );
+	pEntity->StartReading( buf );
+
+	DecodeInfo decodeInfo;
+	decodeInfo.m_pIn = &buf;
+	decodeInfo.m_ObjectID = objectID;
+	decodeInfo.m_iElement = 0;
+
+	const CRecvDecodeOp *pOps = pDecoder->m_Ops.Base();
+
+	CFieldPath path;
+	int nDataOffset;
+	int nNextDataOffset;
+
+	for ( int nFieldIndex = 0 ; nFieldIndex < pEntity->GetFieldCount() ; ++nFieldIndex )
+	{
+		pEntity->GetField( nFieldIndex, path, &nDataOffset, &nNextDataOffset );
+
+		const CRecvDecodeOp &op = pOps[path];
+		unsigned char *pStructBase = theStack.m_pProxies[op.m_iProxy];
 
+		// Every field is found by its offset, so there's no need to read data nothing receives.
+		if ( op.m_nStore == RECVSTORE_NONE || !pStructBase )
+			continue;
+
+		buf.Seek( nDataOffset );
+		if ( DecodeOpValue( op, buf, decodeInfo.m_Value ) )
+		{
+			StoreOpValue( op, pStructBase, &decodeInfo );
+		}
+		else
+		{
+			DecodeOpGeneric( op, pStructBase, &decodeInfo );
+		}
+	}
+
+	return !buf.IsOverflowed();
+}
+
+static bool RecvTable_DecodeGeneric( CRecvDecoder *pDecoder, void *pStruct, CSerializedEntity *pEntity, int objectID )
+{
 	// While there are properties, decode them.. walk the stack as you go.
 	CClientDatatableStack theStack( pDecoder, (unsigned char*)pStruct, objectID );
 	theStack.Init( false, false );
@@ -683,6 +1027,159 @@ bool RecvTable_Decode(
 	return !buf.IsOverflowed();			
 }
 
+bool RecvTable_Decode( 
+	RecvTable *pTable, 
+	void *pStruct, 
+	SerializedEntityHandle_t dest,
+	int objectID
+	)
+{
+	CRecvDecoder *pDecoder = pTable->m_pDecoder;
+	ErrorIfNot( pDecoder,
+		("RecvTable_Decode: table '%s' missing a decoder.", pTable->GetName())
+		);
+
+	CSerializedEntity *pEntity = reinterpret_cast< CSerializedEntity * >( dest );
+	Assert( pEntity );
+
+	bool bCompiled = dt_compiled_decoders.GetBool() && pDecoder->m_Ops.Count();
+
+	if ( !g_bDecodeBench )
+	{
+		return bCompiled ? RecvTable_DecodeCompiled( pDecoder, pStruct, pEntity, objectID ) : RecvTable_DecodeGeneric( pDecoder, pStruct, pEntity, objectID );
+	}
+
+	CFastTimer timer;
+	timer.Start();
+	bool bRet = bCompiled ? RecvTable_DecodeCompiled( pDecoder, pStruct, pEntity, objectID ) : RecvTable_DecodeGeneric( pDecoder, pStruct, pEntity, objectID );
+	timer.End();
+
+	g_DecodeBenchTime += timer.GetDuration();
+	++g_nDecodeBenchEntities;
+	g_nDecodeBenchFields += pEntity->GetFieldCount();
+	return bRet;
+}
+
+bool RecvTable_CanPreDecode( RecvTable *pTable )
+{
+	CRecvDecoder *pDecoder = pTable->m_pDecoder;
+	return pDecoder && pDecoder->m_Ops.Count() && dt_compiled_decoders.GetBool();
+}
+
+void RecvTable_PreDecode( RecvTable *pTable, SerializedEntityHandle_t handle, DVariant *pValues )
+{
+	CRecvDecoder *pDecoder = pTable->m_pDecoder;
+	Assert( pDecoder && pDecoder->m_Ops.Count() );
+
+	CSerializedEntity *pEntity = reinterpret_cast< CSerializedEntity * >( handle );
+	Assert( pEntity );
+
+	bf_read buf;
+	buf.SetDebugName( "CFlattenedSerializer::PreDecode" );
+	pEntity->StartReading( buf );
+
+	const CRecvDecodeOp *pOps = pDecoder->m_Ops.Base();
+
+	CFieldPath path;
+	int nDataOffset;
+	int nNextDataOffset;
+
+	for ( int nFieldIndex = 0 ; nFieldIndex < pEntity->GetFieldCount() ; ++nFieldIndex )
+	{
+		pEntity->GetField( nFieldIndex, path, &nDataOffset, &nNextDataOffset );
+
+		const CRecvDecodeOp &op = pOps[path];
+		if ( op.m_nStore == RECVSTORE_NONE || op.m_nOpcode == RECVOP_GENERIC )
+			continue;
+
+		buf.Seek( nDataOffset );
+		DecodeOpValue( op, buf, pValues[nFieldIndex] );
+	}
+}
+
+bool RecvTable_ApplyPreDecoded( RecvTable *pTable, void *pStruct, SerializedEntityHandle_t handle, const DVariant *pValues, int objectID )
+{
+	CRecvDecoder *pDecoder = pTable->m_pDecoder;
+	ErrorIfNot( pDecoder,
+		("RecvTable_ApplyPreDecoded: table '%s' missing a decoder.", pTable->GetName())
+		);
+
+	CSerializedEntity *pEntity = reinterpret_cast< CSerializedEntity * >( handle );
+	Assert( pEntity );
+
+	CClientDatatableStack theStack( pDecoder, (unsigned char*)pStruct, objectID );
+	theStack.Init( false, false );
+
+	// Only RECVOP_GENERIC fields are still read from the serialized data.
+	bf_read buf;
+	buf.SetDebugName( "CFlattenedSerializer::ApplyPreDecoded" );
+	pEntity->StartReading( buf );
+
+	DecodeInfo decodeInfo;
+	decodeInfo.m_pIn = &buf;
+	decodeInfo.m_ObjectID = objectID;
+	decodeInfo.m_iElement = 0;
+
+	const CRecvDecodeOp *pOps = pDecoder->m_Ops.Base();
+
+	CFieldPath path;
+	int nDataOffset;
+	int nNextDataOffset;
+
+	for ( int nFieldIndex = 0 ; nFieldIndex < pEntity->GetFieldCount() ; ++nFieldIndex )
+	{
+		pEntity->GetField( nFieldIndex, path, &nDataOffset, &nNextDataOffset );
+
+		const CRecvDecodeOp &op = pOps[path];
+		unsigned char *pStructBase = theStack.m_pProxies[op.m_iProxy];
+		if ( op.m_nStore == RECVSTORE_NONE || !pStructBase )
+			continue;
+
+		if ( op.m_nOpcode == RECVOP_GENERIC )
+		{
+			buf.Seek( nDataOffset );
+			DecodeOpGeneric( op, pStructBase, &decodeInfo );
+		}
+		else
+		{
+			decodeInfo.m_Value = pValues[nFieldIndex];
+			StoreOpValue( op, pStructBase, &decodeInfo );
+		}
+	}
+
+	return !buf.IsOverflowed();
+}
+
+CON_COMMAND( dt_decode_bench, "Times RecvTable_Decode. 'dt_decode_bench start', play back a demo, then 'dt_decode_bench stop'. Compare runs with dt_compiled_decoders 0 and 1." )
+{
+	if ( args.ArgC() >= 2 && !V_stricmp( args[1], "start" ) )
+	{
+		g_DecodeBenchTime.Init();
+		g_nDecodeBenchEntities = 0;
+		g_nDecodeBenchFields = 0;
+		g_bDecodeBench = true;
+		ConMsg( "dt_decode_bench: timing RecvTable_Decode with %s decoders\n", dt_compiled_decoders.GetBool() ? "compiled" : "generic" );
+		return;
+	}
+
+	if ( args.ArgC() >= 2 && !V_stricmp( args[1], "stop" ) )
+	{
+		g_bDecodeBench = false;
+	}
+	else if ( args.ArgC() >= 2 )
+	{
+		ConMsg( "Usage: dt_decode_bench [start|stop]\n" );
+		return;
+	}
+
+	double flMS = g_DecodeBenchTime.GetMillisecondsF();
+	ConMsg( "dt_decode_bench: %d entities, %d fields decoded in %.2f ms (%.3f us/entity, %.1f ns/field)%s\n",
+		g_nDecodeBenchEntities, g_nDecodeBenchFields, flMS,
+		g_nDecodeBenchEntities ? flMS * 1000.0 / g_nDecodeBenchEntities : 0.0,
+		g_nDecodeBenchFields ? flMS * 1000000.0 / g_nDecodeBenchFields : 0.0,
+		g_bDecodeBench ? " (still running)" : "" );
+}
+
 void RecvTable_DecodeZeros( RecvTable *pTable, void *pStruct, int objectID )
 {
 	CRecvDecoder *pDecoder = pTable->m_pDecoder;
@@ -863,6 +1360,9 @@ bool RecvTable_ReadFieldList_Guts(
 	// Remember where the "data" payload started
 	int nStartBit = buf.GetNumBitsRead();
 
+	// The compiled ops know the encoded size of most props up front.
+	const CRecvDecodeOp *pOps = ( dt_compiled_decoders.GetBool() && pDecoder->m_Ops.Count() ) ? pDecoder->m_Ops.Base() : NULL;
+
 	CFieldPath path;
 	for ( int nFieldIndex = 0; nFieldIndex < pEntity->GetFieldCount(); ++nFieldIndex )
 	{
@@ -871,8 +1371,15 @@ bool RecvTable_ReadFieldList_Guts(
 		path = pEntity->GetFieldPath( nFieldIndex );
 		pEntity->SetFieldDataBitOffset( nFieldIndex, nDataOffset - nStartBit ); // Offset from start of data payload
 
-		const SendProp *pSendProp = pDecoder->GetSendProp( path );
-		g_PropTypeFns[ pSendProp->GetType() ].SkipProp( pSendProp, &buf );
+		if ( pOps && pOps[path].m_nSkipBits >= 0 )
+		{
+			buf.SeekRelative( pOps[path].m_nSkipBits );
+		}
+		else
+		{
+			const SendProp *pSendProp = pDecoder->GetSendProp( path );
+			g_PropTypeFns[ pSendProp->GetType() ].SkipProp( pSendProp, &buf );
+		}
 		// buffer now just after payload
 
 		if ( bDTIEnabled )
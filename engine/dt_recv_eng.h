@@ -54,6 +54,15 @@ bool		RecvTable_Decode(
 	int objectID
 	);
 
+// RecvTable_Decode split in two, so many entities can be decoded in parallel.
+// RecvTable_PreDecode reads the value of each field in handle into pValues (one per
+// field) without touching the entity, so it can run on any thread.
+// RecvTable_ApplyPreDecoded then stores them into pStruct and calls the proxies.
+// Only tables RecvTable_CanPreDecode returns true for can be split.
+bool		RecvTable_CanPreDecode( RecvTable *pTable );
+void		RecvTable_PreDecode( RecvTable *pTable, SerializedEntityHandle_t handle, DVariant *pValues );
+bool		RecvTable_ApplyPreDecoded( RecvTable *pTable, void *pStruct, SerializedEntityHandle_t handle, const DVariant *pValues, int objectID );
+
 // This acts like a RecvTable_Decode() call where all properties are written and all their values are zero.
 void RecvTable_DecodeZeros( RecvTable *pTable, void *pStruct, int objectID );
 
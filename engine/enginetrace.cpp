@@ -197,6 +197,7 @@ private:
 
 	friend void RayBench( const CCommand &args );
 	friend void RayBatchBench( const CCommand &args );
+	friend class CTraceListData;
 };
 
 extern void FlushOcclusionQueries();
@@ -1733,8 +1734,26 @@ static bool IsBoxWithinBounds( const Vector &boxMins, const Vector &boxMaxs, con
 }
 
 
+DEFINE_FRAME_ALLOC_COUNTER( CTraceListData );
+
+CTraceListData::CTraceListData()
+{
+	m_pEngineTrace = NULL;
+	m_bFoundNonSolidLeaf = false;
+	m_bSkipStaticProps = false;
+	m_mins.Init();
+	m_maxs.Init();
+	m_brushList.SetAllocCounter( FRAME_ALLOC_COUNTER( CTraceListData ) );
+	m_dispList.SetAllocCounter( FRAME_ALLOC_COUNTER( CTraceListData ) );
+	m_entityList.SetAllocCounter( FRAME_ALLOC_COUNTER( CTraceListData ) );
+	m_staticPropList.SetAllocCounter( FRAME_ALLOC_COUNTER( CTraceListData ) );
+}
+
 bool CTraceListData::CanTraceRay( const Ray_t &ray )
 {
+	if ( IsStale() )
+		return false;
+
 	Vector rayMins, rayMaxs;
 	ComputeRayBounds( ray, rayMins, rayMaxs );
 	return IsBoxWithinBounds( rayMins, rayMaxs, m_mins, m_maxs );
@@ -1762,6 +1781,10 @@ IterationRetval_t CTraceListData::EnumElement( IHandleEntity *pHandleEntity )
 	{
 		if ( StaticPropMgr()->IsStaticProp( pHandleEntity ) )
 		{
+			// Static props are still in the list from the initial setup
+			if ( m_bSkipStaticProps )
+				return ITERATION_CONTINUE;
+
 			int index = m_staticPropList.AddToTail();
 			m_staticPropList[index].pCollideable = pCollideable;
 			m_staticPropList[index].pEntity = pHandleEntity;
@@ -1777,6 +1800,23 @@ IterationRetval_t CTraceListData::EnumElement( IHandleEntity *pHandleEntity )
 	return ITERATION_CONTINUE;
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Rebuilds only the entity list. The world brushes, displacements and
+//			static props can't move, so a list gathered earlier in the frame
+//			(possibly on another thread) stays valid for them.
+//-----------------------------------------------------------------------------
+void CTraceListData::RefreshEntityList()
+{
+	if ( !m_pEngineTrace )
+		return;
+
+	VPROF("RefreshEntityList");
+	m_entityList.Purge();
+	m_bSkipStaticProps = true;
+	SpatialPartition()->EnumerateElementsInBox( m_pEngineTrace->SpatialPartitionMask(), m_mins, m_maxs, false, this );
+	m_bSkipStaticProps = false;
+}
+
 //-----------------------------------------------------------------------------
 // Purpose:
 //-----------------------------------------------------------------------------
@@ -1821,7 +1861,7 @@ void CEngineTrace::TraceRayAgainstLeafAndEntityList( const Ray_t &ray, ITraceLis
 	CTraceListData &traceData = *static_cast<CTraceListData *>(pTraceData);
 	Vector rayMins, rayMaxs;
 	ComputeRayBounds( ray, rayMins, rayMaxs );
-	if ( !IsBoxWithinBounds( rayMins, rayMaxs, traceData.m_mins, traceData.m_maxs ) )
+	if ( traceData.IsStale() || !IsBoxWithinBounds( rayMins, rayMaxs, traceData.m_mins, traceData.m_maxs ) )
 	{
 		TraceRay( ray, fMask, pTraceFilter, pTrace );
 		return;
@@ -12,6 +12,10 @@
 #include "clientframe.h"
 #include "packed_entity.h"
 #include "iclientnetworkable.h"
+#include "tier1/utlvector.h"
+
+class RecvTable;
+class DVariant;
 
 #ifdef _WIN32
 #pragma once
@@ -144,6 +148,40 @@ public:
 };
 
 
+// An entity decode queued by CL_CopyNewEntity or CL_CopyExistingEntity while
+// u.m_bDeferDecodes is set. The values are decoded on the job threads, then
+// PreDataUpdate is called and they are stored into the entity on the main
+// thread in stream order.
+class CDeferredEntityDecode
+{
+public:
+	enum
+	{
+		MAX_STATES = 2
+	};
+
+	void AddState( SerializedEntityHandle_t handle, bool bOwned )
+	{
+		Assert( m_nStates < MAX_STATES );
+		m_States[m_nStates] = handle;
+		m_bOwnsState[m_nStates] = bOwned;
+		m_pValues[m_nStates] = NULL;
+		++m_nStates;
+	}
+
+	int							m_nEntity;
+	IClientNetworkable			*m_pEnt;
+	DataUpdateType_t			m_UpdateType;				// Passed to PreDataUpdate when the decode is applied.
+	RecvTable					*m_pRecvTable;
+	void						*m_pStruct;
+
+	int							m_nStates;
+	SerializedEntityHandle_t	m_States[MAX_STATES];		// Decoded in order, ie: the baseline, then the delta.
+	bool						m_bOwnsState[MAX_STATES];	// Released once it's been decoded.
+	DVariant					*m_pValues[MAX_STATES];		// One per field of the state.
+};
+
+
 // Passed around the read functions.
 class CEntityReadInfo : public CEntityInfo
 {
@@ -155,12 +193,33 @@ public:
 		m_nLocalPlayerBits = 0;
 		m_nOtherPlayerBits = 0;
 		m_UpdateType = PreserveEnt;
+		m_bDeferDecodes = false;
 		m_DecodeEntity = g_pSerializedEntities->AllocateSerializedEntity( __FILE__, __LINE__ );
 	}
 
 	~CEntityReadInfo()
 	{
 		g_pSerializedEntities->ReleaseSerializedEntity( m_DecodeEntity );
+
+		for ( int i = 0; i < m_DeferredDecodes.Count(); ++i )
+		{
+			CDeferredEntityDecode &decode = m_DeferredDecodes[i];
+			for ( int j = 0; j < decode.m_nStates; ++j )
+			{
+				if ( decode.m_bOwnsState[j] )
+				{
+					g_pSerializedEntities->ReleaseSerializedEntity( decode.m_States[j] );
+				}
+			}
+		}
+	}
+
+	// Hands m_DecodeEntity over to the caller and starts a new one.
+	SerializedEntityHandle_t TakeDecodeEntity()
+	{
+		SerializedEntityHandle_t handle = m_DecodeEntity;
+		m_DecodeEntity = g_pSerializedEntities->AllocateSerializedEntity( __FILE__, __LINE__ );
+		return handle;
 	}
 
 	SerializedEntityHandle_t m_DecodeEntity;
@@ -177,6 +236,9 @@ public:
 
 	CPostDataUpdateCall	m_PostDataUpdateCalls[MAX_EDICTS];
 	int					m_nPostDataUpdateCalls;
+
+	bool				m_bDeferDecodes;	// queue entity decodes instead of decoding right away
+	CUtlVector< CDeferredEntityDecode > m_DeferredDecodes;
 };
 
 #endif // ENTS_SHARED_H
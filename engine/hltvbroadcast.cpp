@@ -27,6 +27,8 @@
 #endif
 #include "networkstringtableclient.h"
 #include "tier1/fmtstr.h"
+#include "tier1/lzss.h"
+#include "vstdlib/jobthread.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -41,6 +43,8 @@ ConVar tv_broadcast_startup_resend_interval( "tv_broadcast_startup_resend_interv
 ConVar tv_broadcast_max_requests( "tv_broadcast_max_requests", "20", FCVAR_RELEASE, "Max number of broadcast http requests in flight. If there is a network issue, the requests may start piling up, degrading server performance. If more than the specified number of requests are in flight, the new requests are dropped." );
 ConVar tv_broadcast_drop_fragments( "tv_broadcast_drop_fragments", "0", FCVAR_RELEASE | FCVAR_HIDDEN, "Drop every Nth fragment" );
 ConVar tv_broadcast_terminate( "tv_broadcast_terminate", "1", FCVAR_RELEASE | FCVAR_HIDDEN, "Terminate every broadcast with a stop command" );
+ConVar tv_broadcast_compress( "tv_broadcast_compress", "0", FCVAR_RELEASE, "LZSS compress broadcast fragments before posting them, the relay must understand the X-Fragment-Encoding header" );
+ConVar tv_broadcast_local_dir( "tv_broadcast_local_dir", "", FCVAR_RELEASE, "Mirror broadcast fragments into this directory under the game write path, laid out like the relay urls (<dir>/<token>/<fragment>/start|full|delta and sync) so a local http server can serve them" );
 ConVar tv_broadcast_origin_auth( "tv_broadcast_origin_auth", "gocastauth" /*use something secure, like hMugYm7Lv4o5*/, FCVAR_RELEASE | FCVAR_HIDDEN, "X-Origin-Auth header of the broadcast POSTs" );
 
 //////////////////////////////////////////////////////////////////////
@@ -55,6 +59,9 @@ CHLTVBroadcast::CHLTVBroadcast(CHLTVServer *pHltvServer) :m_pHltvServer( pHltvSe
 	m_nHttpRequestBacklogHighWatermark = 0;
 	m_nMatchFragmentCounter = 0;
 	m_flBroadcastKeyframeInterval = tv_broadcast_keyframe_interval.GetFloat();
+	m_nFragmentBytes = m_nFragmentSentBytes = 0;
+	m_flFragmentLatency = m_flMaxFragmentLatency = 0;
+	m_nFragmentsSent = 0;
 }
 
 CHLTVBroadcast::CMemoryStream::CMemoryStream() : m_Buffer( NET_MAX_PAYLOAD, NET_MAX_PAYLOAD )
@@ -110,6 +117,10 @@ void CHLTVBroadcast::StartRecording( const char *pBroadcastUrl )
 	m_nKeyframeBytes = m_nDeltaFrameBytes = 0;
 	m_nFailedHttpRequests = 0;
 	m_mpFrame.Reset();
+	m_mpFinalize.Reset();
+	m_nFragmentBytes = m_nFragmentSentBytes = 0;
+	m_flFragmentLatency = m_flMaxFragmentLatency = 0;
+	m_nFragmentsSent = 0;
 
 	// extern ConVar sv_mmqueue_reservation;
 	if ( uint64 nMatchId = sv.GetMatchId() )
@@ -122,6 +133,15 @@ void CHLTVBroadcast::StartRecording( const char *pBroadcastUrl )
 		uint64 nSteamId = Steam3Server().GetGSSteamID().ConvertToUint64();
 		m_Url.Format( "%s/s%llut%llu", pBroadcastUrl, nSteamId, m_nMasterCookie );
 	}
+
+	m_LocalDir.Clear();
+	if ( *tv_broadcast_local_dir.GetString() )
+	{
+		// use the same token as the url, so that a local http server can stand in for the relay
+		const char *pToken = V_strrchr( m_Url.Get(), '/' );
+		m_LocalDir.Format( "%s/%s", tv_broadcast_local_dir.GetString(), pToken ? pToken + 1 : m_Url.Get() );
+		g_pFullFileSystem->CreateDirHierarchy( m_LocalDir.Get(), "DEFAULT_WRITE_PATH" );
+	}
 }
 
 bool CHLTVBroadcast::IsRecording()
@@ -139,6 +159,7 @@ void CHLTVBroadcast::StopRecording( )
 	if ( tv_broadcast_terminate.GetBool() )
 		m_DeltaStream.WriteCmdHeader( dem_stop, GetRecordingTick(), 0 );
 	FlushCollectedStreams( "&final" );
+	SendFinalizedFragments( true ); // nothing may be left referencing us or our streams
 	m_nMatchFragmentCounter += 2; // we need to create a hole in the broadcast in case we change our mind and start broadcast again some moments (or hours) later. This will force all clients to re-sync to the new keyframe
 
 	m_DeltaStream.Purge();
@@ -429,6 +450,9 @@ void CHLTVBroadcast::WriteFrame( CHLTVFrame *pFrame, bf_write *additionaldata )
 {
 	Assert( m_pHltvServer->IsMasterProxy() ); // this works only on the master since we use sv.
 
+	// post whatever the thread pool finished since the last frame
+	SendFinalizedFragments();
+
 	m_nCurrentTick = pFrame->tick_count;
 	bool bKeyFrame = ( m_nCurrentTick - m_nKeyframeTick ) * sv.GetTickInterval() >= m_flBroadcastKeyframeInterval;
 
@@ -454,11 +478,12 @@ void CHLTVBroadcast::WriteFrame( CHLTVFrame *pFrame, bf_write *additionaldata )
 
 	if ( bKeyFrame )
 	{
-		if ( m_HttpRequests.Count() > tv_broadcast_max_requests.GetInt() )
+		int nBacklog = m_HttpRequests.Count() + m_FragmentQueue.Count();
+		if ( nBacklog > tv_broadcast_max_requests.GetInt() )
 		{
 			int nFragment = ++m_nMatchFragmentCounter;
 			Warning( "Broadcast backlog of http requests in flight is too high (%d > %d), dropping %d/full and %d/delta.\n",
-					 m_HttpRequests.Count(), tv_broadcast_max_requests.GetInt(), m_nMatchFragmentCounter, nFragment );
+					 nBacklog, tv_broadcast_max_requests.GetInt(), m_nMatchFragmentCounter, nFragment );
 		}
 		else
 		{
@@ -480,7 +505,11 @@ void CHLTVBroadcast::WriteFrame( CHLTVFrame *pFrame, bf_write *additionaldata )
 				m_nDecayMaxKeyframeTicks = Max( m_nDecayMaxKeyframeTicks * 933 / 1000, nElapsedTicks ); // 0.933 ^ 20 = .25 , this will decay 1/4 every minute
 			}
 			m_nKeyframeBytes += m_DeltaStream.GetCommitSize();
-			Send( CFmtStr( "/%d/full?tick=%d", nFragment, m_nCurrentTick ), m_DeltaStream );
+			if ( CFragment *pFragment = Send( CFmtStr( "/%d/full?tick=%d", nFragment, m_nCurrentTick ), m_DeltaStream ) )
+			{
+				pFragment->m_nSyncFragment = nFragment;
+				pFragment->m_nSyncTick = m_nCurrentTick;
+			}
 		}
 		m_DeltaStream.Reset();
 	}
@@ -513,6 +542,12 @@ void CHLTVBroadcast::DumpStats()
 			 m_nFailedHttpRequests, m_HttpRequests.Count(), m_nHttpRequestBacklogHighWatermark
 		);
 		Msg( "http Send %.3f ms ave, %.3f ms max\n", m_mpLowLevelSend.GetAverageMilliseconds(), CMicroProfiler::TimeBaseTicksToMilliseconds( m_nMaxLowLevelSendTicks ) );
+		if ( m_nFragmentsSent )
+		{
+			Msg( "Fragments: %d posted, %d finalizing, %.3f ms ave finalize, %.1f ms ave latency (%.1f max), %s", m_nFragmentsSent, m_FragmentQueue.Count(),
+				 m_mpFinalize.GetAverageMilliseconds(), m_flFragmentLatency * 1000 / m_nFragmentsSent, m_flMaxFragmentLatency * 1000, V_pretifynum( m_nFragmentBytes ) );
+			Msg( " bytes -> %s bytes posted\n", V_pretifynum( m_nFragmentSentBytes ) );
+		}
 	}
 	else
 	{
@@ -625,15 +660,16 @@ void CHLTVBroadcast::FlushCollectedStreams( const char *pExtraParams )
 }
 
 // protocol is very simple: a=<account/match id> & t=  <type, i=initial/startup, k=keyframe/full frame, d=delta frames> & 
-CHLTVBroadcast::CHttpCallback * CHLTVBroadcast::Send( const char* pPath, CMemoryStream &stream )
+CHLTVBroadcast::CFragment * CHLTVBroadcast::Send( const char* pPath, CMemoryStream &stream )
 {
 	return Send( pPath, stream.Base(), stream.GetCommitSize() );
 }
 
 
-CHLTVBroadcast::CHttpCallback * CHLTVBroadcast::Send( const char* pPath, const void *pBase, uint nSize )
+// the fragment is copied out of the stream and finalized on the thread pool; SendFinalizedFragments() posts it once that's done
+CHLTVBroadcast::CFragment * CHLTVBroadcast::Send( const char* pPath, const void *pBase, uint nSize )
 {
-	if ( !s_pSteamHTTP )
+	if ( !s_pSteamHTTP && m_LocalDir.IsEmpty() )
 	{
 		Warning( "HLTV Broadcast cannot send data because steam http is not available. Are you logged into Steam?\n" );
 		return NULL;
@@ -644,11 +680,152 @@ CHLTVBroadcast::CHttpCallback * CHLTVBroadcast::Send( const char* pPath, const v
 		return NULL;
 	}
 
-	return LowLevelSend( m_Url + pPath, pBase, nSize );
+	CFragment *pFragment = new CFragment( pPath, pBase, nSize, m_LocalDir.IsEmpty() ? NULL : m_LocalDir.Get() );
+	m_FragmentQueue.AddToTail( pFragment );
+
+	if ( g_pThreadPool )
+	{
+		pFragment->m_pJob = new CFunctorJob( CreateFunctor( pFragment, &CFragment::Finalize ) );
+		g_pThreadPool->AddJob( pFragment->m_pJob );
+	}
+	else
+	{
+		pFragment->Finalize();
+	}
+
+	return pFragment;
+}
+
+
+void CHLTVBroadcast::SendFinalizedFragments( bool bWait )
+{
+	// fragments must reach the relay in the order they were cut, so stop at the first one that isn't done yet
+	while ( m_FragmentQueue.Count() )
+	{
+		CFragment *pFragment = m_FragmentQueue[ 0 ];
+		if ( !bWait && !pFragment->IsFinalized() )
+			break;
+
+		pFragment->WaitForFinalize();
+		m_FragmentQueue.Remove( 0 );
+
+		m_mpFinalize.Add( pFragment->m_nFinalizeTicks );
+
+		if ( s_pSteamHTTP )
+			LowLevelSend( m_Url + pFragment->m_Path, pFragment->m_Data.Base(), pFragment->m_nSize, pFragment );
+
+		// file system writes stay on the main thread, in fragment order, so the sync file never points past what's on disk
+		pFragment->WriteLocal();
+
+		if ( pFragment->m_nSyncFragment >= 0 && !m_LocalDir.IsEmpty() )
+			WriteLocalSync( pFragment->m_nSyncFragment, pFragment->m_nSyncTick );
+
+		double flLatency = Plat_FloatTime() - pFragment->m_flQueueTime;
+		uint nSentSize = pFragment->m_pCompressed ? pFragment->m_nCompressedSize : pFragment->m_nSize;
+		m_nFragmentsSent++;
+		m_nFragmentBytes += pFragment->m_nSize;
+		m_nFragmentSentBytes += nSentSize;
+		m_flFragmentLatency += flLatency;
+		m_flMaxFragmentLatency = Max( m_flMaxFragmentLatency, flLatency );
+
+		if ( tv_debug.GetInt() > 1 )
+		{
+			Msg( "Broadcast[%d] %s: %u bytes (%u posted), crc %08x, finalize %.2f ms, latency %.1f ms\n", m_pHltvServer->GetInstanceIndex(), pFragment->m_Path.Get(),
+				 pFragment->m_nSize, nSentSize, pFragment->m_nCrc, CMicroProfiler::TimeBaseTicksToMilliseconds( pFragment->m_nFinalizeTicks ), flLatency * 1000 );
+		}
+
+		delete pFragment;
+	}
+}
+
+
+// the sync file tells a local http server which keyframe spectators should start from, the same way the relay's /sync does
+void CHLTVBroadcast::WriteLocalSync( int nFragment, int nTick )
+{
+	CUtlBuffer buf( 0, 0, CUtlBuffer::TEXT_BUFFER );
+	buf.Printf( "{\n\t\"tick\": %d,\n\t\"fragment\": %d,\n\t\"signup_fragment\": %d,\n\t\"tps\": %.1f,\n\t\"protocol\": %d\n}\n",
+				nTick, nFragment, m_nSignonDataFragment, 1.0f / sv.GetTickInterval(), DEMO_PROTOCOL );
+	g_pFullFileSystem->WriteFile( CFmtStr( "%s/sync", m_LocalDir.Get() ), "DEFAULT_WRITE_PATH", buf );
+}
+
+
+CHLTVBroadcast::CFragment::CFragment( const char *pPath, const void *pBase, uint nSize, const char *pLocalDir ) :
+	m_Path( pPath ), m_Data( 0, nSize ), m_nSize( nSize )
+{
+	V_memcpy( m_Data.Base(), pBase, nSize );
+	m_pCompressed = NULL;
+	m_nCompressedSize = 0;
+	m_nCrc = 0;
+	m_bCompress = tv_broadcast_compress.GetBool();
+	m_nSyncFragment = -1;
+	m_nSyncTick = -1;
+	m_flQueueTime = Plat_FloatTime();
+	m_nFinalizeTicks = 0;
+	m_pJob = NULL;
+
+	if ( pLocalDir )
+	{
+		// "/<fragment>/<type>?<params>" maps onto "<dir>/<fragment>/<type>"
+		const char *pParams = V_strchr( pPath, '?' );
+		int nPathLen = pParams ? pParams - pPath : V_strlen( pPath );
+		m_LocalPath.Format( "%s%.*s", pLocalDir, nPathLen, pPath );
+	}
+}
+
+CHLTVBroadcast::CFragment::~CFragment()
+{
+	WaitForFinalize();
+	free( m_pCompressed );
 }
 
+void CHLTVBroadcast::CFragment::Finalize()
+{
+	CMicroProfilerSample sample;
 
-CHLTVBroadcast::CHttpCallback * CHLTVBroadcast::LowLevelSend( const CUtlString &path, const void *pBase, uint nSize )
+	m_nCrc = CRC32_ProcessSingleBuffer( m_Data.Base(), m_nSize );
+
+	if ( m_bCompress )
+	{
+		// NULL if it wouldn't compress, in which case we post the raw data
+		CLZSS lzss;
+		m_pCompressed = lzss.Compress( m_Data.Base(), m_nSize, &m_nCompressedSize );
+	}
+
+	m_nFinalizeTicks = sample.GetElapsed();
+}
+
+void CHLTVBroadcast::CFragment::WriteLocal()const
+{
+	if ( m_LocalPath.IsEmpty() )
+		return;
+
+	char szDir[ MAX_PATH ];
+	V_ExtractFilePath( m_LocalPath.Get(), szDir, sizeof( szDir ) );
+	g_pFullFileSystem->CreateDirHierarchy( szDir, "DEFAULT_WRITE_PATH" );
+
+	CUtlBuffer buf( m_Data.Base(), m_nSize, CUtlBuffer::READ_ONLY );
+	if ( !g_pFullFileSystem->WriteFile( m_LocalPath.Get(), "DEFAULT_WRITE_PATH", buf ) )
+	{
+		Warning( "Broadcast cannot write fragment %s\n", m_LocalPath.Get() );
+	}
+}
+
+bool CHLTVBroadcast::CFragment::IsFinalized()const
+{
+	return !m_pJob || m_pJob->IsFinished();
+}
+
+void CHLTVBroadcast::CFragment::WaitForFinalize()
+{
+	if ( m_pJob )
+	{
+		m_pJob->WaitForFinishAndRelease();
+		m_pJob = NULL;
+	}
+}
+
+
+CHLTVBroadcast::CHttpCallback * CHLTVBroadcast::LowLevelSend( const CUtlString &path, const void *pBase, uint nSize, const CFragment *pFragment )
 {
 	CMicroProfilerGuard mpg( &m_mpLowLevelSend );
 
@@ -667,6 +844,18 @@ CHLTVBroadcast::CHttpCallback * CHLTVBroadcast::LowLevelSend( const CUtlString &
 			Warning( "Cannot set http X-Origin-Auth\n" );
 		}
 	}
+	if ( pFragment )
+	{
+		s_pSteamHTTP->SetHTTPRequestHeaderValue( hRequest, "X-Fragment-CRC32", CFmtStr( "%08x", pFragment->m_nCrc ) );
+		if ( pFragment->m_pCompressed )
+		{
+			// the relay needs the raw size to set up the decompression
+			s_pSteamHTTP->SetHTTPRequestHeaderValue( hRequest, "X-Fragment-Encoding", "lzss" );
+			s_pSteamHTTP->SetHTTPRequestHeaderValue( hRequest, "X-Fragment-Size", CFmtStr( "%u", pFragment->m_nSize ) );
+			pBase = pFragment->m_pCompressed;
+			nSize = pFragment->m_nCompressedSize;
+		}
+	}
 	if ( !s_pSteamHTTP->SetHTTPRequestRawPostBody( hRequest, "application/octet-stream", ( uint8* )pBase, nSize ) )
 	{
 		Warning( "Cannot set http post body for %s, %u bytes\n", path.Get(), nSize );
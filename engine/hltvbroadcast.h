@@ -15,11 +15,13 @@
 #include "broadcast.h"
 #include "tier0/microprofiler.h"
 #include "tier1/utlincrementalvector.h"
+#include "tier1/checksum_crc.h"
 #include "steam/steam_api.h"
 #include "steam/isteamhttp.h"
 
 class CHLTVFrame;
 class CHLTVServer;
+class CJob;
 
 class CEngineGotvSyncPacket;	// forward declare protobuf message here
 
@@ -86,6 +88,33 @@ protected:
 		}
 	};
 
+	// a fragment that has been cut from a stream and is waiting to be finalized (checksummed and compressed) on the thread pool
+	// before it can be posted and written out locally
+	class CFragment
+	{
+	public:
+		CFragment( const char *pPath, const void *pBase, uint nSize, const char *pLocalDir );
+		~CFragment();
+		void Finalize();
+		bool IsFinalized()const;
+		void WaitForFinalize();
+		void WriteLocal()const;
+
+	public:
+		CUtlString m_Path;
+		CUtlString m_LocalPath; // empty if fragments aren't written to a local directory
+		CUtlMemory< uint8 > m_Data;
+		uint m_nSize;
+		uint8 *m_pCompressed; // NULL unless compression is on and the data compressed
+		uint m_nCompressedSize;
+		CRC32_t m_nCrc;
+		bool m_bCompress;
+		int m_nSyncFragment, m_nSyncTick; // for full fragments, what the local sync file should advertise once this is written
+		double m_flQueueTime;
+		int64 m_nFinalizeTicks;
+		CJob *m_pJob;
+	};
+
 	class CHttpCallback : public CCallbackBase
 	{
 	public:
@@ -157,9 +186,11 @@ public:
 	void Unregister( CHttpCallback *pCallback );
 protected:
 	void FlushCollectedStreams(const char *pExtraParams = "");
-	CHttpCallback * Send( const char* pPath, CMemoryStream &stream );
-	CHttpCallback * Send( const char* pPath, const void *pBase, uint nSize );
-	CHttpCallback * LowLevelSend( const CUtlString &path, const void *pBase, uint nSize );
+	CFragment * Send( const char* pPath, CMemoryStream &stream );
+	CFragment * Send( const char* pPath, const void *pBase, uint nSize );
+	CHttpCallback * LowLevelSend( const CUtlString &path, const void *pBase, uint nSize, const CFragment *pFragment = NULL );
+	void SendFinalizedFragments( bool bWait = false );
+	void WriteLocalSync( int nFragment, int nTick );
 protected:
 	bool			m_bIsRecording;
 	int				m_nFrameCount;
@@ -173,9 +204,12 @@ protected:
 	uint64			m_nMasterCookie;
 	CHLTVServer		*m_pHltvServer;
 
-	CMicroProfiler	m_mpKeyframe, m_mpFrame, m_mpLowLevelSend;
+	CMicroProfiler	m_mpKeyframe, m_mpFrame, m_mpLowLevelSend, m_mpFinalize;
 	int64 m_nMaxKeyframeTicks, m_nDecayMaxKeyframeTicks, m_nMaxLowLevelSendTicks;
 	int64 m_nKeyframeBytes, m_nDeltaFrameBytes;
+	int64 m_nFragmentBytes, m_nFragmentSentBytes; // raw and posted (possibly compressed) fragment sizes
+	double m_flFragmentLatency, m_flMaxFragmentLatency; // seconds from cutting a fragment to posting it
+	int m_nFragmentsSent;
 
 	FileHandle_t m_pFile;
 
@@ -191,6 +225,8 @@ protected:
 
 	friend class CHttpCallback;
 	CUtlIncrementalVector< CHttpCallback > m_HttpRequests; // requests in flight
+	CUtlVector< CFragment* > m_FragmentQueue; // fragments being finalized, posted in order
+	CUtlString m_LocalDir; // directory that fragments are mirrored into, laid out like the relay urls
 	int m_nHttpRequestBacklogHighWatermark;
 
 	int m_nMatchFragmentCounter;
@@ -46,6 +46,10 @@ CHLTVClient::CHLTVClient(int slot, CBaseServer *pServer)
 	m_fLastSendTime = 0.0f;
 	m_flLastChatTime = 0.0f;
 	m_bNoChat = false;
+	m_nBaselineHash = 0;
+	m_pHashedBaseline = NULL;
+	m_nHashedBaselineTick = -1;
+	m_nHashedBaselineUsed = -1;
 
 	if ( tv_chatgroupsize.GetInt() > 0  )
 	{
@@ -183,6 +187,23 @@ CClientFrame *CHLTVClient::GetDeltaFrame( int nTick )
 	return m_pHLTV->GetDeltaFrame( nTick );
 }
 
+uint64 CHLTVClient::GetBaselineHash()
+{
+	if ( !m_pBaseline )
+		return 0;
+
+	// the baseline only changes on spawn and when an update is acked, which moves its tick and flips the slot
+	if ( m_pBaseline != m_pHashedBaseline || m_pBaseline->m_nTickCount != m_nHashedBaselineTick || m_nBaselineUsed != m_nHashedBaselineUsed )
+	{
+		m_nBaselineHash = HashBaselineEntities( m_pBaseline->m_pEntities, m_pBaseline->m_nNumEntities );
+		m_pHashedBaseline = m_pBaseline;
+		m_nHashedBaselineTick = m_pBaseline->m_nTickCount;
+		m_nHashedBaselineUsed = m_nBaselineUsed;
+	}
+
+	return m_nBaselineHash;
+}
+
 
 bool CHLTVClient::ExecuteStringCommand( const char *pCommandString )
 {
@@ -548,6 +569,14 @@ bool CHLTVClient::SendSnapshot( CClientFrame * pFrame )
 
 	// TODO delta cache whole snapshots, not just packet entities. then use net_Align
 	// send entity update, delta compressed if deltaFrame != NULL
+	CHLTVPacketEntitiesPayload *pPayload = ( pDeltaFrame && m_pHLTV->UseSharedDeltaEntities() ) ? m_pHLTV->GetSharedDeltaEntities( this, pFrame, pDeltaFrame ) : NULL;
+	if ( pPayload )
+	{
+		// relay spectators at the same tick and delta state share one encoded message
+		msg.WriteBits( pPayload->m_pData, pPayload->m_nBits );
+		pPayload->Release();
+	}
+	else
 	{
 		CSVCMsg_PacketEntities_t packetmsg;
 		m_Server->WriteDeltaEntities( this, pFrame, pDeltaFrame, packetmsg );
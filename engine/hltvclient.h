@@ -63,6 +63,8 @@ public: // IClientMessageHandlers
 
 public:
 	CClientFrame *GetDeltaFrame( int nTick );
+	// content hash of m_pBaseline, recomputed only when the baseline changes
+	uint64 GetBaselineHash();
 
 protected:
 	virtual bool	ProcessSignonStateMsg(int state, int spawncount) OVERRIDE;
@@ -75,6 +77,12 @@ public:
 	double	m_flLastChatTime;	// last time user send a chat text
 	bool	m_bNoChat;			// if true don't send chat message to this client
 	char	m_szChatGroup[128];	// client password
+
+private:
+	uint64			m_nBaselineHash;
+	CFrameSnapshot	*m_pHashedBaseline;
+	int				m_nHashedBaselineTick;
+	int				m_nHashedBaselineUsed;
 };
 
 
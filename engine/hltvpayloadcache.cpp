@@ -0,0 +1,173 @@
+//========= Copyright (c) 1996-2005, Valve Corporation, All rights reserved. ============//
+//
+// Purpose: encoded svc_PacketEntities messages shared between relay spectators
+//
+//=============================================================================//
+
+#include "hltvpayloadcache.h"
+#include "framesnapshot.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+
+uint64 HashBaselineEntities( const CFrameSnapshotEntry *pEntities, int nEntities )
+{
+	// FNV-1a over the entities actually in the baseline. every client baseline is a private snapshot,
+	// but the packed entity handles it holds are shared with the relay frames they were copied from
+	uint64 nHash = 14695981039346656037ull;
+
+	for ( int i = 0; i < nEntities; i++ )
+	{
+		const CFrameSnapshotEntry &entry = pEntities[i];
+
+		if ( entry.m_pPackedData == INVALID_PACKED_ENTITY_HANDLE )
+			continue;
+
+		uint64 values[4] = { (uint64)i, (uint64)entry.m_nSerialNumber, (uint64)(uintp)entry.m_pClass, (uint64)entry.m_pPackedData };
+
+		for ( int j = 0; j < ARRAYSIZE( values ); j++ )
+		{
+			nHash ^= values[j];
+			nHash *= 1099511628211ull;
+		}
+	}
+
+	return nHash;
+}
+
+
+CHLTVPacketEntitiesPayload::CHLTVPacketEntitiesPayload() :
+	m_nDeltaTick( -1 ),
+	m_nBaselineTick( -1 ),
+	m_nBaselineHash( 0 ),
+	m_nBaselineUsed( 0 ),
+	m_bPendingBaseline( false ),
+	m_pData( NULL ),
+	m_nBits( 0 ),
+	m_bUpdateBaseline( false )
+{
+}
+
+CHLTVPacketEntitiesPayload::~CHLTVPacketEntitiesPayload()
+{
+	delete [] m_pData;
+}
+
+void CHLTVPacketEntitiesPayload::SetBaseline( const CFrameSnapshotEntry *pEntities, int nEntities )
+{
+	m_BaselineEntities.RemoveAll();
+
+	for ( int i = 0; i < nEntities; i++ )
+	{
+		const CFrameSnapshotEntry &entry = pEntities[i];
+
+		if ( entry.m_pPackedData == INVALID_PACKED_ENTITY_HANDLE )
+			continue;
+
+		BaselineEntity_t &baseline = m_BaselineEntities[ m_BaselineEntities.AddToTail() ];
+		baseline.m_nIndex = i;
+		baseline.m_nSerialNumber = entry.m_nSerialNumber;
+		baseline.m_pClass = entry.m_pClass;
+		baseline.m_pPackedData = entry.m_pPackedData;
+	}
+}
+
+bool CHLTVPacketEntitiesPayload::MatchesBaseline( const CFrameSnapshotEntry *pEntities, int nEntities ) const
+{
+	// walk both in index order, the client baseline must have nothing the payload's baseline doesn't
+	int nNext = 0;
+
+	for ( int i = 0; i < nEntities; i++ )
+	{
+		const CFrameSnapshotEntry &entry = pEntities[i];
+
+		if ( entry.m_pPackedData == INVALID_PACKED_ENTITY_HANDLE )
+			continue;
+
+		if ( nNext >= m_BaselineEntities.Count() )
+			return false;
+
+		const BaselineEntity_t &baseline = m_BaselineEntities[ nNext++ ];
+
+		if ( baseline.m_nIndex != i || baseline.m_nSerialNumber != entry.m_nSerialNumber ||
+			 baseline.m_pClass != entry.m_pClass || baseline.m_pPackedData != entry.m_pPackedData )
+			return false;
+	}
+
+	return nNext == m_BaselineEntities.Count();
+}
+
+CPacketEntitiesCache::CPacketEntitiesCache()
+{
+	m_nTick = 0;
+	m_nEncodes = 0;
+	m_nShares = 0;
+	m_nCollisions = 0;
+}
+
+CPacketEntitiesCache::~CPacketEntitiesCache()
+{
+	Flush();
+}
+
+void CPacketEntitiesCache::Flush()
+{
+	AUTO_LOCK_FM( m_Mutex );
+
+	// clients still sending a payload hold their own reference
+	FOR_EACH_VEC( m_Payloads, i )
+	{
+		m_Payloads[i]->Release();
+	}
+
+	m_Payloads.RemoveAll();
+}
+
+void CPacketEntitiesCache::SetTick( int nTick )
+{
+	if ( nTick == m_nTick )
+		return;
+
+	Flush();
+
+	m_nTick = nTick;
+}
+
+CHLTVPacketEntitiesPayload *CPacketEntitiesCache::FindPayload( int nDeltaTick, int nBaselineTick, uint64 nBaselineHash, int nBaselineUsed, bool bPendingBaseline,
+	const CFrameSnapshotEntry *pBaselineEntities, int nBaselineEntities )
+{
+	AUTO_LOCK_FM( m_Mutex );
+
+	// spectators mostly share a handful of delta ticks, so a linear search is fine
+	FOR_EACH_VEC( m_Payloads, i )
+	{
+		CHLTVPacketEntitiesPayload *pPayload = m_Payloads[i];
+
+		if ( pPayload->m_nDeltaTick == nDeltaTick && pPayload->m_nBaselineTick == nBaselineTick && pPayload->m_nBaselineHash == nBaselineHash &&
+			 pPayload->m_nBaselineUsed == nBaselineUsed && pPayload->m_bPendingBaseline == bPendingBaseline )
+		{
+			// a delta against the wrong baseline would silently corrupt the client, so never trust the hash alone
+			if ( !pPayload->MatchesBaseline( pBaselineEntities, nBaselineEntities ) )
+			{
+				m_nCollisions++;
+				continue;
+			}
+
+			m_nShares++;
+			pPayload->AddRef();
+			return pPayload;
+		}
+	}
+
+	return NULL;
+}
+
+void CPacketEntitiesCache::AddPayload( CHLTVPacketEntitiesPayload *pPayload )
+{
+	AUTO_LOCK_FM( m_Mutex );
+
+	m_nEncodes++;
+	pPayload->AddRef();
+	m_Payloads.AddToTail( pPayload );
+}
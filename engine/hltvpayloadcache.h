@@ -0,0 +1,91 @@
+//========= Copyright (c) 1996-2005, Valve Corporation, All rights reserved. ============//
+//
+// Purpose: encoded svc_PacketEntities messages shared between relay spectators
+//
+//=============================================================================//
+
+#ifndef HLTVPAYLOADCACHE_H
+#define HLTVPAYLOADCACHE_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "const.h"
+#include "tier0/threadtools.h"
+#include "tier1/refcount.h"
+#include "tier1/utlvector.h"
+#include "bitvec.h"
+
+class CFrameSnapshotEntry;
+class ServerClass;
+
+// hash of the entities in a client baseline, clients with equal baseline contents get equal hashes.
+// only a quick reject, payloads are reused after comparing the baseline contents themselves
+uint64 HashBaselineEntities( const CFrameSnapshotEntry *pEntities, int nEntities );
+
+// an encoded svc_PacketEntities message shared by every relay spectator that is at the same tick and delta state
+class CHLTVPacketEntitiesPayload : public CRefCounted<>
+{
+public:
+	CHLTVPacketEntitiesPayload();
+	~CHLTVPacketEntitiesPayload();
+
+	// remembers the baseline the payload was encoded against
+	void SetBaseline( const CFrameSnapshotEntry *pEntities, int nEntities );
+	// true if a client baseline holds exactly the entities the payload was encoded against
+	bool MatchesBaseline( const CFrameSnapshotEntry *pEntities, int nEntities ) const;
+
+	// cache key
+	int				m_nDeltaTick;
+	int				m_nBaselineTick;	// tick of the last baseline update the client acknowledged
+	uint64			m_nBaselineHash;	// HashBaselineEntities of the client baseline
+	int				m_nBaselineUsed;
+	bool			m_bPendingBaseline;	// encoded for clients without a baseline update in flight
+
+	// the entities of the baseline the payload was encoded against, same fields HashBaselineEntities covers
+	struct BaselineEntity_t
+	{
+		int				m_nIndex;
+		int				m_nSerialNumber;
+		ServerClass		*m_pClass;
+		intp			m_pPackedData;
+	};
+	CUtlVector< BaselineEntity_t > m_BaselineEntities;
+
+	// the encoded message
+	byte			*m_pData;
+	int				m_nBits;
+
+	// client side effects of the encode, replayed for every client sharing the payload
+	bool				m_bUpdateBaseline;
+	CBitVec<MAX_EDICTS>	m_BaselinesSent;
+};
+
+class CPacketEntitiesCache
+{
+public:
+	CPacketEntitiesCache();
+	~CPacketEntitiesCache();
+
+	void SetTick( int nTick );
+	// returns a referenced payload or NULL, caller must release it
+	CHLTVPacketEntitiesPayload *FindPayload( int nDeltaTick, int nBaselineTick, uint64 nBaselineHash, int nBaselineUsed, bool bPendingBaseline,
+		const CFrameSnapshotEntry *pBaselineEntities, int nBaselineEntities );
+	// takes a reference on the payload until the tick changes
+	void AddPayload( CHLTVPacketEntitiesPayload *pPayload );
+	void Flush();
+
+	int	GetEncodeCount() const { return m_nEncodes; }
+	int	GetShareCount() const { return m_nShares; }
+	int	GetCollisionCount() const { return m_nCollisions; }
+
+protected:
+	int	m_nTick;	// current tick
+	int	m_nEncodes;	// payloads encoded
+	int	m_nShares;	// sends that reused an encoded payload
+	int	m_nCollisions;	// payloads whose key and hash matched but whose baseline didn't
+	CUtlVector< CHLTVPacketEntitiesPayload* > m_Payloads;
+	CThreadFastMutex m_Mutex;
+};
+
+#endif // HLTVPAYLOADCACHE_H
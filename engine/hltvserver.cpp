@@ -39,6 +39,8 @@
 #include "tier1/fmtstr.h"
 #include "serializedentity.h"
 #include "changeframelist.h"
+#include "tier1/lzss.h"
+#include "vstdlib/jobthread.h"
 #include "ihltv.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
@@ -98,12 +100,17 @@ ConVar tv_transmitall( "tv_transmitall", "1", FCVAR_REPLICATED | FCVAR_RELEASE,
 ConVar tv_debug( "tv_debug", "0", FCVAR_RELEASE, "GOTV debug info." );
 ConVar tv_title( "tv_title", "GOTV", FCVAR_RELEASE, "Set title for GOTV spectator UI", tv_title_changed_f );
 static ConVar tv_deltacache( "tv_deltacache", "2", FCVAR_RELEASE, "Enable delta entity bit stream cache" );
+static ConVar tv_relay_shared_payloads( "tv_relay_shared_payloads", "1", FCVAR_RELEASE, "Relay proxies encode packet entities once per tick and delta state and send the same payload to every spectator sharing it" );
 static ConVar tv_relayvoice( "tv_relayvoice", "1", FCVAR_RELEASE, "Relay voice data: 0=off, 1=on" );
 static ConVar tv_encryptdata_key( "tv_encryptdata_key", "", FCVAR_RELEASE, "When set to a valid key communication messages will be encrypted for GOTV" );
 static ConVar tv_encryptdata_key_pub( "tv_encryptdata_key_pub", "", FCVAR_RELEASE, "When set to a valid key public communication messages will be encrypted for GOTV" );
 
 static ConVar tv_window_size( "tv_window_size", "16.0", FCVAR_NONE, "Specifies the number of seconds worth of frames that the tv replay system should keep in memory. Increasing this greatly increases the amount of memory consumed by the TV system" );
 static ConVar tv_enable_delta_frames( "tv_enable_delta_frames", "1", FCVAR_RELEASE, "Indicates whether or not the tv should use delta frames for storage of intermediate frames. This takes more CPU but significantly less memory." );
+static ConVar tv_delta_compress( "tv_delta_compress", "1", FCVAR_RELEASE, "Compress the entity properties of delta frames on the thread pool while they wait out the tv delay." );
+static ConVar tv_delta_compress_backlog_mb( "tv_delta_compress_backlog_mb", "32", FCVAR_RELEASE, "Megabytes of delta frame properties that may wait on the thread pool for compression. Frames beyond this are compressed on the main thread, so uncompressed delta frames never exceed it." );
+//merging is lossy: the entity states of the older frame are dropped and the delayed stream jumps straight to the newer frame's state
+static ConVar tv_delta_max_mb( "tv_delta_max_mb", "512", FCVAR_RELEASE, "Hard cap in megabytes on the memory held by delta frames waiting out the tv delay (0 = no cap). Over the cap adjacent delta frames are merged, which is lossy: the intermediate entity states of the merged frame are dropped (events, sounds and messages are kept), so spectators see those entities skip a snapshot.", true, 0.0f, true, 2047.0f );
 extern ConVar spec_replay_enable;
 extern ConVar spec_replay_message_time;
 ConVar	spec_replay_leadup_time( "spec_replay_leadup_time", "5.3438", FCVAR_RELEASE | FCVAR_REPLICATED, "Replay time in seconds before the highlighted event" );
@@ -118,11 +125,22 @@ m_pRelativeFrame( NULL ),
 	m_nNumValidEntities( 0 ),
 	m_nTotalEntities( 0 ),
 	m_pEntities( NULL ),
-	m_pNewerDeltaFrame( NULL )
+	m_pNewerDeltaFrame( NULL ),
+	m_pCopyEntities( NULL ),
+	m_pCompressedProps( NULL ),
+	m_nCompressedPropBytes( 0 ),
+	m_nPackedPropBytes( 0 ),
+	m_nTrackedMemSize( 0 ),
+	m_pCompressJob( NULL )
 {}
 
 CHLTVServer::SHLTVDeltaFrame_t::~SHLTVDeltaFrame_t()
 {
+	//the compression job may still be working on our entities
+	WaitForCompression();
+	free( m_pCompressedProps );
+	m_pCompressedProps = NULL;
+
 	delete [] m_pCopyEntities;
 	m_pCopyEntities = NULL;
 
@@ -158,7 +176,7 @@ CHLTVServer::SHLTVDeltaEntity_t::~SHLTVDeltaEntity_t()
 	//free any recipients if we allocated them
 	delete [] m_pNewRecipients;
 
-	if( (m_SerializedEntity != knNoPackedData) && ( m_SerializedEntity != SERIALIZED_ENTITY_HANDLE_INVALID ) )
+	if( (m_SerializedEntity != knNoPackedData) && ( m_SerializedEntity != knCompressedData ) && ( m_SerializedEntity != SERIALIZED_ENTITY_HANDLE_INVALID ) )
 		delete ( CSerializedEntity* )m_SerializedEntity;
 }
 
@@ -576,6 +594,9 @@ CHLTVServer::CHLTVServer( uint nInstanceIndex, float flSnapshotRate )
 
 	m_pOldestDeltaFrame = NULL;
 	m_pNewestDeltaFrame = NULL;
+	m_nDeltaFrameBytes = 0;
+	m_nDeltaFramesMerged = 0;
+	m_nDeltaMergeTick = 0;
 
 	m_pLastSourceSnapshot = NULL;
 	m_pLastTargetSnapshot = NULL;
@@ -1615,6 +1636,12 @@ static int GetBitBufBytes( int nNumBits )
 	return ( ( nNumBits + 31 ) / 32) * 4;
 }
 
+//the number of bytes a serialized entity takes once packed into a delta frame's compression block
+static uint32 GetPackedPropsSize( const CSerializedEntity *pProps )
+{
+	return sizeof( uint16 ) + sizeof( uint32 ) + pProps->GetFieldCount() * ( sizeof( short ) + sizeof( uint32 ) ) + Bits2Bytes( pProps->GetFieldDataBitCount() );
+}
+
 //given a tick that the time changed on, and the current value along with the previous properties, this will determine which properties
 //have changed, and create a serialized entity handle that contains just the delta properties
 static SerializedEntityHandle_t CreateDeltaProperties( int nTick, const PackedEntity* pCurrPacked, const PackedEntity *pDeltaBase )
@@ -1903,6 +1930,29 @@ void CHLTVServer::AddNewDeltaFrame( CClientFrame *pClientFrame )
 	if( !m_pOldestDeltaFrame )
 		m_pOldestDeltaFrame = pNewDeltaFrame;
 
+	//account for the frame before the compression job can change its size
+	pNewDeltaFrame->m_nTrackedMemSize = ( int )pNewDeltaFrame->GetMemSize();
+	m_nDeltaFrameBytes += pNewDeltaFrame->m_nTrackedMemSize;
+
+	//the properties are the bulk of a delta frame, so compress them while the frame waits to be expanded
+	if( tv_delta_compress.GetBool() )
+	{
+		const int nPropBytes = ( int )pNewDeltaFrame->GetPropsMemSize();
+		if( g_pThreadPool && ( m_nPendingCompressBytes + nPropBytes <= tv_delta_compress_backlog_mb.GetInt() * 1024 * 1024 ) )
+		{
+			m_nPendingCompressBytes += nPropBytes;
+			pNewDeltaFrame->m_pCompressJob = new CFunctorJob( CreateFunctor( this, &CHLTVServer::CompressDeltaFrameJob, pNewDeltaFrame, nPropBytes ) );
+			g_pThreadPool->AddJob( pNewDeltaFrame->m_pCompressJob );
+		}
+		else
+		{
+			//the pool has fallen behind, don't let uncompressed frames pile up
+			CompressDeltaFrame( pNewDeltaFrame, nPropBytes );
+		}
+	}
+
+	EnforceDeltaFrameMemoryCap();
+
 	// reset HLTV frame for recording next messages etc.
 	m_HLTVFrame.Reset();
 	m_HLTVFrame.SetSnapshot( NULL );
@@ -2113,14 +2163,434 @@ static void CompareSnapshot( const CFrameSnapshot* pOldSnapshot, const CFrameSna
 
 size_t CHLTVServer::SHLTVDeltaFrame_t::GetMemSize()const
 {
-	uint nSize = sizeof( *this );
-	if ( CFrameSnapshot *pSnapshot = m_pClientFrame->GetSnapshot() )
+	size_t nSize = sizeof( *this );
+	nSize += sizeof( uint32 ) * ( ( m_nTotalEntities + 31 ) / 32 );
+	for( const SHLTVDeltaEntity_t *pEntity = m_pEntities; pEntity; pEntity = pEntity->m_pNext )
+	{
+		nSize += sizeof( *pEntity );
+		if( pEntity->m_pNewRecipients )
+			nSize += pEntity->m_nNumRecipients * sizeof( CSendProxyRecipients );
+	}
+	nSize += GetPropsMemSize();
+	nSize += m_nCompressedPropBytes;
+
+	if ( m_pClientFrame )
+	{
+		nSize += m_pClientFrame->GetMemSize();
+		if ( CFrameSnapshot *pSnapshot = m_pClientFrame->GetSnapshot() )
+		{
+			nSize += pSnapshot->GetMemSize();
+		}
+	}
+	return nSize;
+}
+
+bool CHLTVServer::SHLTVDeltaFrame_t::HasProps( SerializedEntityHandle_t hProps )
+{
+	return ( hProps != SERIALIZED_ENTITY_HANDLE_INVALID ) && ( hProps != SHLTVDeltaEntity_t::knNoPackedData ) && ( hProps != SHLTVDeltaEntity_t::knCompressedData );
+}
+
+size_t CHLTVServer::SHLTVDeltaFrame_t::GetPropsMemSize()const
+{
+	size_t nSize = 0;
+	for( const SHLTVDeltaEntity_t *pEntity = m_pEntities; pEntity; pEntity = pEntity->m_pNext )
 	{
-		nSize += pSnapshot->GetMemSize();
+		if( !HasProps( pEntity->m_SerializedEntity ) )
+			continue;
+
+		const CSerializedEntity *pProps = ( const CSerializedEntity* )pEntity->m_SerializedEntity;
+		nSize += sizeof( CSerializedEntity ) + PAD_NUMBER( pProps->GetFieldCount() * sizeof( short ), 4 ) + PAD_NUMBER( pProps->GetFieldCount() * sizeof( uint32 ), 4 ) + PAD_NUMBER( Bits2Bytes( pProps->GetFieldDataBitCount() ), 4 );
 	}
 	return nSize;
 }
 
+void CHLTVServer::SHLTVDeltaFrame_t::WaitForCompression()
+{
+	if( m_pCompressJob )
+	{
+		m_pCompressJob->WaitForFinishAndRelease();
+		m_pCompressJob = NULL;
+	}
+}
+
+void CHLTVServer::SHLTVDeltaFrame_t::CompressProperties()
+{
+	Assert( !m_pCompressedProps );
+
+	//first pass, determine how much memory the packed properties will take
+	uint32 nPackedBytes = 0;
+	for( SHLTVDeltaEntity_t *pEntity = m_pEntities; pEntity; pEntity = pEntity->m_pNext )
+	{
+		if( HasProps( pEntity->m_SerializedEntity ) )
+			nPackedBytes += GetPackedPropsSize( ( const CSerializedEntity* )pEntity->m_SerializedEntity );
+	}
+	if( !nPackedBytes )
+		return;
+
+	//pack the properties back to back: field count, data bits, field paths, data offsets and then the data itself
+	uint8 *pPacked = ( uint8* )malloc( nPackedBytes );
+	uint8 *pOut = pPacked;
+	for( SHLTVDeltaEntity_t *pEntity = m_pEntities; pEntity; pEntity = pEntity->m_pNext )
+	{
+		if( !HasProps( pEntity->m_SerializedEntity ) )
+			continue;
+
+		CSerializedEntity *pProps = ( CSerializedEntity* )pEntity->m_SerializedEntity;
+		const uint16 nFields	= ( uint16 )pProps->GetFieldCount();
+		const uint32 nDataBits	= pProps->GetFieldDataBitCount();
+		V_memcpy( pOut, &nFields, sizeof( nFields ) );					pOut += sizeof( nFields );
+		V_memcpy( pOut, &nDataBits, sizeof( nDataBits ) );				pOut += sizeof( nDataBits );
+		V_memcpy( pOut, pProps->GetFieldPaths(), nFields * sizeof( short ) );				pOut += nFields * sizeof( short );
+		V_memcpy( pOut, pProps->GetFieldDataBitOffsets(), nFields * sizeof( uint32 ) );	pOut += nFields * sizeof( uint32 );
+		V_memcpy( pOut, pProps->GetFieldData(), Bits2Bytes( nDataBits ) );				pOut += Bits2Bytes( nDataBits );
+
+		delete pProps;
+		pEntity->m_SerializedEntity = SHLTVDeltaEntity_t::knCompressedData;
+	}
+	Assert( pOut == pPacked + nPackedBytes );
+
+	//LZSS gives up on data that won't get smaller, in which case we just hold onto the packed form
+	CLZSS lzss;
+	unsigned int nCompressedBytes = 0;
+	uint8 *pCompressed = lzss.Compress( pPacked, nPackedBytes, &nCompressedBytes );
+	if( pCompressed )
+	{
+		free( pPacked );
+		m_pCompressedProps		= pCompressed;
+		m_nCompressedPropBytes	= nCompressedBytes;
+	}
+	else
+	{
+		m_pCompressedProps		= pPacked;
+		m_nCompressedPropBytes	= nPackedBytes;
+	}
+	m_nPackedPropBytes = nPackedBytes;
+}
+
+void CHLTVServer::SHLTVDeltaFrame_t::DecompressProperties()
+{
+	if( !m_pCompressedProps )
+		return;
+
+	//compression only ever produces something smaller, so matching sizes means it was kept packed
+	uint8 *pPacked = m_pCompressedProps;
+	if( m_nCompressedPropBytes != m_nPackedPropBytes )
+	{
+		pPacked = ( uint8* )malloc( m_nPackedPropBytes );
+		CLZSS lzss;
+		unsigned int nUncompressedBytes = lzss.SafeUncompress( m_pCompressedProps, pPacked, m_nPackedPropBytes );
+		Assert( nUncompressedBytes == m_nPackedPropBytes );
+		NOTE_UNUSED( nUncompressedBytes );
+	}
+
+	//and rebuild the serialized entities in the same order they were packed
+	const uint8 *pIn = pPacked;
+	for( SHLTVDeltaEntity_t *pEntity = m_pEntities; pEntity; pEntity = pEntity->m_pNext )
+	{
+		if( pEntity->m_SerializedEntity != SHLTVDeltaEntity_t::knCompressedData )
+			continue;
+
+		uint16 nFields;
+		uint32 nDataBits;
+		V_memcpy( &nFields, pIn, sizeof( nFields ) );				pIn += sizeof( nFields );
+		V_memcpy( &nDataBits, pIn, sizeof( nDataBits ) );			pIn += sizeof( nDataBits );
+
+		CSerializedEntity *pProps = new CSerializedEntity( );
+		pProps->SetupPackMemory( nFields, nDataBits );
+		V_memcpy( pProps->GetFieldPaths(), pIn, nFields * sizeof( short ) );				pIn += nFields * sizeof( short );
+		V_memcpy( pProps->GetFieldDataBitOffsets(), pIn, nFields * sizeof( uint32 ) );		pIn += nFields * sizeof( uint32 );
+		V_memcpy( pProps->GetFieldData(), pIn, Bits2Bytes( nDataBits ) );					pIn += Bits2Bytes( nDataBits );
+
+		pEntity->m_SerializedEntity = ( SerializedEntityHandle_t )pProps;
+	}
+	Assert( pIn == pPacked + m_nPackedPropBytes );
+
+	if( pPacked != m_pCompressedProps )
+		free( pPacked );
+	free( m_pCompressedProps );
+	m_pCompressedProps		= NULL;
+	m_nCompressedPropBytes	= 0;
+	m_nPackedPropBytes		= 0;
+}
+
+void CHLTVServer::CompressDeltaFrameJob( SHLTVDeltaFrame_t *pDeltaFrame, int nPendingBytes )
+{
+	CompressDeltaFrame( pDeltaFrame, nPendingBytes );
+	m_nPendingCompressBytes -= nPendingBytes;
+}
+
+void CHLTVServer::CompressDeltaFrame( SHLTVDeltaFrame_t *pDeltaFrame, int nPropBytes )
+{
+	pDeltaFrame->CompressProperties();
+
+	//the serialized entities are gone, the compressed block replaces them
+	const int nChange = ( int )pDeltaFrame->m_nCompressedPropBytes - nPropBytes;
+	pDeltaFrame->m_nTrackedMemSize += nChange;
+	m_nDeltaFrameBytes += nChange;
+}
+
+//given the changed properties of an entity in two consecutive delta frames, builds the properties that changed across both. Both lists are
+//in field order, and where both changed a property the newer value wins
+static CSerializedEntity* BuildUnionPropertySet( const CSerializedEntity *pOlder, const CSerializedEntity *pNewer )
+{
+	const int nOlderFields = pOlder->GetFieldCount();
+	const int nNewerFields = pNewer->GetFieldCount();
+
+	//first pass, determine the size of the union
+	int nNumFields = 0;
+	int nDataBits = 0;
+	for( int nOlder = 0, nNewer = 0; ( nOlder < nOlderFields ) || ( nNewer < nNewerFields ); ++nNumFields )
+	{
+		if( ( nNewer < nNewerFields ) && ( ( nOlder >= nOlderFields ) || ( pNewer->GetFieldPath( nNewer ) <= pOlder->GetFieldPath( nOlder ) ) ) )
+		{
+			if( ( nOlder < nOlderFields ) && ( pNewer->GetFieldPath( nNewer ) == pOlder->GetFieldPath( nOlder ) ) )
+				nOlder++;
+			nDataBits += pNewer->GetFieldDataSizeInBits( nNewer++ );
+		}
+		else
+		{
+			nDataBits += pOlder->GetFieldDataSizeInBits( nOlder++ );
+		}
+	}
+
+	CSerializedEntity *pUnion = new CSerializedEntity( );
+	pUnion->SetupPackMemory( nNumFields, nDataBits );
+
+	//setup the readers and writers
+	bf_read OlderData, NewerData;
+	pOlder->StartReading( OlderData );
+	pNewer->StartReading( NewerData );
+	bf_write OutPropData;
+	pUnion->StartWriting( OutPropData );
+
+	//and copy over each field from whichever side has the latest value
+	int nOutputProp = 0;
+	for( int nOlder = 0, nNewer = 0; ( nOlder < nOlderFields ) || ( nNewer < nNewerFields ); ++nOutputProp )
+	{
+		const CSerializedEntity *pSrcProps;
+		bf_read *pSrcData;
+		int nSrcField;
+		if( ( nNewer < nNewerFields ) && ( ( nOlder >= nOlderFields ) || ( pNewer->GetFieldPath( nNewer ) <= pOlder->GetFieldPath( nOlder ) ) ) )
+		{
+			if( ( nOlder < nOlderFields ) && ( pNewer->GetFieldPath( nNewer ) == pOlder->GetFieldPath( nOlder ) ) )
+				nOlder++;
+			pSrcProps	= pNewer;
+			pSrcData	= &NewerData;
+			nSrcField	= nNewer++;
+		}
+		else
+		{
+			pSrcProps	= pOlder;
+			pSrcData	= &OlderData;
+			nSrcField	= nOlder++;
+		}
+
+		int nDataOffset, nNextOffset;
+		CFieldPath PropIndex;
+		pSrcProps->GetField( nSrcField, PropIndex, &nDataOffset, &nNextOffset );
+
+		pUnion->SetFieldPath( nOutputProp, PropIndex );
+		pUnion->SetFieldDataBitOffset( nOutputProp, OutPropData.GetNumBitsWritten() );
+
+		pSrcData->Seek( nDataOffset );
+		OutPropData.WriteBitsFromBuffer( pSrcData, nNextOffset - nDataOffset );
+	}
+
+	//make sure our size calculations line up
+	Assert( ( nOutputProp == nNumFields ) && ( ( uint32 )OutPropData.GetNumBitsWritten() == pUnion->GetFieldDataBitCount() ) );
+	return pUnion;
+}
+
+//puts the messages of an older frame in front of the ones in this buffer, so nothing recorded for a merged away frame is lost
+static void PrependHLTVMessages( bf_write &msg, const bf_write &olderMsg )
+{
+	const int nOlderBits = olderMsg.GetNumBitsWritten();
+	if( nOlderBits <= 0 )
+		return;
+
+	const int nBits = nOlderBits + msg.GetNumBitsWritten();
+	const int nBytes = PAD_NUMBER( Bits2Bytes( nBits ), 4 );
+	char *pOldBuffer = ( char* )msg.GetBasePointer();
+
+	bf_write merged;
+	merged.StartWriting( new char[ nBytes ], nBytes );
+	merged.WriteBits( olderMsg.GetData(), nOlderBits );
+	merged.WriteBits( msg.GetData(), msg.GetNumBitsWritten() );
+
+	msg.StartWriting( merged.GetBasePointer(), nBytes, nBits );
+	delete [] pOldBuffer;
+}
+
+//this is lossy: every entity state the older frame recorded that the newer frame changes again is overwritten, so that intermediate
+//state never reaches spectators or the demo. Only the older frame's events, sounds and messages survive the merge
+CHLTVServer::SHLTVDeltaFrame_t* CHLTVServer::MergeDeltaFrameIntoNewer( SHLTVDeltaFrame_t *pPrev, SHLTVDeltaFrame_t *pOlder )
+{
+	VPROF_BUDGET( "CHLTVServer::MergeDeltaFrameIntoNewer", "HLTV" );
+
+	SHLTVDeltaFrame_t *pNewer = pOlder->m_pNewerDeltaFrame;
+	Assert( pNewer && ( pPrev ? ( pPrev->m_pNewerDeltaFrame == pOlder ) : ( m_pOldestDeltaFrame == pOlder ) ) );
+
+	//both frames need their own properties back before they can be combined
+	pOlder->WaitForCompression();
+	pOlder->DecompressProperties();
+	pNewer->WaitForCompression();
+	pNewer->DecompressProperties();
+	m_nDeltaFrameBytes -= pOlder->m_nTrackedMemSize + pNewer->m_nTrackedMemSize;
+
+	SHLTVDeltaEntity_t *pOlderEntity = pOlder->m_pEntities;
+	SHLTVDeltaEntity_t *pNewerEntity = pNewer->m_pEntities;
+	pOlder->m_pEntities = NULL;
+	pNewer->m_pEntities = NULL;
+	SHLTVDeltaEntity_t** pListTail = &pNewer->m_pEntities;
+
+	//both entity lists are in slot order, walk them together
+	for( uint32 nCurrEntity = 0; nCurrEntity < pNewer->m_nTotalEntities; ++nCurrEntity )
+	{
+		//the older frame's record of this slot, anything before it is for slots the newer frame no longer has
+		SHLTVDeltaEntity_t *pOld = NULL;
+		while( pOlderEntity && ( pOlderEntity->m_nSourceIndex <= nCurrEntity ) )
+		{
+			SHLTVDeltaEntity_t *pEntity = pOlderEntity;
+			pOlderEntity = pOlderEntity->m_pNext;
+			pEntity->m_pNext = NULL;
+			if( pEntity->m_nSourceIndex == nCurrEntity )
+				pOld = pEntity;
+			else
+				delete pEntity;
+		}
+
+		SHLTVDeltaEntity_t *pNew = NULL;
+		if( pNewerEntity && ( pNewerEntity->m_nSourceIndex == nCurrEntity ) )
+		{
+			pNew = pNewerEntity;
+			pNewerEntity = pNewerEntity->m_pNext;
+			pNew->m_pNext = NULL;
+		}
+
+		const uint32 nCopyBit = ( 1 << ( nCurrEntity % 32 ) );
+		const bool bOldCopy = ( nCurrEntity < pOlder->m_nTotalEntities ) && ( pOlder->m_pCopyEntities[ nCurrEntity / 32 ] & nCopyBit );
+
+		SHLTVDeltaEntity_t *pKeep = NULL;
+		if( pNewer->m_pCopyEntities[ nCurrEntity / 32 ] & nCopyBit )
+		{
+			//unchanged by the newer frame, so it is whatever the older frame made of it
+			Assert( !pNew && ( bOldCopy || pOld ) );
+			if( !bOldCopy )
+			{
+				pNewer->m_pCopyEntities[ nCurrEntity / 32 ] &= ~nCopyBit;
+				pKeep = pOld;
+				pOld = NULL;
+			}
+		}
+		else if( pNew )
+		{
+			//if the older frame changed the same object, the newer changes were relative to those and need folding together. Otherwise the
+			//newer entity is either relative to a copied forward entity (so relative to the older baseline as well) or a new object
+			if( pOld && ( pOld->m_nSerialNumber == pNew->m_nSerialNumber ) && ( pOld->m_pServerClass == pNew->m_pServerClass ) &&
+				( pOld->m_SerializedEntity != SHLTVDeltaEntity_t::knNoPackedData ) && ( pNew->m_SerializedEntity != SHLTVDeltaEntity_t::knNoPackedData ) )
+			{
+				if( pNew->m_SerializedEntity == SERIALIZED_ENTITY_HANDLE_INVALID )
+				{
+					pNew->m_SerializedEntity = pOld->m_SerializedEntity;
+					pOld->m_SerializedEntity = SERIALIZED_ENTITY_HANDLE_INVALID;
+				}
+				else if( pOld->m_SerializedEntity != SERIALIZED_ENTITY_HANDLE_INVALID )
+				{
+					CSerializedEntity *pUnion = BuildUnionPropertySet( ( const CSerializedEntity* )pOld->m_SerializedEntity, ( const CSerializedEntity* )pNew->m_SerializedEntity );
+					delete ( CSerializedEntity* )pNew->m_SerializedEntity;
+					pNew->m_SerializedEntity = ( SerializedEntityHandle_t )pUnion;
+				}
+
+				//recipients the newer frame didn't change are the ones the older frame set
+				if( !pNew->m_pNewRecipients && pOld->m_pNewRecipients )
+				{
+					pNew->m_pNewRecipients = pOld->m_pNewRecipients;
+					pOld->m_pNewRecipients = NULL;
+				}
+			}
+
+			pKeep = pNew;
+		}
+
+		delete pOld;
+
+		if( pKeep )
+		{
+			*pListTail = pKeep;
+			pListTail = &pKeep->m_pNext;
+		}
+	}
+
+	//anything left over is for slots past the end of the newer frame
+	Assert( !pNewerEntity );
+	while( pOlderEntity )
+	{
+		SHLTVDeltaEntity_t *pEntity = pOlderEntity;
+		pOlderEntity = pOlderEntity->m_pNext;
+		delete pEntity;
+	}
+
+	//the newer frame is now relative to the older frame's baseline
+	if( pNewer->m_pRelativeFrame )
+		pNewer->m_pRelativeFrame->ReleaseReference();
+	pNewer->m_pRelativeFrame = pOlder->m_pRelativeFrame;
+	pOlder->m_pRelativeFrame = NULL;
+
+	//keep the events, sounds and messages recorded for the older frame
+	for( int nBuffer = 0; nBuffer < HLTV_BUFFER_MAX; ++nBuffer )
+	{
+		PrependHLTVMessages( pNewer->m_pClientFrame->m_Messages[ nBuffer ], pOlder->m_pClientFrame->m_Messages[ nBuffer ] );
+	}
+
+	//unlink and free the older frame
+	if( pPrev )
+		pPrev->m_pNewerDeltaFrame = pNewer;
+	else
+		m_pOldestDeltaFrame = pNewer;
+	delete pOlder;
+	m_nDeltaFramesMerged++;
+
+	//and put the merged frame back in its compressed form
+	if( tv_delta_compress.GetBool() )
+		pNewer->CompressProperties();
+	pNewer->m_nTrackedMemSize = ( int )pNewer->GetMemSize();
+	m_nDeltaFrameBytes += pNewer->m_nTrackedMemSize;
+
+	return pNewer;
+}
+
+void CHLTVServer::EnforceDeltaFrameMemoryCap()
+{
+	const int nCapBytes = tv_delta_max_mb.GetInt() * 1024 * 1024;
+	if( nCapBytes <= 0 )
+		return;
+
+	while( m_nDeltaFrameBytes > nCapBytes )
+	{
+		//sweep from the oldest frame to the newest merging every other frame, so the delayed stream thins out evenly instead of
+		//losing one long stretch
+		SHLTVDeltaFrame_t *pPrev = NULL;
+		SHLTVDeltaFrame_t *pOlder = m_pOldestDeltaFrame;
+		while( pOlder && ( pOlder->m_pClientFrame->tick_count < m_nDeltaMergeTick ) )
+		{
+			pPrev = pOlder;
+			pOlder = pOlder->m_pNewerDeltaFrame;
+		}
+
+		if( !pOlder || !pOlder->m_pNewerDeltaFrame )
+		{
+			//reached the newest frame, start the next pass from the oldest
+			pPrev = NULL;
+			pOlder = m_pOldestDeltaFrame;
+			if( !pOlder || !pOlder->m_pNewerDeltaFrame )
+				break;
+		}
+
+		SHLTVDeltaFrame_t *pMerged = MergeDeltaFrameIntoNewer( pPrev, pOlder );
+		m_nDeltaMergeTick = pMerged->m_pNewerDeltaFrame ? pMerged->m_pNewerDeltaFrame->m_pClientFrame->tick_count : INT_MAX;
+	}
+}
+
 size_t CFrameSnapshot::GetMemSize()const
 {
 	size_t nSize = sizeof( *this );
@@ -2133,6 +2603,10 @@ void CHLTVServer::ExpandDeltaFrameToFullFrame( SHLTVDeltaFrame_t *pDeltaFrame )
 	//track the performance of this frame
 	VPROF_BUDGET( "CHLTVServer::ExpandDeltaFrameToFullFrame", "HLTV" );
 
+	//bring back the properties if they were compressed while the frame was queued
+	pDeltaFrame->WaitForCompression();
+	pDeltaFrame->DecompressProperties();
+
 	CFrameSnapshot *pSnapshot = pDeltaFrame->m_pClientFrame->GetSnapshot();
 
 	//we need to construct our full entity list in our snapshot
@@ -2302,6 +2776,9 @@ void CHLTVServer::ExpandDeltaFramesToTick( int nTick )
 		//expand the frame
 		ExpandDeltaFrameToFullFrame( pFrame );
 
+		//the frame is leaving the delta list
+		m_nDeltaFrameBytes -= pFrame->m_nTrackedMemSize;
+
 		//now add this into our frame list
 		AddClientFrame( pFrame->m_pClientFrame );
 
@@ -2327,11 +2804,15 @@ void CHLTVServer::FreeAllDeltaFrames( )
 		m_pOldestDeltaFrame = pCurrFrame->m_pNewerDeltaFrame;
 
 		//free everything about this frame
+		pCurrFrame->WaitForCompression();
+		m_nDeltaFrameBytes -= pCurrFrame->m_nTrackedMemSize;
 		delete pCurrFrame;
 	}
 
 	//and make sure to completely reset our list
+	Assert( m_nDeltaFrameBytes == 0 );
 	m_pNewestDeltaFrame = NULL;
+	m_nDeltaMergeTick = 0;
 }
 
 
@@ -2728,6 +3209,73 @@ CClientFrame *CHLTVServer::GetDeltaFrame( int nTick )
 }
 
 
+CHLTVPacketEntitiesPayload *CHLTVServer::GetSharedDeltaEntities( CHLTVClient *client, CClientFrame *to, CClientFrame *from )
+{
+	Assert( from && !IsMasterProxy() );
+
+	// a client without a baseline update in flight will have one started by this message, so it can only share with clients in the same state
+	bool bPendingBaseline = ( client->m_nBaselineUpdateTick == -1 );
+
+	// each client baseline is its own snapshot, so clients are matched on what their baselines hold
+	int nBaselineTick = client->m_pBaseline ? client->m_pBaseline->m_nTickCount : -1;
+	uint64 nBaselineHash = client->GetBaselineHash();
+
+	const CFrameSnapshotEntry *pBaselineEntities = client->m_pBaseline ? client->m_pBaseline->m_pEntities : NULL;
+	int nBaselineEntities = client->m_pBaseline ? client->m_pBaseline->m_nNumEntities : 0;
+
+	CHLTVPacketEntitiesPayload *pPayload = m_PacketEntitiesCache.FindPayload( from->tick_count, nBaselineTick, nBaselineHash, client->m_nBaselineUsed, bPendingBaseline,
+		pBaselineEntities, nBaselineEntities );
+
+	if ( pPayload )
+	{
+		// replay what the encode did to the client that built the payload
+		if ( bPendingBaseline )
+		{
+			client->m_BaselinesSent = pPayload->m_BaselinesSent;
+
+			if ( pPayload->m_bUpdateBaseline )
+			{
+				client->m_nBaselineUpdateTick = to->tick_count;
+			}
+		}
+
+		return pPayload;
+	}
+
+	CSVCMsg_PacketEntities_t packetmsg;
+	WriteDeltaEntities( client, to, from, packetmsg );
+
+	net_scratchbuffer_t scratch;
+	bf_write buf( "CHLTVServer::GetSharedDeltaEntities", scratch.GetBuffer(), scratch.Size() );
+	packetmsg.WriteToBuffer( buf );
+
+	if ( buf.IsOverflowed() )
+		return NULL;
+
+	pPayload = new CHLTVPacketEntitiesPayload;
+	pPayload->m_nDeltaTick = from->tick_count;
+	pPayload->m_nBaselineTick = nBaselineTick;
+	pPayload->m_nBaselineHash = nBaselineHash;
+	pPayload->m_nBaselineUsed = client->m_nBaselineUsed;
+	pPayload->m_bPendingBaseline = bPendingBaseline;
+	pPayload->SetBaseline( pBaselineEntities, nBaselineEntities );
+	pPayload->m_nBits = buf.GetNumBitsWritten();
+	pPayload->m_pData = new byte[ buf.GetNumBytesWritten() ];
+	V_memcpy( pPayload->m_pData, buf.GetData(), buf.GetNumBytesWritten() );
+	pPayload->m_bUpdateBaseline = packetmsg.update_baseline();
+	pPayload->m_BaselinesSent = client->m_BaselinesSent;
+
+	// the cache keeps its own reference until the tick changes, ours goes to the caller
+	m_PacketEntitiesCache.AddPayload( pPayload );
+
+	return pPayload;
+}
+
+bool CHLTVServer::UseSharedDeltaEntities()
+{
+	return !IsMasterProxy() && tv_relay_shared_payloads.GetBool();
+}
+
 CClientFrame *CHLTVServer::ExpandAndGetClientFrame( int nTick, bool bExact )
 {
 	ExpandDeltaFramesToTick( nTick );
@@ -2849,6 +3397,7 @@ void CHLTVServer::UpdateTick( void )
 	{
 		// delta entity cache works only for relay proxies
 		m_DeltaCache.SetTick( m_CurrentFrame->tick_count, m_CurrentFrame->last_entity+1 );
+		m_PacketEntitiesCache.SetTick( m_CurrentFrame->tick_count );
 	}
 
 	int removeTick = m_nTickCount - tv_window_size.GetFloat() / m_flTickInterval; // keep 16 seconds buffer
@@ -2926,6 +3475,7 @@ void CHLTVServer::Changelevel( bool bInactivateClients )
 	DeleteClientFrames( -1 );
 
 	m_DeltaCache.Flush();
+	m_PacketEntitiesCache.Flush();
 	m_FrameCache.RemoveAll();
 
 
@@ -3589,6 +4139,12 @@ CON_COMMAND( tv_status, "Show GOTV server status." )
 		ConMsg( "Total Slots %i, Spectators %i, Proxies %i\n",
 			slots, clients - proxies, proxies );
 
+		if ( !hltv->IsMasterProxy() && tv_relay_shared_payloads.GetBool() )
+		{
+			ConMsg( "Shared packet entities: %i encoded, %i reused, %i baseline hash collisions\n",
+				hltv->m_PacketEntitiesCache.GetEncodeCount(), hltv->m_PacketEntitiesCache.GetShareCount(), hltv->m_PacketEntitiesCache.GetCollisionCount() );
+		}
+
 		hltv->GetExternalStats( slots, clients );
 		if ( slots > 0 )
 		{
@@ -4012,13 +4568,20 @@ void CHLTVServer::DumpMem()
 	}
 	Msg( "%4u  Hltv Frames: %10s\n", nHltvFrameCount, V_pretifynum( nHltvFrameSize ) );
 
-	uint nDeltaFrameCount = 0, nDeltaFrameSize = 0;
+	uint nDeltaFrameCount = 0, nDeltaFrameSize = 0, nPackedPropSize = 0, nCompressedPropSize = 0;
 	for ( SHLTVDeltaFrame_t *pFrame = m_pOldestDeltaFrame; pFrame; pFrame = pFrame->m_pNewerDeltaFrame )
 	{
+		pFrame->WaitForCompression();
 		nDeltaFrameSize += pFrame->GetMemSize();
+		nPackedPropSize += pFrame->m_nPackedPropBytes;
+		nCompressedPropSize += pFrame->m_nCompressedPropBytes;
 		nDeltaFrameCount++;
 	}
 	Msg( "%4u Delta Frames: %10s\n", nDeltaFrameCount, V_pretifynum( nDeltaFrameSize ) );
+	Msg( "     Compressed Props: %10s", V_pretifynum( nCompressedPropSize ) );
+	Msg( " (from %s)\n", V_pretifynum( nPackedPropSize ) );
+	Msg( "     Tracked: %s", V_pretifynum( ( int )m_nDeltaFrameBytes ) );
+	Msg( ", cap %d MB, %d frames merged to stay under it\n", tv_delta_max_mb.GetInt(), m_nDeltaFramesMerged );
 	// dump packed entity sizes from framesnapshotmanager?
 }
 
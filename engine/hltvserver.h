@@ -19,6 +19,9 @@
 #include "networkstringtable.h"
 #include <ihltv.h>
 #include <convar.h>
+#include "hltvpayloadcache.h"
+
+class CJob;
 
 #define HLTV_BUFFER_VOICE			0	// player voice data
 #define HLTV_BUFFER_SOUNDS			1	// unreliable sounds
@@ -85,7 +88,6 @@ protected:
 	DeltaEntityEntry_s* m_Cache[MAX_EDICTS]; // array of pointers to delta entries
 };
 
-
 class CGameClient;
 class CGameServer;
 class IHLTVDirector;
@@ -220,6 +222,9 @@ public:
 	bool	DispatchToRelay( CHLTVClient *pClient);
 	bf_write *GetBuffer( int nBuffer);
 	CClientFrame *GetDeltaFrame( int nTick );
+	// relay proxies only, returns a referenced payload encoding the delta from 'from' to 'to' for this client or NULL on failure
+	CHLTVPacketEntitiesPayload *GetSharedDeltaEntities( CHLTVClient *client, CClientFrame *to, CClientFrame *from );
+	bool	UseSharedDeltaEntities();
 	CClientFrame *ExpandAndGetClientFrame( int nTick, bool bExact );
 
 	inline  CHLTVClient* Client( int i ) { return static_cast<CHLTVClient*>(m_Clients[i]); }
@@ -258,6 +263,8 @@ private:
 	{
 		//a constant used to denote that no packed data is associated with this object
 		static const SerializedEntityHandle_t	knNoPackedData = (SerializedEntityHandle_t)-1;
+		//a constant used to denote that the properties are held in the compressed block of the owning delta frame
+		static const SerializedEntityHandle_t	knCompressedData = (SerializedEntityHandle_t)-2;
 
 		SHLTVDeltaEntity_t();
 		~SHLTVDeltaEntity_t();
@@ -306,6 +313,25 @@ private:
 		//the next frame in our list (newest is at the tail of the list)
 		SHLTVDeltaFrame_t	*m_pNewerDeltaFrame;
 
+		//once compressed, the properties of every entity marked knCompressedData, packed back to back and LZSS compressed (or
+		//just packed if they wouldn't compress)
+		uint8				*m_pCompressedProps;
+		uint32				m_nCompressedPropBytes;
+		uint32				m_nPackedPropBytes;
+		//what this frame currently adds to CHLTVServer::m_nDeltaFrameBytes
+		int					m_nTrackedMemSize;
+		//the job compressing this frame on the thread pool, must be waited on before the entities are touched
+		CJob				*m_pCompressJob;
+
+		void CompressProperties();
+		void DecompressProperties();
+		void WaitForCompression();
+
+		//determines if the entity holds its own serialized properties (and not a placeholder)
+		static bool HasProps( SerializedEntityHandle_t hProps );
+		//the memory held by the uncompressed serialized properties of our entities
+		size_t GetPropsMemSize()const;
+
 		size_t GetMemSize()const;
 	};
 
@@ -334,6 +360,28 @@ private:
 	//called to free all delta frames that are queued
 	void				FreeAllDeltaFrames( );
 
+	//compresses the properties of a delta frame, run on the thread pool
+	void				CompressDeltaFrameJob( SHLTVDeltaFrame_t *pDeltaFrame, int nPendingBytes );
+	//compresses the properties of a delta frame and updates the memory accounting, nPropBytes is the size of the properties before
+	void				CompressDeltaFrame( SHLTVDeltaFrame_t *pDeltaFrame, int nPropBytes );
+
+	//folds a delta frame into the next newer one, which then encodes both changes relative to the older frame's baseline. Lossy: the
+	//older frame's intermediate entity states are dropped, only its messages are kept. pPrev is the frame before pOlder in the list
+	//(or NULL), returns the merged frame
+	SHLTVDeltaFrame_t*	MergeDeltaFrameIntoNewer( SHLTVDeltaFrame_t *pPrev, SHLTVDeltaFrame_t *pOlder );
+
+	//merges delta frames until they fit in tv_delta_max_mb again
+	void				EnforceDeltaFrameMemoryCap();
+
+	//bytes of delta frame properties that are queued for compression but not done yet
+	CInterlockedInt		m_nPendingCompressBytes;
+	//the memory held by all of our delta frames, as tracked by SHLTVDeltaFrame_t::m_nTrackedMemSize
+	CInterlockedInt		m_nDeltaFrameBytes;
+	//how many delta frames were merged away to stay under the memory cap
+	int					m_nDeltaFramesMerged;
+	//where the next merge pass continues from, so frames are thinned evenly across the delay
+	int					m_nDeltaMergeTick;
+
 	virtual IDemoStream *GetDemoStream() OVERRIDE { return &m_DemoFile; }
 public:
 
@@ -373,6 +421,7 @@ public:
 	CNetworkStringTableContainer m_NetworkStringTables;
 
 	CDeltaEntityCache				m_DeltaCache;
+	CPacketEntitiesCache			m_PacketEntitiesCache;	// encoded packet entities shared between relay spectators
 	CUtlVector<CFrameCacheEntry_s>	m_FrameCache;
 	CThreadFastMutex				m_FrameCacheMutex; // locks frame cache
 
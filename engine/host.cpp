@@ -158,6 +158,7 @@
 
 #include "matchmaking/mm_helpers.h"
 #include "ixboxsystem.h"
+#include "tier1/framememory.h"
 #if defined( INCLUDE_SCALEFORM )
 #include "scaleformui/scaleformui.h"
 #endif
@@ -442,6 +443,11 @@ CON_COMMAND( mem_verify, "Verify the validity of the heap" )
 	g_pMemAlloc->heapchk();
 }
 
+CON_COMMAND( mem_frame_alloc_stats, "Lists engine frame arena usage and the busiest per-frame allocation counters. Usage: mem_frame_alloc_stats [count]" )
+{
+	FrameMemory_PrintStats( ( args.ArgC() > 1 ) ? atoi( args[1] ) : 20 );
+}
+
 CON_COMMAND( mem_compact, "" )
 {
 	g_pMemAlloc->CompactHeap();
@@ -4629,6 +4635,9 @@ void _Host_RunFrame (float time)
 		Host_CheckDumpMemoryStats();
 
 		GetTestScriptMgr()->CheckPoint( "frame_end" );
+
+		// recycle everything the engine handed out of frame memory this frame
+		FrameMemory_EndFrame();
 	} // Profile scope, protect from setjmp() problems
 
 	Host_ShowIPCCallCount();
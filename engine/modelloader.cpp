@@ -957,34 +957,45 @@ CMapLoadHelper::CMapLoadHelper( int lumpToLoad, bool bUncompress )
 			Sys_Error( "Can't load map from invalid handle!!!" );
 		}
 
-		unsigned nOffsetAlign, nSizeAlign, nBufferAlign;
-		bool bTryOptimal = g_pFileSystem->GetOptimalIOConstraints( fileToUse, &nOffsetAlign, &nSizeAlign, &nBufferAlign );
-
-		if ( bTryOptimal )
+		// the whole file may already be in memory, then the lump is used where it lies.
+		// Don't return badly aligned data, misaligned lumps are copied like before.
+		unsigned int nViewSize = 0;
+		const byte *pFileView = IsPC() ? (const byte *)g_pFileSystem->GetReadOnlyFileView( fileToUse, &nViewSize ) : NULL;
+		if ( pFileView && (unsigned int)m_nLumpOffset + m_nLumpSize <= nViewSize && ( (uintp)( pFileView + m_nLumpOffset ) % 4 ) == 0 )
 		{
-			bTryOptimal = ( m_nLumpOffset % 4 == 0 ); // Don't return badly aligned data
+			m_pData = (unsigned char *)pFileView + m_nLumpOffset;
 		}
+		else
+		{
+			unsigned nOffsetAlign, nSizeAlign, nBufferAlign;
+			bool bTryOptimal = g_pFileSystem->GetOptimalIOConstraints( fileToUse, &nOffsetAlign, &nSizeAlign, &nBufferAlign );
 
-		unsigned int alignedOffset = m_nLumpOffset;
-		unsigned int alignedBytesToRead = ( ( m_nLumpSize ) ? m_nLumpSize : 1 );
+			if ( bTryOptimal )
+			{
+				bTryOptimal = ( m_nLumpOffset % 4 == 0 ); // Don't return badly aligned data
+			}
 
-		if ( bTryOptimal )
-		{
-			alignedOffset = AlignValue( ( alignedOffset - nOffsetAlign ) + 1, nOffsetAlign );
-			alignedBytesToRead = AlignValue( ( m_nLumpOffset - alignedOffset ) + alignedBytesToRead, nSizeAlign );
-		}
+			unsigned int alignedOffset = m_nLumpOffset;
+			unsigned int alignedBytesToRead = ( ( m_nLumpSize ) ? m_nLumpSize : 1 );
 
-		m_pRawData = (byte *)g_pFileSystem->AllocOptimalReadBuffer( fileToUse, alignedBytesToRead, alignedOffset );
-		if ( !m_pRawData && m_nLumpSize )
-		{
-			Sys_Error( "Can't load lump %i, allocation of %i bytes failed!!!", lumpToLoad, m_nLumpSize + 1 );
-		}
+			if ( bTryOptimal )
+			{
+				alignedOffset = AlignValue( ( alignedOffset - nOffsetAlign ) + 1, nOffsetAlign );
+				alignedBytesToRead = AlignValue( ( m_nLumpOffset - alignedOffset ) + alignedBytesToRead, nSizeAlign );
+			}
 
-		if ( m_nLumpSize )
-		{
-			g_pFileSystem->Seek( fileToUse, alignedOffset, FILESYSTEM_SEEK_HEAD );
-			g_pFileSystem->ReadEx( m_pRawData, alignedBytesToRead, alignedBytesToRead, fileToUse );
-			m_pData = m_pRawData + ( m_nLumpOffset - alignedOffset );
+			m_pRawData = (byte *)g_pFileSystem->AllocOptimalReadBuffer( fileToUse, alignedBytesToRead, alignedOffset );
+			if ( !m_pRawData && m_nLumpSize )
+			{
+				Sys_Error( "Can't load lump %i, allocation of %i bytes failed!!!", lumpToLoad, m_nLumpSize + 1 );
+			}
+
+			if ( m_nLumpSize )
+			{
+				g_pFileSystem->Seek( fileToUse, alignedOffset, FILESYSTEM_SEEK_HEAD );
+				g_pFileSystem->ReadEx( m_pRawData, alignedBytesToRead, alignedBytesToRead, fileToUse );
+				m_pData = m_pRawData + ( m_nLumpOffset - alignedOffset );
+			}
 		}
 	}
 
@@ -31,6 +31,8 @@
 
 ConVar sv_dumpstringtables( "sv_dumpstringtables", "0", FCVAR_CHEAT );
 
+extern CNetworkStringTableContainer *networkStringTableContainerServer;
+
 #define BSPPACK_STRINGTABLE_DICTIONARY "stringtable_dictionary.dct"
 #define BSPPACK_STRINGTABLE_DICTIONARY_FALLBACK "stringtable_dictionary_fallback.dct"
 // These are automatically added by vbsp.  Should be removed when adding the real files here
@@ -85,6 +87,247 @@ static int GetBestPreviousString( CUtlVector< StringHistoryEntry >& history, cha
 	return bestindex;
 }
 
+//-----------------------------------------------------------------------------
+// Prefix coding for tables created with NSF_PREFIX_HISTORY. Instead of the last 32 strings of the update, a new string
+// can reference any string with a lower index in the table, or one of the shared prefixes below, and copy up to 255
+// characters from it. The decoder has all of those already: they were either known before the update or sent earlier
+// in it, since entries go out in index order. References are ranks, the shared prefixes first and then the table
+// strings by index, so they don't depend on what a client already had and one trie per table serves every client.
+//-----------------------------------------------------------------------------
+#define PREFIX_LENGTH_BITS	8
+
+// Shared prefix dictionary, referenced by both ends ahead of the table strings. Tuned from the precache and
+// downloadables tables of the shipping maps, use stringtable_train_prefixes to re-tune it. Never change this without
+// bumping the network protocol, both ends must agree on it.
+static const char *s_pPrefixDictionary[] =
+{
+	"models/",
+	"models/player/custom_player/legacy/",
+	"models/player/custom_player/legacy/tm_",
+	"models/player/custom_player/legacy/ctm_",
+	"models/weapons/",
+	"models/weapons/v_",
+	"models/weapons/w_",
+	"models/weapons/v_models/arms/",
+	"models/props/",
+	"models/props/de_",
+	"models/props/cs_office/",
+	"models/props_junk/",
+	"models/props_c17/",
+	"models/props_debris/",
+	"models/gibs/",
+	"models/shells/",
+	"models/chicken/",
+	"models/inventory_items/",
+	"materials/",
+	"materials/models/",
+	"materials/models/weapons/",
+	"materials/models/player/",
+	"materials/sprites/",
+	"materials/particle/",
+	"materials/decals/",
+	"sprites/",
+	"particles/",
+	"particles/weapons/",
+	"sound/",
+	"sound/weapons/",
+	"sound/player/",
+	"sound/ambient/",
+	")weapons/",
+	")player/",
+	"~player/",
+	"weapons/",
+	"player/",
+	"ambient/",
+	"physics/",
+	"items/",
+	"maps/",
+	"resource/",
+	"scripts/",
+	"decals/",
+	"effects/",
+	"Weapon_",
+	"Player.",
+	"Default.",
+	".mdl",
+	".vmt",
+	".wav",
+	".pcf",
+};
+
+// ranks an entry of the given table index may reference
+static int GetPrefixReferenceCount( int nEntryIndex )
+{
+	return ARRAYSIZE( s_pPrefixDictionary ) + nEntryIndex;
+}
+
+static int GetPrefixReferenceBits( int nReferences )
+{
+	int nBits = 1;
+	while ( ( 1 << nBits ) < nReferences )
+	{
+		++nBits;
+	}
+	return nBits;
+}
+
+class CStringPrefixTrie
+{
+public:
+	CStringPrefixTrie();
+
+	// number of ranks added, the shared prefixes count too
+	int Count() const { return m_nStrings; }
+
+	// returns the rank below nReferences sharing the longest prefix with pString or -1
+	int FindLongestPrefix( const char *pString, int nReferences, int &nPrefixLength ) const;
+
+	// adds the next rank
+	void AddString( const char *pString );
+
+private:
+	struct Node_t
+	{
+		int		m_nFirstChild;
+		int		m_nNextSibling;
+		int		m_nString;	// lowest rank passing through this node
+		char	m_nChar;
+	};
+
+	CUtlVector< Node_t >	m_Nodes; // m_Nodes[0] is the root
+	int						m_nStrings;
+};
+
+CStringPrefixTrie::CStringPrefixTrie() : m_nStrings( 0 )
+{
+	Node_t &root = m_Nodes[ m_Nodes.AddToTail() ];
+	root.m_nFirstChild = -1;
+	root.m_nNextSibling = -1;
+	root.m_nString = -1;
+	root.m_nChar = 0;
+
+	for ( int i = 0; i < ARRAYSIZE( s_pPrefixDictionary ); ++i )
+	{
+		AddString( s_pPrefixDictionary[ i ] );
+	}
+}
+
+int CStringPrefixTrie::FindLongestPrefix( const char *pString, int nReferences, int &nPrefixLength ) const
+{
+	int nBest = -1;
+	nPrefixLength = 0;
+
+	int nNode = 0;
+	for ( int nDepth = 1; pString[ nDepth - 1 ] && nDepth < ( 1 << PREFIX_LENGTH_BITS ); ++nDepth )
+	{
+		int nChild = m_Nodes[ nNode ].m_nFirstChild;
+		while ( nChild != -1 && m_Nodes[ nChild ].m_nChar != pString[ nDepth - 1 ] )
+		{
+			nChild = m_Nodes[ nChild ].m_nNextSibling;
+		}
+
+		// the lowest rank only grows further down, so nothing deeper can be referenced either
+		if ( nChild == -1 || m_Nodes[ nChild ].m_nString >= nReferences )
+			break;
+
+		nNode = nChild;
+		nBest = m_Nodes[ nNode ].m_nString;
+		nPrefixLength = nDepth;
+	}
+
+	return nBest;
+}
+
+void CStringPrefixTrie::AddString( const char *pString )
+{
+	int nIndex = m_nStrings++;
+
+	// only the first 255 characters can ever be referenced
+	int nLength = MIN( V_strlen( pString ), ( 1 << PREFIX_LENGTH_BITS ) - 1 );
+
+	int nNode = 0;
+	for ( int i = 0; i < nLength; ++i )
+	{
+		int nChild = m_Nodes[ nNode ].m_nFirstChild;
+		while ( nChild != -1 && m_Nodes[ nChild ].m_nChar != pString[ i ] )
+		{
+			nChild = m_Nodes[ nChild ].m_nNextSibling;
+		}
+
+		if ( nChild == -1 )
+		{
+			// ranks are added in order, so the string creating a node is the lowest one through it
+			nChild = m_Nodes.AddToTail();
+			Node_t &child = m_Nodes[ nChild ];
+			child.m_nFirstChild = -1;
+			child.m_nNextSibling = m_Nodes[ nNode ].m_nFirstChild;
+			child.m_nString = nIndex;
+			child.m_nChar = pString[ i ];
+			m_Nodes[ nNode ].m_nFirstChild = nChild;
+		}
+
+		nNode = nChild;
+	}
+}
+
+// writes pEntry, table string nEntryIndex, prefix coded against the trie
+static void WritePrefixCodedString( const CStringPrefixTrie &trie, bf_write &buf, const char *pEntry, int nEntryIndex )
+{
+	int nReferences = GetPrefixReferenceCount( nEntryIndex );
+	int nPrefixLength = 0;
+	int nReference = trie.FindLongestPrefix( pEntry, nReferences, nPrefixLength );
+	int nReferenceBits = GetPrefixReferenceBits( nReferences );
+
+	// only worth it when the copied characters cost more than the reference
+	if ( nReference != -1 && nPrefixLength * 8 > nReferenceBits + PREFIX_LENGTH_BITS )
+	{
+		buf.WriteOneBit( 1 );
+		buf.WriteUBitLong( nReference, nReferenceBits );
+		buf.WriteUBitLong( nPrefixLength, PREFIX_LENGTH_BITS );
+		buf.WriteString( pEntry + nPrefixLength );
+	}
+	else
+	{
+		buf.WriteOneBit( 0 );
+		buf.WriteString( pEntry );
+	}
+}
+
+static bool ReadPrefixCodedString( INetworkStringTable *pTable, bf_read &buf, int nEntryIndex, char *pEntry, int nEntrySize )
+{
+	if ( buf.ReadOneBit() )
+	{
+		int nReferences = GetPrefixReferenceCount( nEntryIndex );
+		int nReference = buf.ReadUBitLong( GetPrefixReferenceBits( nReferences ) );
+		int nPrefixLength = buf.ReadUBitLong( PREFIX_LENGTH_BITS );
+
+		if ( nReference >= nReferences )
+			return false;
+
+		int nDictionary = ARRAYSIZE( s_pPrefixDictionary );
+		const char *pReference = NULL;
+		if ( nReference < nDictionary )
+		{
+			pReference = s_pPrefixDictionary[ nReference ];
+		}
+		else if ( nReference - nDictionary < pTable->GetNumStrings() )
+		{
+			pReference = pTable->GetString( nReference - nDictionary );
+		}
+
+		if ( !pReference || nPrefixLength > V_strlen( pReference ) || nPrefixLength >= nEntrySize )
+			return false;
+
+		V_memcpy( pEntry, pReference, nPrefixLength );
+		buf.ReadString( pEntry + nPrefixLength, nEntrySize - nPrefixLength );
+	}
+	else
+	{
+		buf.ReadString( pEntry, nEntrySize );
+	}
+
+	return true;
+}
 
 static ConVar stringtable_usedictionaries( "stringtable_usedictionaries", 
 #if defined( PORTAL2 )
@@ -95,6 +338,7 @@ static ConVar stringtable_usedictionaries( "stringtable_usedictionaries",
 										   0, "Use dictionaries for string table networking\n" );
 static ConVar stringtable_alwaysrebuilddictionaries( "stringtable_alwaysrebuilddictionaries", "0", 0, "Rebuild dictionary file on every level load\n" );
 static ConVar stringtable_showsizes( "stringtable_showsizes", "0", 0, "Show sizes of string tables when building for signon\n" );
+static ConVar stringtable_prefixhistory( "stringtable_prefixhistory", "0", 0, "Server string tables created from now on prefix code strings against all earlier strings and a shared prefix dictionary. Clients only accept them from a server of their own version, or from demos and broadcasts of demo protocol 5 and later\n" );
 
 
 
@@ -656,7 +900,8 @@ void CNetworkStringTable::CheckDictionary( int stringNumber )
 CNetworkStringTable::CNetworkStringTable( TABLEID id, const char *tableName, int maxentries, int userdatafixedsize, int userdatanetworkbits, int flags ) :
 	m_bAllowClientSideAddString( false ),
 	m_pItemsClientSide( NULL ),
-	m_nFlags( flags )
+	m_nFlags( flags ),
+	m_pPrefixTrie( NULL )
 {
 	if ( maxentries < 0 || userdatafixedsize < 0 || userdatanetworkbits < 0 )
 	{
@@ -768,6 +1013,7 @@ CNetworkStringTable::~CNetworkStringTable( void )
 	delete[] m_pszTableName;
 	delete m_pItems;
 	delete m_pItemsClientSide;
+	delete m_pPrefixTrie;
 }
 
 //-----------------------------------------------------------------------------
@@ -778,6 +1024,10 @@ void CNetworkStringTable::DeleteAllStrings( void )
 	delete m_pItems;
 	m_pItems = new CNetworkStringDict( m_nFlags & NSF_DICTIONARY_ENABLED );
 
+	// the trie ranks strings by index, which now belong to different strings
+	delete m_pPrefixTrie;
+	m_pPrefixTrie = NULL;
+
 	if ( m_pItemsClientSide )
 	{
 		delete m_pItemsClientSide;
@@ -943,9 +1193,33 @@ void CNetworkStringTable::UpdateMirrorTable( int tick_ack  )
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Brings the prefix trie up to date with the table, it's shared by the updates for all clients
+//-----------------------------------------------------------------------------
+const CStringPrefixTrie *CNetworkStringTable::UpdatePrefixTrie() const
+{
+	// updates may be written for several clients at once, strings are only added between them
+	AUTO_LOCK_FM( m_PrefixTrieMutex );
+
+	if ( !m_pPrefixTrie )
+	{
+		m_pPrefixTrie = new CStringPrefixTrie;
+	}
+
+	int count = m_pItems->Count();
+	for ( int i = m_pPrefixTrie->Count() - ARRAYSIZE( s_pPrefixDictionary ); i < count; i++ )
+	{
+		m_pPrefixTrie->AddString( m_pItems->String( i ) );
+	}
+
+	return m_pPrefixTrie;
+}
+
 int CNetworkStringTable::WriteUpdate( CBaseClient *client, bf_write &buf, int tick_ack ) const
 {
 	CUtlVector< StringHistoryEntry > history;
+	bool bPrefixHistory = ( m_nFlags & NSF_PREFIX_HISTORY ) != 0;
+	const CStringPrefixTrie *pPrefixTrie = bPrefixHistory ? UpdatePrefixTrie() : NULL;
 
 	int entriesUpdated = 0;
 	int lastEntry = -1;
@@ -1022,6 +1296,15 @@ int CNetworkStringTable::WriteUpdate( CBaseClient *client, bf_write &buf, int ti
 
 				lastDictionaryIndex = nCurrentDictionaryIndex;
 			}
+			else if ( bPrefixHistory )
+			{
+				if ( bEncodeUsingDictionaries )
+				{
+					buf.WriteOneBit( 0 );
+				}
+
+				WritePrefixCodedString( *pPrefixTrie, buf, pEntry, i );
+			}
 			else
 			{
 				if ( bEncodeUsingDictionaries )
@@ -1124,6 +1407,7 @@ void CNetworkStringTable::ParseUpdate( bf_read &buf, int entries )
 	bool bEncodeUsingDictionaries = buf.ReadOneBit() ? true : false;
 
 	CUtlVector< StringHistoryEntry > history;
+	bool bPrefixHistory = ( m_nFlags & NSF_PREFIX_HISTORY ) != 0;
 
 	for (int i=0; i<entries; i++)
 	{
@@ -1163,6 +1447,13 @@ void CNetworkStringTable::ParseUpdate( bf_read &buf, int entries )
 				char const *lookup = g_StringTableDictionary.Lookup( lastDictionaryIndex );
 				Q_strncpy( entry, lookup, sizeof( entry ) );
 			}
+			else if ( bPrefixHistory )
+			{
+				if ( !ReadPrefixCodedString( this, buf, entryIndex, entry, sizeof( entry ) ) )
+				{
+					Host_Error( "Server sent bogus string prefix for table %s\n", GetTableName() );
+				}
+			}
 			else
 			{
 				bool substringcheck = buf.ReadOneBit() ? true : false;
@@ -1913,6 +2204,14 @@ INetworkStringTable *CNetworkStringTableContainer::CreateStringTable( const char
 
 	TABLEID id = m_Tables.Count();
 
+#ifndef SHARED_NET_STRING_TABLES
+	// the server picks the string encoding, clients and relays get it through the table flags
+	if ( this == networkStringTableContainerServer && stringtable_prefixhistory.GetBool() )
+	{
+		flags |= NSF_PREFIX_HISTORY;
+	}
+#endif
+
 	pTable = new CNetworkStringTable( id, tableName, maxentries, userdatafixedsize, userdatanetworkbits, flags );
 
 	Assert( pTable );
@@ -2257,3 +2556,132 @@ void CNetworkStringTableContainer::UpdateDictionaryStrings()
 	}
 }
 
+#ifndef SHARED_NET_STRING_TABLES
+struct PrefixSaving_t
+{
+	const char *m_pPrefix;
+	int m_nBytes;
+};
+
+static int __cdecl PrefixSavingCompare( const PrefixSaving_t *pLeft, const PrefixSaving_t *pRight )
+{
+	return pRight->m_nBytes - pLeft->m_nBytes;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Compares the string encodings on the current server tables and ranks the directory prefixes that would
+//			save the most if they were added to s_pPrefixDictionary
+//-----------------------------------------------------------------------------
+CON_COMMAND_F( stringtable_train_prefixes, "Measure string table prefix coding on the current map and suggest shared prefixes", FCVAR_CHEAT )
+{
+	if ( !networkStringTableContainerServer || !networkStringTableContainerServer->GetNumTables() )
+	{
+		Msg( "No server string tables\n" );
+		return;
+	}
+
+	int nMaxPrefixes = ( args.ArgC() > 1 ) ? Q_atoi( args[ 1 ] ) : 32;
+
+	CUtlDict< int, int > prefixCounts;
+	int nTotalLegacyBits = 0, nTotalPrefixBits = 0;
+	double flLegacyTime = 0, flPrefixTime = 0;
+
+	static char scratch[ 1 << 18 ];
+
+	for ( int i = 0; i < networkStringTableContainerServer->GetNumTables(); ++i )
+	{
+		CNetworkStringTable *pTable = ( CNetworkStringTable * )networkStringTableContainerServer->GetTable( i );
+
+		// the string part of a signon, encoded the old way and the prefix way
+		bf_write legacyBuf( scratch, sizeof( scratch ) );
+		double flStart = Plat_FloatTime();
+		{
+			CUtlVector< StringHistoryEntry > history;
+			for ( int j = 0; j < pTable->GetNumStrings(); ++j )
+			{
+				const char *pEntry = pTable->GetString( j );
+				int substringsize = 0;
+				int bestprevious = GetBestPreviousString( history, pEntry, substringsize );
+				if ( bestprevious != -1 )
+				{
+					legacyBuf.WriteOneBit( 1 );
+					legacyBuf.WriteUBitLong( bestprevious, 5 );
+					legacyBuf.WriteUBitLong( substringsize, SUBSTRING_BITS );
+					legacyBuf.WriteString( pEntry + substringsize );
+				}
+				else
+				{
+					legacyBuf.WriteOneBit( 0 );
+					legacyBuf.WriteString( pEntry );
+				}
+
+				if ( history.Count() > 31 )
+				{
+					history.Remove( 0 );
+				}
+				StringHistoryEntry she;
+				Q_strncpy( she.string, pEntry, sizeof( she.string ) );
+				history.AddToTail( she );
+			}
+		}
+		flLegacyTime += Plat_FloatTime() - flStart;
+		int nLegacyBits = legacyBuf.GetNumBitsWritten();
+
+		bf_write prefixBuf( scratch, sizeof( scratch ) );
+		flStart = Plat_FloatTime();
+		{
+			CStringPrefixTrie prefixTrie;
+			for ( int j = 0; j < pTable->GetNumStrings(); ++j )
+			{
+				prefixTrie.AddString( pTable->GetString( j ) );
+				WritePrefixCodedString( prefixTrie, prefixBuf, pTable->GetString( j ), j );
+			}
+		}
+		flPrefixTime += Plat_FloatTime() - flStart;
+		int nPrefixBits = prefixBuf.GetNumBitsWritten();
+
+		Msg( "%-32s %5d strings %8d bytes legacy %8d bytes prefix\n", pTable->GetTableName(), pTable->GetNumStrings(), Bits2Bytes( nLegacyBits ), Bits2Bytes( nPrefixBits ) );
+		nTotalLegacyBits += nLegacyBits;
+		nTotalPrefixBits += nPrefixBits;
+
+		// count every directory prefix, it's what the shared dictionary is made of
+		for ( int j = 0; j < pTable->GetNumStrings(); ++j )
+		{
+			const char *pEntry = pTable->GetString( j );
+			for ( const char *pSlash = strchr( pEntry, '/' ); pSlash; pSlash = strchr( pSlash + 1, '/' ) )
+			{
+				CUtlString prefix;
+				prefix.SetDirect( pEntry, pSlash - pEntry + 1 );
+				int nIndex = prefixCounts.Find( prefix.Get() );
+				if ( nIndex == prefixCounts.InvalidIndex() )
+				{
+					nIndex = prefixCounts.Insert( prefix.Get(), 0 );
+				}
+				prefixCounts[ nIndex ]++;
+			}
+		}
+	}
+
+	Msg( "Total: %d bytes legacy (%.2f ms), %d bytes prefix (%.2f ms)\n", Bits2Bytes( nTotalLegacyBits ), flLegacyTime * 1000, Bits2Bytes( nTotalPrefixBits ), flPrefixTime * 1000 );
+
+	// a prefix is worth the characters it saves on each use after the first
+	CUtlVector< PrefixSaving_t > ranked;
+	for ( int i = prefixCounts.First(); i != prefixCounts.InvalidIndex(); i = prefixCounts.Next( i ) )
+	{
+		int nSaving = ( prefixCounts[ i ] - 1 ) * V_strlen( prefixCounts.GetElementName( i ) );
+		if ( nSaving > 0 )
+		{
+			PrefixSaving_t &saving = ranked[ ranked.AddToTail() ];
+			saving.m_pPrefix = prefixCounts.GetElementName( i );
+			saving.m_nBytes = nSaving;
+		}
+	}
+	ranked.Sort( PrefixSavingCompare );
+
+	Msg( "Suggested shared prefixes:\n" );
+	for ( int i = 0; i < ranked.Count() && i < nMaxPrefixes; ++i )
+	{
+		Msg( "\t\"%s\",\t// %d bytes\n", ranked[ i ].m_pPrefix, ranked[ i ].m_nBytes );
+	}
+}
+#endif
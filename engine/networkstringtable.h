@@ -20,6 +20,7 @@
 
 class SVC_CreateStringTable;
 class CBaseClient;
+class CStringPrefixTrie;
 
 abstract_class INetworkStringDict
 {
@@ -127,6 +128,9 @@ public:
 
 protected:
 	void			DataChanged( int stringNumber, CNetworkStringTableItem *item );
+#ifndef SHARED_NET_STRING_TABLES
+	const CStringPrefixTrie *UpdatePrefixTrie() const;
+#endif
 
 	// Destroy string table
 	void			DeleteAllStrings( void );
@@ -162,6 +166,10 @@ protected:
 
 	INetworkStringDict		*m_pItems;
 	INetworkStringDict		*m_pItemsClientSide;	 // For m_bAllowClientSideAddString, these items are non-networked and are referenced by a negative string index!!!
+
+	// NSF_PREFIX_HISTORY encoder state, built on the first update and shared by all clients
+	mutable CStringPrefixTrie	*m_pPrefixTrie;
+	mutable CThreadFastMutex	m_PrefixTrieMutex;
 };
 
 //-----------------------------------------------------------------------------
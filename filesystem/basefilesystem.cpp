@@ -15,6 +15,7 @@
 #include "tier0/stacktools.h"
 #include "generichash.h"
 #include "tier1/utllinkedlist.h"
+#include "tier1/utlstring.h"
 #include "filesystem/IQueuedLoader.h"
 #include "filesystem/IXboxInstaller.h"
 #include "tier2/tier2.h"
@@ -322,6 +323,9 @@ CBaseFileSystem *BaseFileSystem()
 #endif
 
 ConVar filesystem_buffer_size( "filesystem_buffer_size", "0", 0, "Size of per file buffers. 0 for none" );
+ConVar fs_lookup_cache( "fs_lookup_cache", "1", 0, "Remember which search path each relative file open resolved to (or that it wasn't found) until the search paths change." );
+ConVar fs_lookup_cache_miss_ttl( "fs_lookup_cache_miss_ttl", "5", 0, "Seconds a file that wasn't found in any search path is remembered as missing.", true, 0.0f, false, 0.0f );
+ConVar fs_lookup_cache_max_misses( "fs_lookup_cache_max_misses", "4096", 0, "Number of missing files the lookup cache remembers before it drops all of them.", true, 1.0f, false, 0.0f );
 
 
 class CFileHandleTimer : public CFastTimer
@@ -651,6 +655,8 @@ CBaseFileSystem::CBaseFileSystem()
 	g_pFullFileSystem = this;			// Left in for non tier Apps, tools, etc...
 
 	m_WhitelistFileTrackingEnabled = -1;
+	m_nFileLookupCacheGeneration = -1;
+	m_nFileLookupMisses = 0;
 
 	// If this changes then FileNameHandleInternal_t/FileNameHandle_t needs to be fixed!!!
 	Assert( sizeof( CUtlSymbol ) == sizeof( short ) );
@@ -1294,6 +1300,8 @@ void CBaseFileSystem::PrintOpenedFiles( void )
 
 void CBaseFileSystem::AddVPKFile( char const *pBasename, SearchPathAdd_t addType )
 {
+	CFileLookupCacheInvalidator invalidateLookups( this );
+
 	// Ensure that the passed in file name has a .vpk extension. Otherwise the check
 	// for already having the .vpk file will always fail and the same file may get
 	// added dozens of times, wasting hundreds of MB of memory.
@@ -1351,6 +1359,8 @@ void CBaseFileSystem::AddVPKFile( char const *pBasename, SearchPathAdd_t addType
 
 void CBaseFileSystem::RemoveVPKFile( char const *pBasename )
 {
+	CFileLookupCacheInvalidator invalidateLookups( this );
+
 #ifdef SUPPORT_VPK
 	char nameBuf[MAX_PATH];
 	Q_MakeAbsolutePath( nameBuf, sizeof( nameBuf ), pBasename );
@@ -1397,6 +1407,8 @@ bool CBaseFileSystem::AddPackFile( const char *pFileName, const char *pathID )
 //-----------------------------------------------------------------------------
 bool CBaseFileSystem::AddPackFileFromPath( const char *pPath, const char *pakfile, bool bCheckForAppendedPack, const char *pathID )
 {
+	CFileLookupCacheInvalidator invalidateLookups( this );
+
 	char fullpath[ MAX_PATH ];
 	_snprintf( fullpath, sizeof(fullpath), "%s%s", pPath, pakfile );
 	Q_FixSlashes( fullpath );
@@ -2097,6 +2109,8 @@ bool CZipPackFile::CPackFileLessFunc::Less( CZipPackFile::CPackFileEntry const&
 
 void CBaseFileSystem::AddPackFiles( const char *pPath, const CUtlSymbol &pathID, SearchPathAdd_t addType, int iForceInsertIndex )
 {
+	CFileLookupCacheInvalidator invalidateLookups( this );
+
 	Assert( ThreadInMainThread() );
 	DISK_INTENSIVE();
 
@@ -2323,6 +2337,8 @@ void CBaseFileSystem::AddPackFiles( const char *pPath, const CUtlSymbol &pathID,
 //-----------------------------------------------------------------------------
 void CBaseFileSystem::RemoveAllMapSearchPaths( void )
 {
+	CFileLookupCacheInvalidator invalidateLookups( this );
+
 	AsyncFinishAll();
 
 	int c = m_SearchPaths.Count();
@@ -2342,6 +2358,8 @@ void CBaseFileSystem::RemoveAllMapSearchPaths( void )
 //-----------------------------------------------------------------------------
 void CBaseFileSystem::AddMapPackFile( const char *pPath, const char *pPathID, SearchPathAdd_t addType )
 {
+	CFileLookupCacheInvalidator invalidateLookups( this );
+
 	char tempPathID[MAX_PATH];
 	ParsePathID( pPath, pPathID, tempPathID );
 
@@ -2670,6 +2688,8 @@ void CBaseFileSystem::PrintSearchPaths( void )
 //-----------------------------------------------------------------------------
 void CBaseFileSystem::AddSearchPathInternal( const char *pPath, const char *pathID, SearchPathAdd_t addType, bool bAddPackFiles, int iForceInsertIndex )
 {
+	CFileLookupCacheInvalidator invalidateLookups( this );
+
 	AsyncFinishAll();
 
 	Assert( ThreadInMainThread() );
@@ -3024,6 +3044,8 @@ void CBaseFileSystem::AddSearchPath( const char *pPath, const char *pathID, Sear
 //-----------------------------------------------------------------------------
 bool CBaseFileSystem::FixupSearchPathsAfterInstall()
 {
+	CFileLookupCacheInvalidator invalidateLookups( this );
+
 #if defined( _X360 )
 	if ( m_bSearchPathsPatchedAfterInstall )
 	{
@@ -3276,6 +3298,8 @@ int CBaseFileSystem::GetSearchPathID( char *pPath, int nMaxLen )
 //-----------------------------------------------------------------------------
 bool CBaseFileSystem::RemoveSearchPath( const char *pPath, const char *pathID )
 {
+	CFileLookupCacheInvalidator invalidateLookups( this );
+
 	char tempSymlinkBuffer[MAX_PATH];
 	pPath = V_FormatFilenameForSymlinking( tempSymlinkBuffer, pPath );
 
@@ -3369,6 +3393,8 @@ bool CBaseFileSystem::RemoveSearchPath( const char *pPath, const char *pathID )
 //-----------------------------------------------------------------------------
 void CBaseFileSystem::RemoveSearchPaths( const char *pathID )
 {
+	CFileLookupCacheInvalidator invalidateLookups( this );
+
 	AsyncFinishAll();
 
 	int nCount = m_SearchPaths.Count();
@@ -3789,6 +3815,8 @@ bool CBaseFileSystem::UnzipFile( const char *pFileName, const char *pPath, const
 //-----------------------------------------------------------------------------
 void CBaseFileSystem::RemoveAllSearchPaths( void )
 {
+	CFileLookupCacheInvalidator invalidateLookups( this );
+
 	AUTO_LOCK( m_SearchPathsMutex );
 	// Sergiy: AaronS said it is a good idea to destroy these paths in reverse order
 	while( m_SearchPaths.Count() )
@@ -4249,15 +4277,356 @@ FileHandle_t CBaseFileSystem::FindFileInSearchPaths(
 		}
 	}
 
-	CSearchPathsIterator iter( this, &pFileName, pathID, pathFilter );
-	for ( CSearchPath *pSearchPath = iter.GetFirst(); pSearchPath != NULL; pSearchPath = iter.GetNext() )
+	// The lookup cache only covers the plain search, consoles filter paths per request
+	bool bUseLookupCache = !IsGameConsole() && fs_lookup_cache.GetBool() && pathFilter == FILTER_NONE;
+	if ( !bUseLookupCache )
+	{
+		CSearchPathsIterator iter( this, &pFileName, pathID, pathFilter );
+		for ( CSearchPath *pSearchPath = iter.GetFirst(); pSearchPath != NULL; pSearchPath = iter.GetNext() )
+		{
+			FileHandle_t filehandle = FindFile( pSearchPath, pFileName, pOptions, flags, ppszResolvedFilename, bTrackCRCs );
+			if ( filehandle )
+				return filehandle;
+		}
+
+		return ( FileHandle_t )0;
+	}
+
+	CFastTimer timer;
+	timer.Start();
+	++m_FileLookupCacheStats.m_nLookups;
+
+	// Resolve the UNC-type path ID here so the key matches what the iterator would search
+	char tempPathID[MAX_PATH];
+	if ( pFileName && pFileName[0] == '/' && pFileName[1] == '/' )
+	{
+		ParsePathID( pFileName, pathID, tempPathID );
+	}
+
+	// Read the generations before searching, anything that changes the search paths or writes a file bumps them
+	int nGeneration = m_nSearchPathGeneration;
+	int nWriteGeneration = m_nFileWriteGeneration;
+	CUtlSymbol pathIDSymbol( UTL_INVAL_SYMBOL );
+	char szKey[MAX_PATH + 16];
+	szKey[0] = 0;
+	int nCached = FILE_LOOKUP_NOT_CACHED;
+	if ( pFileName && pFileName[0] && !V_IsAbsolutePath( pFileName ) )
+	{
+		if ( pathID )
+		{
+			pathIDSymbol = g_PathIDTable.AddString( pathID );
+		}
+		BuildFileLookupKey( szKey, sizeof( szKey ), pFileName, pathIDSymbol );
+		nCached = FindFileLookup( szKey, nGeneration );
+	}
+
+	FileHandle_t filehandle = ( FileHandle_t )0;
+	if ( nCached == FILE_LOOKUP_MISSING )
+	{
+		++m_FileLookupCacheStats.m_nMissingHits;
+	}
+	else
+	{
+		if ( nCached >= 0 )
+		{
+			filehandle = FindFileInCachedSearchPath( nCached, nGeneration, pFileName, pOptions, flags, ppszResolvedFilename, bTrackCRCs );
+			if ( filehandle )
+			{
+				++m_FileLookupCacheStats.m_nHits;
+			}
+			else
+			{
+				// Deleted or changed on disk behind our back, do the full search
+				++m_FileLookupCacheStats.m_nStaleHits;
+			}
+		}
+
+		if ( !filehandle )
+		{
+			int nFoundIn = FILE_LOOKUP_MISSING;
+			CSearchPathsIterator iter( this, &pFileName, pathID, pathFilter );
+			for ( CSearchPath *pSearchPath = iter.GetFirst(); pSearchPath != NULL; pSearchPath = iter.GetNext() )
+			{
+				filehandle = FindFile( pSearchPath, pFileName, pOptions, flags, ppszResolvedFilename, bTrackCRCs );
+				if ( filehandle )
+				{
+					nFoundIn = iter.GetCurrentIndex();
+					break;
+				}
+			}
+
+			if ( szKey[0] && ( filehandle == ( FileHandle_t )0 || nFoundIn >= 0 ) )
+			{
+				StoreFileLookup( szKey, pathIDSymbol, nGeneration, nWriteGeneration, nFoundIn );
+			}
+		}
+	}
+
+	timer.End();
+	m_FileLookupCacheStats.m_nMicroseconds += (unsigned)timer.GetDuration().GetMicroseconds();
+	return filehandle;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Drops every remembered lookup. Called around anything that can change
+//			where (or whether) a relative filename resolves.
+//-----------------------------------------------------------------------------
+void CBaseFileSystem::InvalidateFileLookupCache()
+{
+	++m_nSearchPathGeneration;
+	++m_FileLookupCacheStats.m_nInvalidations;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Drops the remembered lookups of one file, under every path ID.
+//			Absolute names are mapped back to a name relative to each loose
+//			search path they're under.
+//-----------------------------------------------------------------------------
+void CBaseFileSystem::InvalidateFileLookup( const char *pFileName )
+{
+	if ( !pFileName || !pFileName[0] )
+		return;
+
+	// Strip the UNC-type path ID, the name is dropped under every path ID anyway
+	if ( pFileName[0] == '/' && pFileName[1] == '/' )
+	{
+		const char *pSlash = strchr( pFileName + 2, '/' );
+		if ( !pSlash )
+			return;
+		pFileName = pSlash + 1;
+	}
+
+	if ( !V_IsAbsolutePath( pFileName ) )
+	{
+		InvalidateFileLookupRelative( pFileName );
+		return;
+	}
+
+	char szFullPath[MAX_PATH];
+	V_strncpy( szFullPath, pFileName, sizeof( szFullPath ) );
+	V_FixSlashes( szFullPath );
+
+	CUtlVector< CUtlSymbol > searchPaths;
+	{
+		AUTO_LOCK( m_SearchPathsMutex );
+		for ( int i = 0; i < m_SearchPaths.Count(); i++ )
+		{
+			if ( !m_SearchPaths[i].GetPackFile() && searchPaths.Find( m_SearchPaths[i].GetPath() ) == searchPaths.InvalidIndex() )
+			{
+				searchPaths.AddToTail( m_SearchPaths[i].GetPath() );
+			}
+		}
+	}
+
+	for ( int i = 0; i < searchPaths.Count(); i++ )
+	{
+		char szSearchPath[MAX_PATH];
+		V_strncpy( szSearchPath, g_PathIDTable.String( searchPaths[i] ), sizeof( szSearchPath ) );
+		V_FixSlashes( szSearchPath );
+
+		int nLen = V_strlen( szSearchPath );
+		if ( nLen && !V_strnicmp( szFullPath, szSearchPath, nLen ) )
+		{
+			const char *pRelative = szFullPath + nLen;
+			while ( *pRelative == CORRECT_PATH_SEPARATOR )
+			{
+				++pRelative;
+			}
+			InvalidateFileLookupRelative( pRelative );
+		}
+	}
+}
+
+void CBaseFileSystem::InvalidateFileLookupRelative( const char *pRelativeName )
+{
+	if ( !pRelativeName[0] )
+		return;
+
+	AUTO_LOCK( m_FileLookupCacheMutex );
+	for ( int i = 0; i < m_FileLookupPathIDs.Count(); i++ )
+	{
+		char szKey[MAX_PATH + 16];
+		BuildFileLookupKey( szKey, sizeof( szKey ), pRelativeName, m_FileLookupPathIDs[i] );
+
+		UtlSymId_t sym = m_FileLookupCache.Find( szKey );
+		if ( sym != UTL_INVAL_SYMBOL && m_FileLookupCache[ sym ].m_nSearchPath != FILE_LOOKUP_NOT_CACHED )
+		{
+			m_FileLookupCache[ sym ].m_nSearchPath = FILE_LOOKUP_NOT_CACHED;
+			++m_FileLookupCacheStats.m_nFileInvalidations;
+		}
+	}
+}
+
+CBaseFileSystem::CFileLookupWriteInvalidator::CFileLookupWriteInvalidator( CBaseFileSystem *pFileSystem, const char *pFileName, const char *pOtherFileName ) : m_pFileSystem( pFileSystem )
+{
+	V_strncpy( m_szFileName, pFileName ? pFileName : "", sizeof( m_szFileName ) );
+	V_strncpy( m_szOtherFileName, pOtherFileName ? pOtherFileName : "", sizeof( m_szOtherFileName ) );
+
+	++m_pFileSystem->m_nFileWriteGeneration;
+	m_pFileSystem->InvalidateFileLookup( m_szFileName );
+	m_pFileSystem->InvalidateFileLookup( m_szOtherFileName );
+}
+
+CBaseFileSystem::CFileLookupWriteInvalidator::~CFileLookupWriteInvalidator()
+{
+	++m_pFileSystem->m_nFileWriteGeneration;
+	m_pFileSystem->InvalidateFileLookup( m_szFileName );
+	m_pFileSystem->InvalidateFileLookup( m_szOtherFileName );
+}
+
+void CBaseFileSystem::BuildFileLookupKey( char *pKey, int nKeySize, const char *pFileName, const CUtlSymbol &pathID )
+{
+	// The cache map is case insensitive, so only the slashes need folding
+	V_snprintf( pKey, nKeySize, "%d:%s", (int)(UtlSymId_t)pathID, pFileName );
+	V_FixSlashes( pKey );
+}
+
+int CBaseFileSystem::FindFileLookup( const char *pKey, int nGeneration )
+{
+	AUTO_LOCK( m_FileLookupCacheMutex );
+	if ( m_nFileLookupCacheGeneration != nGeneration )
+	{
+		// Search paths changed since the cache was filled
+		m_FileLookupCache.Purge();
+		m_nFileLookupCacheGeneration = nGeneration;
+		m_nFileLookupMisses = 0;
+		return FILE_LOOKUP_NOT_CACHED;
+	}
+
+	UtlSymId_t sym = m_FileLookupCache.Find( pKey );
+	if ( sym == UTL_INVAL_SYMBOL )
+		return FILE_LOOKUP_NOT_CACHED;
+
+	const FileLookup_t &lookup = m_FileLookupCache[ sym ];
+	if ( lookup.m_nSearchPath == FILE_LOOKUP_MISSING && Plat_FloatTime() > lookup.m_flExpireTime )
+		return FILE_LOOKUP_NOT_CACHED;
+
+	return lookup.m_nSearchPath;
+}
+
+void CBaseFileSystem::StoreFileLookup( const char *pKey, const CUtlSymbol &pathID, int nGeneration, int nWriteGeneration, int nSearchPath )
+{
+	AUTO_LOCK( m_FileLookupCacheMutex );
+
+	// Don't store anything found while the search paths were changing or a file was being written
+	if ( m_nFileLookupCacheGeneration != nGeneration || m_nSearchPathGeneration != nGeneration || m_nFileWriteGeneration != nWriteGeneration )
+		return;
+
+	MEM_ALLOC_CREDIT();
+	if ( m_FileLookupPathIDs.Find( pathID ) == m_FileLookupPathIDs.InvalidIndex() )
+	{
+		m_FileLookupPathIDs.AddToTail( pathID );
+	}
+
+	if ( nSearchPath == FILE_LOOKUP_MISSING )
+	{
+		UtlSymId_t sym = m_FileLookupCache.Find( pKey );
+		if ( sym == UTL_INVAL_SYMBOL || m_FileLookupCache[ sym ].m_nSearchPath != FILE_LOOKUP_MISSING )
+		{
+			if ( m_nFileLookupMisses >= fs_lookup_cache_max_misses.GetInt() )
+			{
+				PruneFileLookupMisses();
+			}
+			++m_nFileLookupMisses;
+		}
+	}
+
+	FileLookup_t &lookup = m_FileLookupCache[ pKey ];
+	lookup.m_nSearchPath = nSearchPath;
+	lookup.m_flExpireTime = ( nSearchPath == FILE_LOOKUP_MISSING ) ? (float)Plat_FloatTime() + fs_lookup_cache_miss_ttl.GetFloat() : 0.0f;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Drops every cached miss and keeps the files that were found. The
+//			symbol table behind the map can't remove single strings, so the
+//			survivors are copied out and put back. Called with the cache locked.
+//-----------------------------------------------------------------------------
+void CBaseFileSystem::PruneFileLookupMisses()
+{
+	CUtlVector< CUtlString > keys;
+	CUtlVector< FileLookup_t > lookups;
+	for ( UtlSymId_t i = m_FileLookupCache.Head(); i != m_FileLookupCache.InvalidIndex(); i = m_FileLookupCache.Next( i ) )
+	{
+		const FileLookup_t &lookup = m_FileLookupCache[ i ];
+		if ( lookup.m_nSearchPath >= 0 )
+		{
+			keys.AddToTail( m_FileLookupCache.String( i ) );
+			lookups.AddToTail( lookup );
+		}
+	}
+
+	m_FileLookupCache.Purge();
+	for ( int i = 0; i < keys.Count(); i++ )
+	{
+		m_FileLookupCache[ keys[i].Get() ] = lookups[i];
+	}
+
+	m_nFileLookupMisses = 0;
+	++m_FileLookupCacheStats.m_nMissPrunes;
+}
+
+FileHandle_t CBaseFileSystem::FindFileInCachedSearchPath( int nSearchPath, int nGeneration, const char *pFileName, const char *pOptions, unsigned flags, char **ppszResolvedFilename, bool bTrackCRCs )
+{
+	// Take our own reference to the path, same as CSearchPathsIterator does
+	CSearchPath searchPath;
+	{
+		AUTO_LOCK( m_SearchPathsMutex );
+
+		// Anything that changes the search paths bumps the generation before it takes this lock,
+		// so a matching generation here means the cached index still names the same path
+		if ( m_nSearchPathGeneration != nGeneration || !m_SearchPaths.IsValidIndex( nSearchPath ) )
+			return ( FileHandle_t )0;
+
+		searchPath = m_SearchPaths[ nSearchPath ];
+		if ( searchPath.GetPackFile() )
+		{
+			searchPath.GetPackFile()->AddRef();
+		}
+	}
+
+	return FindFile( &searchPath, pFileName, pOptions, flags, ppszResolvedFilename, bTrackCRCs );
+}
+
+void CBaseFileSystem::PrintFileLookupCacheStats( bool bReset )
+{
+	int nLookups = m_FileLookupCacheStats.m_nLookups;
+	int nHits = m_FileLookupCacheStats.m_nHits;
+	int nMissingHits = m_FileLookupCacheStats.m_nMissingHits;
+	int nEntries;
 	{
-		FileHandle_t filehandle = FindFile( pSearchPath, pFileName, pOptions, flags, ppszResolvedFilename, bTrackCRCs );
-		if ( filehandle )
-			return filehandle;
+		AUTO_LOCK( m_FileLookupCacheMutex );
+		nEntries = m_FileLookupCache.GetNumStrings();
 	}
 
-	return ( FileHandle_t )0;
+	Msg( "File lookup cache: %s, %d entries\n", fs_lookup_cache.GetBool() ? "enabled" : "disabled", nEntries );
+	Msg( "  %d lookups, %d found in cached path (%.1f%%), %d cached as missing (%.1f%%), %d stale\n",
+		nLookups,
+		nHits, nLookups ? 100.0f * nHits / nLookups : 0.0f,
+		nMissingHits, nLookups ? 100.0f * nMissingHits / nLookups : 0.0f,
+		(int)m_FileLookupCacheStats.m_nStaleHits );
+	Msg( "  %d invalidations, %d names dropped by writes, %d miss prunes, %.1f ms spent resolving opens\n",
+		(int)m_FileLookupCacheStats.m_nInvalidations, (int)m_FileLookupCacheStats.m_nFileInvalidations, (int)m_FileLookupCacheStats.m_nMissPrunes,
+		m_FileLookupCacheStats.m_nMicroseconds / 1000.0f );
+
+	if ( bReset )
+	{
+		m_FileLookupCacheStats.m_nLookups = 0;
+		m_FileLookupCacheStats.m_nHits = 0;
+		m_FileLookupCacheStats.m_nMissingHits = 0;
+		m_FileLookupCacheStats.m_nStaleHits = 0;
+		m_FileLookupCacheStats.m_nInvalidations = 0;
+		m_FileLookupCacheStats.m_nFileInvalidations = 0;
+		m_FileLookupCacheStats.m_nMissPrunes = 0;
+		m_FileLookupCacheStats.m_nMicroseconds = 0;
+	}
+}
+
+CON_COMMAND( fs_lookup_cache_stats, "Prints file lookup cache counters and time spent resolving opens. Pass 'reset' to clear them (e.g. before a map load)." )
+{
+	if ( BaseFileSystem() )
+	{
+		BaseFileSystem()->PrintFileLookupCacheStats( args.ArgC() > 1 && !V_stricmp( args[1], "reset" ) );
+	}
 }
 
 //-----------------------------------------------------------------------------
@@ -4275,6 +4644,8 @@ FileHandle_t CBaseFileSystem::OpenForRead( const char *pFileName, const char *pO
 //-----------------------------------------------------------------------------
 FileHandle_t CBaseFileSystem::OpenForWrite( const char *pFileName, const char *pOptions, const char *pathID )
 {
+	CFileLookupWriteInvalidator invalidateLookups( this, pFileName );
+
 	char tempPathID[MAX_PATH];
 	ParsePathID( pFileName, pathID, tempPathID );
 
@@ -5728,6 +6099,8 @@ bool CBaseFileSystem::CheckVPKFileHash( int PackFileID, int nPackFileNumber, int
 
 void CBaseFileSystem::RegisterFileWhitelist( IFileList *pWantCRCList, IFileList *pAllowFromDiskList, IFileList **pFilesToReload )
 {
+	CFileLookupCacheInvalidator invalidateLookups( this );
+
 	if ( IsGameConsole() )
 	{
 		return;
@@ -6815,6 +7188,8 @@ bool CBaseFileSystem::FullPathToRelativePath( const char *pFullPath, char *pRela
 //-----------------------------------------------------------------------------
 void CBaseFileSystem::RemoveFile( char const* pRelativePath, const char *pathID )
 {
+	CFileLookupWriteInvalidator invalidateLookups( this, pRelativePath );
+
 	CHECK_DOUBLE_SLASHES( pRelativePath );
 
 	// Allow for UNC-type syntax to specify the path ID.
@@ -6846,6 +7221,8 @@ void CBaseFileSystem::RemoveFile( char const* pRelativePath, const char *pathID
 //-----------------------------------------------------------------------------
 bool CBaseFileSystem::RenameFile( char const *pOldPath, char const *pNewPath, const char *pathID )
 {
+	CFileLookupWriteInvalidator invalidateLookups( this, pOldPath, pNewPath );
+
 	Assert( pOldPath && pNewPath );
 
 	CHECK_DOUBLE_SLASHES( pOldPath );
@@ -6973,6 +7350,28 @@ void CBaseFileSystem::GetVPKFileStatisticsKV( KeyValues *pKV )
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Hand out a file's bytes without copying them, when they are mapped
+//-----------------------------------------------------------------------------
+const void *CBaseFileSystem::GetReadOnlyFileView( FileHandle_t file, unsigned int *pnSize )
+{
+	if ( pnSize )
+		*pnSize = 0;
+
+#ifdef SUPPORT_VPK
+	CFileHandle *fh = ( CFileHandle *)file;
+	if ( !fh || !fh->m_VPKHandle )
+		return NULL;
+
+	const void *pData = fh->m_VPKHandle.GetDataPointer();
+	if ( pData && pnSize )
+		*pnSize = fh->m_VPKHandle.m_nFileSize;
+	return pData;
+#else
+	return NULL;
+#endif
+}
+
 
 //-----------------------------------------------------------------------------
 // Purpose: 
@@ -7422,6 +7821,8 @@ CBaseFileSystem::CPathIDInfo* CBaseFileSystem::FindOrAddPathIDInfo( const CUtlSy
 
 void CBaseFileSystem::MarkPathIDByRequestOnly( const char *pPathID, bool bRequestOnly )
 {
+	CFileLookupCacheInvalidator invalidateLookups( this );
+
 	FindOrAddPathIDInfo( g_PathIDTable.AddString( pPathID ), bRequestOnly );
 }
 
@@ -8399,6 +8800,8 @@ void CBaseFileSystem::PrintDLCInfo()
 
 bool CBaseFileSystem::AddXLSPUpdateSearchPath( const void *pData, int nSize )
 {
+	CFileLookupCacheInvalidator invalidateLookups( this );
+
 	if ( IsPC() )
 	{
 		return false;
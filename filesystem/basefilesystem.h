@@ -616,6 +616,8 @@ public:
 	// GetVPKFileStatisticsKV
 	virtual void GetVPKFileStatisticsKV( KeyValues *pKV );
 
+	virtual const void			*GetReadOnlyFileView( FileHandle_t file, unsigned int *pnSize );
+
 	// Load dlls
 	virtual CSysModule 			*LoadModule( const char *pFileName, const char *pPathID, bool bValidatedDllOnly );
 	virtual void				UnloadModule( CSysModule *pModule );
@@ -875,6 +877,9 @@ public:
 		CSearchPath *GetFirst();
 		CSearchPath *GetNext();
 
+		// Index of the current search path in CBaseFileSystem::m_SearchPaths (-1 for absolute names)
+		int GetCurrentIndex() const { return m_Filename[0] ? m_iCurrent : -1; }
+
 	private:
 		CSearchPathsIterator( const  CSearchPathsIterator & );
 		void operator=(const CSearchPathsIterator &);
@@ -1081,6 +1086,84 @@ protected:
 	// Goes through all the search paths (or just the one specified) and calls FindFile on them. Returns the first successful result, if any.
 	FileHandle_t				FindFileInSearchPaths( const char *pFileName, const char *pOptions, const char *pathID, unsigned flags, char **ppszResolvedFilename = NULL, bool bTrackCRCs=false );
 
+	// Lookup cache for FindFileInSearchPaths. Remembers which search path a relative name resolved to
+	// for a path ID, or that it resolved to nothing, so repeated opens (and especially repeated misses)
+	// skip the walk over every search path and pack file. Any change to the search paths, pack files,
+	// VPKs or the whitelist invalidates all of it; a write, remove or rename through the filesystem
+	// only drops the names it touched. Misses expire after fs_lookup_cache_miss_ttl seconds so files
+	// created behind our back (tools, other processes) show up, and once fs_lookup_cache_max_misses
+	// of them have been stored every cached miss is dropped so probing for new names can't grow the
+	// cache forever.
+	enum
+	{
+		FILE_LOOKUP_NOT_CACHED = -2,
+		FILE_LOOKUP_MISSING = -1,
+	};
+
+	struct FileLookup_t
+	{
+		int				m_nSearchPath;		// index into m_SearchPaths, FILE_LOOKUP_MISSING or FILE_LOOKUP_NOT_CACHED
+		float			m_flExpireTime;		// misses only
+	};
+
+	struct FileLookupCacheStats_t
+	{
+		CInterlockedInt	m_nLookups;
+		CInterlockedInt	m_nHits;
+		CInterlockedInt	m_nMissingHits;
+		CInterlockedInt	m_nStaleHits;		// the cached search path no longer had the file
+		CInterlockedInt	m_nInvalidations;
+		CInterlockedInt	m_nFileInvalidations;	// names dropped by writes
+		CInterlockedInt	m_nMissPrunes;		// times every cached miss was dropped
+		CInterlockedUInt m_nMicroseconds;	// total time spent in FindFileInSearchPaths
+	};
+
+	// Bumps the search path generation for its whole lifetime so that lookups racing with the
+	// change can't store a result computed against the old search paths.
+	class CFileLookupCacheInvalidator
+	{
+	public:
+		CFileLookupCacheInvalidator( CBaseFileSystem *pFileSystem ) : m_pFileSystem( pFileSystem ) { m_pFileSystem->InvalidateFileLookupCache(); }
+		~CFileLookupCacheInvalidator() { m_pFileSystem->InvalidateFileLookupCache(); }
+	private:
+		CBaseFileSystem *m_pFileSystem;
+	};
+
+	// Drops the lookups of the files a write, remove or rename touches, on entry and on exit. Lookups
+	// racing with it can't store their result either.
+	class CFileLookupWriteInvalidator
+	{
+	public:
+		CFileLookupWriteInvalidator( CBaseFileSystem *pFileSystem, const char *pFileName, const char *pOtherFileName = NULL );
+		~CFileLookupWriteInvalidator();
+	private:
+		CBaseFileSystem *m_pFileSystem;
+		char			m_szFileName[MAX_PATH];
+		char			m_szOtherFileName[MAX_PATH];
+	};
+
+	void						InvalidateFileLookupCache();
+	void						InvalidateFileLookup( const char *pFileName );
+	void						InvalidateFileLookupRelative( const char *pRelativeName );
+	void						BuildFileLookupKey( char *pKey, int nKeySize, const char *pFileName, const CUtlSymbol &pathID );
+	int							FindFileLookup( const char *pKey, int nGeneration );
+	void						StoreFileLookup( const char *pKey, const CUtlSymbol &pathID, int nGeneration, int nWriteGeneration, int nSearchPath );
+	void						PruneFileLookupMisses();
+	FileHandle_t				FindFileInCachedSearchPath( int nSearchPath, int nGeneration, const char *pFileName, const char *pOptions, unsigned flags, char **ppszResolvedFilename, bool bTrackCRCs );
+
+public:
+	void						PrintFileLookupCacheStats( bool bReset );
+
+protected:
+	CThreadFastMutex			m_FileLookupCacheMutex;
+	CUtlStringMap< FileLookup_t > m_FileLookupCache;			// key -> where it was found
+	CUtlVector< CUtlSymbol >	m_FileLookupPathIDs;			// every path ID with keys in the cache
+	int							m_nFileLookupCacheGeneration;	// m_nSearchPathGeneration the cache contents belong to
+	int							m_nFileLookupMisses;			// misses stored since the last purge or prune
+	CInterlockedInt				m_nSearchPathGeneration;
+	CInterlockedInt				m_nFileWriteGeneration;			// bumped around every write, remove and rename
+	FileLookupCacheStats_t		m_FileLookupCacheStats;
+
 	bool						HandleOpenFromZipFile( CFileOpenInfo &openInfo );
 	void		 				HandleOpenFromPackFile( CPackFile *pPackFile, CFileOpenInfo &openInfo );
 	void						HandleOpenRegularFile( CFileOpenInfo &openInfo, bool bIsAbsolutePath );
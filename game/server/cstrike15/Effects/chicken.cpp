@@ -9,10 +9,13 @@
 #include "engine/IEngineSound.h"
 #include "cs_simple_hostage.h"
 #include "cs_player_resource.h"
+#include "tier1/framememory.h"
 
 // NOTE: This has to be the last file included!
 #include "tier0/memdbgon.h"
 
+DEFINE_FRAME_ALLOC_COUNTER( CChicken_Update );
+
 BEGIN_DATADESC( CChicken )
 	DEFINE_ENTITYFUNC( ChickenTouch ),
 	DEFINE_THINKFUNC( ChickenThink ),
@@ -540,7 +543,7 @@ void CChicken::Update( void )
 	m_updateTimer.Start( RandomFloat( 0.5f, 1.0f ) );
 
 	// find closest visible player
-	CUtlVector< CBasePlayer * > playerVector;
+	CUtlVectorFrame< CBasePlayer * > playerVector( FRAME_ALLOC_COUNTER( CChicken_Update ) );
 	CollectPlayers( &playerVector, TEAM_ANY, COLLECT_ONLY_LIVING_PLAYERS );
 
 	float closeRangeSq = FLT_MAX;
@@ -14,12 +14,15 @@
 #include "obstacle_pushaway.h"
 
 #include "cs_bot.h"
+#include "tier1/framememory.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
 
 LINK_ENTITY_TO_CLASS( cs_bot, CCSBot );
 
+DEFINE_FRAME_ALLOC_COUNTER( CCSBot_AvoidPlayers );
+
 BEGIN_DATADESC( CCSBot )
 
 END_DATADESC()
@@ -1183,7 +1186,7 @@ void CCSBot::AvoidPlayers( CUserCmd *pCmd )
 	Vector forward, right;
 	EyeVectors( &forward, &right );
 
-	CUtlVector< CCSPlayer * > playerVector;
+	CUtlVectorFrame< CCSPlayer * > playerVector( FRAME_ALLOC_COUNTER( CCSBot_AvoidPlayers ) );
 	CollectPlayers( &playerVector, GetTeamNumber(), COLLECT_ONLY_LIVING_PLAYERS );
 
 	Vector avoidVector = vec3_origin;
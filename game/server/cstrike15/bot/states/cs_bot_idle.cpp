@@ -10,6 +10,7 @@
 #include "cbase.h"
 #include "cs_simple_hostage.h"
 #include "cs_bot.h"
+#include "tier1/framememory.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -18,6 +19,8 @@
 const float sniperHideRange = 2000.0f;
 
 extern ConVar mp_guardian_target_site;
+
+DEFINE_FRAME_ALLOC_COUNTER( IdleState_OnUpdate );
 //--------------------------------------------------------------------------------------------------------------
 /**
  * The Idle state.
@@ -876,7 +879,7 @@ void IdleState::OnUpdate( CCSBot *me )
 			// if we just spawned, cheat and make us aware of other players so players can't spawncamp us effectively
 			if ( me->m_spawnedTime - gpGlobals->curtime < 1.0f )
 			{
-				CUtlVector< CCSPlayer * > playerVector;
+				CUtlVectorFrame< CCSPlayer * > playerVector( FRAME_ALLOC_COUNTER( IdleState_OnUpdate ) );
 				CollectPlayers( &playerVector, TEAM_ANY, COLLECT_ONLY_LIVING_PLAYERS );
 
 				for( int i=0; i<playerVector.Count(); ++i )
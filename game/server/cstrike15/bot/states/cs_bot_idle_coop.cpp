@@ -7,6 +7,7 @@
 #include "cbase.h"
 #include "cs_bot.h"
 #include "cs_team.h"
+#include "tier1/framememory.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -116,9 +117,11 @@ void RunStrat_GuardSpot( CCSBot *me )
 }
 
 
+DEFINE_FRAME_ALLOC_COUNTER( MakeAwareOfCTs );
+
 void MakeAwareOfCTs( CCSBot * me )
 {
-	CUtlVector< CCSPlayer * > vecCTs;
+	CUtlVectorFrame< CCSPlayer * > vecCTs( FRAME_ALLOC_COUNTER( MakeAwareOfCTs ) );
 	CollectPlayers( &vecCTs, TEAM_CT, COLLECT_ONLY_LIVING_PLAYERS );
 
 	if ( vecCTs.Count() == 0 )
@@ -12,6 +12,7 @@
 #include "ipredictionsystem.h"
 #include "iservervehicle.h"
 #include "cs_player.h"
+#include "tier1/utlbuffer.h"
 
 // NOTE: This has to be the last file included!
 #include "tier0/memdbgon.h"
@@ -33,6 +34,10 @@ DECLARE_CLASS( CCSPlayerMove, CPlayerMove );
 public:
 	virtual void	SetupMove( CBasePlayer *player, CUserCmd *ucmd, IMoveHelper *pHelper, CMoveData *move );
 	virtual void	FinishMove( CBasePlayer *player, CUserCmd *ucmd, CMoveData *move );
+
+protected:
+	virtual void	SaveMovementState( CBasePlayer *player, CUtlBuffer &buf );
+	virtual void	RestoreMovementState( CBasePlayer *player, CUtlBuffer &buf );
 };
 
 // PlayerMove Interface
@@ -92,3 +97,37 @@ void CCSPlayerMove::FinishMove( CBasePlayer *player, CUserCmd *ucmd, CMoveData *
 	pPlayer->m_bInHostageRescueZone = false;
 	pPlayer->m_bInNoDefuseArea = false;
 }
+
+
+//-----------------------------------------------------------------------------
+// Purpose: CS movement keeps some of its state on CCSPlayer as well
+//-----------------------------------------------------------------------------
+void CCSPlayerMove::SaveMovementState( CBasePlayer *player, CUtlBuffer &buf )
+{
+	BaseClass::SaveMovementState( player, buf );
+
+	CCSPlayer *pPlayer = ToCSPlayer( player );
+	buf.PutInt( pPlayer->m_iMoveState );
+	buf.PutChar( pPlayer->m_duckUntilOnGround );
+	buf.PutChar( pPlayer->m_bDuckOverride );
+	buf.PutChar( pPlayer->m_bIsWalking );
+	buf.PutChar( pPlayer->m_bHasMovedSinceSpawn );
+	buf.PutFloat( pPlayer->m_flStamina );
+	buf.PutFloat( pPlayer->m_flVelocityModifier );
+	buf.PutFloat( pPlayer->m_flGroundAccelLinearFracLastTime );
+}
+
+void CCSPlayerMove::RestoreMovementState( CBasePlayer *player, CUtlBuffer &buf )
+{
+	BaseClass::RestoreMovementState( player, buf );
+
+	CCSPlayer *pPlayer = ToCSPlayer( player );
+	pPlayer->m_iMoveState = buf.GetInt();
+	pPlayer->m_duckUntilOnGround = buf.GetChar() != 0;
+	pPlayer->m_bDuckOverride = buf.GetChar() != 0;
+	pPlayer->m_bIsWalking = buf.GetChar() != 0;
+	pPlayer->m_bHasMovedSinceSpawn = buf.GetChar() != 0;
+	pPlayer->m_flStamina = buf.GetFloat();
+	pPlayer->m_flVelocityModifier = buf.GetFloat();
+	pPlayer->m_flGroundAccelLinearFracLastTime = buf.GetFloat();
+}
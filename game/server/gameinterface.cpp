@@ -148,6 +148,7 @@
 #endif
 
 #include "CegClientWrapper.h"
+#include "tier1/framememory.h"
 
 extern IToolFrameworkServer *g_pToolFrameworkServer;
 extern IParticleSystemQuery *g_pParticleSystemQuery;
@@ -1533,6 +1534,14 @@ void CServerGameDLL::GameFrame( bool simulating )
 	g_NetworkPropertyEventMgr.FireEvents();
 
 	gpGlobals->frametime = oldframetime;
+
+	// Recycle everything handed out by FrameAlloc this frame
+	FrameMemory_EndFrame();
+}
+
+CON_COMMAND_F( sv_frame_alloc_stats, "Lists frame arena usage and the busiest per-frame allocation counters. Usage: sv_frame_alloc_stats [count]", FCVAR_CHEAT )
+{
+	FrameMemory_PrintStats( ( args.ArgC() > 1 ) ? atoi( args[1] ) : 20 );
 }
 
 //-----------------------------------------------------------------------------
@@ -33,6 +33,7 @@
 #include "vphysicsupdateai.h"
 #include "pushentity.h"
 #include "igamemovement.h"
+#include "player_command.h"
 #include "tier0/cache_hints.h"
 #include "basecsgrenade_projectile.h"
 // memdbgon must be the last include file in a .cpp file!!!
@@ -2319,6 +2320,9 @@ void Physics_RunThinkFunctions( bool simulating )
 		// Do we really need UTIL_RemoveImmediate()?
 		int count = SimThink_ListCopy( list, listMax );
 
+		// Gather player movement trace lists on the job pool; players claim them as their usercmds run
+		PrefetchMovementTraceLists();
+
 		//DevMsg(1, "Count: %d\n", count );
 		for ( int i = 0; i < count; i++ )
 		{
@@ -2329,6 +2333,7 @@ void Physics_RunThinkFunctions( bool simulating )
 
 		// The pusher system queued up a bunch of physics updates.  Make them happen now.
 		g_pPushedEntities->UpdatePusherPhysicsEndOfTick();
+		ReleasePrefetchedMovementTraceLists();
 
 		stackfree( list );
 		UTIL_EnableRemoveImmediate();
@@ -1687,8 +1687,8 @@ inline bool ForEachPlayer( IPlayerFunctor &func )
 //
 #define COLLECT_ONLY_LIVING_PLAYERS true
 #define APPEND_PLAYERS true
-template < typename T >
-int CollectPlayers( CUtlVector< T * > *playerVector, int team = TEAM_ANY, bool isAlive = false, bool shouldAppend = false )
+template < typename T, typename A >
+int CollectPlayers( CUtlVector< T *, A > *playerVector, int team = TEAM_ANY, bool isAlive = false, bool shouldAppend = false )
 {
 	if ( !shouldAppend )
 	{
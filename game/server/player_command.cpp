@@ -14,6 +14,11 @@
 #include "movehelper_server.h"
 #include "iservervehicle.h"
 #include "tier0/vprof.h"
+#include "tier0/fasttimer.h"
+#include "gamemovement.h"
+#include "engine/IEngineTrace.h"
+#include "vstdlib/jobthread.h"
+#include "tier1/utlbuffer.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -181,6 +186,8 @@ void CPlayerMove::SetupMove( CBasePlayer *player, CUserCmd *ucmd, IMoveHelper *p
 	move->m_vecAngles			= player->pl.v_angle;
 
 	move->m_vecVelocity			= player->GetAbsVelocity();
+	// ProcessMovement sets this as well, but the movement bounds below need it now
+	move->m_flMaxSpeed			= player->GetPlayerMaxSpeed();
 
 	move->m_nPlayerHandle		= player;
 
@@ -306,6 +313,26 @@ void CPlayerMove::RunPostThink( CBasePlayer *player )
 	player->PostThink();
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Returns the frametime movement runs a usercmd from this player with
+//-----------------------------------------------------------------------------
+float CPlayerMove::GetMovementFrameTime( CBasePlayer *player )
+{
+	if ( !player->m_bGamePaused )
+		return TICK_INTERVAL;
+
+	// If no clipping and cheats enabled and noclipduring game enabled, then leave
+	//  forwardmove and angles stuff in usercmd
+	if ( player->GetMoveType() == MOVETYPE_NOCLIP &&
+		 sv_cheats->GetBool() && 
+		 sv_noclipduringpause.GetBool() )
+	{
+		return TICK_INTERVAL;
+	}
+
+	return 0.0f;
+}
+
 void CommentarySystem_PePlayerRunCommand( CBasePlayer *player, CUserCmd *ucmd );
 
 //-----------------------------------------------------------------------------
@@ -343,24 +370,12 @@ void CPlayerMove::RunCommand ( CBasePlayer *player, CUserCmd *ucmd, IMoveHelper
 	const float serverCurTime = gpGlobals->curtime;
 	const float serverFrameTime = gpGlobals->frametime;
 	gpGlobals->curtime		=  playerCurTime;
-	gpGlobals->frametime	=  playerFrameTime;
+	gpGlobals->frametime	=  GetMovementFrameTime( player );
 
 	// Add and subtract buttons we're forcing on the player
 	ucmd->buttons |= player->m_afButtonForced;
 	ucmd->buttons &= ~player->m_afButtonDisabled;
 
-	if ( player->m_bGamePaused )
-	{
-		// If no clipping and cheats enabled and noclipduring game enabled, then leave
-		//  forwardmove and angles stuff in usercmd
-		if ( player->GetMoveType() == MOVETYPE_NOCLIP &&
-			 sv_cheats->GetBool() && 
-			 sv_noclipduringpause.GetBool() )
-		{
-			gpGlobals->frametime = TICK_INTERVAL;
-		}
-	}
-
 	/*
 	// TODO:  We can check whether the player is sending more commands than elapsed real time
 	cmdtimeremaining -= ucmd->msec;
@@ -480,3 +495,379 @@ void CPlayerMove::RunCommand ( CBasePlayer *player, CUserCmd *ucmd, IMoveHelper
 		player->m_nTickBase++;
 	}
 }
+
+//-----------------------------------------------------------------------------
+// Purpose: Saves everything ProcessMovement writes into the player
+//-----------------------------------------------------------------------------
+void CPlayerMove::SaveMovementState( CBasePlayer *player, CUtlBuffer &buf )
+{
+	CBaseEntity *pGroundEntity = player->GetGroundEntity();
+	buf.Put( &player->GetAbsOrigin(), sizeof( Vector ) );
+	buf.Put( &player->GetAbsVelocity(), sizeof( Vector ) );
+	buf.Put( &player->GetBaseVelocity(), sizeof( Vector ) );
+	buf.Put( &player->GetViewOffset(), sizeof( Vector ) );
+	buf.PutInt( player->GetFlags() );
+	buf.PutPtr( pGroundEntity );
+	buf.PutInt( player->GetMoveType() );
+	buf.PutInt( player->GetMoveCollide() );
+	buf.PutInt( player->GetWaterLevel() );
+	buf.PutInt( player->GetWaterType() );
+	buf.PutFloat( player->GetGravity() );
+
+	buf.PutInt( player->m_surfaceProps );
+	buf.PutPtr( player->m_pSurfaceData );
+	buf.PutFloat( player->m_surfaceFriction );
+	buf.PutChar( player->m_chTextureType );
+	buf.PutChar( player->m_chPreviousTextureType );
+	buf.PutFloat( player->m_flStepSoundTime );
+	buf.PutFloat( player->m_flSwimSoundTime );
+	buf.PutFloat( player->m_flWaterJumpTime );
+	buf.PutFloat( player->m_ignoreLadderJumpTime );
+	buf.PutChar( player->m_bHasWalkMovedSinceLastJump );
+	buf.Put( &player->m_vecLadderNormal.Get(), sizeof( Vector ) );
+	buf.Put( &player->m_vecLastPositionAtFullCrouchSpeed, sizeof( Vector2D ) );
+	buf.PutInt( player->m_StuckLast );
+	buf.PutFloat( player->m_flMaxspeed );
+	buf.PutFloat( player->m_flDuckAmount );
+	buf.PutFloat( player->m_flDuckSpeed );
+
+	buf.PutChar( player->m_Local.m_bDucked );
+	buf.PutChar( player->m_Local.m_bDucking );
+	buf.PutChar( player->m_Local.m_bInDuckJump );
+	buf.PutInt( player->m_Local.m_nDuckTimeMsecs );
+	buf.PutInt( player->m_Local.m_nDuckJumpTimeMsecs );
+	buf.PutInt( player->m_Local.m_nJumpTimeMsecs );
+	buf.PutFloat( player->m_Local.m_flFallVelocity );
+	buf.PutFloat( player->m_Local.m_flLastDuckTime );
+	buf.Put( &player->m_Local.m_viewPunchAngle.Get(), sizeof( QAngle ) );
+	buf.Put( &player->m_Local.m_aimPunchAngle.Get(), sizeof( QAngle ) );
+	buf.Put( &player->m_Local.m_aimPunchAngleVel.Get(), sizeof( QAngle ) );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Puts back what SaveMovementState saved, in the same order
+//-----------------------------------------------------------------------------
+void CPlayerMove::RestoreMovementState( CBasePlayer *player, CUtlBuffer &buf )
+{
+	Vector vecOrigin, vecVelocity, vecBaseVelocity, vecViewOffset;
+	buf.Get( &vecOrigin, sizeof( Vector ) );
+	buf.Get( &vecVelocity, sizeof( Vector ) );
+	buf.Get( &vecBaseVelocity, sizeof( Vector ) );
+	buf.Get( &vecViewOffset, sizeof( Vector ) );
+	player->SetAbsOrigin( vecOrigin );
+	player->SetAbsVelocity( vecVelocity );
+	player->SetBaseVelocity( vecBaseVelocity );
+	player->SetViewOffset( vecViewOffset );
+	player->ClearFlags();
+	player->AddFlag( buf.GetInt() );
+	player->SetGroundEntity( (CBaseEntity *)buf.GetPtr() );
+	MoveType_t moveType = (MoveType_t)buf.GetInt();
+	player->SetMoveType( moveType, (MoveCollide_t)buf.GetInt() );
+	player->SetWaterLevel( buf.GetInt() );
+	player->SetWaterType( buf.GetInt() );
+	player->SetGravity( buf.GetFloat() );
+
+	player->m_surfaceProps = buf.GetInt();
+	player->m_pSurfaceData = (surfacedata_t *)buf.GetPtr();
+	player->m_surfaceFriction = buf.GetFloat();
+	player->m_chTextureType = buf.GetChar();
+	player->m_chPreviousTextureType = buf.GetChar();
+	player->m_flStepSoundTime = buf.GetFloat();
+	player->m_flSwimSoundTime = buf.GetFloat();
+	player->m_flWaterJumpTime = buf.GetFloat();
+	player->m_ignoreLadderJumpTime = buf.GetFloat();
+	player->m_bHasWalkMovedSinceLastJump = buf.GetChar() != 0;
+	Vector vecLadderNormal;
+	buf.Get( &vecLadderNormal, sizeof( Vector ) );
+	player->m_vecLadderNormal = vecLadderNormal;
+	buf.Get( &player->m_vecLastPositionAtFullCrouchSpeed, sizeof( Vector2D ) );
+	player->m_StuckLast = buf.GetInt();
+	player->m_flMaxspeed = buf.GetFloat();
+	player->m_flDuckAmount = buf.GetFloat();
+	player->m_flDuckSpeed = buf.GetFloat();
+
+	player->m_Local.m_bDucked = buf.GetChar() != 0;
+	player->m_Local.m_bDucking = buf.GetChar() != 0;
+	player->m_Local.m_bInDuckJump = buf.GetChar() != 0;
+	player->m_Local.m_nDuckTimeMsecs = buf.GetInt();
+	player->m_Local.m_nDuckJumpTimeMsecs = buf.GetInt();
+	player->m_Local.m_nJumpTimeMsecs = buf.GetInt();
+	player->m_Local.m_flFallVelocity = buf.GetFloat();
+	player->m_Local.m_flLastDuckTime = buf.GetFloat();
+	QAngle angPunch;
+	buf.Get( &angPunch, sizeof( QAngle ) );
+	player->m_Local.m_viewPunchAngle = angPunch;
+	buf.Get( &angPunch, sizeof( QAngle ) );
+	player->m_Local.m_aimPunchAngle = angPunch;
+	buf.Get( &angPunch, sizeof( QAngle ) );
+	player->m_Local.m_aimPunchAngleVel = angPunch;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Runs the movement part of the player's next pending usercmd and
+//			undoes it, so the final player state can be compared between two
+//			ways of running it. Returns false when no usercmd is pending.
+//-----------------------------------------------------------------------------
+bool CPlayerMove::SimulateNextMovement( CBasePlayer *player, Vector &vecOrigin, Vector &vecVelocity, int &nFlags )
+{
+	if ( !player->GetCommandContextCount() )
+		return false;
+
+	// The oldest context runs first, and within it the commands run from the end
+	CCommandContext *ctx = player->GetCommandContext( 0 );
+	if ( !ctx->numcmds )
+		return false;
+
+	CUtlBuffer state;
+	SaveMovementState( player, state );
+
+	const float serverCurTime = gpGlobals->curtime;
+	const float serverFrameTime = gpGlobals->frametime;
+	gpGlobals->curtime = player->m_nTickBase * TICK_INTERVAL;
+	gpGlobals->frametime = GetMovementFrameTime( player );
+
+	CUserCmd cmd = ctx->cmds[ ctx->numcmds - 1 ];
+	cmd.buttons |= player->m_afButtonForced;
+	cmd.buttons &= ~player->m_afButtonDisabled;
+
+	StartCommand( player, &cmd );
+	MoveHelperServer()->SetHost( player );
+
+	CMoveData move;
+	SetupMove( player, &cmd, MoveHelperServer(), &move );
+	// No sounds or effects from a move that is thrown away
+	move.m_bFirstRunOfFunctions = false;
+	g_pGameMovement->ProcessMovement( player, &move );
+
+	vecOrigin = move.GetAbsOrigin();
+	vecVelocity = move.m_vecVelocity;
+	nFlags = player->GetFlags();
+
+	g_pGameMovement->Reset();
+	MoveHelperServer()->ResetTouchList();
+	MoveHelperServer()->SetHost( NULL );
+	FinishCommand( player );
+
+	gpGlobals->curtime = serverCurTime;
+	gpGlobals->frametime = serverFrameTime;
+
+	RestoreMovementState( player, state );
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Movement trace list prefetch: before entities simulate, gather the world part (brushes,
+// displacements, static props) of every pending player's movement trace list
+// on the job pool. Movement itself still runs serially in PhysicsSimulate;
+// SetupMovementBounds claims a prefetched list only when its bounds match
+// exactly and then re-gathers the dynamic entities on the main thread, so
+// the traces movement sees are identical to the serial path.
+//-----------------------------------------------------------------------------
+static ConVar sv_movement_tracelist_prefetch( "sv_movement_tracelist_prefetch", "1", FCVAR_RELEASE, "Gather the world part of player movement trace lists on the job pool before entities simulate. Movement itself still runs serially" );
+
+struct MovementPrefetch_t
+{
+	CBasePlayer		*m_pPlayer;
+	Vector			m_vecMins;
+	Vector			m_vecMaxs;
+	ITraceListData	*m_pTraceListData;
+	bool			m_bClaimed;
+};
+
+static CUtlVector< MovementPrefetch_t > s_MovementPrefetch;
+static CUtlVector< ITraceListData * > s_FreeMovementTraceLists;
+
+static ITraceListData *AllocMovementTraceList()
+{
+	if ( s_FreeMovementTraceLists.Count() )
+	{
+		ITraceListData *pTraceListData = s_FreeMovementTraceLists.Tail();
+		s_FreeMovementTraceLists.RemoveMultipleFromTail( 1 );
+		return pTraceListData;
+	}
+	return enginetrace->AllocTraceListData();
+}
+
+static void ProcessMovementPrefetch( MovementPrefetch_t &prefetch )
+{
+	enginetrace->SetupLeafAndEntityListBox( prefetch.m_vecMins, prefetch.m_vecMaxs, prefetch.m_pTraceListData );
+}
+
+// Fills in the bounds the player's first usercmd this tick will ask for, assuming nothing moves the player first
+static void ComputePredictedMovementBounds( CBasePlayer *pPlayer, Vector &vecMins, Vector &vecMaxs )
+{
+	CGameMovement *pGameMovement = static_cast< CGameMovement * >( g_pGameMovement );
+	// SetupMovementBounds sizes the box with the frametime RunCommand sets, the two have to agree to match
+	pGameMovement->ComputeMovementBounds( pPlayer, pPlayer->GetAbsOrigin(), pPlayer->GetAbsVelocity(), pPlayer->GetPlayerMaxSpeed(), CPlayerMove::GetMovementFrameTime( pPlayer ), vecMins, vecMaxs );
+}
+
+static int GatherMovementPrefetch()
+{
+	s_MovementPrefetch.RemoveAll();
+	for ( int i = 1; i <= gpGlobals->maxClients; i++ )
+	{
+		CBasePlayer *pPlayer = UTIL_PlayerByIndex( i );
+		if ( !pPlayer || !pPlayer->IsConnected() || pPlayer->IsHLTV() || !pPlayer->GetCommandContextCount() )
+			continue;
+
+		MovementPrefetch_t &prefetch = s_MovementPrefetch[ s_MovementPrefetch.AddToTail() ];
+		prefetch.m_pPlayer = pPlayer;
+		ComputePredictedMovementBounds( pPlayer, prefetch.m_vecMins, prefetch.m_vecMaxs );
+		prefetch.m_pTraceListData = AllocMovementTraceList();
+		prefetch.m_bClaimed = false;
+	}
+	return s_MovementPrefetch.Count();
+}
+
+void PrefetchMovementTraceLists()
+{
+	if ( !sv_movement_tracelist_prefetch.GetBool() || !g_pThreadPool )
+		return;
+
+	VPROF( "PrefetchMovementTraceLists" );
+	// Nothing to win over the serial path with a single player
+	if ( GatherMovementPrefetch() < 2 )
+	{
+		ReleasePrefetchedMovementTraceLists();
+		return;
+	}
+
+	ParallelProcess( s_MovementPrefetch.Base(), s_MovementPrefetch.Count(), &ProcessMovementPrefetch );
+}
+
+bool ClaimPrefetchedMovementTraceList( CBasePlayer *pPlayer, const Vector &vecMins, const Vector &vecMaxs, ITraceListData *&pTraceListData )
+{
+	FOR_EACH_VEC( s_MovementPrefetch, i )
+	{
+		MovementPrefetch_t &prefetch = s_MovementPrefetch[i];
+		if ( prefetch.m_pPlayer != pPlayer )
+			continue;
+
+		// Only the first command can match the position the stage predicted
+		if ( prefetch.m_bClaimed )
+			return false;
+		prefetch.m_bClaimed = true;
+
+		if ( prefetch.m_vecMins != vecMins || prefetch.m_vecMaxs != vecMaxs )
+			return false;
+
+		if ( pTraceListData )
+		{
+			pTraceListData->Reset();
+			s_FreeMovementTraceLists.AddToTail( pTraceListData );
+		}
+		pTraceListData = prefetch.m_pTraceListData;
+		prefetch.m_pTraceListData = NULL;
+
+		// Anything dynamic may have moved since the stage ran
+		pTraceListData->RefreshEntityList();
+		return true;
+	}
+	return false;
+}
+
+void ReleasePrefetchedMovementTraceLists()
+{
+	FOR_EACH_VEC( s_MovementPrefetch, i )
+	{
+		ITraceListData *pTraceListData = s_MovementPrefetch[i].m_pTraceListData;
+		if ( pTraceListData )
+		{
+			pTraceListData->Reset();
+			s_FreeMovementTraceLists.AddToTail( pTraceListData );
+		}
+	}
+	s_MovementPrefetch.RemoveAll();
+}
+
+//-----------------------------------------------------------------------------
+// Runs every pending player's next usercmd through movement twice, once with
+// a serially built trace list and once with the prefetched one, and reports
+// any player whose origin, velocity or flags end up different.
+//-----------------------------------------------------------------------------
+CON_COMMAND_F( sv_movement_prefetch_test, "Checks that movement through prefetched trace lists ends in the same player state as the serial path", FCVAR_CHEAT )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	ReleasePrefetchedMovementTraceLists();
+	int nPlayers = GatherMovementPrefetch();
+	if ( !nPlayers )
+	{
+		Msg( "No players with pending usercmds.\n" );
+		return;
+	}
+
+	CUtlVector< ITraceListData * > serialLists;
+	CFastTimer timer;
+	timer.Start();
+	FOR_EACH_VEC( s_MovementPrefetch, i )
+	{
+		ITraceListData *pTraceListData = AllocMovementTraceList();
+		enginetrace->SetupLeafAndEntityListBox( s_MovementPrefetch[i].m_vecMins, s_MovementPrefetch[i].m_vecMaxs, pTraceListData );
+		serialLists.AddToTail( pTraceListData );
+	}
+	timer.End();
+	float flSerialMs = timer.GetDuration().GetMillisecondsF();
+
+	FOR_EACH_VEC( serialLists, i )
+	{
+		serialLists[i]->Reset();
+		s_FreeMovementTraceLists.AddToTail( serialLists[i] );
+	}
+
+	timer.Start();
+	ParallelProcess( s_MovementPrefetch.Base(), s_MovementPrefetch.Count(), &ProcessMovementPrefetch );
+	FOR_EACH_VEC( s_MovementPrefetch, i )
+	{
+		s_MovementPrefetch[i].m_pTraceListData->RefreshEntityList();
+	}
+	timer.End();
+	float flPrefetchMs = timer.GetDuration().GetMillisecondsF();
+
+	CPlayerMove *pPlayerMove = PlayerMove();
+	int nMoves = 0, nUnclaimed = 0, nMismatches = 0;
+	FOR_EACH_VEC( s_MovementPrefetch, i )
+	{
+		MovementPrefetch_t &prefetch = s_MovementPrefetch[i];
+		CBasePlayer *pPlayer = prefetch.m_pPlayer;
+
+		// Vehicles drive their own movement
+		if ( pPlayer->GetVehicle() )
+			continue;
+
+		Vector vecSerialOrigin, vecSerialVelocity, vecPrefetchOrigin, vecPrefetchVelocity;
+		int nSerialFlags, nPrefetchFlags;
+
+		// A claimed entry is skipped, so the first run builds its own list
+		prefetch.m_bClaimed = true;
+		if ( !pPlayerMove->SimulateNextMovement( pPlayer, vecSerialOrigin, vecSerialVelocity, nSerialFlags ) )
+			continue;
+		prefetch.m_bClaimed = false;
+		pPlayerMove->SimulateNextMovement( pPlayer, vecPrefetchOrigin, vecPrefetchVelocity, nPrefetchFlags );
+		nMoves++;
+
+		// Still holding its list means SetupMovementBounds asked for a different box than predicted
+		if ( prefetch.m_pTraceListData )
+		{
+			nUnclaimed++;
+			Msg( "  %s: prefetched bounds not claimed\n", pPlayer->GetPlayerName() );
+			continue;
+		}
+
+		if ( vecSerialOrigin != vecPrefetchOrigin || vecSerialVelocity != vecPrefetchVelocity || nSerialFlags != nPrefetchFlags )
+		{
+			nMismatches++;
+			Msg( "  %s: serial origin (%.3f %.3f %.3f) velocity (%.3f %.3f %.3f) flags 0x%x, prefetched origin (%.3f %.3f %.3f) velocity (%.3f %.3f %.3f) flags 0x%x\n",
+				pPlayer->GetPlayerName(),
+				vecSerialOrigin.x, vecSerialOrigin.y, vecSerialOrigin.z, vecSerialVelocity.x, vecSerialVelocity.y, vecSerialVelocity.z, nSerialFlags,
+				vecPrefetchOrigin.x, vecPrefetchOrigin.y, vecPrefetchOrigin.z, vecPrefetchVelocity.x, vecPrefetchVelocity.y, vecPrefetchVelocity.z, nPrefetchFlags );
+		}
+	}
+
+	ReleasePrefetchedMovementTraceLists();
+
+	Msg( "%d players, %d moves, %d not prefetched, %d mismatches\n", nPlayers, nMoves, nUnclaimed, nMismatches );
+	Msg( "Gather: serial %.3f ms, prefetched %.3f ms\n", flSerialMs, flPrefetchMs );
+}
+
@@ -17,6 +17,8 @@
 class IMoveHelper;
 class CMoveData;
 class CBasePlayer;
+class CUtlBuffer;
+class Vector;
 
 //-----------------------------------------------------------------------------
 // Purpose: Server side player movement
@@ -34,7 +36,17 @@ public:
 	// Run a movement command from the player
 	virtual void	RunCommand ( CBasePlayer *player, CUserCmd *ucmd, IMoveHelper *moveHelper );
 
+	// The frametime movement runs with for this player's usercmds
+	static float	GetMovementFrameTime( CBasePlayer *player );
+
+	// Runs the movement for the next pending usercmd, returns where it left the player and then undoes it
+	bool			SimulateNextMovement( CBasePlayer *player, Vector &vecOrigin, Vector &vecVelocity, int &nFlags );
+
 protected:
+	// Save and restore the player state ProcessMovement writes to
+	virtual void	SaveMovementState( CBasePlayer *player, CUtlBuffer &buf );
+	virtual void	RestoreMovementState( CBasePlayer *player, CUtlBuffer &buf );
+
 	// Prepare for running movement
 	virtual void	SetupMove( CBasePlayer *player, CUserCmd *ucmd, IMoveHelper *pHelper, CMoveData *move );
 
@@ -60,5 +72,14 @@ protected:
 //-----------------------------------------------------------------------------
 CPlayerMove *PlayerMove();
 
+//-----------------------------------------------------------------------------
+// Movement trace list prefetch, run around the entity simulation loop
+//-----------------------------------------------------------------------------
+class ITraceListData;
+
+void PrefetchMovementTraceLists();
+bool ClaimPrefetchedMovementTraceList( CBasePlayer *pPlayer, const Vector &vecMins, const Vector &vecMaxs, ITraceListData *&pTraceListData );
+void ReleasePrefetchedMovementTraceLists();
+
 
 #endif // PLAYER_COMMAND_H
@@ -39,6 +39,7 @@ extern IFileSystem *filesystem;
 
 #ifndef CLIENT_DLL
 	#include "env_player_surface_trigger.h"
+	#include "player_command.h"
 	static ConVar dispcoll_drawplane( "dispcoll_drawplane", "0" );
 #endif
 
@@ -755,6 +756,9 @@ CGameMovement::CGameMovement( void )
 
 	memset( m_flStuckCheckTime, 0, sizeof(m_flStuckCheckTime) );
 	m_pTraceListData = NULL;
+	m_nTraceCount = 0;
+	m_nTraceCacheHits = 0;
+	ClearTraceCache();
 }
 
 //-----------------------------------------------------------------------------
@@ -936,14 +940,61 @@ const Vector& CGameMovement::GetPlayerViewOffset( bool ducked ) const
 	return ducked ? VEC_DUCK_VIEW : VEC_VIEW;
 }
 
+static ConVar sv_movement_trace_cache( "sv_movement_trace_cache", "1", FCVAR_REPLICATED | FCVAR_DEVELOPMENTONLY, "Reuse identical player hull traces within a single usercmd's movement." );
+
+//-----------------------------------------------------------------------------
+// Purpose: Returns a hull trace already done during this ProcessMovement
+//-----------------------------------------------------------------------------
+bool CGameMovement::FindCachedTrace( const Vector& start, const Vector& end, const Vector& mins, const Vector& maxs, unsigned int fMask, int collisionGroup, trace_t& pm )
+{
+	for ( int i = 0; i < m_nTraceCacheCount; ++i )
+	{
+		const TraceCacheEntry_t &entry = m_TraceCache[i];
+		if ( entry.m_fMask != fMask || entry.m_nCollisionGroup != collisionGroup )
+			continue;
+		if ( entry.m_vecStart != start || entry.m_vecEnd != end || entry.m_vecMins != mins || entry.m_vecMaxs != maxs )
+			continue;
+
+		pm = entry.m_Trace;
+		++m_nTraceCacheHits;
+		return true;
+	}
+	return false;
+}
+
+void CGameMovement::AddCachedTrace( const Vector& start, const Vector& end, const Vector& mins, const Vector& maxs, unsigned int fMask, int collisionGroup, const trace_t& pm )
+{
+	// Traces outside ProcessMovement (or with the cache off) are never reused
+	if ( !m_bProcessingMovement || !sv_movement_trace_cache.GetBool() )
+		return;
+
+	TraceCacheEntry_t &entry = m_TraceCache[m_nTraceCacheNext];
+	m_nTraceCacheNext = ( m_nTraceCacheNext + 1 ) % MAX_TRACE_CACHE_ENTRIES;
+	m_nTraceCacheCount = MIN( m_nTraceCacheCount + 1, (int)MAX_TRACE_CACHE_ENTRIES );
+
+	entry.m_vecStart = start;
+	entry.m_vecEnd = end;
+	entry.m_vecMins = mins;
+	entry.m_vecMaxs = maxs;
+	entry.m_fMask = fMask;
+	entry.m_nCollisionGroup = collisionGroup;
+	entry.m_Trace = pm;
+}
+
 CBaseHandle CGameMovement::TestPlayerPosition( const Vector& pos, int collisionGroup, trace_t& pm )
 {
-	++m_nTraceCount;
-	Ray_t ray;
-	ray.Init( pos, pos, GetPlayerMins(), GetPlayerMaxs() );
-	ITraceFilter *filter = LockTraceFilter( collisionGroup );
-	UTIL_TraceRay( ray, PlayerSolidMask(), filter, &pm );
-	UnlockTraceFilter( filter );
+	const Vector &mins = GetPlayerMins();
+	const Vector &maxs = GetPlayerMaxs();
+	if ( !FindCachedTrace( pos, pos, mins, maxs, PlayerSolidMask(), collisionGroup, pm ) )
+	{
+		++m_nTraceCount;
+		Ray_t ray;
+		ray.Init( pos, pos, mins, maxs );
+		ITraceFilter *filter = LockTraceFilter( collisionGroup );
+		UTIL_TraceRay( ray, PlayerSolidMask(), filter, &pm );
+		UnlockTraceFilter( filter );
+		AddCachedTrace( pos, pos, mins, maxs, PlayerSolidMask(), collisionGroup, pm );
+	}
 	if ( (pm.contents & PlayerSolidMask()) && pm.m_pEnt )
 		return pm.m_pEnt->GetRefEHandle();
 	return INVALID_EHANDLE;
@@ -1301,9 +1352,22 @@ void CGameMovement::SetupMovementBounds( CMoveData *move )
 	CBasePlayer *pPlayer = (CBasePlayer *)move->m_nPlayerHandle.Get();
 
 	Vector moveMins, moveMaxs;
-	ClearBounds( moveMins, moveMaxs );
-	Vector start = move->GetAbsOrigin();
-	float radius = ((move->m_vecVelocity.Length() + move->m_flMaxSpeed) * gpGlobals->frametime) + 1.0f;
+	ComputeMovementBounds( pPlayer, move->GetAbsOrigin(), move->m_vecVelocity, move->m_flMaxSpeed, gpGlobals->frametime, moveMins, moveMaxs );
+
+#ifndef CLIENT_DLL
+	// The movement stage may have gathered the world part of this list on the job pool already
+	if ( ClaimPrefetchedMovementTraceList( pPlayer, moveMins, moveMaxs, m_pTraceListData ) )
+		return;
+#endif
+
+	// now build an optimized trace within these bounds
+	enginetrace->SetupLeafAndEntityListBox( moveMins, moveMaxs, m_pTraceListData );
+}
+
+void CGameMovement::ComputeMovementBounds( CBasePlayer *pPlayer, const Vector &vecOrigin, const Vector &vecVelocity, float flMaxSpeed, float flFrameTime, Vector &vecMins, Vector &vecMaxs )
+{
+	ClearBounds( vecMins, vecMaxs );
+	float radius = ((vecVelocity.Length() + flMaxSpeed) * flFrameTime) + 1.0f;
 	// NOTE: assumes the unducked bbox encloses the ducked bbox
 	Vector boxMins = GetPlayerMins(false);
 	Vector boxMaxs = GetPlayerMaxs(false);
@@ -1312,10 +1376,8 @@ void CGameMovement::SetupMovementBounds( CMoveData *move )
 	Vector bloat;
 	bloat.Init(radius, radius, radius);
 	bloat.z += pPlayer->m_Local.m_flStepSize;
-	AddPointToBounds( start + boxMaxs + bloat, moveMins, moveMaxs );
-	AddPointToBounds( start + boxMins - bloat, moveMins, moveMaxs );
-	// now build an optimized trace within these bounds
-	enginetrace->SetupLeafAndEntityListBox( moveMins, moveMaxs, m_pTraceListData );
+	AddPointToBounds( vecOrigin + boxMaxs + bloat, vecMins, vecMaxs );
+	AddPointToBounds( vecOrigin + boxMins - bloat, vecMins, vecMaxs );
 }
 
 //-----------------------------------------------------------------------------
@@ -1325,6 +1387,8 @@ void CGameMovement::SetupMovementBounds( CMoveData *move )
 void CGameMovement::ProcessMovement( CBasePlayer *pPlayer, CMoveData *pMove )
 {
 	m_nTraceCount = 0;
+	m_nTraceCacheHits = 0;
+	ClearTraceCache();
 
 	Assert( pMove && pPlayer );
 
@@ -1367,11 +1431,13 @@ void CGameMovement::ProcessMovement( CBasePlayer *pPlayer, CMoveData *pMove )
 	gpGlobals->frametime = flStoreFrametime;
 
 	m_bProcessingMovement = false;
+	ClearTraceCache();
 
 #if !defined( CLIENT_DLL )
 	if ( !player->IsBot() )
 	{
 		VPROF_INCREMENT_COUNTER( "PlayerMovementTraces", m_nTraceCount );
+		VPROF_INCREMENT_COUNTER( "PlayerMovementTraceCacheHits", m_nTraceCacheHits );
 	}
 #endif
 }
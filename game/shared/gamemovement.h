@@ -53,6 +53,8 @@ public:
 	virtual const Vector&	GetPlayerMaxs( bool ducked ) const;
 	virtual const Vector&	GetPlayerViewOffset( bool ducked ) const;
 	virtual void SetupMovementBounds( CMoveData *pMove );
+	// The conservative box SetupMovementBounds gathers the trace list for
+	void			ComputeMovementBounds( CBasePlayer *pPlayer, const Vector &vecOrigin, const Vector &vecVelocity, float flMaxSpeed, float flFrameTime, Vector &vecMins, Vector &vecMaxs );
 
 	virtual bool		IsMovingPlayerStuck( void ) const;
 	virtual CBasePlayer *GetMovingPlayer( void ) const;
@@ -299,6 +301,34 @@ public:
 	ITraceListData	*m_pTraceListData;
 
 	int				m_nTraceCount;
+
+	// Player hull traces repeated within one ProcessMovement (ground checks,
+	// step up/down, position tests) are answered from this cache. Nothing
+	// the filter can hit moves while a single command's movement runs.
+	enum
+	{
+		MAX_TRACE_CACHE_ENTRIES = 8,
+	};
+
+	struct TraceCacheEntry_t
+	{
+		Vector			m_vecStart;
+		Vector			m_vecEnd;
+		Vector			m_vecMins;
+		Vector			m_vecMaxs;
+		unsigned int	m_fMask;
+		int				m_nCollisionGroup;
+		trace_t			m_Trace;
+	};
+
+	bool			FindCachedTrace( const Vector& start, const Vector& end, const Vector& mins, const Vector& maxs, unsigned int fMask, int collisionGroup, trace_t& pm );
+	void			AddCachedTrace( const Vector& start, const Vector& end, const Vector& mins, const Vector& maxs, unsigned int fMask, int collisionGroup, const trace_t& pm );
+	void			ClearTraceCache() { m_nTraceCacheCount = 0; m_nTraceCacheNext = 0; }
+
+	TraceCacheEntry_t	m_TraceCache[MAX_TRACE_CACHE_ENTRIES];
+	int				m_nTraceCacheCount;
+	int				m_nTraceCacheNext;
+	int				m_nTraceCacheHits;
 };
 
 
@@ -307,11 +337,16 @@ public:
 //-----------------------------------------------------------------------------
 inline void CGameMovement::TracePlayerBBox( const Vector& start, const Vector& end, unsigned int fMask, int collisionGroup, trace_t& pm )
 {
-	++m_nTraceCount;
 	VPROF( "CGameMovement::TracePlayerBBox" );
 
+	const Vector &mins = GetPlayerMins();
+	const Vector &maxs = GetPlayerMaxs();
+	if ( FindCachedTrace( start, end, mins, maxs, fMask, collisionGroup, pm ) )
+		return;
+
+	++m_nTraceCount;
 	Ray_t ray;
-	ray.Init( start, end, GetPlayerMins(), GetPlayerMaxs() );
+	ray.Init( start, end, mins, maxs );
 	ITraceFilter *pFilter = LockTraceFilter( collisionGroup );
 	if ( m_pTraceListData && m_pTraceListData->CanTraceRay(ray) )
 	{
@@ -322,6 +357,8 @@ inline void CGameMovement::TracePlayerBBox( const Vector& start, const Vector& e
 		enginetrace->TraceRay( ray, fMask, pFilter, &pm );
 	}
 	UnlockTraceFilter( pFilter );
+
+	AddCachedTrace( start, end, mins, maxs, fMask, collisionGroup, pm );
 }
 
 inline void CGameMovement::GameMovementTraceHull( const Vector& start, const Vector& end, const Vector &mins, const Vector &maxs, unsigned int fMask, ITraceFilter *pFilter, trace_t *pTrace )
@@ -29,7 +29,9 @@
 #include "tier1/fmtstr.h"
 #include "utlvector.h"
 #include "tier0/vprof.h"
+#include "tier0/fasttimer.h"
 #include "tier1/tokenset.h"
+#include "mathlib/ssemath.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -1239,6 +1241,77 @@ static void BuildDataRuns( datamap_t *dmap )
 	}
 }
 
+// How the fast error check compares a field, or -1 for field types which are never error checked
+static int GetCompareSpanType( const typedescription_t *td )
+{
+	switch ( td->fieldType )
+	{
+	case FIELD_INTEGER:
+	case FIELD_SHORT:
+	case FIELD_BOOLEAN:
+	case FIELD_CHARACTER:
+	case FIELD_COLOR32:
+		return COMPARESPAN_BITWISE;
+	case FIELD_FLOAT:
+	case FIELD_VECTOR:
+		return COMPARESPAN_FLOAT;
+	case FIELD_STRING:
+	case FIELD_QUATERNION:
+	case FIELD_EHANDLE:
+		return COMPARESPAN_FIELD;
+	default:
+		return -1;
+	}
+}
+
+static void BuildCompareSpans( datamap_t *dmap )
+{
+	for ( int pc = 0; pc < PC_COPYTYPE_COUNT; ++pc )
+	{
+		datamapinfo_t &info = dmap->m_pOptimizedDataMap->m_Info[ pc ];
+		CUtlVector< datacomparespan_t > &vecSpans = info.m_CompareSpans.m_vecSpans;
+
+		Assert( !vecSpans.Count() );
+
+		const flattenedoffsets_t &flat = info.m_Flat;
+		for ( int i = 0; i < flat.m_Flattened.Count(); ++i )
+		{
+			const typedescription_t *td = &flat.m_Flattened[ i ];
+			if ( td->flags & FTYPEDESC_NOERRORCHECK )
+				continue;
+
+			int nType = GetCompareSpanType( td );
+			if ( nType < 0 )
+				continue;
+
+			float flTolerance = ( nType == COMPARESPAN_FLOAT ) ? td->fieldTolerance : 0.0f;
+
+			// Grow the previous span if this field follows on from it in both the normal and packed layouts
+			if ( nType != COMPARESPAN_FIELD && vecSpans.Count() )
+			{
+				datacomparespan_t &last = vecSpans.Tail();
+				if ( last.m_nType == nType &&
+					last.m_flTolerance == flTolerance &&
+					last.m_nStartOffset[ TD_OFFSET_NORMAL ] + last.m_nLength == td->flatOffset[ TD_OFFSET_NORMAL ] &&
+					last.m_nStartOffset[ TD_OFFSET_PACKED ] + last.m_nLength == td->flatOffset[ TD_OFFSET_PACKED ] )
+				{
+					last.m_nLength += td->fieldSizeInBytes;
+					continue;
+				}
+			}
+
+			datacomparespan_t span;
+			span.m_nStartOffset[ TD_OFFSET_NORMAL ] = td->flatOffset[ TD_OFFSET_NORMAL ];
+			span.m_nStartOffset[ TD_OFFSET_PACKED ] = td->flatOffset[ TD_OFFSET_PACKED ];
+			span.m_nLength = td->fieldSizeInBytes;
+			span.m_nType = nType;
+			span.m_flTolerance = flTolerance;
+			span.m_nFlatField = i;
+			vecSpans.AddToTail( span );
+		}
+	}
+}
+
 static void BuildFlattenedChains( datamap_t *dmap )
 {
 	if ( dmap->m_pOptimizedDataMap )
@@ -1287,6 +1360,7 @@ static void BuildFlattenedChains( datamap_t *dmap )
 	}
 
 	BuildDataRuns( dmap );
+	BuildCompareSpans( dmap );
 }
 
 const tokenset_t< int > s_PredCopyType[] =
@@ -1319,6 +1393,18 @@ static void DescribeRuns( const datamap_t *dmap, int nPredictionCopyType, int pa
 			flat->m_Flattened[ run->m_nStartFlatField ].fieldName,
 			flat->m_Flattened[ run->m_nEndFlatField ].fieldName );
 	}
+
+	static const char *s_pCompareSpanTypes[] = { "bitwise", "float", "field" };
+	const datacomparespans_t &spans = dmap->m_pOptimizedDataMap->m_Info[ nPredictionCopyType ].m_CompareSpans;
+	Msg( "   Compare spans for copy type: %s, packing: %s\n", s_PredCopyType->GetNameByToken( nPredictionCopyType ), s_PredPackType->GetNameByToken( packType ) );
+	for ( int i = 0; i < spans.m_vecSpans.Count(); ++i )
+	{
+		const datacomparespan_t *span = &spans.m_vecSpans[ i ];
+		Msg( "     %5d:  %5d -> %5d (%5d bytes): %-7s tolerance %f from %s\n",
+			i, span->m_nStartOffset[ packType ], span->m_nStartOffset[ packType ] + span->m_nLength, span->m_nLength,
+			s_pCompareSpanTypes[ span->m_nType ], span->m_flTolerance,
+			flat->m_Flattened[ span->m_nFlatField ].fieldName );
+	}
 }
 
 static void DescribeFlattenedList( const datamap_t *dmap, int nPredictionCopyType, int packType )
@@ -1500,6 +1586,89 @@ void CPredictionCopy::ErrorCheckFlatFields_NoSpew( const datamap_t *pCurrentMap,
 	}
 }
 
+// Same result as CompareField over a run of FIELD_FLOAT/FIELD_VECTOR data, four floats at a time
+static FORCEINLINE bool FloatSpanDiffers( const float *pOutput, const float *pInput, int nCount, float flTolerance )
+{
+	int i = 0;
+	if ( flTolerance > 0.0f )
+	{
+		fltx4 tolerance = ReplicateX4( flTolerance );
+		for ( ; i + 4 <= nCount; i += 4 )
+		{
+			// NaNs fail the bounds test, just like they fail fabs( delta ) <= tolerance
+			fltx4 delta = SubSIMD( LoadUnalignedSIMD( pOutput + i ), LoadUnalignedSIMD( pInput + i ) );
+			if ( TestSignSIMD( CmpInBoundsSIMD( delta, tolerance ) ) != 0xf )
+				return true;
+		}
+		for ( ; i < nCount; ++i )
+		{
+			if ( !( fabs( pOutput[ i ] - pInput[ i ] ) <= flTolerance ) )
+				return true;
+		}
+	}
+	else
+	{
+		for ( ; i + 4 <= nCount; i += 4 )
+		{
+			if ( !IsAllEqual( LoadUnalignedSIMD( pOutput + i ), LoadUnalignedSIMD( pInput + i ) ) )
+				return true;
+		}
+		for ( ; i < nCount; ++i )
+		{
+			if ( pOutput[ i ] != pInput[ i ] )
+				return true;
+		}
+	}
+	return false;
+}
+
+void CPredictionCopy::ErrorCheckFlatFields_NoSpewUsingSpans( const datamap_t *pCurrentMap, int nPredictionCopyType )
+{
+	const datamapinfo_t &info = pCurrentMap->m_pOptimizedDataMap->m_Info[ nPredictionCopyType ];
+	const datacomparespans_t &spans = info.m_CompareSpans;
+
+	const byte * RESTRICT pDest = (const byte * RESTRICT)m_pDest;
+	const byte * RESTRICT pSrc = (const byte * RESTRICT)m_pSrc;
+
+	const byte *pOutputData;
+	const byte *pInputData;
+
+	PREFETCH360( pSrc, 0 );
+	PREFETCH360( pDest, 0 );
+
+	int c = spans.m_vecSpans.Count();
+	for ( int i = 0; i < c && !m_nErrorCount; ++i )
+	{
+		const datacomparespan_t * RESTRICT span = &spans.m_vecSpans[ i ];
+		pOutputData = pDest + span->m_nStartOffset[ m_nDestOffsetIndex ];
+		pInputData = pSrc + span->m_nStartOffset[ m_nSrcOffsetIndex ];
+
+		switch ( span->m_nType )
+		{
+		case COMPARESPAN_BITWISE:
+			if ( Q_memcmp( pOutputData, pInputData, span->m_nLength ) )
+			{
+				++m_nErrorCount;
+			}
+			break;
+		case COMPARESPAN_FLOAT:
+			if ( FloatSpanDiffers( (const float *)pOutputData, (const float *)pInputData, span->m_nLength / sizeof( float ), span->m_flTolerance ) )
+			{
+				++m_nErrorCount;
+			}
+			break;
+		default:
+			{
+				const typedescription_t *pField = &info.m_Flat.m_Flattened[ span->m_nFlatField ];
+				int fieldSize = pField->fieldSize;
+				int nFieldType = pField->fieldType;
+				PREDICTIONCOPY_APPLY( ProcessField_Compare_NoSpew, nFieldType, pCurrentMap, pField, pOutputData, pInputData, fieldSize );
+			}
+			break;
+		}
+	}
+}
+
 void CPredictionCopy::ErrorCheckFlatFields_Spew( const datamap_t *pCurrentMap, int nPredictionCopyType )
 {
 	int				i;
@@ -1606,54 +1775,46 @@ FORCEINLINE int ComputeTypeMask( int nType )
 	return nType + 1;
 }
 
-#if 0 // Enable this for perf testing
-static ConVar cl_predictioncopy_runs( "cl_predictioncopy_runs", "1" );
-static ConVar cl_predictioncopy_repeats( "cl_predictioncopy_repeats", "1" );
-void CPredictionCopy::TransferDataCopyOnly( datamap_t *dmap )
-{
-	int repeat = cl_predictioncopy_repeats.GetInt();
-	for ( int k = 0; k < repeat; ++k )
-	{
-		int types = ComputeTypeMask( m_nType );
-		for ( int i = 0; i < PC_COPYTYPE_COUNT; ++i )
-		{
-			if ( types & (1<<i) )
-			{
-				if ( !cl_predictioncopy_runs.GetBool() )
-				{
-					CopyFlatFields( dmap, i );
-				}
-				else
-				{	
-					CopyFlatFieldsUsingRuns( dmap, i );
-				}
-			}
-		}
-	}
-}
-#else
+static ConVar cl_predictioncopy_runs( "cl_predictioncopy_runs", "1", FCVAR_DEVELOPMENTONLY, "Copy prediction data using the precomputed memcpy runs instead of field by field." );
+static ConVar cl_predictioncopy_spans( "cl_predictioncopy_spans", "1", FCVAR_DEVELOPMENTONLY, "Error check prediction data using the precomputed compare spans instead of field by field." );
+
 void CPredictionCopy::TransferDataCopyOnly( const datamap_t *dmap )
 {
+	bool bUseRuns = cl_predictioncopy_runs.GetBool();
 	int types = ComputeTypeMask( m_nType );
 	for ( int i = 0; i < PC_COPYTYPE_COUNT; ++i )
 	{
 		if ( types & (1<<i) )
 		{
-			CopyFlatFieldsUsingRuns( dmap, i );
+			if ( bUseRuns )
+			{
+				CopyFlatFieldsUsingRuns( dmap, i );
+			}
+			else
+			{
+				CopyFlatFields( dmap, i );
+			}
 		}
 	}
 }
-#endif
 
 // Stop at first error
 void CPredictionCopy::TransferDataErrorCheckNoSpew( char const *pchOperation, const datamap_t *dmap )
 {
+	bool bUseSpans = cl_predictioncopy_spans.GetBool();
 	int types = ComputeTypeMask( m_nType );
 	for ( int i = 0; i < PC_COPYTYPE_COUNT && !m_nErrorCount; ++i )
 	{
 		if ( types & (1<<i) )
 		{
-			ErrorCheckFlatFields_NoSpew( dmap, i );
+			if ( bUseSpans )
+			{
+				ErrorCheckFlatFields_NoSpewUsingSpans( dmap, i );
+			}
+			else
+			{
+				ErrorCheckFlatFields_NoSpew( dmap, i );
+			}
 		}
 	}
 }
@@ -1729,6 +1890,93 @@ int CPredictionCopy::TransferData( const char *operation, int entindex, datamap_
 	return m_nErrorCount;
 }
 
+static void BenchPredictionCopy( datamap_t *dmap, byte *pDest, const byte *pSrc, int nIterations, double &flCopyUsec, double &flCompareUsec, int &nErrors )
+{
+	CFastTimer timer;
+	timer.Start();
+	for ( int i = 0; i < nIterations; ++i )
+	{
+		CPredictionCopy copyHelper( PC_EVERYTHING, pDest, TD_OFFSET_PACKED, pSrc, TD_OFFSET_PACKED, CPredictionCopy::TRANSFERDATA_COPYONLY );
+		copyHelper.TransferData( "", -1, dmap );
+	}
+	timer.End();
+	flCopyUsec = timer.GetDuration().GetMicrosecondsF() / nIterations;
+
+	// Both frames are identical now, so every error check walks the whole datamap
+	nErrors = 0;
+	timer.Start();
+	for ( int i = 0; i < nIterations; ++i )
+	{
+		CPredictionCopy errorCheckHelper( PC_NETWORKED_ONLY, pDest, TD_OFFSET_PACKED, pSrc, TD_OFFSET_PACKED, CPredictionCopy::TRANSFERDATA_ERRORCHECK_NOSPEW );
+		nErrors += errorCheckHelper.TransferData( "", -1, dmap );
+	}
+	timer.End();
+	flCompareUsec = timer.GetDuration().GetMicrosecondsF() / nIterations;
+}
+
+CON_COMMAND( cl_predictioncopy_bench, "Times copying and error checking the local player's prediction data field by field and with runs/spans" )
+{
+	int nIterations = ( args.ArgC() > 1 ) ? MAX( Q_atoi( args[ 1 ] ), 1 ) : 10000;
+
+	C_BasePlayer *pPlayer = C_BasePlayer::GetLocalPlayer();
+	if ( !pPlayer )
+	{
+		Msg( "cl_predictioncopy_bench:  no local player\n" );
+		return;
+	}
+
+	datamap_t *dmap = pPlayer->GetPredDescMap();
+	if ( !dmap )
+	{
+		return;
+	}
+	CPredictionCopy::PrepareDataMap( dmap );
+
+	// Work on two packed copies of the player, like the predicted frames do
+	int nPackedSize = dmap->m_nPackedSize;
+	byte *pFrames = new byte[ 2 * nPackedSize ];
+	{
+		CPredictionCopy copyHelper( PC_EVERYTHING, pFrames, TD_OFFSET_PACKED, (const byte *)pPlayer, TD_OFFSET_NORMAL, CPredictionCopy::TRANSFERDATA_COPYONLY );
+		copyHelper.TransferData( "", -1, dmap );
+	}
+
+	bool bOldRuns = cl_predictioncopy_runs.GetBool();
+	bool bOldSpans = cl_predictioncopy_spans.GetBool();
+
+	double flCopyUsec[ 2 ], flCompareUsec[ 2 ];
+	int nErrors[ 2 ];
+	for ( int nPlan = 0; nPlan < 2; ++nPlan )
+	{
+		cl_predictioncopy_runs.SetValue( nPlan );
+		cl_predictioncopy_spans.SetValue( nPlan );
+		BenchPredictionCopy( dmap, pFrames + nPackedSize, pFrames, nIterations, flCopyUsec[ nPlan ], flCompareUsec[ nPlan ], nErrors[ nPlan ] );
+	}
+
+	cl_predictioncopy_runs.SetValue( bOldRuns );
+	cl_predictioncopy_spans.SetValue( bOldSpans );
+	delete[] pFrames;
+
+	int nFields = 0, nRuns = 0, nSpans = 0;
+	for ( int i = 0; i < PC_COPYTYPE_COUNT; ++i )
+	{
+		const datamapinfo_t &info = dmap->m_pOptimizedDataMap->m_Info[ i ];
+		nFields += info.m_Flat.m_Flattened.Count();
+		nRuns += info.m_CopyRuns.m_vecRuns.Count();
+		nSpans += info.m_CompareSpans.m_vecSpans.Count();
+	}
+
+	Msg( "%s: %d bytes packed, %d fields, %d copy runs, %d compare spans, %d iterations\n",
+		dmap->dataClassName, nPackedSize, nFields, nRuns, nSpans, nIterations );
+	Msg( "  copy:     %8.3f usec per field, %8.3f usec with runs  (%.2fx)\n",
+		flCopyUsec[ 0 ], flCopyUsec[ 1 ], flCopyUsec[ 0 ] / MAX( flCopyUsec[ 1 ], 0.001 ) );
+	Msg( "  compare:  %8.3f usec per field, %8.3f usec with spans (%.2fx)\n",
+		flCompareUsec[ 0 ], flCompareUsec[ 1 ], flCompareUsec[ 0 ] / MAX( flCompareUsec[ 1 ], 0.001 ) );
+	if ( nErrors[ 0 ] || nErrors[ 1 ] )
+	{
+		Warning( "  compare found %d errors per field and %d with spans on identical data!\n", nErrors[ 0 ], nErrors[ 1 ] );
+	}
+}
+
 #endif
 
 
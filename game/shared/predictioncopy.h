@@ -42,6 +42,7 @@ typedef void ( *FN_FIELD_COMPARE )( const char *classname, const char *fieldname
 //  one for PC_NETWORKED_DATA and one for PC_NON_NETWORKED_ONLY (optimized_datamap_t::datamapinfo_t::flattenedoffsets_t)
 // Each flattened array is sorted by offset for better cache performance
 // Finally, contiguous "runs" off offsets are precomputed (optimized_datamap_t::datamapinfo_t::datacopyruns_t) for fast copy operations
+// and contiguous "spans" of error checked fields (optimized_datamap_t::datamapinfo_t::datacomparespans_t) for fast compares
 
 // A data run is a set of DEFINE_PRED_FIELD fields in a c++ object which are contiguous and can be processing
 //  using a single memcpy operation
@@ -78,6 +79,30 @@ public:
 	CUtlVector< datarun_t > m_vecRuns;
 };
 
+// A compare span is a set of error checked DEFINE_PRED_FIELD fields which are contiguous in both the unpacked
+//  and packed data and can be compared in one go, either bytewise or as a block of floats sharing a tolerance
+enum
+{
+	COMPARESPAN_BITWISE = 0,	// ints, shorts, bools, chars and color32s, compared with a memcmp
+	COMPARESPAN_FLOAT,			// floats and vectors, compared four at a time against m_flTolerance
+	COMPARESPAN_FIELD,			// strings, quaternions and handles, a single field compared through CompareField
+};
+
+struct datacomparespan_t
+{
+	int		m_nStartOffset[ TD_OFFSET_COUNT ];
+	int		m_nLength;			// in bytes
+	int		m_nType;
+	float	m_flTolerance;
+	int		m_nFlatField;		// Index of the first field in the flattened typedescription_t list
+};
+
+struct datacomparespans_t
+{
+public:
+	CUtlVector< datacomparespan_t > m_vecSpans;
+};
+
 struct flattenedoffsets_t
 {
 	CUtlVector< typedescription_t >	m_Flattened;
@@ -91,6 +116,7 @@ struct datamapinfo_t
 	//  and FTYPEDESC_OVERRIDE (overridden) fields removed
 	flattenedoffsets_t	m_Flat;
 	datacopyruns_t		m_CopyRuns;
+	datacomparespans_t	m_CompareSpans;
 };
 
 struct optimized_datamap_t
@@ -145,6 +171,7 @@ private:
 
 	// Helper for TransferDataErrorCheckNoSpew
 	void	ErrorCheckFlatFields_NoSpew( const datamap_t *pCurrentMap, int nPredictionCopyType );
+	void	ErrorCheckFlatFields_NoSpewUsingSpans( const datamap_t *pCurrentMap, int nPredictionCopyType );
 	template< class T >
 	FORCEINLINE void ProcessField_Compare_NoSpew( const datamap_t *pCurrentMap, const typedescription_t *pField, const T *pOutputData, const T *pInputData, int fieldSize );
 
@@ -17,6 +17,8 @@
 
 #include "bitmap/imageformat_declarations.h"
 
+class IThreadPool;
+
 
 //-----------------------------------------------------------------------------
 // Color structures
@@ -465,6 +467,13 @@ namespace ImageLoader
 							 unsigned char *dst, enum ImageFormat dstImageFormat, 
 							 int width, int height, int srcStride = 0, int dstStride = 0 );
 
+	// Thread pool to block compress and decompress large images on, NULL to use the calling thread only
+	void SetThreadPool( IThreadPool *pPool );
+
+	// Checks the DXT block decoders against the per-pixel ones and prints decode
+	// and runtime encode throughput for an image of nMegaPixels. False on a mismatch.
+	bool BenchmarkDXT( int nMegaPixels );
+
 	// must be used in conjunction with ConvertImageFormat() to pre-swap and post-swap
 	void PreConvertSwapImageData( unsigned char *pImageData, int nImageSize, ImageFormat imageFormat, VtfConsoleFormatType_t targetConsole, int width = 0, int stride = 0 );
 	void PostConvertSwapImageData( unsigned char *pImageData, int nImageSize, ImageFormat imageFormat, VtfConsoleFormatType_t targetConsole, int width = 0, int stride = 0 );
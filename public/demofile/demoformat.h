@@ -15,7 +15,10 @@
 #include "tier0/platform.h"
 
 #define DEMO_HEADER_ID		"HL2DEMO"
-#define DEMO_PROTOCOL		4
+#define DEMO_PROTOCOL		5
+
+// First demo protocol whose string tables may be created with NSF_PREFIX_HISTORY
+#define DEMO_PROTOCOL_PREFIX_HISTORY	5
 
 #if !defined( MAX_OSPATH )
 #define	MAX_OSPATH		260			// max length of a filesystem pathname
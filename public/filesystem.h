@@ -956,6 +956,11 @@ public:
 
 	virtual void			GetVPKFileStatisticsKV( KeyValues *pKV ) = 0;
 
+	// Returns all of an open file's bytes in place, or NULL if the file must be read.
+	// Only files in memory mapped VPKs (-vpkmmap) can do this. The view is read-only
+	// and stays valid until the file is closed.
+	virtual const void		*GetReadOnlyFileView( FileHandle_t file, unsigned int *pnSize ) = 0;
+
 };
 
 //-----------------------------------------------------------------------------
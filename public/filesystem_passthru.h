@@ -291,6 +291,7 @@ public:
 	virtual bool			CheckVPKFileHash( int PackFileID, int nPackFileNumber, int nFileFraction, MD5Value_t &md5Value )
 		{ return m_pFileSystemPassThru->CheckVPKFileHash( PackFileID, nPackFileNumber, nFileFraction, md5Value ); }
 	virtual void GetVPKFileStatisticsKV( KeyValues *pKV )												{ m_pFileSystemPassThru->GetVPKFileStatisticsKV( pKV ); }
+	virtual const void		*GetReadOnlyFileView( FileHandle_t file, unsigned int *pnSize )		{ return m_pFileSystemPassThru->GetReadOnlyFileView( file, pnSize ); }
 
 protected:
 	IFileSystem *m_pFileSystemPassThru;
@@ -106,6 +106,9 @@ public:
 	// NOTE: The leaflist trace will NOT check this.  Traces are intersected
 	// against the culled volume exclusively.
 	virtual bool CanTraceRay( const Ray_t &ray ) = 0;
+	// Re-gathers the entities in the current volume. Brushes, displacements and
+	// static props gathered by SetupLeafAndEntityList* are kept as they are.
+	virtual void RefreshEntityList() = 0;
 };
 #endif // GAMETRACE_H
 
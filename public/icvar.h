@@ -168,6 +168,11 @@ protected:
 
 	virtual ICVarIteratorInternal	*FactoryInternalIterator( void ) = 0;
 	friend class Iterator;
+
+public:
+	// Changes whenever a command or convar is registered or unregistered, so a
+	// pointer found by name can be kept until the generation moves on
+	virtual int				GetRegistrationGeneration() const = 0;
 };
 
 inline ICvar::Iterator::Iterator(ICvar *icvar)
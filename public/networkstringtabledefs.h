@@ -62,6 +62,7 @@ enum ENetworkStringtableFlags
 {
 	NSF_NONE = 0,
 	NSF_DICTIONARY_ENABLED  = (1<<0), // Uses pre-calculated per map dictionaries to reduce bandwidth
+	NSF_PREFIX_HISTORY		= (1<<1), // Strings are prefix coded against every lower indexed string in the table plus a shared prefix dictionary, rather than the last 32 sent
 };
 
 class INetworkStringTableContainer
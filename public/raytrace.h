@@ -313,7 +313,8 @@ public:
 										const Vector &color);
 
 
-	// SetupAccelerationStructure to prepare for tracing
+	// SetupAccelerationStructure to prepare for tracing. Large triangle counts are built
+	// on all cores.
 	void SetupAccelerationStructure(void);
 
 	// lowest level intersection routine - fire 4 rays through the scene. all 4 rays must pass the
@@ -370,14 +371,6 @@ public:
 	int MakeLeafNode(int first_tri, int last_tri);
 
 
-	float CalculateCostsOfSplit(
-		int split_plane,int32 const *tri_list,int ntris,
-		Vector MinBound,Vector MaxBound, float &split_value,
-		int &nleft, int &nright, int &nboth);
-		
-	void RefineNode(int node_number,int32 const *tri_list,int ntris,
-						 Vector MinBound,Vector MaxBound, int depth);
-	
 	void CalculateTriangleListBounds(int32 const *tris,int ntris,
 									 Vector &minout, Vector &maxout);
 
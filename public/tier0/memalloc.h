@@ -103,6 +103,10 @@ PLATFORM_INTERFACE void RemoveMemoryInfoCallback( IMemoryInfo* pMemoryInfo );
 // Display the memory statistics from the callbacks controlled by the above functions.
 PLATFORM_INTERFACE void DumpMemoryInfoStats();
 
+// Checks cross-thread frees, batching, thread cache draining and compaction of the small block heap on a
+// private heap. Returns true when they pass, or when this build has no small block heap thread caches.
+PLATFORM_INTERFACE bool RunSmallBlockHeapTests();
+
 //-----------------------------------------------------------------------------
 // NOTE! This should never be called directly from leaf code
 // Just use new,delete,malloc,free etc. They will call into this eventually
@@ -53,6 +53,8 @@ public:
 	// Used to iterate over all commands appropriate for the current time
 	void BeginProcessingCommands( int nDeltaTicks );
 	bool DequeueNextCommand( /*out*/ CCommand* pCommand );
+	// Same, but hands back the untokenized text; it stays valid until the next AddText
+	bool DequeueNextCommandText( /*out*/ const char **ppCommandText, /*out*/ cmd_source_t *pSource );
 	void EndProcessingCommands();
 
 	// Are we in the middle of processing commands?
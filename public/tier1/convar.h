@@ -288,6 +288,12 @@ public:
 	static int MaxCommandLength();
 	static characterset_t* DefaultBreakSet();
 
+	// Compact copy of the tokenized command, for callers that run the same
+	// lines over and over and want to skip re-tokenizing them
+	int GetTokenizedSize() const;
+	void SaveTokenized( void *pDest ) const;
+	void RestoreTokenized( const void *pSrc, cmd_source_t source );
+
 private:
 	enum
 	{
@@ -0,0 +1,319 @@
+//===== Copyright  1996-2005, Valve Corporation, All rights reserved. ======//
+//
+// Purpose: Per-thread frame arenas for allocations that die within a frame
+//
+// FrameAlloc() hands out memory from a CMemoryStack owned by the calling
+// thread. Nothing is freed individually; the whole arena is recycled once
+// the owning module calls FrameMemory_EndFrame(), so nothing allocated from
+// it may be kept past the end of the frame it was allocated in.
+//
+//===========================================================================//
+
+#ifndef FRAMEMEMORY_H
+#define FRAMEMEMORY_H
+
+#if defined( _WIN32 )
+#pragma once
+#endif
+
+#include "tier0/threadtools.h"
+#include "tier1/utlvector.h"
+
+
+//-----------------------------------------------------------------------------
+// Allocation counters, to find which per-tick allocation sites are hottest.
+// Declare one at file scope with DEFINE_FRAME_ALLOC_COUNTER and count
+// through it with COUNT_FRAME_ALLOC, around heap allocations as well as
+// frame allocations. FrameMemory_PrintStats lists them by allocations/frame.
+//-----------------------------------------------------------------------------
+class CFrameAllocCounter
+{
+public:
+	CFrameAllocCounter( const char *pszName );
+
+	void Count( int nBytes )					{ ++m_nAllocs; m_nBytes += nBytes; }
+
+	const char *GetName() const					{ return m_pszName; }
+	int GetLastFrameAllocs() const				{ return m_nLastFrameAllocs; }
+	int GetLastFrameBytes() const				{ return m_nLastFrameBytes; }
+	int GetPeakFrameAllocs() const				{ return m_nPeakFrameAllocs; }
+	int64 GetTotalAllocs() const				{ return m_nTotalAllocs; }
+
+	static CFrameAllocCounter *GetFirst()		{ return s_pFirst; }
+	CFrameAllocCounter *GetNext() const			{ return m_pNext; }
+
+private:
+	friend void FrameMemory_EndFrame();
+	void EndFrame();
+
+	const char *m_pszName;
+	CInterlockedInt m_nAllocs;
+	CInterlockedInt m_nBytes;
+	int m_nLastFrameAllocs;
+	int m_nLastFrameBytes;
+	int m_nPeakFrameAllocs;
+	int64 m_nTotalAllocs;
+
+	CFrameAllocCounter *m_pNext;
+	static CFrameAllocCounter *s_pFirst;
+};
+
+#define DEFINE_FRAME_ALLOC_COUNTER( name )		static CFrameAllocCounter g_FrameAllocCounter_##name( #name )
+#define COUNT_FRAME_ALLOC( name, nBytes )		g_FrameAllocCounter_##name.Count( nBytes )
+#define FRAME_ALLOC_COUNTER( name )				( &g_FrameAllocCounter_##name )
+
+
+//-----------------------------------------------------------------------------
+// Frame arena entry points
+//-----------------------------------------------------------------------------
+
+// Returns 16 byte aligned memory valid until the end of the current frame.
+// Falls back to the heap (still released at the end of the frame) once the
+// calling thread's arena is full.
+void *FrameAlloc( size_t nBytes, CFrameAllocCounter *pCounter = NULL );
+
+// Ends the current frame. Call once per frame from the main thread, when no
+// jobs that use frame memory are in flight. Arenas are recycled lazily by the
+// thread that owns them, on its first allocation of the next frame.
+void FrameMemory_EndFrame();
+
+// Incremented by every FrameMemory_EndFrame
+int FrameMemory_GetFrame();
+
+// Spews the arena usage and the allocation counters
+void FrameMemory_PrintStats( int nMaxCounters = 20 );
+
+
+//-----------------------------------------------------------------------------
+// The CUtlMemoryFrame class:
+// Growable memory from the frame arena. Growing copies into a new block and
+// abandons the old one to the arena, which is fine for the small, short
+// lived arrays this is meant for.
+//-----------------------------------------------------------------------------
+template< class T >
+class CUtlMemoryFrame
+{
+public:
+	// constructor, destructor
+	CUtlMemoryFrame( int nGrowSize = 0, int nInitSize = 0 ) : m_pMemory( NULL ), m_nAllocationCount( 0 ), m_nGrowSize( nGrowSize ), m_nFrame( FrameMemory_GetFrame() ), m_pCounter( NULL )
+	{
+		if ( nInitSize )
+		{
+			EnsureCapacity( nInitSize );
+		}
+	}
+	CUtlMemoryFrame( T* pMemory, int numElements )			{ Assert( 0 ); }
+
+	// Can we use this index?
+	bool IsIdxValid( int i ) const							{ return ( i >= 0 ) && ( i < m_nAllocationCount ); }
+	static int InvalidIndex()								{ return -1; }
+
+	// Gets the base address
+	T* Base()												{ AssertFrame(); return m_pMemory; }
+	const T* Base() const									{ AssertFrame(); return m_pMemory; }
+
+	// element access
+	T& operator[]( int i )									{ Assert( IsIdxValid(i) ); return Base()[i];	}
+	const T& operator[]( int i ) const						{ Assert( IsIdxValid(i) ); return Base()[i];	}
+	T& Element( int i )										{ Assert( IsIdxValid(i) ); return Base()[i];	}
+	const T& Element( int i ) const							{ Assert( IsIdxValid(i) ); return Base()[i];	}
+
+	// Attaches the buffer to external memory....
+	void SetExternalBuffer( T* pMemory, int numElements )	{ Assert( 0 ); }
+
+	// Size
+	int NumAllocated() const								{ return m_nAllocationCount; }
+	int Count() const										{ return m_nAllocationCount; }
+
+	// Grows the memory, so that at least allocated + num elements are allocated
+	void Grow( int num = 1 )
+	{
+		Assert( num > 0 );
+		int nAllocationRequested = m_nAllocationCount + num;
+		Reallocate( UtlMemory_CalcNewAllocationCount( m_nAllocationCount, m_nGrowSize, nAllocationRequested, sizeof(T) ) );
+	}
+
+	// Makes sure we've got at least this much memory
+	void EnsureCapacity( int num )
+	{
+		if ( m_nAllocationCount < num )
+		{
+			Reallocate( num );
+		}
+	}
+
+	// Memory deallocation; the arena takes the memory back at the end of the frame
+	void Purge()											{ m_pMemory = NULL; m_nAllocationCount = 0; }
+	void Purge( int numElements )							{ Assert( numElements >= 0 && numElements <= m_nAllocationCount ); }
+
+	void Swap( CUtlMemoryFrame< T > &mem )
+	{
+		V_swap( m_pMemory, mem.m_pMemory );
+		V_swap( m_nAllocationCount, mem.m_nAllocationCount );
+		V_swap( m_nGrowSize, mem.m_nGrowSize );
+		V_swap( m_nFrame, mem.m_nFrame );
+		V_swap( m_pCounter, mem.m_pCounter );
+	}
+
+	// is the memory externally allocated?
+	bool IsExternallyAllocated() const						{ return false; }
+
+	// Set the size by which the memory grows
+	void SetGrowSize( int size )							{ Assert( size >= 0 ); m_nGrowSize = size; }
+
+	// Counts every block this memory takes from the arena against pCounter
+	void SetAllocCounter( CFrameAllocCounter *pCounter )	{ m_pCounter = pCounter; }
+
+private:
+	void Reallocate( int nNewAllocationCount )
+	{
+		AssertFrame();
+		T *pNewMemory = (T*)FrameAlloc( nNewAllocationCount * sizeof(T), m_pCounter );
+		if ( m_nAllocationCount )
+		{
+			memcpy( pNewMemory, m_pMemory, m_nAllocationCount * sizeof(T) );
+		}
+		m_pMemory = pNewMemory;
+		m_nAllocationCount = nNewAllocationCount;
+		m_nFrame = FrameMemory_GetFrame();
+	}
+
+	// Frame memory that outlives its frame points into a recycled arena
+	void AssertFrame() const								{ AssertMsg( !m_pMemory || m_nFrame == FrameMemory_GetFrame(), "Frame memory used after the end of its frame\n" ); }
+
+	T *m_pMemory;
+	int m_nAllocationCount;
+	int m_nGrowSize;
+	int m_nFrame;
+	CFrameAllocCounter *m_pCounter;
+};
+
+
+//-----------------------------------------------------------------------------
+// The CUtlMemoryFixedGrowableFrame class:
+// SIZE elements of inline storage that spill into the frame arena instead of
+// the heap. Purge goes back to the inline storage, so an object that purges
+// before every refill can outlive the frame; only spilled contents can't.
+//-----------------------------------------------------------------------------
+template< class T, size_t SIZE >
+class CUtlMemoryFixedGrowableFrame
+{
+public:
+	// constructor, destructor
+	CUtlMemoryFixedGrowableFrame( int nGrowSize = 0, int nInitSize = SIZE ) : m_pMemory( m_FixedMemory ), m_nAllocationCount( SIZE ), m_nGrowSize( nGrowSize ), m_nFrame( 0 ), m_pCounter( NULL )
+	{
+		Assert( nInitSize == 0 || nInitSize == SIZE );
+	}
+	CUtlMemoryFixedGrowableFrame( T* pMemory, int numElements )	{ Assert( 0 ); }
+
+	// Can we use this index?
+	bool IsIdxValid( int i ) const							{ return ( i >= 0 ) && ( i < m_nAllocationCount ); }
+	static int InvalidIndex()								{ return -1; }
+
+	// Gets the base address
+	T* Base()												{ AssertFrame(); return m_pMemory; }
+	const T* Base() const									{ AssertFrame(); return m_pMemory; }
+
+	// element access
+	T& operator[]( int i )									{ Assert( IsIdxValid(i) ); return Base()[i];	}
+	const T& operator[]( int i ) const						{ Assert( IsIdxValid(i) ); return Base()[i];	}
+	T& Element( int i )										{ Assert( IsIdxValid(i) ); return Base()[i];	}
+	const T& Element( int i ) const							{ Assert( IsIdxValid(i) ); return Base()[i];	}
+
+	// Attaches the buffer to external memory....
+	void SetExternalBuffer( T* pMemory, int numElements )	{ Assert( 0 ); }
+
+	// Size
+	int NumAllocated() const								{ return m_nAllocationCount; }
+	int Count() const										{ return m_nAllocationCount; }
+
+	// Grows the memory, so that at least allocated + num elements are allocated
+	void Grow( int num = 1 )
+	{
+		Assert( num > 0 );
+		int nAllocationRequested = m_nAllocationCount + num;
+		Reallocate( UtlMemory_CalcNewAllocationCount( m_nAllocationCount, m_nGrowSize, nAllocationRequested, sizeof(T) ) );
+	}
+
+	// Makes sure we've got at least this much memory
+	void EnsureCapacity( int num )
+	{
+		if ( m_nAllocationCount < num )
+		{
+			Reallocate( num );
+		}
+	}
+
+	// Memory deallocation; a spilled block goes back to the arena at the end of the frame
+	void Purge()											{ m_pMemory = m_FixedMemory; m_nAllocationCount = SIZE; }
+	void Purge( int numElements )							{ Assert( numElements >= 0 && numElements <= m_nAllocationCount ); }
+
+	// is the memory externally allocated?
+	bool IsExternallyAllocated() const						{ return false; }
+
+	// Set the size by which the memory grows
+	void SetGrowSize( int size )							{ Assert( size >= 0 ); m_nGrowSize = size; }
+
+	// Counts every block this memory takes from the arena against pCounter
+	void SetAllocCounter( CFrameAllocCounter *pCounter )	{ m_pCounter = pCounter; }
+
+	// True when the contents spilled into the arena in a frame that has since ended
+	bool IsStale() const									{ return m_pMemory != m_FixedMemory && m_nFrame != FrameMemory_GetFrame(); }
+
+private:
+	void Reallocate( int nNewAllocationCount )
+	{
+		AssertFrame();
+		T *pNewMemory = (T*)FrameAlloc( nNewAllocationCount * sizeof(T), m_pCounter );
+		memcpy( pNewMemory, m_pMemory, m_nAllocationCount * sizeof(T) );
+		m_pMemory = pNewMemory;
+		m_nAllocationCount = nNewAllocationCount;
+		m_nFrame = FrameMemory_GetFrame();
+	}
+
+	void AssertFrame() const								{ AssertMsg( !IsStale(), "Frame memory used after the end of its frame\n" ); }
+
+	T *m_pMemory;
+	int m_nAllocationCount;
+	int m_nGrowSize;
+	int m_nFrame;
+	CFrameAllocCounter *m_pCounter;
+	T m_FixedMemory[ SIZE ];
+};
+
+
+//-----------------------------------------------------------------------------
+// A vector of per-frame temporaries, for use as a local variable
+//-----------------------------------------------------------------------------
+template< class T >
+class CUtlVectorFrame : public CUtlVector< T, CUtlMemoryFrame< T > >
+{
+	typedef CUtlVector< T, CUtlMemoryFrame< T > > BaseClass;
+
+public:
+	explicit CUtlVectorFrame( int growSize = 0, int initSize = 0 ) : BaseClass( growSize, initSize ) {}
+	explicit CUtlVectorFrame( CFrameAllocCounter *pCounter, int growSize = 0 ) : BaseClass( growSize, 0 )
+	{
+		this->m_Memory.SetAllocCounter( pCounter );
+	}
+};
+
+
+//-----------------------------------------------------------------------------
+// A vector with SIZE elements of inline storage that grows into the frame
+// arena. Purge it before refilling it in a later frame.
+//-----------------------------------------------------------------------------
+template< class T, size_t SIZE >
+class CUtlVectorFixedGrowableFrame : public CUtlVector< T, CUtlMemoryFixedGrowableFrame< T, SIZE > >
+{
+	typedef CUtlVector< T, CUtlMemoryFixedGrowableFrame< T, SIZE > > BaseClass;
+
+public:
+	explicit CUtlVectorFixedGrowableFrame( int growSize = 0 ) : BaseClass( growSize, SIZE ) {}
+
+	void SetAllocCounter( CFrameAllocCounter *pCounter )	{ this->m_Memory.SetAllocCounter( pCounter ); }
+	bool IsStale() const									{ return this->m_Memory.IsStale(); }
+};
+
+
+#endif // FRAMEMEMORY_H
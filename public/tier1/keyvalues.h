@@ -84,6 +84,7 @@ class CKeyValuesGrowableStringTable;
 class KeyValues
 {
 	friend class CKeyValuesTokenReader;
+	friend class KVPacker;
 
 public:
 	//	By default, the KeyValues class uses a string table for the key names that is
@@ -379,6 +380,13 @@ private:
 
 	bool EvaluateConditional( const char *pExpressionString, GetSymbolProc_t pfnEvaluateSymbolProc );
 
+	// names from symbols already interned by KeyValuesSystem
+	void SetNameSymbols( int hCaseInsensitiveKeyName, int hCaseSensitiveKeyName );
+
+	// compiled script cache used by LoadFromFile, see -kvcache
+	bool LoadFromCompiledCache( IBaseFileSystem *filesystem, const char *resourceName, const char *pathID, const char *pText, int nTextSize );
+	void SaveToCompiledCache( IBaseFileSystem *filesystem, const char *resourceName, const char *pathID, const char *pText, int nTextSize );
+
 	uint32 m_iKeyName : 24;	// keyname is a symbol defined in KeyValuesSystem
 	uint32 m_iKeyNameCaseSensitive1 : 8;	// 1st part of case sensitive symbol defined in KeyValueSystem
 
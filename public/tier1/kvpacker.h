@@ -13,6 +13,7 @@
 #endif
 
 #include "keyvalues.h"
+#include "tier1/utlmap.h"
 
 //-----------------------------------------------------------------------------
 // Purpose: Handles packing KeyValues binary packing and unpacking in a a
@@ -27,7 +28,18 @@ public:
 	bool WriteAsBinary( KeyValues *pNode, CUtlBuffer &buffer );
 	bool ReadAsBinary( KeyValues *pNode, CUtlBuffer &buffer );
 
+	// The compiled format is for local caches of parsed script files, it is not
+	// shared across branches. Key names are stored once in a table up front and
+	// each one is interned once when read back. Bump k_nCompiledVersion whenever
+	// the compiled format changes.
+	static const int k_nCompiledVersion = 1;
+	bool WriteAsCompiled( KeyValues *pNode, CUtlBuffer &buffer );
+	bool ReadAsCompiled( KeyValues *pNode, CUtlBuffer &buffer );
+
 private:
+	bool WriteCompiledPeers( KeyValues *pNode, CUtlBuffer &buffer, CUtlMap< int, int > &keyIndices, CUtlVector< const char * > &keyNames );
+	bool ReadCompiledPeers( KeyValues *pParent, KeyValues *pNode, CUtlBuffer &buffer, const CUtlVector< int > &keySymbols, const CUtlVector< int > &keySymbolsCaseSensitive, int nStackDepth );
+
 	// These types are used for serialization of KeyValues nodes.
 	// Do not renumber them or you will break serialization across
 	// branches.
@@ -196,59 +196,118 @@ private:
 
 };
 
-class CUtlSymbolTableMT :  public CUtlSymbolTable
+//-----------------------------------------------------------------------------
+// CUtlSymbolTableMT:
+// description:
+//    Thread safe symbol table with the same interface as CUtlSymbolTable.
+//
+//    Strings are hashed into one of NUM_SHARDS open addressing tables. Find
+//    and String never lock: a slot is published only after the string and
+//    the symbol->string entry are written, and a full table is replaced by a
+//    bigger copy rather than rehashed in place (the old one is kept until
+//    RemoveAll so readers still probing it stay valid). AddString only locks
+//    the shard its string hashes to, and only when the string is new.
+//    String pools are append only, so returned strings never move.
+//
+//    RemoveAll must not race with any other call.
+//-----------------------------------------------------------------------------
+class CUtlSymbolTableMT
 {
 public:
-	CUtlSymbolTableMT( int growSize = 0, int initSize = 32, bool caseInsensitive = false )
-		: CUtlSymbolTable( growSize, initSize, caseInsensitive )
+	enum
 	{
-	}
+		NUM_SHARDS = 16,	// a string goes to shard HashString( pString ) % NUM_SHARDS, or HashStringCaseless
+	};
 
-	CUtlSymbol AddString( const char* pString )
-	{
-		m_lock.LockForWrite();
-		CUtlSymbol result = CUtlSymbolTable::AddString( pString );
-		m_lock.UnlockWrite();
-		return result;
-	}
+	CUtlSymbolTableMT( int growSize = 0, int initSize = 32, bool caseInsensitive = false );
+	~CUtlSymbolTableMT();
+
+	// Finds and/or creates a symbol based on the string
+	CUtlSymbol AddString( const char* pString );
 
-	CUtlSymbol Find( const char* pString ) const
+	// Finds the symbol for pString
+	CUtlSymbol Find( const char* pString ) const;
+
+	// Look up the string associated with a particular symbol
+	const char* String( CUtlSymbol id ) const;
+
+	// Lookups no longer lock, so this is the same as String
+	const char * StringNoLock( CUtlSymbol id ) const
 	{
-		m_lock.LockForWrite();
-		CUtlSymbol result = CUtlSymbolTable::Find( pString );
-		m_lock.UnlockWrite();
-		return result;
+		return String( id );
 	}
 
-	const char* String( CUtlSymbol id ) const
+	inline bool HasElement(const char* pStr) const
 	{
-		m_lock.LockForRead();
-		const char *pszResult = CUtlSymbolTable::String( id );
-		m_lock.UnlockRead();
-		return pszResult;
+		return Find(pStr) != UTL_INVAL_SYMBOL;
 	}
 
-	const char * StringNoLock( CUtlSymbol id ) const
+	// Remove all symbols in the table.
+	void  RemoveAll();
+
+	int GetNumStrings( void ) const
 	{
-		return CUtlSymbolTable::String( id );
+		return m_nSymbols;
 	}
 
+	// Kept for callers that bracket a batch of String() calls; lookups are lock free
 	void LockForRead()
 	{
-		m_lock.LockForRead();
 	}
 
 	void UnlockForRead()
 	{
-		m_lock.UnlockRead();
 	}
 
 private:
-#ifdef WIN32
-	mutable CThreadSpinRWLock m_lock;
-#else
-	mutable CThreadRWLock m_lock;
-#endif
+	enum
+	{
+		SYMBOL_BLOCK_BITS = 8,
+		SYMBOL_BLOCK_SIZE = ( 1 << SYMBOL_BLOCK_BITS ),
+		NUM_SYMBOL_BLOCKS = ( UTL_INVAL_SYMBOL + SYMBOL_BLOCK_SIZE ) / SYMBOL_BLOCK_SIZE,
+	};
+
+	struct HashSlot_t
+	{
+		unsigned int			m_nHash;
+		volatile unsigned int	m_nSymbolPlusOne;	// 0 while the slot is free
+	};
+
+	struct HashTable_t
+	{
+		int			m_nMask;		// capacity - 1, capacity is a power of two
+		HashSlot_t	m_Slots[1];
+	};
+
+	struct StringPool_t
+	{
+		int m_TotalLen;
+		int m_SpaceUsed;
+		char m_Data[1];
+	};
+
+	struct Shard_t
+	{
+		CThreadFastMutex				m_Mutex;
+		HashTable_t * volatile			m_pTable;
+		int								m_nCount;
+		CUtlVector<HashTable_t*>		m_RetiredTables;
+		CUtlVector<StringPool_t*>		m_StringPools;
+	};
+
+	unsigned int HashSymbolString( const char *pString ) const;
+	bool StringsMatch( const char *pString1, const char *pString2 ) const;
+	UtlSymId_t FindInTable( const HashTable_t *pTable, unsigned int nHash, const char *pString ) const;
+	void InsertIntoTable( HashTable_t *pTable, unsigned int nHash, UtlSymId_t id );
+	HashTable_t *AllocTable( int nCapacity );
+	const char *CopyString( Shard_t &shard, const char *pString );
+	const char **GetSymbolBlock( int nBlock );
+
+	Shard_t m_Shards[NUM_SHARDS];
+	const char ** volatile m_pSymbolBlocks[NUM_SYMBOL_BLOCKS];	// symbol -> string
+	CInterlockedInt m_nSymbols;
+	int m_nInitialShardCapacity;
+	bool m_bInsensitive;
 };
 
 
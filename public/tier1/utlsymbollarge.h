@@ -181,6 +181,10 @@ class CNonThreadsafeTree : public CUtlRBTree<CUtlSymbolTableLargeBaseTreeEntry_t
 public:
 	typedef CUtlRBTree<CUtlSymbolTableLargeBaseTreeEntry_t *, intp, CTreeEntryLess< CNonThreadsafeTree, CASEINSENSITIVE > > CNonThreadsafeTreeType;
 
+	// Single threaded tables keep all their strings in one pool list and never lock it
+	typedef CThreadNullMutex CPoolMutex;
+	enum { POOL_SHARD_COUNT = 1 };
+
 	CNonThreadsafeTree() : 
 		CNonThreadsafeTreeType( 0, 16 ) 
 	{
@@ -256,6 +260,11 @@ class CThreadsafeTree : public CUtlTSHash< CUtlSymbolTableLargeBaseTreeEntry_t *
 public:
 	typedef CUtlTSHash< CUtlSymbolTableLargeBaseTreeEntry_t *, 2048, CUtlSymbolTableLargeBaseTreeEntry_t *, CCThreadsafeTreeHashMethod< 2048, CUtlSymbolTableLargeBaseTreeEntry_t *, CASEINSENSITIVE > > CThreadsafeTreeType;
 
+	// Lookups of committed strings take no lock and inserts only lock their hash bucket, so string
+	//  copies are spread over several pool lists by hash as well
+	typedef CThreadFastMutex CPoolMutex;
+	enum { POOL_SHARD_COUNT = 16 };
+
 	CThreadsafeTree() : 
 		CThreadsafeTreeType( 32 ) 
 	{
@@ -333,11 +342,16 @@ public:
 	{
 		uint64 unBytesUsed = 0u;
 
-		for ( int i=0; i < m_StringPools.Count(); i++ )
+		for ( int nShard = 0; nShard < TreeType::POOL_SHARD_COUNT; nShard++ )
 		{
-			StringPool_t *pPool = m_StringPools[i];
-
-			unBytesUsed += (uint64)pPool->m_TotalLen;
+			const PoolShard_t &shard = m_PoolShards[ nShard ];
+			AUTO_LOCK( shard.m_Mutex );
+			for ( int i=0; i < shard.m_StringPools.Count(); i++ )
+			{
+				StringPool_t *pPool = shard.m_StringPools[i];
+
+				unBytesUsed += (uint64)pPool->m_TotalLen;
+			}
 		}
 		return unBytesUsed;
 	}
@@ -352,21 +366,26 @@ protected:
 		char m_Data[1];
 	};
 
+	// stores the string data. Pools are append only, so symbols stay valid until RemoveAll
+	struct PoolShard_t
+	{
+		CUtlVector< StringPool_t * > m_StringPools;
+		typename TreeType::CPoolMutex m_Mutex;
+	};
+
 	TreeType m_Lookup;
 
-	// stores the string data
-	CUtlVector< StringPool_t * > m_StringPools;
+	PoolShard_t m_PoolShards[ TreeType::POOL_SHARD_COUNT ];
 
 private:
-	int FindPoolWithSpace( int len ) const;
+	static int FindPoolWithSpace( const CUtlVector< StringPool_t * > &pools, int len );
 };
 
 //-----------------------------------------------------------------------------
 // constructor, destructor
 //-----------------------------------------------------------------------------
 template < class TreeType, bool CASEINSENSITIVE, size_t POOL_SIZE >
-inline CUtlSymbolTableLargeBase<TreeType, CASEINSENSITIVE, POOL_SIZE >::CUtlSymbolTableLargeBase() : 
-	m_StringPools( 8 )
+inline CUtlSymbolTableLargeBase<TreeType, CASEINSENSITIVE, POOL_SIZE >::CUtlSymbolTableLargeBase()
 {
 }
 
@@ -402,11 +421,11 @@ inline CUtlSymbolLarge CUtlSymbolTableLargeBase<TreeType, CASEINSENSITIVE, POOL_
 }
 
 template < class TreeType, bool CASEINSENSITIVE, size_t POOL_SIZE >
-inline int CUtlSymbolTableLargeBase<TreeType, CASEINSENSITIVE, POOL_SIZE>::FindPoolWithSpace( int len )	const
+inline int CUtlSymbolTableLargeBase<TreeType, CASEINSENSITIVE, POOL_SIZE>::FindPoolWithSpace( const CUtlVector< StringPool_t * > &pools, int len )
 {
-	for ( int i=0; i < m_StringPools.Count(); i++ )
+	for ( int i=0; i < pools.Count(); i++ )
 	{
-		StringPool_t *pPool = m_StringPools[i];
+		StringPool_t *pPool = pools[i];
 
 		if ( (pPool->m_TotalLen - pPool->m_SpaceUsed) >= len )
 		{
@@ -439,37 +458,45 @@ inline CUtlSymbolLarge CUtlSymbolTableLargeBase<TreeType, CASEINSENSITIVE, POOL_
 	//COMPILE_TIME_ASSERT(sizeof(LargeSymbolTableHashDecoration_t) == sizeof(intp));
 	lenDecorated = ALIGN_VALUE(lenDecorated, sizeof( LargeSymbolTableHashDecoration_t ) );
 
-	// Find a pool with space for this string, or allocate a new one.
-	int iPool = FindPoolWithSpace( lenDecorated );
-	if ( iPool == -1 )
+	// Compute a hash
+	LargeSymbolTableHashDecoration_t hash = CUtlSymbolLarge_Hash( CASEINSENSITIVE, pString, lenString );
+
+	CUtlSymbolTableLargeBaseTreeEntry_t *entry;
 	{
-		// Add a new pool.
-		int newPoolSize = MAX( lenDecorated + sizeof( StringPool_t ), POOL_SIZE );
-		StringPool_t *pPool = (StringPool_t*)malloc( newPoolSize );
+		// Only carving the space out of a pool is locked, and only for this hash's shard
+		PoolShard_t &shard = m_PoolShards[ hash % TreeType::POOL_SHARD_COUNT ];
+		AUTO_LOCK( shard.m_Mutex );
 
-		pPool->m_TotalLen = newPoolSize - sizeof( StringPool_t );
-		pPool->m_SpaceUsed = 0;
-		iPool = m_StringPools.AddToTail( pPool );
-	}
+		// Find a pool with space for this string, or allocate a new one.
+		int iPool = FindPoolWithSpace( shard.m_StringPools, lenDecorated );
+		if ( iPool == -1 )
+		{
+			// Add a new pool.
+			int newPoolSize = MAX( lenDecorated + sizeof( StringPool_t ), POOL_SIZE );
+			StringPool_t *pPool = (StringPool_t*)malloc( newPoolSize );
 
-	// Compute a hash
-	LargeSymbolTableHashDecoration_t hash = CUtlSymbolLarge_Hash( CASEINSENSITIVE, pString, lenString );
+			pPool->m_TotalLen = newPoolSize - sizeof( StringPool_t );
+			pPool->m_SpaceUsed = 0;
+			iPool = shard.m_StringPools.AddToTail( pPool );
+		}
 
-	// Copy the string in.
-	StringPool_t *pPool = m_StringPools[iPool];
-	// Assert( pPool->m_SpaceUsed < 0xFFFF );	// Pool could be bigger than 2k
-	// This should never happen, because if we had a string > 64k, it
-	// would have been given its entire own pool.
-	
-	CUtlSymbolTableLargeBaseTreeEntry_t *entry = ( CUtlSymbolTableLargeBaseTreeEntry_t * )&pPool->m_Data[ pPool->m_SpaceUsed ];
-	
-	pPool->m_SpaceUsed += lenDecorated;
+		StringPool_t *pPool = shard.m_StringPools[iPool];
+		// Assert( pPool->m_SpaceUsed < 0xFFFF );	// Pool could be bigger than 2k
+		// This should never happen, because if we had a string > 64k, it
+		// would have been given its entire own pool.
+		
+		entry = ( CUtlSymbolTableLargeBaseTreeEntry_t * )&pPool->m_Data[ pPool->m_SpaceUsed ];
+		
+		pPool->m_SpaceUsed += lenDecorated;
+	}
 
+	// Copy the string in.
 	entry->m_Hash = hash;
 	char *pText = (char *)&entry->m_String [ 0 ];
 	Q_memcpy( pText, pString, lenString );
 
-	// insert the string into the database
+	// insert the string into the database. If another thread inserted the same string first, Insert
+	//  returns its entry and this copy is just unused pool space
 	MEM_ALLOC_CREDIT();
 	return m_Lookup.Element( m_Lookup.Insert( entry ) )->ToSymbol();
 }
@@ -485,10 +512,14 @@ inline void CUtlSymbolTableLargeBase<TreeType, CASEINSENSITIVE, POOL_SIZE>::Remo
 {
 	m_Lookup.Purge();
 
-	for ( int i=0; i < m_StringPools.Count(); i++ )
-		free( m_StringPools[i] );
+	for ( int nShard = 0; nShard < TreeType::POOL_SHARD_COUNT; nShard++ )
+	{
+		CUtlVector< StringPool_t * > &pools = m_PoolShards[ nShard ].m_StringPools;
+		for ( int i=0; i < pools.Count(); i++ )
+			free( pools[i] );
 
-	m_StringPools.RemoveAll();
+		pools.RemoveAll();
+	}
 }
 #ifdef ANALYZE_UNSUPPRESS // So that swig builds
 ANALYZE_UNSUPPRESS(); // warning C6001: Using uninitialized memory '*m_StringPools.public: ...
@@ -23,6 +23,11 @@
 
 //#define VPK_ENABLE_SIGNING
 
+// Data files can be memory mapped (-vpkmmap) where there is address space to spare for them
+#if defined( POSIX ) && defined( PLATFORM_64BITS )
+#define VPK_ENABLE_MMAP
+#endif
+
 const int k_nVPKDefaultChunkSize = 200 * 1024 * 1024;
 
 class CPackedStore;
@@ -74,6 +79,9 @@ public:
 
 	FORCEINLINE int Read( void *pOutData, int nNumBytes );
 
+	// Read-only view of all m_nFileSize bytes of the file, or NULL if it has to be read
+	FORCEINLINE void const *GetDataPointer( void );
+
 	CPackedStoreFileHandle( void )
 	{
 		m_nFileNumber = -1;
@@ -126,11 +134,17 @@ struct FileHandleTracker_t
 	int m_nFileNumber;
 	PackDataFileHandle_t m_hFileHandle;
 	int m_nCurOfs;
+	int m_nLastCachedFraction;	// last chunk CPackedStoreReadCache loaded from this file, for read-ahead
+	uint8 const *m_pMappedData;	// the whole data file when it is memory mapped, else NULL
+	int64 m_nMappedSize;
 	CThreadFastMutex m_Mutex;
 
 	FileHandleTracker_t( void )
 	{
 		m_nFileNumber = -1;
+		m_nLastCachedFraction = -1;
+		m_pMappedData = NULL;
+		m_nMappedSize = 0;
 	}
 };
 
@@ -216,56 +230,84 @@ struct CachedVPKRead_t
 
 
 // Read the VPK file in 1MB chunks
-// and we hang on to those chunks so we can serve other reads out of the cache
-// This sounds great, but is only of secondary importance.
-// The primary reason we do this is so that the FileTracker can calculate the 
-// MD5 of the 1MB chunks asynchronously in another thread - while we hold
-// the chunk in cache - making the MD5 calculation "free"
+// and we hang on to those chunks so we can serve other reads out of the cache.
+// The FileTracker calculates the MD5 of each chunk asynchronously in another
+// thread while we hold it in cache, making the MD5 calculation "free".
+// The cache is split into shards by chunk so threads reading different parts of
+// the pack files don't contend on one lock, and each shard evicts with a clock.
+// Its size comes from -vpkcachesize <MB> (default 8MB, 0 on dedicated servers,
+// where the OS disk cache is shared by all server processes), and -vpkreadahead <n>
+// loads up to n chunks past a miss once a file is being read sequentially.
+// Memory mapped data files (-vpkmmap) bypass the cache since the page cache already
+// holds their bytes, but each of their chunks is still MD5ed the first time it is
+// read, straight out of the mapping, and goes through the same failure tracking.
 class CPackedStoreReadCache
 {
 public:
 	CPackedStoreReadCache( IBaseFileSystem *pFS );
+	~CPackedStoreReadCache();
 
-	bool ReadCacheLine( FileHandleTracker_t &fHandle, CachedVPKRead_t &cachedVPKRead, int &nRead );
+	bool ReadCacheLine( FileHandleTracker_t &fHandle, CachedVPKRead_t &cachedVPKRead, int &nRead, bool bSubmitMD5 = true );
 	bool BCanSatisfyFromReadCache( uint8 *pOutData, CPackedStoreFileHandle &handle, FileHandleTracker_t &fHandle, int nDesiredPos, int nNumBytes, int &nRead );
 	bool BCanSatisfyFromReadCacheInternal( uint8 *pOutData, CPackedStoreFileHandle &handle, FileHandleTracker_t &fHandle, int nDesiredPos, int nNumBytes, int &nRead );
 	bool CheckMd5Result( CachedVPKRead_t &cachedVPKRead, MD5Value_t &md5Value );
-	int FindBufferToUse();
 	void RereadBadCacheLine( CachedVPKRead_t &cachedVPKRead );
 	void RecheckBadCacheLine( CachedVPKRead_t &cachedVPKRead );
 	void RetryAllBadCacheLines();
+	void TrackMappedRead( FileHandleTracker_t &fHandle, int nPackFileNumber, int nDesiredPos, int nNumBytes );
+	void CheckMappedMD5Requests( bool bBlock );
 
-
-	// cache 8 MB total. Caching more wastes too much memory.
-	// On dedicated servers this cache is not used.
-	static const int k_nCacheBuffersToKeep = 8;
 	static const int k_cubCacheBufferSize = 0x00100000; // 1MB
 	static const int k_nCacheBufferMask = 0x7FF00000;
+	static const int k_nCacheShards = 8;
+	static const int k_nDefaultCacheSizeMB = 8;
+
+	struct Shard_t
+	{
+		Shard_t() : m_treeCachedVPKRead( CachedVPKRead_t::Less ), m_cItemsInCache( 0 ), m_iClockHand( 0 ) {}
+
+		CThreadRWLock m_rwlock;
+		CUtlRBTree<CachedVPKRead_t> m_treeCachedVPKRead; // all the reads we have done in this shard
+		CUtlVector<int> m_rgCurrentCacheIndex;			// slot -> tree index of the chunk holding that buffer
+		CUtlVector<CInterlockedInt> m_rgReferenced;		// clock reference bit per slot
+		int m_cItemsInCache;
+		int m_iClockHand;
+	};
+
+	int GetCacheSizeMB() const { return m_nCacheLines; }
+	Shard_t &ShardForChunk( int nPackFileNumber, int nFileFraction );
+	int FindBufferToUse( Shard_t &shard );
+	int LoadCacheLine( Shard_t &shard, FileHandleTracker_t &fHandle, CachedVPKRead_t &cachedVPKRead, int &nRead );
+	void ReadAhead( CPackedStoreFileHandle &handle, FileHandleTracker_t &fHandle, int nFileFraction );
 
-	CThreadRWLock m_rwlock;
-	CUtlRBTree<CachedVPKRead_t> m_treeCachedVPKRead; // all the reads we have done
+	Shard_t m_Shards[k_nCacheShards];
+	int m_nCacheLines;			// total 1MB lines across all shards
+	int m_nLinesPerShard;
+	int m_nReadAheadLines;
 
 	CTSQueue<CachedVPKRead_t> m_queueCachedVPKReadsRetry; // all the reads that have failed
 	CUtlLinkedList<CachedVPKRead_t> m_listCachedVPKReadsFailed; // all the reads that have failed
+	CThreadFastMutex m_FailedMutex;
 
-	// current items in the cache
-	int m_cItemsInCache;
-	int m_rgCurrentCacheIndex[k_nCacheBuffersToKeep];
-	CInterlockedUInt m_rgLastUsedTime[k_nCacheBuffersToKeep];
+	CUtlVector<CachedVPKRead_t> m_vecMappedMD5Pending;	// chunks of mapped files with an MD5 in flight
+	CThreadMutex m_MappedMD5Mutex;
 
 	CPackedStore *m_pPackedStore;
 	IBaseFileSystem *m_pFileSystem;
 	IThreadedFileMD5Processor *m_pFileTracker;
 	// stats
-	int m_cubReadFromCache;
-	int m_cReadFromCache;
-	int m_cDiscardsFromCache;
-	int m_cAddedToCache;
-	int m_cCacheMiss;
-	int m_cubCacheMiss;
-	int m_cFileErrors;
-	int m_cFileErrorsCorrected;
-	int m_cFileResultsDifferent;
+	CInterlockedInt m_cubReadFromCache;
+	CInterlockedInt m_cReadFromCache;
+	CInterlockedInt m_cDiscardsFromCache;
+	CInterlockedInt m_cAddedToCache;
+	CInterlockedInt m_cCacheMiss;
+	CInterlockedInt m_cubCacheMiss;
+	CInterlockedInt m_cReadAhead;
+	CInterlockedInt m_cubReadFromMapping;
+	CInterlockedInt m_cReadFromMapping;
+	CInterlockedInt m_cFileErrors;
+	CInterlockedInt m_cFileErrorsCorrected;
+	CInterlockedInt m_cFileResultsDifferent;
 };
 
 class CPackedStore
@@ -293,6 +335,10 @@ public:
 
 	int ReadData( CPackedStoreFileHandle &handle, void *pOutData, int nNumBytes );
 
+	// Returns the file's bytes in place when its data file is memory mapped and none of it
+	// lives in the directory metadata. The pointer stays valid as long as this CPackedStore.
+	void const *GetDataPointer( CPackedStoreFileHandle &handle );
+
 	~CPackedStore( void );
 
 	FORCEINLINE void *DirectoryData( void )
@@ -390,6 +436,7 @@ private:
 	int m_nDirectoryDataSize;
 	int m_nWriteChunkSize;
 	bool m_bUseDirFile;
+	bool m_bMemoryMapData;
 
 	IBaseFileSystem *m_pFileSystem;
 	IThreadedFileMD5Processor *m_pFileTracker;
@@ -436,6 +483,7 @@ private:
 	void BuildHashTables( void );
 
 	FileHandleTracker_t &GetFileHandle( int nFileNumber );
+	void MapDataFile( FileHandleTracker_t &fHandle, char const *pszDataFileName );
 
 	void CloseWriteHandle( void );
 
@@ -454,6 +502,11 @@ FORCEINLINE int CPackedStoreFileHandle::Read( void *pOutData, int nNumBytes )
 	return m_pOwner->ReadData( *this, pOutData, nNumBytes );
 }
 
+FORCEINLINE void const *CPackedStoreFileHandle::GetDataPointer( void )
+{
+	return m_pOwner->GetDataPointer( *this );
+}
+
 FORCEINLINE void CPackedStoreFileHandle::GetPackFileName( char *pchFileNameOut, int cchFileNameOut )
 {
 	m_pOwner->GetPackFileName( *this, pchFileNameOut, cchFileNameOut );
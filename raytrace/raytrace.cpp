@@ -4,6 +4,7 @@
 #include <filesystem_tools.h>
 #include <cmdlib.h>
 #include <stdio.h>
+#include "tier0/threadtools.h"
 
 // NOTE: This has to be the last file included!
 #include "tier0/memdbgon.h"
@@ -707,12 +708,12 @@ void RayTracingEnvironment::CalculateTriangleListBounds(int32 const *tris,int nt
 }
 
 
-// Both the "quick" and regular kd tree building algorithms here use the "surface area heuristic":
-// the relative probability of hitting the "left" subvolume (Vl) from a split is equal to that
-// subvolume's surface area divided by its parent's surface area (Vp) : P(Vl | V) = SA(Vl)/SA(Vp).
-// The same holds for the right subvolume, Vp. Nl is the number of triangles in the left volume,
-// and Nr in the right volume. if Ct is the cost of traversing one tree node, and Ci is the cost of
-// intersection with the primitive, than the cost of splitting is estimated as:
+// The kd tree is built using the "surface area heuristic": the relative probability of hitting
+// the "left" subvolume (Vl) from a split is equal to that subvolume's surface area divided by its
+// parent's surface area (Vp) : P(Vl | V) = SA(Vl)/SA(Vp). The same holds for the right
+// subvolume, Vp. Nl is the number of triangles in the left volume, and Nr in the right volume. if
+// Ct is the cost of traversing one tree node, and Ci is the cost of intersection with the
+// primitive, than the cost of splitting is estimated as:
 //
 //    Ct+Ci*((SA(Vl)/SA(V))*Nl+(SA(Vr)/SA(V)*Nr)).
 // and the cost of not splitting is
@@ -721,250 +722,449 @@ void RayTracingEnvironment::CalculateTriangleListBounds(int32 const *tris,int nt
 //  This both provides a metric to minimize when computing how and where to split, and also a
 //  termination criterion.
 //
-// the "quick" method just splits down the middle, while the slow method splits at the best
-// discontinuity of the cost formula. The quick method splits along the longest axis ; the 
-// regular algorithm tries all 3 to find which one results in the minimum cost
-// 
-// both methods use the additional optimization of "growing" empty nodes - if the split results in
-// one side being devoid of triangles, the empty side is "grown" as much as possible.
+// Split candidates are found by binning: each axis of a node is cut into SAH_BIN_COUNT bins, the
+// triangle extents are counted into them, and one sweep over the bins gives the triangle counts
+// on either side of every bin boundary. That keeps the work per node linear in its triangle
+// count.
+//
+// The bounds of the triangles along each axis are tried as split planes too. That is the
+// "growing" of empty nodes - if a split would leave one side devoid of triangles, the empty side
+// is grown as much as possible.
+//
+// Big trees are built in parallel. The top of the tree is built on the calling thread, down to
+// subtrees of a size that only depends on the triangle count. Worker threads build those into
+// their own arrays, which are then spliced into the tree in order, so the tree comes out the
+// same no matter how many threads built it.
 //
 
 #define COST_OF_TRAVERSAL 75								// approximate #operations
 #define COST_OF_INTERSECTION 167							// approximate #operations
 
+#define SAH_BIN_COUNT 32
+
+// trees with fewer triangles than this are built on the calling thread only
+#define PARALLEL_BUILD_MIN_TRIANGLES 32768
+
+// subtrees smaller than this aren't worth handing to another thread
+#define PARALLEL_BUILD_MIN_SUBTREE_TRIANGLES 1024
+
+
+struct KDSubtreeBuild_t
+{
+	int m_nNode;											// node of the tree the subtree hangs off
+	int32 *m_pTriList;
+	int m_nTris;
+	Vector m_MinBound;
+	Vector m_MaxBound;
+	int m_nDepth;
+
+	CUtlVector<CacheOptimizedKDNode> m_Nodes;				// the built subtree, root first
+	CUtlVector<int32> m_TriangleIndices;
+};
+
 
-float RayTracingEnvironment::CalculateCostsOfSplit(
-	int split_plane,int32 const *tri_list,int ntris,
-	Vector MinBound,Vector MaxBound, float &split_value,
-	int &nleft, int &nright, int &nboth)
+class CKDTreeBuilder
 {
-	// determine the costs of splitting on a given axis, and label triangles with respect to
-	// that axis by storing the value in coordselect0. It will also return the number of
-	// tris in the left, right, and nboth groups, in order to facilitate memory
-	nleft = nboth = nright = 0;
-
-	// now, label each triangle. Since we have not converted the triangles into
-	// intersection fromat yet, we can use the CoordSelect0 field of each as a temp.
-	nleft = 0;
-	nright = 0;
-	nboth = 0;
-	float min_coord = 1.0e23, max_coord =- 1.0e23;
+public:
+	CKDTreeBuilder( RayTracingEnvironment *pEnv );
+	~CKDTreeBuilder();
+
+	void Build( void );
+
+private:
+	void RefineNode( CUtlVector<CacheOptimizedKDNode> &nodes, CUtlVector<int32> &triangleIndices,
+					 int node_number, int32 const *tri_list, int ntris,
+					 Vector MinBound, Vector MaxBound, int depth );
+
+	void MakeLeaf( CUtlVector<CacheOptimizedKDNode> &nodes, CUtlVector<int32> &triangleIndices,
+				   int node_number, int32 const *tri_list, int ntris,
+				   Vector const &MinBound, Vector const &MaxBound );
 
+	float FindBestSplit( int32 const *tri_list, int ntris, Vector const &MinBound, Vector const &MaxBound,
+						 int &split_plane, float &split_value );
+
+	int ClassifyTriangle( int32 tri, int split_plane, float split_value ) const
+	{
+		// same as CacheOptimizedTriangle::ClassifyAgainstAxisSplit
+		if ( m_pTriMins[tri][split_plane] >= split_value )
+			return PLANECHECK_POSITIVE;
+		if ( m_pTriMaxs[tri][split_plane] <= split_value )
+			return PLANECHECK_NEGATIVE;
+		return PLANECHECK_STRADDLING;
+	}
+
+	void BuildSubtrees( void );
+	void SpliceSubtree( KDSubtreeBuild_t *pSubtree );
+	static uintp SubtreeThreadFunc( void *pParam );
+
+	RayTracingEnvironment *m_pEnv;
+	Vector *m_pTriMins;										// triangle bounds, by triangle index
+	Vector *m_pTriMaxs;
+
+	int m_nSubtreeTriangles;								// nodes this small are left for the workers
+	CUtlVector<KDSubtreeBuild_t *> m_Subtrees;
+	CInterlockedInt m_nNextSubtree;
+};
+
+
+CKDTreeBuilder::CKDTreeBuilder( RayTracingEnvironment *pEnv ) : m_pEnv( pEnv ), m_nSubtreeTriangles( 0 )
+{
+	int ntris = pEnv->OptimizedTriangleList.Count();
+	m_pTriMins = new Vector[ntris];
+	m_pTriMaxs = new Vector[ntris];
 	for( int t = 0; t < ntris; t++ )
 	{
-		CacheOptimizedTriangle &tri = OptimizedTriangleList[tri_list[t]];
-		// determine max and min coordinate values for later optimization
-		for( int v = 0; v < 3; v++ )
+		CacheOptimizedTriangle const &tri = pEnv->OptimizedTriangleList[t];
+		VectorMin( tri.Vertex( 0 ), tri.Vertex( 1 ), m_pTriMins[t] );
+		VectorMin( m_pTriMins[t], tri.Vertex( 2 ), m_pTriMins[t] );
+		VectorMax( tri.Vertex( 0 ), tri.Vertex( 1 ), m_pTriMaxs[t] );
+		VectorMax( m_pTriMaxs[t], tri.Vertex( 2 ), m_pTriMaxs[t] );
+	}
+	m_nNextSubtree = 0;
+}
+
+
+CKDTreeBuilder::~CKDTreeBuilder()
+{
+	delete[] m_pTriMins;
+	delete[] m_pTriMaxs;
+}
+
+
+static inline float CostOfSplit( int split_plane, float split_value, Vector const &MinBound, Vector const &MaxBound,
+								 float ISA, int nleft, int nright, int nboth )
+{
+	Vector LeftMaxes = MaxBound;
+	Vector RightMins = MinBound;
+	LeftMaxes[split_plane] = split_value;
+	RightMins[split_plane] = split_value;
+	float SA_L = BoxSurfaceArea( MinBound, LeftMaxes );
+	float SA_R = BoxSurfaceArea( RightMins, MaxBound );
+	return COST_OF_TRAVERSAL + COST_OF_INTERSECTION * ( nboth + ( SA_L * ISA * nleft ) + ( SA_R * ISA * nright ) );
+}
+
+
+float CKDTreeBuilder::FindBestSplit( int32 const *tri_list, int ntris, Vector const &MinBound, Vector const &MaxBound,
+									 int &split_plane, float &split_value )
+{
+	float best_cost = 1.0e23;
+	float ISA = 1.0 / BoxSurfaceArea( MinBound, MaxBound );
+
+	for( int axis = 0; axis < 3; axis++ )
+	{
+		float lo = MinBound[axis];
+		float hi = MaxBound[axis];
+		if ( hi <= lo )
+			continue;
+
+		// count the low and high end of every triangle into the bins
+		int nMinCount[SAH_BIN_COUNT];
+		int nMaxCount[SAH_BIN_COUNT];
+		memset( nMinCount, 0, sizeof( nMinCount ) );
+		memset( nMaxCount, 0, sizeof( nMaxCount ) );
+		float flBinScale = SAH_BIN_COUNT / ( hi - lo );
+		float min_coord = 1.0e23, max_coord = -1.0e23;
+		for( int t = 0; t < ntris; t++ )
+		{
+			float minc = m_pTriMins[tri_list[t]][axis];
+			float maxc = m_pTriMaxs[tri_list[t]][axis];
+			min_coord = MIN( min_coord, minc );
+			max_coord = MAX( max_coord, maxc );
+			nMinCount[clamp( (int)( ( minc - lo ) * flBinScale ), 0, SAH_BIN_COUNT - 1 )]++;
+			nMaxCount[clamp( (int)( ( maxc - lo ) * flBinScale ), 0, SAH_BIN_COUNT - 1 )]++;
+		}
+
+		// a triangle is left of a bin boundary if it ends in a bin below it, and right of it if
+		// it starts in a bin above it
+		int nleft = 0;
+		int nright = ntris;
+		for( int b = 1; b < SAH_BIN_COUNT; b++ )
+		{
+			nleft += nMaxCount[b - 1];
+			nright -= nMinCount[b - 1];
+			float trial_splitvalue = lo + b * ( hi - lo ) / SAH_BIN_COUNT;
+			float trial_cost = CostOfSplit( axis, trial_splitvalue, MinBound, MaxBound, ISA,
+											nleft, nright, ntris - nleft - nright );
+			if ( trial_cost < best_cost )
+			{
+				best_cost = trial_cost;
+				split_plane = axis;
+				split_value = trial_splitvalue;
+			}
+		}
+
+		// cut off the empty space on either side
+		if ( min_coord > lo && min_coord < hi )
 		{
-			min_coord = MIN( min_coord, tri.Vertex(v)[split_plane] );
-			max_coord = MAX( max_coord, tri.Vertex(v)[split_plane] );
+			float trial_cost = CostOfSplit( axis, min_coord, MinBound, MaxBound, ISA, 0, ntris, 0 );
+			if ( trial_cost < best_cost )
+			{
+				best_cost = trial_cost;
+				split_plane = axis;
+				split_value = min_coord;
+			}
 		}
-		switch( tri.ClassifyAgainstAxisSplit( split_plane, split_value ))
+		if ( max_coord < hi && max_coord > lo )
+		{
+			float trial_cost = CostOfSplit( axis, max_coord, MinBound, MaxBound, ISA, ntris, 0, 0 );
+			if ( trial_cost < best_cost )
+			{
+				best_cost = trial_cost;
+				split_plane = axis;
+				split_value = max_coord;
+			}
+		}
+	}
+	return best_cost;
+}
+
+
+void CKDTreeBuilder::MakeLeaf( CUtlVector<CacheOptimizedKDNode> &nodes, CUtlVector<int32> &triangleIndices,
+							   int node_number, int32 const *tri_list, int ntris,
+							   Vector const &MinBound, Vector const &MaxBound )
+{
+	nodes[node_number].Children = KDNODE_STATE_LEAF + ( triangleIndices.Count() << 2 );
+	nodes[node_number].SetNumberOfTrianglesInLeafNode( ntris );
+#ifdef DEBUG_RAYTRACE
+	nodes[node_number].vecMins = MinBound;
+	nodes[node_number].vecMaxs = MaxBound;
+#endif
+	if ( ntris )
+		triangleIndices.AddMultipleToTail( ntris, tri_list );
+}
+
+
+void CKDTreeBuilder::RefineNode( CUtlVector<CacheOptimizedKDNode> &nodes, CUtlVector<int32> &triangleIndices,
+								 int node_number, int32 const *tri_list, int ntris,
+								 Vector MinBound, Vector MaxBound, int depth )
+{
+	if ( ( ntris <= m_nSubtreeTriangles ) && ( ntris >= PARALLEL_BUILD_MIN_SUBTREE_TRIANGLES ) )
+	{
+		// leave this one to the worker threads
+		KDSubtreeBuild_t *pSubtree = new KDSubtreeBuild_t;
+		pSubtree->m_nNode = node_number;
+		pSubtree->m_pTriList = new int32[ntris];
+		memcpy( pSubtree->m_pTriList, tri_list, ntris * sizeof( int32 ) );
+		pSubtree->m_nTris = ntris;
+		pSubtree->m_MinBound = MinBound;
+		pSubtree->m_MaxBound = MaxBound;
+		pSubtree->m_nDepth = depth;
+		m_Subtrees.AddToTail( pSubtree );
+		return;
+	}
+
+	if ( ntris < 3 )											// never split empty lists
+	{
+		// no point in continuing
+		MakeLeaf( nodes, triangleIndices, node_number, tri_list, ntris, MinBound, MaxBound );
+		return;
+	}
+
+	int split_plane = 0;
+	float best_splitvalue = 0;
+	float best_cost = FindBestSplit( tri_list, ntris, MinBound, MaxBound, split_plane, best_splitvalue );
+
+	float cost_of_no_split = COST_OF_INTERSECTION * ntris;
+	if ( ( cost_of_no_split <= best_cost ) || ( depth > MAX_TREE_DEPTH ))
+	{
+		// no benefit to splitting. just make this a leaf node
+		MakeLeaf( nodes, triangleIndices, node_number, tri_list, ntris, MinBound, MaxBound );
+		return;
+	}
+
+	// its worth splitting! the bins only gave estimates, so classify for real. we will achieve
+	// the splitting without sorting by using a selection algorithm.
+	int8 *pSide = new int8[ntris];
+	int best_nleft = 0, best_nright = 0, best_nboth = 0;
+	for( int t = 0; t < ntris; t++ )
+	{
+		pSide[t] = ClassifyTriangle( tri_list[t], split_plane, best_splitvalue );
+		switch( pSide[t] )
 		{
 			case PLANECHECK_NEGATIVE:
-				nleft++;
-				tri.m_Data.m_GeometryData.m_nTmpData0 = PLANECHECK_NEGATIVE;
+				best_nleft++;
 				break;
-
 			case PLANECHECK_POSITIVE:
-				nright++;
-				tri.m_Data.m_GeometryData.m_nTmpData0 = PLANECHECK_POSITIVE;
+				best_nright++;
+				break;
+			case PLANECHECK_STRADDLING:
+				best_nboth++;
 				break;
+		}
+	}
 
+	int32 *new_triangle_list = new int32[ntris];
+	int n_left_output = 0;
+	int n_both_output = 0;
+	int n_right_output = 0;
+	for( int t = 0; t < ntris; t++ )
+	{
+		switch( pSide[t] )
+		{
+			case PLANECHECK_NEGATIVE:
+				new_triangle_list[n_left_output++] = tri_list[t];
+				break;
+			case PLANECHECK_POSITIVE:
+				n_right_output++;
+				new_triangle_list[ntris - n_right_output] = tri_list[t];
+				break;
 			case PLANECHECK_STRADDLING:
-				nboth++;
-				tri.m_Data.m_GeometryData.m_nTmpData0 = PLANECHECK_STRADDLING;
+				new_triangle_list[best_nleft + n_both_output] = tri_list[t];
+				n_both_output++;
 				break;
 		}
 	}
-	// now, if the split resulted in one half being empty, "grow" the empty half
-	if ( nleft && ( nboth == 0 ) && ( nright == 0 ))
-		split_value = max_coord;
-	if ( nright && ( nboth == 0 ) && ( nleft == 0 ))
-		split_value = min_coord;
+	delete[] pSide;
 
-	// now, perform surface area/cost check to determine whether this split was worth it
 	Vector LeftMins = MinBound;
 	Vector LeftMaxes = MaxBound;
 	Vector RightMins = MinBound;
 	Vector RightMaxes = MaxBound;
-	LeftMaxes[split_plane] = split_value;
-	RightMins[split_plane] = split_value;
-	float SA_L = BoxSurfaceArea( LeftMins, LeftMaxes );
-	float SA_R = BoxSurfaceArea( RightMins, RightMaxes );
-	float ISA = 1.0 / BoxSurfaceArea( MinBound, MaxBound );
-	float cost_of_split = COST_OF_TRAVERSAL + COST_OF_INTERSECTION * ( nboth +
-																	   ( SA_L * ISA * ( nleft )) + ( SA_R * ISA * ( nright )) );
-	return cost_of_split;
-}
+	LeftMaxes[split_plane] = best_splitvalue;
+	RightMins[split_plane] = best_splitvalue;
 
+	int left_child = nodes.Count();
+	int right_child = left_child + 1;
+	nodes[node_number].Children = split_plane + ( left_child << 2 );
+	nodes[node_number].SplittingPlaneValue = best_splitvalue;
+#ifdef DEBUG_RAYTRACE
+	nodes[node_number].vecMins = MinBound;
+	nodes[node_number].vecMaxs = MaxBound;
+#endif
+	CacheOptimizedKDNode newnode;
+	nodes.AddToTail( newnode );
+	nodes.AddToTail( newnode );
+	// now, recurse!
+	if ( ( ntris < 20 ) && ( (best_nleft == 0 ) || ( best_nright == 0 )) )
+		depth += 100;
+	RefineNode( nodes, triangleIndices, left_child, new_triangle_list, best_nleft + best_nboth,
+				LeftMins, LeftMaxes, depth + 1 );
+	RefineNode( nodes, triangleIndices, right_child, new_triangle_list + best_nleft, best_nright + best_nboth,
+				RightMins, RightMaxes, depth + 1 );
+	delete[] new_triangle_list;
+}
 
-#define NEVER_SPLIT 0
 
-void RayTracingEnvironment::RefineNode( int node_number, int32 const * tri_list, int ntris,
-										Vector MinBound, Vector MaxBound, int depth )
+uintp CKDTreeBuilder::SubtreeThreadFunc( void *pParam )
 {
-	if ( ntris < 3 )											// never split empty lists
+	CKDTreeBuilder *pBuilder = ( CKDTreeBuilder * ) pParam;
+	for(;;)
 	{
-		// no point in continuing
-		OptimizedKDTree[node_number].Children = KDNODE_STATE_LEAF + ( TriangleIndexList.Count() << 2 );
-		OptimizedKDTree[node_number].SetNumberOfTrianglesInLeafNode( ntris );
+		int nSubtree = ++pBuilder->m_nNextSubtree - 1;
+		if ( nSubtree >= pBuilder->m_Subtrees.Count() )
+			break;
+
+		KDSubtreeBuild_t *pSubtree = pBuilder->m_Subtrees[nSubtree];
+		CacheOptimizedKDNode root;
+		pSubtree->m_Nodes.AddToTail( root );
+		pBuilder->RefineNode( pSubtree->m_Nodes, pSubtree->m_TriangleIndices, 0, pSubtree->m_pTriList, pSubtree->m_nTris,
+							  pSubtree->m_MinBound, pSubtree->m_MaxBound, pSubtree->m_nDepth );
+		delete[] pSubtree->m_pTriList;
+		pSubtree->m_pTriList = NULL;
+	}
+	return 0;
+}
 
-#ifdef DEBUG_RAYTRACE
-		OptimizedKDTree[node_number].vecMins = MinBound;
-		OptimizedKDTree[node_number].vecMaxs = MaxBound;
-#endif
 
-		for( int t = 0; t < ntris; t++ )
-			TriangleIndexList.AddToTail( tri_list[t] );
-		return;
+void CKDTreeBuilder::BuildSubtrees( void )
+{
+	// the workers build everything they get
+	m_nSubtreeTriangles = 0;
+	m_nNextSubtree = 0;
+
+	int nThreads = MIN( (int)GetCPUInformation().m_nLogicalProcessors, m_Subtrees.Count() );
+	CUtlVector<ThreadHandle_t> threads;
+	for( int i = 1; i < nThreads; i++ )
+	{
+		ThreadHandle_t hThread = CreateSimpleThread( SubtreeThreadFunc, this );
+		if ( hThread )
+			threads.AddToTail( hThread );
 	}
 
-	float best_cost = 1.0e23;
-	int best_nleft = 0, best_nright = 0, best_nboth = 0;
-	float best_splitvalue = 0;
-	int split_plane = 0;
+	SubtreeThreadFunc( this );
 
-	int tri_skip = 1 + ( ntris / 10 );								// don't try all trinagles as split
-	// points when there are a lot of them
-	for( int axis = 0; axis < 3; axis++ )
+	for( int i = 0; i < threads.Count(); i++ )
 	{
-		for( int ts =- 1; ts < ntris; ts += tri_skip )
-		{
-			for( int tv = 0; tv < 3; tv++ )
-			{
-				int trial_nleft, trial_nright, trial_nboth;
-				float trial_splitvalue;
-				if ( ts ==- 1 )
-					trial_splitvalue = 0.5 * ( MinBound[axis]+ MaxBound[axis] );
-				else
-				{
-					// else, split at the triangle vertex if possible
-					CacheOptimizedTriangle &tri = OptimizedTriangleList[tri_list[ts]];
-					trial_splitvalue = tri.Vertex( tv )[axis];
-					if ( (trial_splitvalue > MaxBound[axis] ) || ( trial_splitvalue < MinBound[axis] ))
-						continue;							// don't try this vertex - not inside
+		ThreadJoin( threads[i] );
+		ReleaseThreadHandle( threads[i] );
+	}
+}
 
-				}
-//				printf("ts=%d tv=%d tp=%f\n",ts,tv,trial_splitvalue);
-				float trial_cost =
-					CalculateCostsOfSplit( axis, tri_list, ntris, MinBound, MaxBound, trial_splitvalue,
-										   trial_nleft, trial_nright, trial_nboth );
-// 				printf("try %d cost=%f nl=%d nr=%d nb=%d sp=%f\n",axis,trial_cost,trial_nleft,trial_nright, trial_nboth,
-// 					   trial_splitvalue);
-				if ( trial_cost < best_cost )
-				{
-					split_plane = axis;
-					best_cost = trial_cost;
-					best_nleft = trial_nleft;
-					best_nright = trial_nright;
-					best_nboth = trial_nboth;
-					best_splitvalue = trial_splitvalue;
-					// save away the axis classification of each triangle
-					for( int t = 0 ; t < ntris; t++ )
-					{
-						CacheOptimizedTriangle &tri = OptimizedTriangleList[tri_list[t]];
-						tri.m_Data.m_GeometryData.m_nTmpData1 = tri.m_Data.m_GeometryData.m_nTmpData0;
-					}
-				}
-				if ( ts ==- 1 )
-					break;
-			}
-		}
 
-	}
-	float cost_of_no_split = COST_OF_INTERSECTION * ntris;
-	if ( ( cost_of_no_split <= best_cost ) || NEVER_SPLIT || ( depth > MAX_TREE_DEPTH ))
+void CKDTreeBuilder::SpliceSubtree( KDSubtreeBuild_t *pSubtree )
+{
+	// the subtree root takes the place of the node it was deferred from, the rest goes on the end.
+	// children stay in pairs, so only the indices need fixing up.
+	CUtlVector<CacheOptimizedKDNode> &tree = m_pEnv->OptimizedKDTree;
+	int nNodeOffset = tree.Count() - 1;
+	int nTriangleOffset = m_pEnv->TriangleIndexList.Count();
+
+	for( int i = 0; i < pSubtree->m_Nodes.Count(); i++ )
 	{
-		// no benefit to splitting. just make this a leaf node
-		OptimizedKDTree[node_number].Children = KDNODE_STATE_LEAF + ( TriangleIndexList.Count() << 2 );
-		OptimizedKDTree[node_number].SetNumberOfTrianglesInLeafNode( ntris );
-#ifdef DEBUG_RAYTRACE
-		OptimizedKDTree[node_number].vecMins = MinBound;
-		OptimizedKDTree[node_number].vecMaxs = MaxBound;
-#endif
-		for( int t = 0; t < ntris; t++ )
-			TriangleIndexList.AddToTail( tri_list[t] );
+		CacheOptimizedKDNode node = pSubtree->m_Nodes[i];
+		if ( node.NodeType() == KDNODE_STATE_LEAF )
+			node.Children = KDNODE_STATE_LEAF + ( ( node.TriangleIndexStart() + nTriangleOffset ) << 2 );
+		else
+			node.Children = node.NodeType() + ( ( node.LeftChild() + nNodeOffset ) << 2 );
+
+		if ( i == 0 )
+			tree[pSubtree->m_nNode] = node;
+		else
+			tree.AddToTail( node );
 	}
-	else
+
+	if ( pSubtree->m_TriangleIndices.Count() )
+		m_pEnv->TriangleIndexList.AddMultipleToTail( pSubtree->m_TriangleIndices.Count(), pSubtree->m_TriangleIndices.Base() );
+}
+
+
+void CKDTreeBuilder::Build( void )
+{
+	int ntris = m_pEnv->OptimizedTriangleList.Count();
+	int32 * root_triangle_list = new int32[ntris];
+	for( int t = 0; t < ntris; t++ )
+		root_triangle_list[t] = t;
+	m_pEnv->CalculateTriangleListBounds( root_triangle_list, ntris, m_pEnv->m_MinBound, m_pEnv->m_MaxBound );
+
+	if ( ntris >= PARALLEL_BUILD_MIN_TRIANGLES )
+		m_nSubtreeTriangles = MAX( ntris / 256, PARALLEL_BUILD_MIN_SUBTREE_TRIANGLES );
+
+	CacheOptimizedKDNode root;
+	m_pEnv->OptimizedKDTree.AddToTail( root );
+	RefineNode( m_pEnv->OptimizedKDTree, m_pEnv->TriangleIndexList, 0, root_triangle_list, ntris,
+				m_pEnv->m_MinBound, m_pEnv->m_MaxBound, 0 );
+	delete[] root_triangle_list;
+
+	if ( m_Subtrees.Count() )
 	{
-// 		printf("best split was %d at %f (mid=%f,n=%d, sk=%d)\n",split_plane,best_splitvalue,
-// 			   0.5*(MinBound[split_plane]+MaxBound[split_plane]),ntris,tri_skip);
-		// its worth splitting!
-		// we will achieve the splitting without sorting by using a selection algorithm.
-		int32 * new_triangle_list;
-		new_triangle_list = new int32[ntris];
-
-		// now, perform surface area/cost check to determine whether this split was worth it
-		Vector LeftMins = MinBound;
-		Vector LeftMaxes = MaxBound;
-		Vector RightMins = MinBound;
-		Vector RightMaxes = MaxBound;
-		LeftMaxes[split_plane] = best_splitvalue;
-		RightMins[split_plane] = best_splitvalue;
-
-		int n_left_output = 0;
-		int n_both_output = 0;
-		int n_right_output = 0;
-		for( int t = 0; t < ntris; t++ )
-		{
-			CacheOptimizedTriangle &tri = OptimizedTriangleList[tri_list[t]];
-			switch( tri.m_Data.m_GeometryData.m_nTmpData1 )
-			{
-				case PLANECHECK_NEGATIVE:
-//					printf("%d goes left\n",t);
-					new_triangle_list[n_left_output++] = tri_list[t];
-					break;
-				case PLANECHECK_POSITIVE:
-					n_right_output++;
-//					printf("%d goes right\n",t);
-					new_triangle_list[ntris - n_right_output] = tri_list[t];
-					break;
-				case PLANECHECK_STRADDLING:
-//					printf("%d goes both\n",t);
-					new_triangle_list[best_nleft + n_both_output] = tri_list[t];
-					n_both_output++;
-					break;
+		BuildSubtrees();
 
+		int nTotalNodes = m_pEnv->OptimizedKDTree.Count();
+		int nTotalIndices = m_pEnv->TriangleIndexList.Count();
+		for( int i = 0; i < m_Subtrees.Count(); i++ )
+		{
+			nTotalNodes += m_Subtrees[i]->m_Nodes.Count() - 1;
+			nTotalIndices += m_Subtrees[i]->m_TriangleIndices.Count();
+		}
+		m_pEnv->OptimizedKDTree.EnsureCapacity( nTotalNodes );
+		m_pEnv->TriangleIndexList.EnsureCapacity( nTotalIndices );
 
-			}
+		for( int i = 0; i < m_Subtrees.Count(); i++ )
+		{
+			SpliceSubtree( m_Subtrees[i] );
+			delete m_Subtrees[i];
 		}
-		int left_child = OptimizedKDTree.Count();
-		int right_child = left_child + 1;
-// 		printf("node %d split on axis %d at %f, nl=%d nr=%d nb=%d lc=%d rc=%d\n",node_number,
-// 			   split_plane,best_splitvalue,best_nleft,best_nright,best_nboth,
-// 			   left_child,right_child);
-		OptimizedKDTree[node_number].Children = split_plane + ( left_child << 2 );
-		OptimizedKDTree[node_number].SplittingPlaneValue = best_splitvalue;
-#ifdef DEBUG_RAYTRACE
-		OptimizedKDTree[node_number].vecMins = MinBound;
-		OptimizedKDTree[node_number].vecMaxs = MaxBound;
-#endif
-		CacheOptimizedKDNode newnode;
-		OptimizedKDTree.AddToTail( newnode );
-		OptimizedKDTree.AddToTail( newnode );
-		// now, recurse!
-		if ( ( ntris < 20 ) && ( (best_nleft == 0 ) || ( best_nright == 0 )) )
-			depth += 100;
-		RefineNode( left_child, new_triangle_list, best_nleft + best_nboth, LeftMins, LeftMaxes, depth + 1 );
-		RefineNode( right_child, new_triangle_list + best_nleft, best_nright + best_nboth,
-					RightMins, RightMaxes, depth + 1 );
-		delete[] new_triangle_list;
+		m_Subtrees.Purge();
 	}
 }
 
 
 void RayTracingEnvironment::SetupAccelerationStructure( void )
 {
-	CacheOptimizedKDNode root;
-	OptimizedKDTree.AddToTail( root );
-	int32 * root_triangle_list = new int32[OptimizedTriangleList.Count()];
-	for( int t = 0; t < OptimizedTriangleList.Count(); t++ )
-		root_triangle_list[t] = t;
-	CalculateTriangleListBounds( root_triangle_list, OptimizedTriangleList.Count(), m_MinBound,
-								 m_MaxBound );
-	RefineNode( 0, root_triangle_list, OptimizedTriangleList.Count(), m_MinBound, m_MaxBound, 0 );
-	delete[] root_triangle_list;
+	{
+		CKDTreeBuilder builder( this );
+		builder.Build();
+	}
 
 	// now, convert all triangles to "intersection format"
 	for( int i = 0; i < OptimizedTriangleList.Count(); i++ )
@@ -85,6 +85,7 @@ IEngineEmulator *IEngineEmulator::Get()
 ConVar rr_debugresponses( "rr_debugresponses", "0", FCVAR_NONE, "Show verbose matching output (1 for simple, 2 for rule scoring, 3 for noisy). If set to 4, it will only show response success/failure for npc_selected NPCs." );
 ConVar rr_debugrule( "rr_debugrule", "", FCVAR_NONE, "If set to the name of the rule, that rule's score will be shown whenever a concept is passed into the response rules system.");
 ConVar rr_dumpresponses( "rr_dumpresponses", "0", FCVAR_NONE, "Dump all response_rules.txt and rules (requires restart)" );
+ConVar rr_compiledrules( "rr_compiledrules", "1", FCVAR_NONE, "Only score the rules whose required criteria can match, using a per-bucket index built at load." );
 ConVar rr_debugresponseconcept( "rr_debugresponseconcept", "", FCVAR_NONE, "If set, rr_debugresponses will print only responses testing for the specified concept" );
 #define RR_DEBUGRESPONSES_SPECIALCASE 4
 
@@ -414,6 +415,7 @@ void CResponseSystem::ComputeMatcher( Criteria *c, Matcher& matcher )
 
 	matcher.SetToken( token );
 	matcher.SetRaw( rawtoken );
+	matcher.tokenval = (float)atof( token );
 	matcher.valid = true;
 }
 
@@ -422,11 +424,16 @@ bool CResponseSystem::CompareUsingMatcher( const char *setValue, Matcher& m, boo
 	if ( !m.valid )
 		return false;
 
-	float v = (float)atof( setValue );
-	if ( setValue[0] == '[' )
+	// Plain string compares don't need the set value as a number
+	float v = 0.0f;
+	if ( m.usemin || m.usemax || m.isnumeric )
 	{
-		bool found = false;
-		v = LookupEnumeration( setValue, found );
+		v = (float)atof( setValue );
+		if ( setValue[0] == '[' )
+		{
+			bool found = false;
+			v = LookupEnumeration( setValue, found );
+		}
 	}
 
 	int minmaxcount = 0;
@@ -473,7 +480,7 @@ bool CResponseSystem::CompareUsingMatcher( const char *setValue, Matcher& m, boo
 	{
 		if ( m.isnumeric )
 		{
-			if ( v == (float)atof( m.GetToken() ) )
+			if ( v == m.tokenval )
 				return false;
 		}
 		else
@@ -492,7 +499,7 @@ bool CResponseSystem::CompareUsingMatcher( const char *setValue, Matcher& m, boo
 		if ( !setValue || !setValue[0] )
 			return false;
 
-		return v == (float)atof( m.GetToken() );
+		return v == m.tokenval;
 	}
 
 	return !Q_stricmp( setValue, m.GetToken() ) ? true : false;
@@ -1143,15 +1150,21 @@ ResponseRulePartition::tIndex CResponseSystem::FindBestMatchingRule( const Crite
 	float bestscore = 0.001f;
 	scoreOfBestMatchingRule = 0;
 
+	// Verbose output and rr_debugrule want to see every rule in the bucket scored
+	const char *pszDebugRule = rr_debugrule.GetString();
+	bool bUseCompiled = rr_compiledrules.GetBool() && !verbose && !( pszDebugRule && pszDebugRule[0] );
+	CUtlVector< unsigned short > candidates;
+
 	CUtlVectorFixed< ResponseRulePartition::tRuleDict *, 2 > buckets( 0, 2 );
 	m_RulePartitions.GetDictsForCriteria( &buckets, set );
 	for ( int b = 0 ; b < buckets.Count() ; ++b )
 	{
 		ResponseRulePartition::tRuleDict *prules = buckets[b];
-		int c = prules->Count();
-	int i;
-	for ( i = 0; i < c; i++ )
+		bool bCandidates = bUseCompiled && m_RulePartitions.GetCandidateRules( this, prules, set, &candidates );
+		int c = bCandidates ? candidates.Count() : prules->Count();
+	for ( int n = 0; n < c; n++ )
 	{
+			int i = bCandidates ? candidates[ n ] : n;
 			float score = ScoreCriteriaAgainstRule( set, *prules, i, verbose );
 		// Check equals so that we keep track of all matching rules
 		if ( score >= bestscore )
@@ -67,6 +67,7 @@ void ResponseRulePartition::RemoveAll( void )
 			delete m_RuleParts[bukkit][ i ];
 		}
 		m_RuleParts[bukkit].RemoveAll();
+		m_Compiled[bukkit].m_bDirty = true;
 	}
 }
 
@@ -89,12 +90,14 @@ ResponseRulePartition::tRuleDict &ResponseRulePartition::GetDictForRule( CRespon
 	const char *pszConcept = pRule->GetValueForRuleCriterionByName( pSystem, kCONCEPT );
 	const Criteria *pSubjCrit = pRule->GetPointerForRuleCriterionByName( pSystem, kSUBJECT );
 
-	return m_RuleParts[ 
-		GetBucketForSpeakerAndConcept( pszSpeaker, pszConcept, 
+	unsigned int bucket = GetBucketForSpeakerAndConcept( pszSpeaker, pszConcept, 
 			( pSubjCrit && pSubjCrit->required && CanBucketBySubject(pSubjCrit->value) ) ? 
 			pSubjCrit->value : 
-		NULL ) 
-	];
+		NULL );
+
+	// the caller is about to add a rule to this bucket
+	m_Compiled[bucket].m_bDirty = true;
+	return m_RuleParts[bucket];
 }
 
 
@@ -117,4 +120,189 @@ void ResponseRulePartition::GetDictsForCriteria( CUtlVectorFixed< ResponseRulePa
 	// also try the rules not specifying subject
 	pResult->AddToTail( &m_RuleParts[ GetBucketForSpeakerAndConcept(pszSpeaker, pszConcept, NULL) ] );
 
-}
\ No newline at end of file
+}
+
+// Hash of a criterion name and a value, folded the same way Q_stricmp compares them.
+static unsigned int HashCriterionKey( const CUtlSymbol &nameSym, const char * RESTRICT pszValue )
+{
+	unsigned int hash = 0xAAAAAAAA ^ ( (UtlSymId_t)nameSym * 2654435761u );
+	for ( ; *pszValue ; ++pszValue )
+	{
+		uint8 c = (uint8)(*pszValue);
+		if ( c >= 'A' && c <= 'Z' )
+		{
+			c += 'a' - 'A';
+		}
+		hash = ( ( hash << 5 ) + hash ) + c;
+	}
+	return hash;
+}
+
+// Can this criterion be matched by looking its value up in a hash?
+static bool IsKeyableCriterion( Criteria *pCrit )
+{
+	if ( !pCrit->required || pCrit->IsSubCriteriaType() )
+		return false;
+
+	Matcher &m = pCrit->matcher;
+	if ( !m.valid || m.isnumeric || m.notequal || m.usemin || m.usemax )
+		return false;
+
+	// only fold ASCII, leave anything locale dependent to the full compare
+	for ( const char *p = m.GetToken(); *p; ++p )
+	{
+		if ( (uint8)(*p) >= 0x80 )
+			return false;
+	}
+	return true;
+}
+
+int __cdecl ResponseRulePartition::KeyedRuleSortFunc( const CompiledBucket_t::KeyedRule_t *a, const CompiledBucket_t::KeyedRule_t *b )
+{
+	if ( a->m_nKeyHash != b->m_nKeyHash )
+		return a->m_nKeyHash < b->m_nKeyHash ? -1 : 1;
+	return (int)a->m_nElem - (int)b->m_nElem;
+}
+
+static int __cdecl ElemSortFunc( const unsigned short *a, const unsigned short *b )
+{
+	return (int)*a - (int)*b;
+}
+
+void ResponseRulePartition::CompileBucket( CResponseSystem *pSystem, int bucket )
+{
+	CompiledBucket_t &compiled = m_Compiled[bucket];
+	tRuleDict &dict = m_RuleParts[bucket];
+
+	compiled.m_KeySymbols.RemoveAll();
+	compiled.m_KeyedRules.RemoveAll();
+	compiled.m_UnkeyedRules.RemoveAll();
+	compiled.m_bDirty = false;
+
+	// count how many rules in the bucket use each name/value pair so that
+	// every rule gets filed under its most selective required criterion
+	CUtlMap< unsigned int, int > keyCounts( DefLessFunc( unsigned int ) );
+	int c = dict.Count();
+	for ( int i = 0; i < c; ++i )
+	{
+		const Rule *pRule = dict[i];
+		for ( int j = 0; j < pRule->m_Criteria.Count(); ++j )
+		{
+			Criteria *pCrit = &pSystem->m_Criteria[ pRule->m_Criteria[j] ];
+			if ( !IsKeyableCriterion( pCrit ) )
+				continue;
+
+			unsigned int hash = HashCriterionKey( pCrit->nameSym, pCrit->matcher.GetToken() );
+			unsigned short slot = keyCounts.Find( hash );
+			if ( slot == keyCounts.InvalidIndex() )
+			{
+				keyCounts.Insert( hash, 1 );
+			}
+			else
+			{
+				++keyCounts[slot];
+			}
+		}
+	}
+
+	for ( int i = 0; i < c; ++i )
+	{
+		const Rule *pRule = dict[i];
+		Criteria *pBest = NULL;
+		unsigned int bestHash = 0;
+		int bestCount = INT_MAX;
+		for ( int j = 0; j < pRule->m_Criteria.Count(); ++j )
+		{
+			Criteria *pCrit = &pSystem->m_Criteria[ pRule->m_Criteria[j] ];
+			if ( !IsKeyableCriterion( pCrit ) )
+				continue;
+
+			unsigned int hash = HashCriterionKey( pCrit->nameSym, pCrit->matcher.GetToken() );
+			int count = keyCounts[ keyCounts.Find( hash ) ];
+			if ( count < bestCount )
+			{
+				pBest = pCrit;
+				bestHash = hash;
+				bestCount = count;
+			}
+		}
+
+		if ( !pBest )
+		{
+			compiled.m_UnkeyedRules.AddToTail( i );
+			continue;
+		}
+
+		CompiledBucket_t::KeyedRule_t &keyed = compiled.m_KeyedRules[ compiled.m_KeyedRules.AddToTail() ];
+		keyed.m_nKeyHash = bestHash;
+		keyed.m_nElem = i;
+
+		if ( compiled.m_KeySymbols.Find( pBest->nameSym ) == -1 )
+		{
+			compiled.m_KeySymbols.AddToTail( pBest->nameSym );
+		}
+	}
+
+	compiled.m_KeyedRules.Sort( KeyedRuleSortFunc );
+}
+
+bool ResponseRulePartition::GetCandidateRules( CResponseSystem *pSystem, tRuleDict *pDict, const CriteriaSet &criteria, CUtlVector< unsigned short > *pResult )
+{
+	Assert( pDict >= m_RuleParts && pDict < m_RuleParts + N_RESPONSE_PARTITIONS );
+	int bucket = pDict - m_RuleParts;
+	if ( m_Compiled[bucket].m_bDirty )
+	{
+		CompileBucket( pSystem, bucket );
+	}
+
+	const CompiledBucket_t &compiled = m_Compiled[bucket];
+	pResult->RemoveAll();
+	pResult->AddVectorToTail( compiled.m_UnkeyedRules );
+
+	int nKeyed = compiled.m_KeyedRules.Count();
+	for ( int k = 0; k < compiled.m_KeySymbols.Count(); ++k )
+	{
+		// a criterion missing from the set is compared as the empty string
+		const char *pszValue = "";
+		int idx = criteria.FindCriterionIndex( compiled.m_KeySymbols[k] );
+		if ( idx != -1 )
+		{
+			pszValue = criteria.GetValue( idx );
+			if ( !pszValue )
+				return false;
+		}
+
+		// lower bound for this key, then every rule filed under it
+		unsigned int hash = HashCriterionKey( compiled.m_KeySymbols[k], pszValue );
+		int lo = 0, hi = nKeyed;
+		while ( lo < hi )
+		{
+			int mid = ( lo + hi ) >> 1;
+			if ( compiled.m_KeyedRules[mid].m_nKeyHash < hash )
+			{
+				lo = mid + 1;
+			}
+			else
+			{
+				hi = mid;
+			}
+		}
+
+		for ( ; lo < nKeyed && compiled.m_KeyedRules[lo].m_nKeyHash == hash; ++lo )
+		{
+			pResult->AddToTail( compiled.m_KeyedRules[lo].m_nElem );
+		}
+	}
+
+	// score in dictionary order so ties are broken exactly as a full scan would
+	pResult->Sort( ElemSortFunc );
+	for ( int i = pResult->Count() - 1; i > 0; --i )
+	{
+		if ( pResult->Element( i ) == pResult->Element( i - 1 ) )
+		{
+			pResult->Remove( i );
+		}
+	}
+
+	return true;
+}
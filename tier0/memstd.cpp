@@ -445,6 +445,33 @@ inline T MemAlign( T val, unsigned alignment )
 
 
 
+#ifdef MEM_SBH_THREAD_CACHE
+// FLS rather than TLS so a thread's magazines can be handed back when it exits.
+// Resolved at runtime, the SDK version tier0 builds against predates the Fls API.
+typedef DWORD ( WINAPI *FlsAllocFn_t )( void ( WINAPI *pfnCallback )( void * ) );
+typedef void *( WINAPI *FlsGetValueFn_t )( DWORD dwFlsIndex );
+typedef BOOL ( WINAPI *FlsSetValueFn_t )( DWORD dwFlsIndex, void *pFlsData );
+
+static FlsAllocFn_t g_pfnFlsAlloc;
+static FlsGetValueFn_t g_pfnFlsGetValue;
+static FlsSetValueFn_t g_pfnFlsSetValue;
+
+static bool ResolveFlsFunctions()
+{
+	if ( !g_pfnFlsAlloc )
+	{
+		HMODULE hKernel = GetModuleHandleA( "kernel32.dll" );
+		if ( hKernel )
+		{
+			g_pfnFlsGetValue = (FlsGetValueFn_t)GetProcAddress( hKernel, "FlsGetValue" );
+			g_pfnFlsSetValue = (FlsSetValueFn_t)GetProcAddress( hKernel, "FlsSetValue" );
+			g_pfnFlsAlloc = (FlsAllocFn_t)GetProcAddress( hKernel, "FlsAlloc" );
+		}
+	}
+	return ( g_pfnFlsAlloc && g_pfnFlsGetValue && g_pfnFlsSetValue );
+}
+#endif // MEM_SBH_THREAD_CACHE
+
 template <typename CAllocator>
 void CSmallBlockHeap<CAllocator>::InitPools( const uint *pSizes )
 {
@@ -536,6 +563,10 @@ void CSmallBlockPool<CAllocator>::Init( unsigned nBlockSize )
 	m_pNextAlloc = NULL;
 	m_nCommittedPages = 0;
 	m_nIsCompact = 1;
+
+#ifdef MEM_SBH_THREAD_CACHE
+	m_nMagazineSize = ( nBlockSize <= SBH_MAGAZINE_MAX_BLOCK ) ? MIN( MAX( SBH_MAGAZINE_BYTES / (int)nBlockSize, 4 ), SBH_MAGAZINE_MAX_COUNT ) : 0;
+#endif
 }
 
 template <typename CAllocator>
@@ -583,6 +614,44 @@ void *CSmallBlockPool<CAllocator>::Alloc()
 		sharedLock.LockForRead();
 	}
 
+	byte *pResult = AllocLocked( pSharedData );
+
+	sharedLock.UnlockRead();
+
+	return pResult;
+}
+
+// Fills ppBlocks with up to nBlocks blocks under a single acquire of the shared lock, returns how many it got
+template <typename CAllocator>
+int CSmallBlockPool<CAllocator>::AllocBatch( byte **ppBlocks, int nBlocks )
+{
+	SharedData_t *pSharedData = GetSharedData();
+
+	ValidateFreelist( pSharedData );
+
+	CThreadSpinRWLock &sharedLock = pSharedData->m_Lock;
+	if ( !sharedLock.TryLockForRead() )
+	{
+		sharedLock.LockForRead();
+	}
+
+	int nAllocated = 0;
+	while ( nAllocated < nBlocks )
+	{
+		byte *pResult = AllocLocked( pSharedData );
+		if ( !pResult )
+			break;
+		ppBlocks[nAllocated++] = pResult;
+	}
+
+	sharedLock.UnlockRead();
+
+	return nAllocated;
+}
+
+template <typename CAllocator>
+byte *CSmallBlockPool<CAllocator>::AllocLocked( SharedData_t *pSharedData )
+{
 	byte *pResult;
 	intp iPage = -1;
 	int iThreadPriority = INT_MAX;
@@ -660,7 +729,6 @@ void *CSmallBlockPool<CAllocator>::Alloc()
 						{
 							m_pNextAlloc = NULL;
 							m_CommitMutex.Unlock();
-							sharedLock.UnlockRead();
 							return NULL;
 						}
 					}
@@ -697,8 +765,6 @@ void *CSmallBlockPool<CAllocator>::Alloc()
 #endif
 	++pSharedData->m_PageStatus[iPage].m_nAllocated;
 
-	sharedLock.UnlockRead();
-
 	return pResult;
 }
 
@@ -706,13 +772,43 @@ template <typename CAllocator>
 void CSmallBlockPool<CAllocator>::Free( void *p )
 {
 	SharedData_t *pSharedData = GetSharedData();
-	size_t iPage = (size_t)((byte *)p - pSharedData->m_pBase) / BYTES_PAGE;
 
 	CThreadSpinRWLock &sharedLock = pSharedData->m_Lock;
 	if ( !sharedLock.TryLockForRead() )
 	{
 		sharedLock.LockForRead();
 	}
+	FreeLocked( pSharedData, p );
+	sharedLock.UnlockRead();
+
+	ValidateFreelist( pSharedData );
+}
+
+// Returns nBlocks blocks under a single acquire of the shared lock
+template <typename CAllocator>
+void CSmallBlockPool<CAllocator>::FreeBatch( byte **ppBlocks, int nBlocks )
+{
+	SharedData_t *pSharedData = GetSharedData();
+
+	CThreadSpinRWLock &sharedLock = pSharedData->m_Lock;
+	if ( !sharedLock.TryLockForRead() )
+	{
+		sharedLock.LockForRead();
+	}
+	for ( int i = 0; i < nBlocks; i++ )
+	{
+		FreeLocked( pSharedData, ppBlocks[i] );
+	}
+	sharedLock.UnlockRead();
+
+	ValidateFreelist( pSharedData );
+}
+
+template <typename CAllocator>
+void CSmallBlockPool<CAllocator>::FreeLocked( SharedData_t *pSharedData, void *p )
+{
+	size_t iPage = (size_t)((byte *)p - pSharedData->m_pBase) / BYTES_PAGE;
+
 	--pSharedData->m_PageStatus[iPage].m_nAllocated;
 
 	// Once the last allocation is removed from any page in a pool, the pool will no longer be considered compact
@@ -729,9 +825,6 @@ void CSmallBlockPool<CAllocator>::Free( void *p )
 	++m_nFreeBlocks;
 #endif
 	m_FreeList.Push( p );
-	pSharedData->m_Lock.UnlockRead();
-
-	ValidateFreelist( pSharedData );
 }
 
 // Count the free blocks.  
@@ -1194,6 +1287,16 @@ CSmallBlockHeap<CAllocator>::CSmallBlockHeap()
 {
 	m_pSharedData = CPool::GetSharedData();
 
+#ifdef MEM_SBH_THREAD_CACHE
+	m_pThreadCaches = NULL;
+	m_iThreadCacheSlot = SBH_INVALID_FLS_INDEX;
+	const char *pszPlatCommandLine = Plat_GetCommandLineA();
+	if ( !( pszPlatCommandLine && strstr( pszPlatCommandLine, "-nosbhthreadcache" ) ) && ResolveFlsFunctions() )
+	{
+		m_iThreadCacheSlot = g_pfnFlsAlloc( &ThreadCacheExitCallback );
+	}
+#endif
+
 	// Build a lookup table used to find the correct pool based on size
 
 #ifdef _M_X64
@@ -1341,6 +1444,16 @@ void *CSmallBlockHeap<CAllocator>::Alloc( size_t nBytes )
 	}
 	Assert( ShouldUse( nBytes ) );
 	CPool *pPool = FindPool( nBytes );
+#ifdef MEM_SBH_THREAD_CACHE
+	if ( pPool->m_nMagazineSize )
+	{
+		ThreadCache_t *pCache = GetThreadCache();
+		if ( pCache )
+		{
+			return AllocFromThreadCache( pCache, pPool );
+		}
+	}
+#endif
 	void *p = pPool->Alloc();
 	return p;
 }
@@ -1394,6 +1507,17 @@ void CSmallBlockHeap<CAllocator>::Free( void *p )
 	CPool *pPool = FindPool( p );
 	if ( pPool )
 	{
+#ifdef MEM_SBH_THREAD_CACHE
+		if ( pPool->m_nMagazineSize )
+		{
+			ThreadCache_t *pCache = GetThreadCache();
+			if ( pCache )
+			{
+				FreeToThreadCache( pCache, pPool, p );
+				return;
+			}
+		}
+#endif
 		pPool->Free( p );
 	}
 	else
@@ -1417,11 +1541,26 @@ void CSmallBlockHeap<CAllocator>::Usage( size_t &bytesCommitted, size_t &bytesAl
 	bytesAllocated = 0;
 	for ( int i = 0; i < NUM_POOLS; i++ )
 	{
+		uint nAllocatedBlocks, nFreeBlocks;
+		CountPoolBlocks( i, nAllocatedBlocks, nFreeBlocks );
 		bytesCommitted += m_Pools[i].GetCommittedSize();
-		bytesAllocated += ( size_t( m_Pools[i].CountAllocatedBlocks() ) * size_t( m_Pools[i].GetBlockSize() ) );
+		bytesAllocated += ( size_t( nAllocatedBlocks ) * size_t( m_Pools[i].GetBlockSize() ) );
 	}
 }
 
+// Blocks sitting in thread magazines count as allocated in their pool, but they are free as far as anyone else cares
+template <typename CAllocator>
+void CSmallBlockHeap<CAllocator>::CountPoolBlocks( int iPool, uint &nAllocatedBlocks, uint &nFreeBlocks )
+{
+	nAllocatedBlocks = m_Pools[iPool].CountAllocatedBlocks();
+	nFreeBlocks = m_Pools[iPool].CountFreeBlocks();
+#if defined( MEM_SBH_THREAD_CACHE ) && defined( TRACK_SBH_COUNTS )
+	uint nCached = MIN( (uint)CountThreadCachedBlocks( iPool ), nAllocatedBlocks );
+	nAllocatedBlocks -= nCached;
+	nFreeBlocks += nCached;
+#endif
+}
+
 
 
 const char *Tier0_Prettynum( int64 num )
@@ -1480,8 +1619,8 @@ void CSmallBlockHeap<CAllocator>::DumpStats( const char *pszTag, FILE *pFile, IM
 				for ( int i = 0; i < NUM_POOLS; i++ )
 				{
 					uint nBlockSize = uint( m_Pools[ i ].GetBlockSize() );
-					uint nAllocatedBlocks = m_Pools[ i ].CountAllocatedBlocks();
-					uint nFreeBlocks = m_Pools[ i ].CountFreeBlocks();
+					uint nAllocatedBlocks, nFreeBlocks;
+					CountPoolBlocks( i, nAllocatedBlocks, nFreeBlocks );
 					uint nCommittedBlocks = m_Pools[ i ].CountCommittedBlocks();
 					uint64 nCommittedSize = m_Pools[ i ].GetCommittedSize();
 					if ( nCommittedBlocks )
@@ -1512,8 +1651,8 @@ void CSmallBlockHeap<CAllocator>::DumpStats( const char *pszTag, FILE *pFile, IM
 				for ( int i = 0; i < NUM_POOLS; i++ )
 				{
 					uint nBlockSize = uint( m_Pools[ i ].GetBlockSize() );
-					uint nAllocatedBlocks = m_Pools[ i ].CountAllocatedBlocks();
-					uint nFreeBlocks = m_Pools[ i ].CountFreeBlocks();
+					uint nAllocatedBlocks, nFreeBlocks;
+					CountPoolBlocks( i, nAllocatedBlocks, nFreeBlocks );
 					uint nCommittedBlocks = m_Pools[ i ].CountCommittedBlocks();
 					uint64 nCommittedSize = m_Pools[ i ].GetCommittedSize();
 					if ( nCommittedBlocks )
@@ -1549,8 +1688,8 @@ void CSmallBlockHeap<CAllocator>::DumpStats( const char *pszTag, FILE *pFile, IM
 		for ( int i = 0; i < NUM_POOLS; i++ )
 		{
 			uint nBlockSize = uint( m_Pools[ i ].GetBlockSize() );
-			uint nAllocatedBlocks = m_Pools[ i ].CountAllocatedBlocks();
-			uint nFreeBlocks = m_Pools[ i ].CountFreeBlocks();
+			uint nAllocatedBlocks, nFreeBlocks;
+			CountPoolBlocks( i, nAllocatedBlocks, nFreeBlocks );
 			uint nCommittedBlocks = m_Pools[ i ].CountCommittedBlocks();
 			if ( nCommittedBlocks )
 			{
@@ -1618,6 +1757,10 @@ size_t CSmallBlockHeap<CAllocator>::Compact( bool bIncremental )
 	}
 	else
 	{
+#ifdef MEM_SBH_THREAD_CACHE
+		// Blocks parked in magazines keep their pages alive, hand them all back first
+		DrainThreadCaches();
+#endif
 		for ( int i = 0; i < NUM_POOLS; i++ )
 		{
 			nRecovered += m_Pools[i].Compact( bIncremental );
@@ -1634,9 +1777,211 @@ bool CSmallBlockHeap<CAllocator>::Validate()
 	{
 		valid = m_Pools[i].Validate() && valid;
 	}
+#ifdef MEM_SBH_THREAD_CACHE
+	valid = ValidateThreadCaches() && valid;
+#endif
+	return valid;
+}
+
+#ifdef MEM_SBH_THREAD_CACHE
+//-----------------------------------------------------------------------------
+// Per-thread magazines
+//-----------------------------------------------------------------------------
+template <typename CAllocator>
+typename CSmallBlockHeap<CAllocator>::ThreadCache_t *CSmallBlockHeap<CAllocator>::GetThreadCache()
+{
+	if ( m_iThreadCacheSlot == SBH_INVALID_FLS_INDEX )
+		return NULL;
+
+	ThreadCache_t *pCache = (ThreadCache_t *)g_pfnFlsGetValue( m_iThreadCacheSlot );
+	if ( !pCache )
+	{
+		pCache = CreateThreadCache();
+	}
+	return pCache;
+}
+
+template <typename CAllocator>
+typename CSmallBlockHeap<CAllocator>::ThreadCache_t *CSmallBlockHeap<CAllocator>::CreateThreadCache()
+{
+	// Adopt the cache of a thread that has exited, if there is one
+	ThreadCache_t *pCache;
+	for ( pCache = m_pThreadCaches; pCache; pCache = pCache->m_pNext )
+	{
+		if ( pCache->m_nInUse.AssignIf( 0, 1 ) )
+			break;
+	}
+
+	if ( !pCache )
+	{
+		// Can't come from the heap we are caching for. VirtualAlloc hands back zeroed
+		// memory, which is the initial state of the mutex and the magazines.
+		pCache = (ThreadCache_t *)VirtualAlloc( NULL, sizeof( ThreadCache_t ), VA_COMMIT_FLAGS, PAGE_READWRITE );
+		if ( !pCache )
+			return NULL;
+		pCache->m_nInUse = 1;
+		pCache->m_pHeap = this;
+
+		m_ThreadCacheListMutex.Lock();
+		pCache->m_pNext = m_pThreadCaches;
+		ThreadMemoryBarrier();
+		m_pThreadCaches = pCache;
+		m_ThreadCacheListMutex.Unlock();
+	}
+
+	if ( !g_pfnFlsSetValue( m_iThreadCacheSlot, pCache ) )
+	{
+		pCache->m_nInUse = 0;
+		return NULL;
+	}
+	return pCache;
+}
+
+template <typename CAllocator>
+void *CSmallBlockHeap<CAllocator>::AllocFromThreadCache( ThreadCache_t *pCache, CPool *pPool )
+{
+	Magazine_t &magazine = pCache->m_Magazines[ pPool - m_Pools ];
+
+	pCache->m_Mutex.Lock();
+	if ( !magazine.m_pHead )
+	{
+		byte *pBlocks[ SBH_MAGAZINE_MAX_COUNT ];
+		int nBlocks = pPool->AllocBatch( pBlocks, MAX( pPool->m_nMagazineSize / 2, 1 ) );
+		for ( int i = 0; i < nBlocks; i++ )
+		{
+			*(byte **)pBlocks[i] = magazine.m_pHead;
+			magazine.m_pHead = pBlocks[i];
+		}
+		magazine.m_nCount += nBlocks;
+	}
+
+	byte *pResult = magazine.m_pHead;
+	if ( pResult )
+	{
+		magazine.m_pHead = *(byte **)pResult;
+		--magazine.m_nCount;
+	}
+	pCache->m_Mutex.Unlock();
+
+	return pResult;
+}
+
+template <typename CAllocator>
+void CSmallBlockHeap<CAllocator>::FreeToThreadCache( ThreadCache_t *pCache, CPool *pPool, void *p )
+{
+	Magazine_t &magazine = pCache->m_Magazines[ pPool - m_Pools ];
+
+	pCache->m_Mutex.Lock();
+	if ( magazine.m_nCount >= pPool->m_nMagazineSize )
+	{
+		// Spill half of it back to the pool
+		byte *pBlocks[ SBH_MAGAZINE_MAX_COUNT ];
+		int nBlocks = MAX( pPool->m_nMagazineSize / 2, 1 );
+		for ( int i = 0; i < nBlocks; i++ )
+		{
+			pBlocks[i] = magazine.m_pHead;
+			magazine.m_pHead = *(byte **)pBlocks[i];
+		}
+		magazine.m_nCount -= nBlocks;
+		pPool->FreeBatch( pBlocks, nBlocks );
+	}
+
+	*(byte **)p = magazine.m_pHead;
+	magazine.m_pHead = (byte *)p;
+	++magazine.m_nCount;
+	pCache->m_Mutex.Unlock();
+}
+
+// Caller holds pCache->m_Mutex
+template <typename CAllocator>
+void CSmallBlockHeap<CAllocator>::DrainThreadCache( ThreadCache_t *pCache )
+{
+	byte *pBlocks[ SBH_MAGAZINE_MAX_COUNT ];
+	for ( int iPool = 0; iPool < NUM_POOLS; iPool++ )
+	{
+		Magazine_t &magazine = pCache->m_Magazines[iPool];
+		while ( magazine.m_pHead )
+		{
+			int nBlocks = 0;
+			while ( magazine.m_pHead && nBlocks < SBH_MAGAZINE_MAX_COUNT )
+			{
+				pBlocks[nBlocks++] = magazine.m_pHead;
+				magazine.m_pHead = *(byte **)magazine.m_pHead;
+			}
+			m_Pools[iPool].FreeBatch( pBlocks, nBlocks );
+		}
+		magazine.m_nCount = 0;
+	}
+}
+
+template <typename CAllocator>
+void CSmallBlockHeap<CAllocator>::DrainThreadCaches()
+{
+	for ( ThreadCache_t *pCache = m_pThreadCaches; pCache; pCache = pCache->m_pNext )
+	{
+		pCache->m_Mutex.Lock();
+		DrainThreadCache( pCache );
+		pCache->m_Mutex.Unlock();
+	}
+}
+
+// For stats only, so magazines are read without taking their locks
+template <typename CAllocator>
+int CSmallBlockHeap<CAllocator>::CountThreadCachedBlocks( int iPool )
+{
+	int nCached = 0;
+	for ( ThreadCache_t *pCache = m_pThreadCaches; pCache; pCache = pCache->m_pNext )
+	{
+		nCached += pCache->m_Magazines[iPool].m_nCount;
+	}
+	return nCached;
+}
+
+template <typename CAllocator>
+bool CSmallBlockHeap<CAllocator>::ValidateThreadCaches()
+{
+	bool valid = true;
+	for ( ThreadCache_t *pCache = m_pThreadCaches; pCache; pCache = pCache->m_pNext )
+	{
+		pCache->m_Mutex.Lock();
+		for ( int iPool = 0; iPool < NUM_POOLS; iPool++ )
+		{
+			const Magazine_t &magazine = pCache->m_Magazines[iPool];
+			int nCount = 0;
+			for ( byte *pBlock = magazine.m_pHead; pBlock && nCount <= magazine.m_nCount; pBlock = *(byte **)pBlock )
+			{
+				if ( FindPool( pBlock ) != &m_Pools[iPool] || ( pBlock - m_pSharedData->m_pBase ) % BYTES_PAGE % m_Pools[iPool].GetBlockSize() != 0 )
+				{
+					valid = false;
+					break;
+				}
+				nCount++;
+			}
+			if ( nCount != magazine.m_nCount )
+			{
+				valid = false;
+			}
+		}
+		pCache->m_Mutex.Unlock();
+	}
 	return valid;
 }
 
+// Runs on a thread that is exiting: give its blocks back and let another thread adopt the cache
+template <typename CAllocator>
+void WINAPI CSmallBlockHeap<CAllocator>::ThreadCacheExitCallback( void *pData )
+{
+	ThreadCache_t *pCache = (ThreadCache_t *)pData;
+	if ( !pCache )
+		return;
+
+	pCache->m_Mutex.Lock();
+	pCache->m_pHeap->DrainThreadCache( pCache );
+	pCache->m_Mutex.Unlock();
+	pCache->m_nInUse = 0;
+}
+#endif // MEM_SBH_THREAD_CACHE
+
 #endif // MEM_SBH_ENABLED
 
 
@@ -2928,4 +3273,241 @@ size_t CStdMemAlloc::MemoryAllocFailed()
 
 #endif // MEM_IMPL_TYPE_STD
 
+//-----------------------------------------------------------------------------
+// Small block heap tests. They run on a heap of their own, so the rest of the
+// process can't disturb the block counts they check.
+//-----------------------------------------------------------------------------
+#if MEM_IMPL_TYPE_STD && defined( MEM_SBH_THREAD_CACHE )
+
+#define SBH_TEST_BLOCK_SIZE		64
+#define SBH_TEST_BLOCKS			4096
+#define SBH_TEST_BATCH			32
+
+#define SBH_TEST_CHECK( exp ) \
+	if ( !( exp ) ) \
+	{ \
+		Warning( "Small block heap test failed: %s (line %d)\n", #exp, __LINE__ ); \
+		bResult = false; \
+	}
+
+class CSmallBlockHeapTest
+{
+public:
+	typedef CStdMemAlloc::CVirtualSmallBlockHeap CHeap;
+	typedef CHeap::CPool CPool;
+
+	static bool Run();
+
+private:
+	struct CrossThreadTest_t
+	{
+		CHeap *				m_pHeap;
+		CTSList<void *>		m_Blocks;
+		CInterlockedInt		m_bAllocsDone;
+		int					m_nFreed;
+		int					m_nBadBlocks;
+	};
+
+	static uintp AllocThreadFunc( void *pParam );
+	static uintp FreeThreadFunc( void *pParam );
+};
+
+// Every word of a block holds the block's own address while it travels between threads
+uintp CSmallBlockHeapTest::AllocThreadFunc( void *pParam )
+{
+	CrossThreadTest_t *pTest = (CrossThreadTest_t *)pParam;
+	for ( int i = 0; i < SBH_TEST_BLOCKS; i++ )
+	{
+		uintp *pBlock = (uintp *)pTest->m_pHeap->Alloc( SBH_TEST_BLOCK_SIZE );
+		for ( int j = 0; j < (int)( SBH_TEST_BLOCK_SIZE / sizeof(uintp) ); j++ )
+		{
+			pBlock[j] = (uintp)pBlock;
+		}
+		pTest->m_Blocks.PushItem( pBlock );
+	}
+	pTest->m_bAllocsDone = 1;
+	return 0;
+}
+
+uintp CSmallBlockHeapTest::FreeThreadFunc( void *pParam )
+{
+	CrossThreadTest_t *pTest = (CrossThreadTest_t *)pParam;
+	for (;;)
+	{
+		// Read before draining, so nothing pushed before the flag is missed
+		bool bDone = ( pTest->m_bAllocsDone != 0 );
+
+		void *p;
+		while ( pTest->m_Blocks.PopItem( &p ) )
+		{
+			uintp *pBlock = (uintp *)p;
+			for ( int j = 0; j < (int)( SBH_TEST_BLOCK_SIZE / sizeof(uintp) ); j++ )
+			{
+				if ( pBlock[j] != (uintp)pBlock )
+				{
+					pTest->m_nBadBlocks++;
+					break;
+				}
+			}
+			pTest->m_pHeap->Free( p );
+			pTest->m_nFreed++;
+		}
+
+		if ( bDone )
+			break;
+		ThreadPause();
+	}
+	return 0;
+}
+
+bool CSmallBlockHeapTest::Run()
+{
+	bool bResult = true;
+
+	// Never freed: the FLS callback of any thread that used it drains into it on exit
+	CHeap *pHeap = new CHeap;
+	CPool *pPool = pHeap->FindPool( (size_t)SBH_TEST_BLOCK_SIZE );
+	int iPool = pPool - pHeap->m_Pools;
+	bool bThreadCache = ( pHeap->m_iThreadCacheSlot != SBH_INVALID_FLS_INDEX && pPool->m_nMagazineSize > 0 );
+	uint nAllocated, nFree;
+
+	SBH_TEST_CHECK( pPool->GetBlockSize() == SBH_TEST_BLOCK_SIZE );
+
+	// Blocks allocated on one thread and freed on another
+	CrossThreadTest_t test;
+	test.m_pHeap = pHeap;
+	test.m_bAllocsDone = 0;
+	test.m_nFreed = 0;
+	test.m_nBadBlocks = 0;
+	ThreadHandle_t hAllocThread = CreateSimpleThread( AllocThreadFunc, &test );
+	ThreadHandle_t hFreeThread = CreateSimpleThread( FreeThreadFunc, &test );
+	ThreadJoin( hAllocThread );
+	ThreadJoin( hFreeThread );
+	ReleaseThreadHandle( hAllocThread );
+	ReleaseThreadHandle( hFreeThread );
+
+	SBH_TEST_CHECK( test.m_nFreed == SBH_TEST_BLOCKS );
+	SBH_TEST_CHECK( test.m_nBadBlocks == 0 );
+	// Both threads have exited, which hands their magazines back to the pool
+	SBH_TEST_CHECK( pHeap->CountThreadCachedBlocks( iPool ) == 0 );
+#ifdef TRACK_SBH_COUNTS
+	SBH_TEST_CHECK( pPool->CountAllocatedBlocks() == 0 );
+	SBH_TEST_CHECK( pPool->CountFreeBlocks() == pPool->CountCommittedBlocks() );
+#endif
+	SBH_TEST_CHECK( pHeap->Validate() );
+
+	// Blocks this thread frees stay in its magazine until something drains it
+	void *pBlocks[SBH_TEST_BATCH];
+	for ( int i = 0; i < SBH_TEST_BATCH; i++ )
+	{
+		pBlocks[i] = pHeap->Alloc( SBH_TEST_BLOCK_SIZE );
+	}
+	for ( int i = 0; i < SBH_TEST_BATCH; i++ )
+	{
+		pHeap->Free( pBlocks[i] );
+	}
+	if ( bThreadCache )
+	{
+		int nCached = pHeap->CountThreadCachedBlocks( iPool );
+		SBH_TEST_CHECK( nCached > 0 );
+#ifdef TRACK_SBH_COUNTS
+		// The pool still counts cached blocks as allocated, the heap's stats count them as free
+		SBH_TEST_CHECK( pPool->CountAllocatedBlocks() == nCached );
+		pHeap->CountPoolBlocks( iPool, nAllocated, nFree );
+		SBH_TEST_CHECK( nAllocated == 0 );
+		SBH_TEST_CHECK( nFree == (uint)pPool->CountCommittedBlocks() );
+#endif
+		pHeap->DrainThreadCaches();
+		SBH_TEST_CHECK( pHeap->CountThreadCachedBlocks( iPool ) == 0 );
+#ifdef TRACK_SBH_COUNTS
+		SBH_TEST_CHECK( pPool->CountAllocatedBlocks() == 0 );
+#endif
+	}
+	else
+	{
+		Msg( "Small block heap thread caches are off, skipping the drain test\n" );
+	}
+
+	// Batches come straight from the pool's free list
+	byte *pBatch[SBH_TEST_BATCH];
+	int nBatch = pPool->AllocBatch( pBatch, SBH_TEST_BATCH );
+	SBH_TEST_CHECK( nBatch == SBH_TEST_BATCH );
+	for ( int i = 0; i < nBatch; i++ )
+	{
+		SBH_TEST_CHECK( pHeap->FindPool( pBatch[i] ) == pPool );
+		SBH_TEST_CHECK( ( pBatch[i] - pHeap->m_pSharedData->m_pBase ) % CHeap::BYTES_PAGE % SBH_TEST_BLOCK_SIZE == 0 );
+		for ( int j = 0; j < i; j++ )
+		{
+			SBH_TEST_CHECK( pBatch[j] != pBatch[i] );
+		}
+		memset( pBatch[i], 0xdd, SBH_TEST_BLOCK_SIZE );
+	}
+#ifdef TRACK_SBH_COUNTS
+	SBH_TEST_CHECK( pPool->CountAllocatedBlocks() == nBatch );
+#endif
+	pPool->FreeBatch( pBatch, nBatch );
+#ifdef TRACK_SBH_COUNTS
+	SBH_TEST_CHECK( pPool->CountAllocatedBlocks() == 0 );
+	SBH_TEST_CHECK( pPool->CountFreeBlocks() == pPool->CountCommittedBlocks() );
+#endif
+	SBH_TEST_CHECK( pHeap->Validate() );
+
+	if ( !g_bSBHCompactDisabled )
+	{
+		// Every block is free, so an incremental compact releases one page of the pool
+		int nCommitted = pPool->CountCommittedBlocks();
+		SBH_TEST_CHECK( nCommitted > 0 );
+		SBH_TEST_CHECK( pHeap->Compact( true ) == CHeap::BYTES_PAGE );
+		SBH_TEST_CHECK( pPool->CountCommittedBlocks() == nCommitted - (int)( CHeap::BYTES_PAGE / SBH_TEST_BLOCK_SIZE ) );
+#ifdef TRACK_SBH_COUNTS
+		pHeap->CountPoolBlocks( iPool, nAllocated, nFree );
+		SBH_TEST_CHECK( nAllocated == 0 );
+		SBH_TEST_CHECK( nFree == (uint)pPool->CountCommittedBlocks() );
+#endif
+
+		// A full compact drains the magazines first, so it releases every page
+		for ( int i = 0; i < SBH_TEST_BATCH; i++ )
+		{
+			pBlocks[i] = pHeap->Alloc( SBH_TEST_BLOCK_SIZE );
+		}
+		for ( int i = 0; i < SBH_TEST_BATCH; i++ )
+		{
+			pHeap->Free( pBlocks[i] );
+		}
+		pHeap->Compact( false );
+		SBH_TEST_CHECK( pHeap->CountThreadCachedBlocks( iPool ) == 0 );
+		SBH_TEST_CHECK( pPool->CountCommittedBlocks() == 0 );
+#ifdef TRACK_SBH_COUNTS
+		pHeap->CountPoolBlocks( iPool, nAllocated, nFree );
+		SBH_TEST_CHECK( nAllocated == 0 );
+		SBH_TEST_CHECK( nFree == 0 );
+#endif
+		SBH_TEST_CHECK( pHeap->Validate() );
+	}
+	else
+	{
+		Msg( "Small block heap compaction is off, skipping the compact test\n" );
+	}
+
+	return bResult;
+}
+
+bool RunSmallBlockHeapTests()
+{
+	Msg( "Running small block heap tests\n" );
+	bool bResult = CSmallBlockHeapTest::Run();
+	Msg( "Small block heap tests %s\n", bResult ? "passed" : "FAILED" );
+	return bResult;
+}
+
+#else
+
+bool RunSmallBlockHeapTests()
+{
+	Msg( "Small block heap tests skipped, this build has no small block heap thread caches\n" );
+	return true;
+}
+
+#endif
+
 #endif // STEAM
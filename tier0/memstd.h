@@ -70,6 +70,15 @@
 #define TRACK_SBH_COUNTS
 #endif
 
+// Per-thread magazines in front of the shared pool free lists (disable with -nosbhthreadcache)
+#if defined( MEM_SBH_ENABLED ) && IS_WINDOWS_PC
+#define MEM_SBH_THREAD_CACHE 1
+#define SBH_MAGAZINE_BYTES		(8*1024)	// a magazine holds about this many bytes of blocks
+#define SBH_MAGAZINE_MAX_COUNT	64
+#define SBH_MAGAZINE_MAX_BLOCK	1024		// larger blocks always go to the shared pool
+#define SBH_INVALID_FLS_INDEX	0xFFFFFFFF	// FLS_OUT_OF_INDEXES
+#endif
+
 #if defined(_X360)
 
 // 360 uses a 48MB primary (physical) SBH and 10MB secondary (virtual) SBH, with no fallback
@@ -132,6 +141,8 @@ public:
 	size_t GetBlockSize();
 	void *Alloc();
 	void Free( void *p );
+	int AllocBatch( byte **ppBlocks, int nBlocks );
+	void FreeBatch( byte **ppBlocks, int nBlocks );
 	int CountFreeBlocks();
 	size_t GetCommittedSize();
 	int CountCommittedBlocks();
@@ -148,6 +159,7 @@ public:
 private:
 	typedef CSmallBlockHeap<CAllocator> CHeap;
 	friend class CSmallBlockHeap<CAllocator>;
+	friend class CSmallBlockHeapTest;
 
 	struct PageStatus_t : public TSLNodeBase_t
 	{
@@ -179,6 +191,10 @@ private:
 	static int PageSort( const void *p1, const void *p2 ) ;
 	bool RemovePagesFromFreeList( byte **pPages, int nPages, bool bSortList );
 
+	// Callers hold the shared lock for read
+	byte *AllocLocked( SharedData_t *pSharedData );
+	void FreeLocked( SharedData_t *pSharedData, void *p );
+
 	void ValidateFreelist( SharedData_t *pSharedData );
 
 	CFreeList				m_FreeList;
@@ -197,6 +213,10 @@ private:
 	CInterlockedInt			m_nFreeBlocks;
 #endif
 
+#ifdef MEM_SBH_THREAD_CACHE
+	int						m_nMagazineSize;	// 0 if blocks of this pool are not cached per thread
+#endif
+
 	static SharedData_t *GetSharedData()
 	{
 		return &gm_SharedData;
@@ -234,15 +254,53 @@ public:
 private:
 	typedef CSmallBlockPool<CAllocator> CPool;
 	typedef struct CSmallBlockPool<CAllocator>::SharedData_t SharedData_t;
+	friend class CSmallBlockHeapTest;
 
 	CPool *FindPool( size_t nBytes );
 	CPool *FindPool( void *p );
+	void CountPoolBlocks( int iPool, uint &nAllocatedBlocks, uint &nFreeBlocks );
 
 	// Map size to a pool address to a pool
 	CPool *m_PoolLookup[ MAX_SBH_BLOCK >> SBH_BLOCK_LOOKUP_GRANULARITY ];
 	CPool m_Pools[NUM_POOLS];
 
 	SharedData_t *m_pSharedData;
+
+#ifdef MEM_SBH_THREAD_CACHE
+	// Blocks a thread freed, kept for its next allocations of the same size. A
+	// magazine refills from and spills to its pool half a magazine at a time, so
+	// the shared free lists see a fraction of the traffic. Blocks freed by another
+	// thread than the one that allocated them simply join the freeing thread's
+	// magazine; all blocks of a pool are interchangeable.
+	struct Magazine_t
+	{
+		byte *	m_pHead;	// blocks are linked through their first word
+		int		m_nCount;
+	};
+
+	struct ThreadCache_t
+	{
+		CThreadFastMutex	m_Mutex;	// only contended when compacting, validating or dumping stats
+		CInterlockedInt		m_nInUse;	// cleared when the owning thread exits so the cache can be reused
+		ThreadCache_t *		m_pNext;
+		CSmallBlockHeap *	m_pHeap;
+		Magazine_t			m_Magazines[NUM_POOLS];
+	};
+
+	ThreadCache_t *GetThreadCache();
+	ThreadCache_t *CreateThreadCache();
+	void *AllocFromThreadCache( ThreadCache_t *pCache, CPool *pPool );
+	void FreeToThreadCache( ThreadCache_t *pCache, CPool *pPool, void *p );
+	void DrainThreadCache( ThreadCache_t *pCache );
+	void DrainThreadCaches();
+	int CountThreadCachedBlocks( int iPool );
+	bool ValidateThreadCaches();
+	static void WINAPI ThreadCacheExitCallback( void *pData );
+
+	ThreadCache_t * volatile	m_pThreadCaches;	// every cache ever created; caches are never freed
+	CThreadFastMutex			m_ThreadCacheListMutex;
+	uint32						m_iThreadCacheSlot;	// FLS index, SBH_INVALID_FLS_INDEX if caching is off
+#endif
 };
 
 //-----------------------------------------------------------------------------
@@ -329,6 +329,33 @@ bool CCommandBuffer::DequeueNextCommand( CCommand* pCommand )
 	return true;
 }
 
+//-----------------------------------------------------------------------------
+// Returns the next command without tokenizing it
+//-----------------------------------------------------------------------------
+bool CCommandBuffer::DequeueNextCommandText( const char **ppCommandText, cmd_source_t *pSource )
+{
+	*ppCommandText = NULL;
+
+	Assert( m_bIsProcessingCommands );
+	if ( m_Commands.Count() == 0 )
+		return false;
+
+	intp nHead = m_Commands.Head();
+	Command_t &command = m_Commands[ nHead ];
+	if ( command.m_nTick > m_nLastTickToProcess )
+		return false;
+
+	m_nCurrentTick = command.m_nTick;
+	*ppCommandText = ( command.m_nBufferSize > 0 ) ? &m_pArgSBuffer[command.m_nFirstArgS] : "";
+	*pSource = command.m_source;
+
+	m_Commands.Remove( nHead );
+
+	// Necessary to insert commands while commands are being processed
+	m_hNextCommand = m_Commands.Head();
+	return true;
+}
+
 //-----------------------------------------------------------------------------
 // Compacts the command buffer
 //-----------------------------------------------------------------------------
@@ -411,6 +411,64 @@ characterset_t* CCommand::DefaultBreakSet()
 	return &s_BreakSet;
 }
 
+//-----------------------------------------------------------------------------
+// Saved tokenized form: header, then the command string, then the argv
+// strings back to back (which is how Tokenize lays them out)
+//-----------------------------------------------------------------------------
+struct TokenizedCommandHeader_t
+{
+	int16 m_nArgc;
+	int16 m_nArgv0Size;
+	int16 m_nArgSLen;
+	int16 m_nArgvLen;
+};
+
+static int TokenizedArgvLength( int nArgc, const char *pArgvBuffer, const char * const *ppArgv )
+{
+	if ( !nArgc )
+		return 0;
+	return ( ppArgv[nArgc-1] - pArgvBuffer ) + V_strlen( ppArgv[nArgc-1] ) + 1;
+}
+
+int CCommand::GetTokenizedSize() const
+{
+	return sizeof( TokenizedCommandHeader_t ) + V_strlen( m_pArgSBuffer ) + 1 + TokenizedArgvLength( m_nArgc, m_pArgvBuffer, m_ppArgv );
+}
+
+void CCommand::SaveTokenized( void *pDest ) const
+{
+	TokenizedCommandHeader_t *pHeader = (TokenizedCommandHeader_t *)pDest;
+	pHeader->m_nArgc = m_nArgc;
+	pHeader->m_nArgv0Size = m_nArgv0Size;
+	pHeader->m_nArgSLen = V_strlen( m_pArgSBuffer ) + 1;
+	pHeader->m_nArgvLen = TokenizedArgvLength( m_nArgc, m_pArgvBuffer, m_ppArgv );
+
+	char *pData = (char *)( pHeader + 1 );
+	memcpy( pData, m_pArgSBuffer, pHeader->m_nArgSLen );
+	memcpy( pData + pHeader->m_nArgSLen, m_pArgvBuffer, pHeader->m_nArgvLen );
+}
+
+void CCommand::RestoreTokenized( const void *pSrc, cmd_source_t source )
+{
+	const TokenizedCommandHeader_t *pHeader = (const TokenizedCommandHeader_t *)pSrc;
+	Assert( pHeader->m_nArgSLen <= COMMAND_MAX_LENGTH && pHeader->m_nArgvLen <= COMMAND_MAX_LENGTH && pHeader->m_nArgc <= COMMAND_MAX_ARGC );
+
+	const char *pData = (const char *)( pHeader + 1 );
+	memcpy( m_pArgSBuffer, pData, pHeader->m_nArgSLen );
+	memcpy( m_pArgvBuffer, pData + pHeader->m_nArgSLen, pHeader->m_nArgvLen );
+
+	m_nArgc = pHeader->m_nArgc;
+	m_nArgv0Size = pHeader->m_nArgv0Size;
+	m_source = source;
+
+	const char *pArgv = m_pArgvBuffer;
+	for ( int i = 0; i < m_nArgc; ++i )
+	{
+		m_ppArgv[i] = pArgv;
+		pArgv += V_strlen( pArgv ) + 1;
+	}
+}
+
 bool CCommand::Tokenize( const char *pCommand, cmd_source_t source, characterset_t *pBreakSet )
 {
 	Reset();
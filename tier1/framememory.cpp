@@ -0,0 +1,190 @@
+//===== Copyright  1996-2005, Valve Corporation, All rights reserved. ======//
+//
+// Purpose: Per-thread frame arenas for allocations that die within a frame
+//
+//===========================================================================//
+
+#include "tier0/dbg.h"
+#include "tier1/framememory.h"
+#include "tier1/memstack.h"
+#include "tier1/utlsortvector.h"
+#include "tier0/memdbgon.h"
+
+// Each thread reserves this much for its arena; past it allocations come from the heap
+#define FRAME_ARENA_SIZE		( 512 * 1024 )
+
+//-----------------------------------------------------------------------------
+// Per-thread arena
+//-----------------------------------------------------------------------------
+struct FrameArena_t
+{
+	CMemoryStack m_Stack;
+	CUtlVector< void * > m_Overflow;	// heap blocks handed out once the stack was full
+	int m_nFrame;						// frame the arena was last recycled for
+	int m_nPeakUsed;
+	int m_nOverflowBytes;
+	int m_nPeakOverflowBytes;
+};
+
+static CTHREADLOCALPTR( FrameArena_t ) s_pThreadArena;
+static CUtlVector< FrameArena_t * > s_FrameArenas;	// every arena ever created, for stats
+static CThreadFastMutex s_FrameArenasMutex;
+static CInterlockedInt s_nFrame;
+
+CFrameAllocCounter *CFrameAllocCounter::s_pFirst = NULL;
+
+DEFINE_FRAME_ALLOC_COUNTER( FrameAlloc );
+DEFINE_FRAME_ALLOC_COUNTER( FrameAllocOverflow );
+
+//-----------------------------------------------------------------------------
+// Counters register themselves during static construction, no lock needed
+//-----------------------------------------------------------------------------
+CFrameAllocCounter::CFrameAllocCounter( const char *pszName ) : m_pszName( pszName ), m_nLastFrameAllocs( 0 ), m_nLastFrameBytes( 0 ), m_nPeakFrameAllocs( 0 ), m_nTotalAllocs( 0 )
+{
+	m_nAllocs = 0;
+	m_nBytes = 0;
+	m_pNext = s_pFirst;
+	s_pFirst = this;
+}
+
+void CFrameAllocCounter::EndFrame()
+{
+	int nAllocs, nBytes;
+	do
+	{
+		nAllocs = m_nAllocs;
+	} while ( !m_nAllocs.AssignIf( nAllocs, 0 ) );
+	do
+	{
+		nBytes = m_nBytes;
+	} while ( !m_nBytes.AssignIf( nBytes, 0 ) );
+
+	m_nLastFrameAllocs = nAllocs;
+	m_nLastFrameBytes = nBytes;
+	m_nPeakFrameAllocs = MAX( m_nPeakFrameAllocs, nAllocs );
+	m_nTotalAllocs += nAllocs;
+}
+
+//-----------------------------------------------------------------------------
+// Arena management
+//-----------------------------------------------------------------------------
+static FrameArena_t *CreateThreadArena()
+{
+	FrameArena_t *pArena = new FrameArena_t;
+	pArena->m_Stack.Init( "FrameArena", FRAME_ARENA_SIZE, 64 * 1024, 0, 16 );
+	pArena->m_nFrame = s_nFrame;
+	pArena->m_nPeakUsed = 0;
+	pArena->m_nOverflowBytes = 0;
+	pArena->m_nPeakOverflowBytes = 0;
+
+	AUTO_LOCK_FM( s_FrameArenasMutex );
+	s_FrameArenas.AddToTail( pArena );
+	return pArena;
+}
+
+static void RecycleThreadArena( FrameArena_t *pArena )
+{
+	pArena->m_nPeakUsed = MAX( pArena->m_nPeakUsed, pArena->m_Stack.GetUsed() );
+	pArena->m_nPeakOverflowBytes = MAX( pArena->m_nPeakOverflowBytes, pArena->m_nOverflowBytes );
+
+	// Keep what is committed, the next frame will most likely need it again
+	pArena->m_Stack.FreeAll( false );
+	for ( int i = 0; i < pArena->m_Overflow.Count(); ++i )
+	{
+		MemAlloc_FreeAligned( pArena->m_Overflow[i] );
+	}
+	pArena->m_Overflow.RemoveAll();
+	pArena->m_nOverflowBytes = 0;
+	pArena->m_nFrame = s_nFrame;
+}
+
+void *FrameAlloc( size_t nBytes, CFrameAllocCounter *pCounter )
+{
+	FrameArena_t *pArena = s_pThreadArena;
+	if ( !pArena )
+	{
+		pArena = CreateThreadArena();
+		s_pThreadArena = pArena;
+	}
+	else if ( pArena->m_nFrame != s_nFrame )
+	{
+		RecycleThreadArena( pArena );
+	}
+
+	COUNT_FRAME_ALLOC( FrameAlloc, nBytes );
+	if ( pCounter )
+	{
+		pCounter->Count( nBytes );
+	}
+
+	// Check the fit up front, running the stack out of space reports an out of memory
+	void *pMemory = NULL;
+	if ( pArena->m_Stack.GetUsed() + AlignValue( MAX( nBytes, 16 ), 16 ) <= (size_t)pArena->m_Stack.GetMaxSize() )
+	{
+		pMemory = pArena->m_Stack.Alloc( nBytes );
+	}
+	if ( !pMemory )
+	{
+		COUNT_FRAME_ALLOC( FrameAllocOverflow, nBytes );
+		pMemory = MemAlloc_AllocAligned( nBytes, 16 );
+		pArena->m_Overflow.AddToTail( pMemory );
+		pArena->m_nOverflowBytes += nBytes;
+	}
+	return pMemory;
+}
+
+void FrameMemory_EndFrame()
+{
+	++s_nFrame;
+	for ( CFrameAllocCounter *pCounter = CFrameAllocCounter::GetFirst(); pCounter; pCounter = pCounter->GetNext() )
+	{
+		pCounter->EndFrame();
+	}
+}
+
+int FrameMemory_GetFrame()
+{
+	return s_nFrame;
+}
+
+//-----------------------------------------------------------------------------
+// Stats
+//-----------------------------------------------------------------------------
+class CFrameAllocCounterLess
+{
+public:
+	bool Less( CFrameAllocCounter * const &pLeft, CFrameAllocCounter * const &pRight, void *pCtx )
+	{
+		if ( pLeft->GetLastFrameAllocs() != pRight->GetLastFrameAllocs() )
+			return pLeft->GetLastFrameAllocs() > pRight->GetLastFrameAllocs();
+		return pLeft->GetTotalAllocs() > pRight->GetTotalAllocs();
+	}
+};
+
+void FrameMemory_PrintStats( int nMaxCounters )
+{
+	{
+		AUTO_LOCK_FM( s_FrameArenasMutex );
+		Msg( "Frame arenas: %d threads, frame %d\n", s_FrameArenas.Count(), (int)s_nFrame );
+		for ( int i = 0; i < s_FrameArenas.Count(); ++i )
+		{
+			FrameArena_t *pArena = s_FrameArenas[i];
+			Msg( "  arena %d: peak %d of %d bytes, peak overflow %d bytes\n", i,
+				MAX( pArena->m_nPeakUsed, pArena->m_Stack.GetUsed() ), pArena->m_Stack.GetMaxSize(), pArena->m_nPeakOverflowBytes );
+		}
+	}
+
+	CUtlSortVector< CFrameAllocCounter *, CFrameAllocCounterLess > sorted;
+	for ( CFrameAllocCounter *pCounter = CFrameAllocCounter::GetFirst(); pCounter; pCounter = pCounter->GetNext() )
+	{
+		sorted.Insert( pCounter );
+	}
+
+	Msg( "%-40s %10s %10s %10s %14s\n", "Allocation counter", "allocs", "bytes", "peak", "total" );
+	for ( int i = 0; i < sorted.Count() && i < nMaxCounters; ++i )
+	{
+		CFrameAllocCounter *pCounter = sorted[i];
+		Msg( "%-40s %10d %10d %10d %14lld\n", pCounter->GetName(), pCounter->GetLastFrameAllocs(), pCounter->GetLastFrameBytes(),
+			pCounter->GetPeakFrameAllocs(), pCounter->GetTotalAllocs() );
+	}
+}
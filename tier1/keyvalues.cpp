@@ -29,6 +29,9 @@
 #include "utlbuffer.h"
 #include "utlhash.h"
 #include "tier0/vprof.h"
+#include "tier0/icommandline.h"
+#include "tier1/checksum_crc.h"
+#include "tier1/kvpacker.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include <tier0/memdbgon.h>
@@ -718,6 +721,90 @@ void KeyValues::UsesEscapeSequences(bool state)
 }
 
 
+//-----------------------------------------------------------------------------
+// Compiled script cache. With -kvcache the trees LoadFromFile parses are also
+// written out in KVPacker's compiled format under DEFAULT_WRITE_PATH, and a later
+// load of the same text reads them back instead of tokenizing it again. Text that
+// pulls in other files or has conditionals isn't cached, the result of parsing it
+// depends on more than its own bytes.
+//-----------------------------------------------------------------------------
+#define KV_COMPILED_CACHE_ID		( ('C'<<24)+('C'<<16)+('V'<<8)+'K' )
+
+static bool IsCompiledCacheEnabled()
+{
+	static int s_nEnabled = -1;
+	if ( s_nEnabled < 0 )
+	{
+		s_nEnabled = CommandLine()->FindParm( "-kvcache" ) ? 1 : 0;
+	}
+	return s_nEnabled != 0;
+}
+
+static bool IsCompiledCacheable( const char *pText )
+{
+	return !V_stristr( pText, "#include" ) && !V_stristr( pText, "#base" ) && !V_strstr( pText, "[$" ) && !V_strstr( pText, "[!$" );
+}
+
+static void GetCompiledCacheFileName( const char *resourceName, const char *pathID, char *pOut, int nOutSize )
+{
+	char szKey[MAX_PATH * 2];
+	V_snprintf( szKey, sizeof( szKey ), "%s:%s", pathID ? pathID : "", resourceName );
+	V_FixSlashes( szKey, '/' );
+	V_strlower( szKey );
+	V_snprintf( pOut, nOutSize, "kvcache/%08x.kvc", CRC32_ProcessSingleBuffer( szKey, V_strlen( szKey ) ) );
+}
+
+// The cache header records what the tree was parsed from; any change to the text invalidates it
+static void PutCompiledCacheHeader( CUtlBuffer &buf, long nSourceTime, const char *pText, int nTextSize, bool bEscapeSequences )
+{
+	buf.PutInt( KV_COMPILED_CACHE_ID );
+	buf.PutInt( KVPacker::k_nCompiledVersion );
+	buf.PutInt( (int)nSourceTime );
+	buf.PutInt( nTextSize );
+	buf.PutUnsignedInt( CRC32_ProcessSingleBuffer( pText, nTextSize ) );
+	buf.PutUnsignedChar( bEscapeSequences ? 1 : 0 );
+}
+
+bool KeyValues::LoadFromCompiledCache( IBaseFileSystem *filesystem, const char *resourceName, const char *pathID, const char *pText, int nTextSize )
+{
+	char szCacheName[MAX_PATH];
+	GetCompiledCacheFileName( resourceName, pathID, szCacheName, sizeof( szCacheName ) );
+
+	CUtlBuffer cacheBuf;
+	if ( !filesystem->ReadFile( szCacheName, "DEFAULT_WRITE_PATH", cacheBuf ) )
+		return false;
+
+	CUtlBuffer expected;
+	PutCompiledCacheHeader( expected, filesystem->GetFileTime( resourceName, pathID ), pText, nTextSize, m_bHasEscapeSequences != 0 );
+	if ( cacheBuf.TellPut() < expected.TellPut() || V_memcmp( cacheBuf.Base(), expected.Base(), expected.TellPut() ) )
+		return false;
+	cacheBuf.SeekGet( CUtlBuffer::SEEK_HEAD, expected.TellPut() );
+
+	if ( !KVPacker().ReadAsCompiled( this, cacheBuf ) )
+	{
+		// throw away whatever got read, the text is parsed into a clean key
+		bool bEscapeSequences = m_bHasEscapeSequences != 0;
+		RemoveEverything();
+		Init();
+		UsesEscapeSequences( bEscapeSequences );
+		return false;
+	}
+	return true;
+}
+
+void KeyValues::SaveToCompiledCache( IBaseFileSystem *filesystem, const char *resourceName, const char *pathID, const char *pText, int nTextSize )
+{
+	CUtlBuffer cacheBuf;
+	PutCompiledCacheHeader( cacheBuf, filesystem->GetFileTime( resourceName, pathID ), pText, nTextSize, m_bHasEscapeSequences != 0 );
+	if ( !KVPacker().WriteAsCompiled( this, cacheBuf ) )
+		return;
+
+	char szCacheName[MAX_PATH];
+	GetCompiledCacheFileName( resourceName, pathID, szCacheName, sizeof( szCacheName ) );
+	((IFileSystem *)filesystem)->CreateDirHierarchy( "kvcache", "DEFAULT_WRITE_PATH" );
+	filesystem->WriteFile( szCacheName, "DEFAULT_WRITE_PATH", cacheBuf );
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: Load keyValues from disk
 //-----------------------------------------------------------------------------
@@ -747,7 +834,16 @@ bool KeyValues::LoadFromFile( IBaseFileSystem *filesystem, const char *resourceN
 	{
 		buffer[fileSize] = 0; // null terminate file as EOF
 		buffer[fileSize+1] = 0; // double NULL terminating in case this is a unicode file
-		bRetOK = LoadFromBuffer( resourceName, buffer, filesystem, pathID, pfnEvaluateSymbolProc );
+
+		bool bUseCache = !pfnEvaluateSymbolProc && IsCompiledCacheEnabled() && IsCompiledCacheable( buffer );
+		if ( !bUseCache || !LoadFromCompiledCache( filesystem, resourceName, pathID, buffer, fileSize ) )
+		{
+			bRetOK = LoadFromBuffer( resourceName, buffer, filesystem, pathID, pfnEvaluateSymbolProc );
+			if ( bRetOK && bUseCache )
+			{
+				SaveToCompiledCache( filesystem, resourceName, pathID, buffer, fileSize );
+			}
+		}
 	}
 
 	((IFileSystem *)filesystem)->FreeOptimalReadBuffer( buffer );
@@ -1864,6 +1960,11 @@ void KeyValues::SetName( const char * setName )
 	HKeySymbol hCaseSensitiveKeyName = INVALID_KEY_SYMBOL, hCaseInsensitiveKeyName = INVALID_KEY_SYMBOL;
 	hCaseSensitiveKeyName = KeyValuesSystem()->GetSymbolForStringCaseSensitive( hCaseInsensitiveKeyName, setName );
 
+	SetNameSymbols( hCaseInsensitiveKeyName, hCaseSensitiveKeyName );
+}
+
+void KeyValues::SetNameSymbols( int hCaseInsensitiveKeyName, int hCaseSensitiveKeyName )
+{
 	m_iKeyName = hCaseInsensitiveKeyName;
 	SPLIT_3_BYTES_INTO_1_AND_2( m_iKeyNameCaseSensitive1, m_iKeyNameCaseSensitive2, hCaseSensitiveKeyName );
 }
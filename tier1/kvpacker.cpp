@@ -11,6 +11,7 @@
 
 #include "tier0/dbg.h"
 #include "utlbuffer.h"
+#include "vstdlib/ikeyvaluessystem.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include <tier0/memdbgon.h>
@@ -283,3 +284,241 @@ bool KVPacker::ReadAsBinary( KeyValues *pNode, CUtlBuffer &buffer )
 	return buffer.IsValid();
 }
 
+
+// writes a list of peers (and their subkeys) in the compiled format, collecting key names as it goes
+bool KVPacker::WriteCompiledPeers( KeyValues *pNode, CUtlBuffer &buffer, CUtlMap< int, int > &keyIndices, CUtlVector< const char * > &keyNames )
+{
+	for ( KeyValues *dat = pNode; dat != NULL; dat = dat->GetNextKey() )
+	{
+		EPackType ePackType;
+		switch ( dat->GetDataType() )
+		{
+		case KeyValues::TYPE_NONE:		ePackType = PACKTYPE_NONE; break;
+		case KeyValues::TYPE_STRING:	ePackType = PACKTYPE_STRING; break;
+		case KeyValues::TYPE_WSTRING:	ePackType = PACKTYPE_WSTRING; break;
+		case KeyValues::TYPE_INT:		ePackType = PACKTYPE_INT; break;
+		case KeyValues::TYPE_UINT64:	ePackType = PACKTYPE_UINT64; break;
+		case KeyValues::TYPE_FLOAT:		ePackType = PACKTYPE_FLOAT; break;
+		case KeyValues::TYPE_COLOR:		ePackType = PACKTYPE_COLOR; break;
+		default:
+			// pointers mean nothing once written out
+			return false;
+		}
+		buffer.PutUnsignedChar( ePackType );
+
+		// write name as an index into the key table
+		int nSymbol = dat->GetNameSymbolCaseSensitive();
+		int iKey = keyIndices.Find( nSymbol );
+		if ( iKey == keyIndices.InvalidIndex() )
+		{
+			iKey = keyIndices.Insert( nSymbol, keyNames.AddToTail( dat->GetName() ) );
+		}
+		buffer.PutInt( keyIndices[iKey] );
+
+		// write value
+		switch ( ePackType )
+		{
+		case PACKTYPE_NONE:
+			if ( !WriteCompiledPeers( dat->GetFirstSubKey(), buffer, keyIndices, keyNames ) )
+				return false;
+			break;
+		case PACKTYPE_STRING:
+			buffer.PutString( dat->GetString() ? dat->GetString() : "" );
+			break;
+		case PACKTYPE_WSTRING:
+			{
+				int nLength = dat->GetWString() ? Q_wcslen( dat->GetWString() ) : 0;
+				buffer.PutInt( nLength );
+				for( int k = 0; k < nLength; ++ k )
+				{
+					buffer.PutShort( ( unsigned short ) dat->GetWString()[k] );
+				}
+				break;
+			}
+		case PACKTYPE_INT:
+			buffer.PutInt( dat->GetInt() );
+			break;
+		case PACKTYPE_UINT64:
+			buffer.PutInt64( dat->GetUint64() );
+			break;
+		case PACKTYPE_FLOAT:
+			buffer.PutFloat( dat->GetFloat() );
+			break;
+		case PACKTYPE_COLOR:
+			{
+				Color color = dat->GetColor();
+				buffer.PutUnsignedChar( color[0] );
+				buffer.PutUnsignedChar( color[1] );
+				buffer.PutUnsignedChar( color[2] );
+				buffer.PutUnsignedChar( color[3] );
+				break;
+			}
+		default:
+			break;
+		}
+	}
+
+	// write tail, marks end of peers
+	buffer.PutUnsignedChar( PACKTYPE_NULLMARKER ); 
+
+	return buffer.IsValid();
+}
+
+// writes pNode and its peers in the compiled format: the key table, then the tree
+bool KVPacker::WriteAsCompiled( KeyValues *pNode, CUtlBuffer &buffer )
+{
+	if ( buffer.IsText() ) // must be a binary buffer
+		return false;
+
+	CUtlMap< int, int > keyIndices( DefLessFunc( int ) );
+	CUtlVector< const char * > keyNames;
+	CUtlBuffer treeBuffer;
+	if ( !WriteCompiledPeers( pNode, treeBuffer, keyIndices, keyNames ) )
+		return false;
+
+	buffer.PutInt( keyNames.Count() );
+	for ( int i = 0; i < keyNames.Count(); i++ )
+	{
+		buffer.PutString( keyNames[i] );
+	}
+	buffer.Put( treeBuffer.Base(), treeBuffer.TellPut() );
+
+	return buffer.IsValid();
+}
+
+// reads a list of peers. The first one is read into pNode if given, otherwise the
+// list is made up of new keys that become pParent's subkeys.
+bool KVPacker::ReadCompiledPeers( KeyValues *pParent, KeyValues *pNode, CUtlBuffer &buffer, const CUtlVector< int > &keySymbols, const CUtlVector< int > &keySymbolsCaseSensitive, int nStackDepth )
+{
+	if ( nStackDepth > 100 )
+	{
+		AssertMsgOnce( false, "KVPacker::ReadAsCompiled() stack depth > 100\n" );
+		return false;
+	}
+
+	bool bEscapeSequences = ( pParent ? pParent : pNode )->m_bHasEscapeSequences != 0;
+	KeyValues *pPrev = NULL;
+	while ( true )
+	{
+		EPackType ePackType = (EPackType)buffer.GetUnsignedChar();
+		if ( !buffer.IsValid() )
+			return false;
+		if ( ePackType == PACKTYPE_NULLMARKER )
+			break; // no more peers
+
+		KeyValues *dat = pNode;
+		pNode = NULL;
+		if ( !dat )
+		{
+			dat = new KeyValues( "" );
+			dat->UsesEscapeSequences( bEscapeSequences );
+			if ( pPrev )
+			{
+				pPrev->SetNextKey( dat );
+			}
+			else
+			{
+				Assert( pParent && !pParent->m_pSub );
+				pParent->m_pSub = dat;
+			}
+		}
+		pPrev = dat;
+
+		int iKey = buffer.GetInt();
+		if ( iKey < 0 || iKey >= keySymbols.Count() )
+			return false;
+		dat->SetNameSymbols( keySymbols[iKey], keySymbolsCaseSensitive[iKey] );
+
+		switch ( ePackType )
+		{
+		case PACKTYPE_NONE:
+			if ( !ReadCompiledPeers( dat, NULL, buffer, keySymbols, keySymbolsCaseSensitive, nStackDepth + 1 ) )
+				return false;
+			break;
+		case PACKTYPE_STRING:
+			{
+				// strings are read in place, there is no limit on their length
+				int nLength = buffer.PeekStringLength();
+				if ( nLength <= 0 || nLength > buffer.GetBytesRemaining() || ( (const char *)buffer.PeekGet() )[nLength - 1] )
+					return false;
+				dat->SetStringValue( (const char *)buffer.PeekGet() );
+				buffer.SeekGet( CUtlBuffer::SEEK_CURRENT, nLength );
+				break;
+			}
+		case PACKTYPE_WSTRING:
+			{
+				int nLength = buffer.GetInt();
+				if ( nLength < 0 || nLength*sizeof( uint16 ) > (uint)buffer.GetBytesRemaining() )
+					return false;
+
+				wchar_t *pTemp = (wchar_t *)malloc( sizeof( wchar_t ) * (1 + nLength) );
+				for ( int k = 0; k < nLength; ++k )
+				{
+					pTemp[k] = (unsigned short)buffer.GetShort();
+				}
+				pTemp[nLength] = 0;
+				dat->SetWString( NULL, pTemp );
+				free( pTemp );
+				break;
+			}
+		case PACKTYPE_INT:
+			dat->SetInt( NULL, buffer.GetInt() );
+			break;
+		case PACKTYPE_UINT64:
+			dat->SetUint64( NULL, (uint64)buffer.GetInt64() );
+			break;
+		case PACKTYPE_FLOAT:
+			dat->SetFloat( NULL, buffer.GetFloat() );
+			break;
+		case PACKTYPE_COLOR:
+			{
+				Color color( 
+					buffer.GetUnsignedChar(),
+					buffer.GetUnsignedChar(),
+					buffer.GetUnsignedChar(),
+					buffer.GetUnsignedChar() );
+				dat->SetColor( NULL, color );
+				break;
+			}
+		default:
+			return false;
+		}
+
+		if ( !buffer.IsValid() ) // error occured
+			return false;
+	}
+
+	return buffer.IsValid();
+}
+
+// read KeyValues written by WriteAsCompiled, returns true if it was all there
+bool KVPacker::ReadAsCompiled( KeyValues *pNode, CUtlBuffer &buffer )
+{
+	if ( buffer.IsText() ) // must be a binary buffer
+		return false;
+
+	pNode->Clear();
+
+	// intern every key name once
+	int nKeys = buffer.GetInt();
+	if ( !buffer.IsValid() || nKeys < 0 || nKeys > buffer.GetBytesRemaining() )
+		return false;
+
+	CUtlVector< int > keySymbols;
+	CUtlVector< int > keySymbolsCaseSensitive;
+	keySymbols.SetCount( nKeys );
+	keySymbolsCaseSensitive.SetCount( nKeys );
+	for ( int i = 0; i < nKeys; i++ )
+	{
+		int nLength = buffer.PeekStringLength();
+		if ( nLength <= 0 || nLength > buffer.GetBytesRemaining() || ( (const char *)buffer.PeekGet() )[nLength - 1] )
+			return false;
+
+		HKeySymbol hCaseInsensitive = INVALID_KEY_SYMBOL;
+		keySymbolsCaseSensitive[i] = KeyValuesSystem()->GetSymbolForStringCaseSensitive( hCaseInsensitive, (const char *)buffer.PeekGet() );
+		keySymbols[i] = hCaseInsensitive;
+		buffer.SeekGet( CUtlBuffer::SEEK_CURRENT, nLength );
+	}
+
+	return ReadCompiledPeers( NULL, pNode, buffer, keySymbols, keySymbolsCaseSensitive, 0 );
+}
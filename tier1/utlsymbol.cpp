@@ -369,6 +369,248 @@ void CUtlSymbolTable::RemoveAll()
 }
 
 
+//-----------------------------------------------------------------------------
+// CUtlSymbolTableMT
+//-----------------------------------------------------------------------------
+CUtlSymbolTableMT::CUtlSymbolTableMT( int growSize, int initSize, bool caseInsensitive ) :
+	m_bInsensitive( caseInsensitive )
+{
+	// keep each shard at most half full for the expected number of strings
+	int nCapacity = 16;
+	while ( nCapacity * NUM_SHARDS < initSize * 2 )
+	{
+		nCapacity <<= 1;
+	}
+	m_nInitialShardCapacity = nCapacity;
+
+	for ( int i = 0; i < NUM_SHARDS; i++ )
+	{
+		m_Shards[i].m_pTable = NULL;
+		m_Shards[i].m_nCount = 0;
+	}
+	memset( (void *)m_pSymbolBlocks, 0, sizeof( m_pSymbolBlocks ) );
+}
+
+CUtlSymbolTableMT::~CUtlSymbolTableMT()
+{
+	RemoveAll();
+}
+
+inline unsigned int CUtlSymbolTableMT::HashSymbolString( const char *pString ) const
+{
+	return m_bInsensitive ? HashStringCaseless( pString ) : HashString( pString );
+}
+
+inline bool CUtlSymbolTableMT::StringsMatch( const char *pString1, const char *pString2 ) const
+{
+	return m_bInsensitive ? !V_stricmp( pString1, pString2 ) : !V_strcmp( pString1, pString2 );
+}
+
+//-----------------------------------------------------------------------------
+// Probes one table without locking. Only slots whose symbol is set are
+// looked at, and the symbol is written last, so the hash and string are valid.
+//-----------------------------------------------------------------------------
+UtlSymId_t CUtlSymbolTableMT::FindInTable( const HashTable_t *pTable, unsigned int nHash, const char *pString ) const
+{
+	if ( !pTable )
+		return UTL_INVAL_SYMBOL;
+
+	// The low bits picked the shard, probe with the rest
+	for ( unsigned int nSlot = ( nHash / NUM_SHARDS ) & pTable->m_nMask; ; nSlot = ( nSlot + 1 ) & pTable->m_nMask )
+	{
+		const HashSlot_t &slot = pTable->m_Slots[nSlot];
+		unsigned int nSymbolPlusOne = slot.m_nSymbolPlusOne;
+		if ( !nSymbolPlusOne )
+			return UTL_INVAL_SYMBOL;
+
+		ThreadMemoryBarrier();
+		if ( slot.m_nHash == nHash )
+		{
+			UtlSymId_t id = (UtlSymId_t)( nSymbolPlusOne - 1 );
+			if ( StringsMatch( String( id ), pString ) )
+				return id;
+		}
+	}
+}
+
+void CUtlSymbolTableMT::InsertIntoTable( HashTable_t *pTable, unsigned int nHash, UtlSymId_t id )
+{
+	for ( unsigned int nSlot = ( nHash / NUM_SHARDS ) & pTable->m_nMask; ; nSlot = ( nSlot + 1 ) & pTable->m_nMask )
+	{
+		HashSlot_t &slot = pTable->m_Slots[nSlot];
+		if ( slot.m_nSymbolPlusOne )
+			continue;
+
+		slot.m_nHash = nHash;
+		ThreadMemoryBarrier();
+		slot.m_nSymbolPlusOne = (unsigned int)id + 1;
+		return;
+	}
+}
+
+CUtlSymbolTableMT::HashTable_t *CUtlSymbolTableMT::AllocTable( int nCapacity )
+{
+	Assert( IsPowerOfTwo( nCapacity ) );
+	HashTable_t *pTable = (HashTable_t *)malloc( sizeof( HashTable_t ) + ( nCapacity - 1 ) * sizeof( HashSlot_t ) );
+	pTable->m_nMask = nCapacity - 1;
+	memset( pTable->m_Slots, 0, nCapacity * sizeof( HashSlot_t ) );
+	return pTable;
+}
+
+//-----------------------------------------------------------------------------
+// Copies the string into the shard's pools. Called with the shard locked.
+//-----------------------------------------------------------------------------
+const char *CUtlSymbolTableMT::CopyString( Shard_t &shard, const char *pString )
+{
+	int nLen = V_strlen( pString ) + 1;
+
+	StringPool_t *pPool = shard.m_StringPools.Count() ? shard.m_StringPools.Tail() : NULL;
+	if ( !pPool || pPool->m_TotalLen - pPool->m_SpaceUsed < nLen )
+	{
+		int nPoolSize = MAX( nLen + (int)sizeof( StringPool_t ), MIN_STRING_POOL_SIZE );
+		pPool = (StringPool_t *)malloc( nPoolSize );
+		pPool->m_TotalLen = nPoolSize - sizeof( StringPool_t );
+		pPool->m_SpaceUsed = 0;
+		shard.m_StringPools.AddToTail( pPool );
+	}
+
+	char *pCopy = &pPool->m_Data[pPool->m_SpaceUsed];
+	memcpy( pCopy, pString, nLen );
+	pPool->m_SpaceUsed += nLen;
+	return pCopy;
+}
+
+//-----------------------------------------------------------------------------
+// Blocks of the symbol->string map are shared by all shards, so whoever
+// needs a block first installs it.
+//-----------------------------------------------------------------------------
+const char **CUtlSymbolTableMT::GetSymbolBlock( int nBlock )
+{
+	const char **pBlock = m_pSymbolBlocks[nBlock];
+	if ( pBlock )
+		return pBlock;
+
+	const char **pNewBlock = (const char **)malloc( SYMBOL_BLOCK_SIZE * sizeof( const char * ) );
+	memset( pNewBlock, 0, SYMBOL_BLOCK_SIZE * sizeof( const char * ) );
+	pBlock = (const char **)ThreadInterlockedCompareExchangePointer( (void * volatile *)&m_pSymbolBlocks[nBlock], pNewBlock, NULL );
+	if ( pBlock )
+	{
+		// someone beat us to it
+		free( pNewBlock );
+		return pBlock;
+	}
+	return pNewBlock;
+}
+
+CUtlSymbol CUtlSymbolTableMT::Find( const char* pString ) const
+{
+	if ( !pString )
+		return CUtlSymbol();
+
+	unsigned int nHash = HashSymbolString( pString );
+	const Shard_t &shard = m_Shards[nHash % NUM_SHARDS];
+	return CUtlSymbol( FindInTable( shard.m_pTable, nHash, pString ) );
+}
+
+CUtlSymbol CUtlSymbolTableMT::AddString( const char* pString )
+{
+	VPROF( "CUtlSymbolTableMT::AddString" );
+	if ( !pString )
+		return CUtlSymbol( UTL_INVAL_SYMBOL );
+
+	unsigned int nHash = HashSymbolString( pString );
+	Shard_t &shard = m_Shards[nHash % NUM_SHARDS];
+
+	UtlSymId_t id = FindInTable( shard.m_pTable, nHash, pString );
+	if ( id != UTL_INVAL_SYMBOL )
+		return CUtlSymbol( id );
+
+	AUTO_LOCK_FM( shard.m_Mutex );
+
+	// Another thread may have added it since we looked
+	HashTable_t *pTable = shard.m_pTable;
+	id = FindInTable( pTable, nHash, pString );
+	if ( id != UTL_INVAL_SYMBOL )
+		return CUtlSymbol( id );
+
+	int nSymbol = ++m_nSymbols - 1;
+	if ( nSymbol >= UTL_INVAL_SYMBOL )
+	{
+		--m_nSymbols;
+		AssertMsg( 0, "CUtlSymbolTableMT is full" );
+		return CUtlSymbol( UTL_INVAL_SYMBOL );
+	}
+	id = (UtlSymId_t)nSymbol;
+
+	MEM_ALLOC_CREDIT();
+	GetSymbolBlock( id >> SYMBOL_BLOCK_BITS )[id & ( SYMBOL_BLOCK_SIZE - 1 )] = CopyString( shard, pString );
+
+	// Grow into a new table so lock free readers of the old one aren't disturbed
+	if ( !pTable || ( shard.m_nCount + 1 ) * 2 > pTable->m_nMask + 1 )
+	{
+		HashTable_t *pNewTable = AllocTable( pTable ? ( pTable->m_nMask + 1 ) * 2 : m_nInitialShardCapacity );
+		if ( pTable )
+		{
+			for ( int i = 0; i <= pTable->m_nMask; i++ )
+			{
+				const HashSlot_t &slot = pTable->m_Slots[i];
+				if ( slot.m_nSymbolPlusOne )
+				{
+					InsertIntoTable( pNewTable, slot.m_nHash, (UtlSymId_t)( slot.m_nSymbolPlusOne - 1 ) );
+				}
+			}
+			shard.m_RetiredTables.AddToTail( pTable );
+		}
+		InsertIntoTable( pNewTable, nHash, id );
+		ThreadMemoryBarrier();
+		shard.m_pTable = pNewTable;
+	}
+	else
+	{
+		InsertIntoTable( pTable, nHash, id );
+	}
+	shard.m_nCount++;
+
+	return CUtlSymbol( id );
+}
+
+const char* CUtlSymbolTableMT::String( CUtlSymbol id ) const
+{
+	if ( !id.IsValid() )
+		return "";
+
+	const char **pBlock = m_pSymbolBlocks[(UtlSymId_t)id >> SYMBOL_BLOCK_BITS];
+	Assert( pBlock && pBlock[(UtlSymId_t)id & ( SYMBOL_BLOCK_SIZE - 1 )] );
+	return pBlock[(UtlSymId_t)id & ( SYMBOL_BLOCK_SIZE - 1 )];
+}
+
+void CUtlSymbolTableMT::RemoveAll()
+{
+	for ( int i = 0; i < NUM_SHARDS; i++ )
+	{
+		Shard_t &shard = m_Shards[i];
+		free( shard.m_pTable );
+		shard.m_pTable = NULL;
+		shard.m_nCount = 0;
+
+		for ( int j = 0; j < shard.m_RetiredTables.Count(); j++ )
+			free( shard.m_RetiredTables[j] );
+		shard.m_RetiredTables.Purge();
+
+		for ( int j = 0; j < shard.m_StringPools.Count(); j++ )
+			free( shard.m_StringPools[j] );
+		shard.m_StringPools.Purge();
+	}
+
+	for ( int i = 0; i < NUM_SYMBOL_BLOCKS; i++ )
+	{
+		free( (void *)m_pSymbolBlocks[i] );
+		m_pSymbolBlocks[i] = NULL;
+	}
+	m_nSymbols = 0;
+}
+
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 // Input  : *pFileName - 
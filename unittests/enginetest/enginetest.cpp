@@ -0,0 +1,21 @@
+//========= Copyright (c) Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Unit tests for engine code that builds outside of the engine
+//
+//=============================================================================//
+
+#include "unitlib/unitlib.h"
+#include "tier1/tier1.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+
+//-----------------------------------------------------------------------------
+// Used to connect/disconnect the DLL
+//-----------------------------------------------------------------------------
+class CEngineTestAppSystem : public CTier1AppSystem< IAppSystem >
+{
+};
+
+USE_UNITTEST_APPSYSTEM( CEngineTestAppSystem )
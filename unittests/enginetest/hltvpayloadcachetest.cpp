@@ -0,0 +1,101 @@
+//========= Copyright (c) Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Unit tests for the relay packet entities payload cache
+//
+//=============================================================================//
+
+#include "unitlib/unitlib.h"
+#include "hltvpayloadcache.h"
+#include "framesnapshot.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+
+DEFINE_TESTSUITE( HLTVPayloadCacheTestSuite )
+
+// fakes the baseline a spectator builds by acking updates from the relay frames
+static void BuildBaseline( CFrameSnapshotEntry *pEntities, int nEntities )
+{
+	V_memset( pEntities, 0, nEntities * sizeof( CFrameSnapshotEntry ) );
+
+	for ( int i = 0; i < nEntities; i += 3 )
+	{
+		pEntities[i].m_pClass = (ServerClass*)(uintp)( 0x1000 + ( i % 7 ) * 0x40 );
+		pEntities[i].m_nSerialNumber = i * 13;
+		pEntities[i].m_pPackedData = 0x100000 + i;
+	}
+}
+
+static CHLTVPacketEntitiesPayload *EncodePayload( CPacketEntitiesCache &cache, int nDeltaTick, int nBaselineTick, uint64 nBaselineHash, const CFrameSnapshotEntry *pBaseline )
+{
+	CHLTVPacketEntitiesPayload *pPayload = new CHLTVPacketEntitiesPayload;
+	pPayload->m_nDeltaTick = nDeltaTick;
+	pPayload->m_nBaselineTick = nBaselineTick;
+	pPayload->m_nBaselineHash = nBaselineHash;
+	pPayload->m_nBaselineUsed = 1;
+	pPayload->m_bPendingBaseline = true;
+	pPayload->SetBaseline( pBaseline, MAX_EDICTS );
+	cache.AddPayload( pPayload );
+	return pPayload;
+}
+
+DEFINE_TESTCASE( HLTVPayloadSharedBaselineTest, HLTVPayloadCacheTestSuite )
+{
+	Msg( "Running HLTV payload cache shared baseline test\n" );
+
+	// two spectators with their own baseline snapshots, filled from the same relay frames
+	CFrameSnapshotEntry *pBaselineA = new CFrameSnapshotEntry[ MAX_EDICTS ];
+	CFrameSnapshotEntry *pBaselineB = new CFrameSnapshotEntry[ MAX_EDICTS ];
+	BuildBaseline( pBaselineA, MAX_EDICTS );
+	BuildBaseline( pBaselineB, MAX_EDICTS );
+
+	uint64 nHashA = HashBaselineEntities( pBaselineA, MAX_EDICTS );
+	uint64 nHashB = HashBaselineEntities( pBaselineB, MAX_EDICTS );
+	Shipping_Assert( nHashA == nHashB );
+
+	CPacketEntitiesCache cache;
+	cache.SetTick( 200 );
+
+	// the first spectator encodes, the second one must get the same payload back
+	Shipping_Assert( cache.FindPayload( 190, 150, nHashA, 1, true, pBaselineA, MAX_EDICTS ) == NULL );
+	CHLTVPacketEntitiesPayload *pEncoded = EncodePayload( cache, 190, 150, nHashA, pBaselineA );
+
+	CHLTVPacketEntitiesPayload *pShared = cache.FindPayload( 190, 150, nHashB, 1, true, pBaselineB, MAX_EDICTS );
+	Shipping_Assert( pShared == pEncoded );
+	Shipping_Assert( cache.GetEncodeCount() == 1 );
+	Shipping_Assert( cache.GetShareCount() == 1 );
+
+	// other delta states must not match
+	Shipping_Assert( cache.FindPayload( 191, 150, nHashB, 1, true, pBaselineB, MAX_EDICTS ) == NULL );
+	Shipping_Assert( cache.FindPayload( 190, 150, nHashB, 0, true, pBaselineB, MAX_EDICTS ) == NULL );
+	Shipping_Assert( cache.FindPayload( 190, 150, nHashB, 1, false, pBaselineB, MAX_EDICTS ) == NULL );
+
+	// a spectator that acked a different entity version has a different baseline
+	pBaselineB[ 30 ].m_pPackedData++;
+	uint64 nHashChanged = HashBaselineEntities( pBaselineB, MAX_EDICTS );
+	Shipping_Assert( nHashChanged != nHashA );
+	Shipping_Assert( cache.FindPayload( 190, 150, nHashChanged, 1, true, pBaselineB, MAX_EDICTS ) == NULL );
+
+	// even if the hash collides, a different baseline must never get the payload
+	Shipping_Assert( cache.FindPayload( 190, 150, nHashA, 1, true, pBaselineB, MAX_EDICTS ) == NULL );
+	Shipping_Assert( cache.GetCollisionCount() == 1 );
+	Shipping_Assert( cache.GetShareCount() == 1 );
+
+	// an entity missing from one baseline must change the hash too
+	pBaselineB[ 30 ].m_pPackedData--;
+	pBaselineB[ 33 ].m_pPackedData = INVALID_PACKED_ENTITY_HANDLE;
+	Shipping_Assert( HashBaselineEntities( pBaselineB, MAX_EDICTS ) != nHashA );
+	Shipping_Assert( cache.FindPayload( 190, 150, nHashA, 1, true, pBaselineB, MAX_EDICTS ) == NULL );
+	Shipping_Assert( cache.GetCollisionCount() == 2 );
+
+	pShared->Release();
+	pEncoded->Release();
+
+	// payloads only live for one relay tick
+	cache.SetTick( 201 );
+	Shipping_Assert( cache.FindPayload( 190, 150, nHashA, 1, true, pBaselineA, MAX_EDICTS ) == NULL );
+
+	delete [] pBaselineA;
+	delete [] pBaselineB;
+}
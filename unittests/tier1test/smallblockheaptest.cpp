@@ -0,0 +1,27 @@
+//========= Copyright (c) Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Unit tests for the small block heap
+//
+//=============================================================================//
+
+#include "unitlib/unitlib.h"
+#include "tier0/platform.h"
+#include "tier0/dbg.h"
+#include "tier0/memalloc.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+
+DEFINE_TESTSUITE( SmallBlockHeapTestSuite )
+
+//-----------------------------------------------------------------------------
+// The checks live in tier0, next to the heap, since they need its block
+// counts: cross-thread frees, AllocBatch/FreeBatch, draining the thread
+// caches and the used/free counts after compaction.
+//-----------------------------------------------------------------------------
+DEFINE_TESTCASE( SmallBlockHeapTest, SmallBlockHeapTestSuite )
+{
+	Shipping_Assert( RunSmallBlockHeapTests() );
+	Shipping_Assert( g_pMemAlloc->CrtCheckMemory() );
+}
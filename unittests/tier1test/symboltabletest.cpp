@@ -0,0 +1,296 @@
+//========= Copyright (c) Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Unit tests for the multithreaded symbol tables
+//
+//=============================================================================//
+
+#include "unitlib/unitlib.h"
+#include "tier0/threadtools.h"
+#include "tier1/utlsymbol.h"
+#include "tier1/utlsymbollarge.h"
+#include "tier1/utlvector.h"
+#include "tier1/utlstring.h"
+#include "tier1/strtools.h"
+#include "tier1/generichash.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+
+DEFINE_TESTSUITE( SymbolTableTestSuite )
+
+enum
+{
+	SYMBOL_TEST_THREADS = 8,
+	SYMBOL_TEST_STRINGS_PER_SHARD = 256,	// enough to make every shard grow its table a few times
+	SYMBOL_TEST_STRINGS = SYMBOL_TEST_STRINGS_PER_SHARD * CUtlSymbolTableMT::NUM_SHARDS,
+};
+
+//-----------------------------------------------------------------------------
+// Path-like strings, SYMBOL_TEST_STRINGS_PER_SHARD of them for every shard of
+// a case insensitive CUtlSymbolTableMT, ordered so neighbours hash to
+// different shards.
+//-----------------------------------------------------------------------------
+class CSymbolTestStrings
+{
+public:
+	CSymbolTestStrings()
+	{
+		CUtlVector< CUtlString > shards[CUtlSymbolTableMT::NUM_SHARDS];
+		char szString[MAX_PATH];
+		for ( int n = 0, nFull = 0; nFull < CUtlSymbolTableMT::NUM_SHARDS; n++ )
+		{
+			V_snprintf( szString, sizeof( szString ), "materials/models/Test/Group%03d/texture%05d.vmt", n % 97, n );
+			CUtlVector< CUtlString > &shard = shards[ HashStringCaseless( szString ) % CUtlSymbolTableMT::NUM_SHARDS ];
+			if ( shard.Count() < SYMBOL_TEST_STRINGS_PER_SHARD )
+			{
+				shard.AddToTail( szString );
+				if ( shard.Count() == SYMBOL_TEST_STRINGS_PER_SHARD )
+				{
+					nFull++;
+				}
+			}
+		}
+
+		for ( int i = 0; i < SYMBOL_TEST_STRINGS_PER_SHARD; i++ )
+		{
+			for ( int nShard = 0; nShard < CUtlSymbolTableMT::NUM_SHARDS; nShard++ )
+			{
+				m_Strings.AddToTail( shards[nShard][i] );
+			}
+		}
+	}
+
+	static int GetShard( int nString )
+	{
+		return nString % CUtlSymbolTableMT::NUM_SHARDS;
+	}
+
+	const char *operator[]( int nString ) const
+	{
+		return m_Strings[nString].Get();
+	}
+
+private:
+	CUtlVector< CUtlString > m_Strings;
+};
+
+static const char *SymbolString( CUtlSymbolTableMT *pTable, CUtlSymbol sym )
+{
+	return pTable->String( sym );
+}
+
+static const char *SymbolString( CUtlSymbolTableLargeMT_CI *pTable, CUtlSymbolLarge sym )
+{
+	return sym.String();
+}
+
+//-----------------------------------------------------------------------------
+// Every thread adds all the strings, each starting at a different one, so
+// most strings are added by several threads at once.
+//-----------------------------------------------------------------------------
+template < class TABLE, class SYMBOL >
+struct SymbolTestThread_t
+{
+	TABLE						*m_pTable;
+	const CSymbolTestStrings	*m_pStrings;
+	int							m_nThread;
+	SYMBOL						m_Symbols[SYMBOL_TEST_STRINGS];
+};
+
+template < class TABLE, class SYMBOL >
+static uintp SymbolTestAddThreadFunc( void *pParam )
+{
+	SymbolTestThread_t< TABLE, SYMBOL > *pThread = (SymbolTestThread_t< TABLE, SYMBOL > *)pParam;
+
+	for ( int i = 0; i < SYMBOL_TEST_STRINGS; i++ )
+	{
+		int nString = ( i + pThread->m_nThread * ( SYMBOL_TEST_STRINGS / SYMBOL_TEST_THREADS ) ) % SYMBOL_TEST_STRINGS;
+		pThread->m_Symbols[nString] = pThread->m_pTable->AddString( ( *pThread->m_pStrings )[nString] );
+	}
+	return 0;
+}
+
+template < class TABLE, class SYMBOL >
+static void AddStringsOnThreads( TABLE *pTable, const CSymbolTestStrings &strings, SymbolTestThread_t< TABLE, SYMBOL > *pThreads )
+{
+	ThreadHandle_t hThreads[SYMBOL_TEST_THREADS];
+	for ( int i = 0; i < SYMBOL_TEST_THREADS; i++ )
+	{
+		pThreads[i].m_pTable = pTable;
+		pThreads[i].m_pStrings = &strings;
+		pThreads[i].m_nThread = i;
+		hThreads[i] = CreateSimpleThread( SymbolTestAddThreadFunc< TABLE, SYMBOL >, &pThreads[i] );
+	}
+	for ( int i = 0; i < SYMBOL_TEST_THREADS; i++ )
+	{
+		ThreadJoin( hThreads[i] );
+		ReleaseThreadHandle( hThreads[i] );
+	}
+}
+
+template < class TABLE, class SYMBOL >
+static void TestConcurrentAddString( TABLE *pTable, const CSymbolTestStrings &strings )
+{
+	SymbolTestThread_t< TABLE, SYMBOL > *pThreads = new SymbolTestThread_t< TABLE, SYMBOL >[SYMBOL_TEST_THREADS];
+	AddStringsOnThreads< TABLE, SYMBOL >( pTable, strings, pThreads );
+
+	// One symbol per string, the same on every thread, and it maps back to the string
+	Shipping_Assert( pTable->GetNumStrings() == SYMBOL_TEST_STRINGS );
+	for ( int nString = 0; nString < SYMBOL_TEST_STRINGS; nString++ )
+	{
+		SYMBOL sym = pThreads[0].m_Symbols[nString];
+		Shipping_Assert( sym.IsValid() );
+		Shipping_Assert( !V_strcmp( SymbolString( pTable, sym ), strings[nString] ) );
+		Shipping_Assert( pTable->Find( strings[nString] ) == sym );
+
+		for ( int i = 1; i < SYMBOL_TEST_THREADS; i++ )
+		{
+			Shipping_Assert( pThreads[i].m_Symbols[nString] == sym );
+		}
+	}
+
+	// Adding again from this thread doesn't make new symbols
+	for ( int nString = 0; nString < SYMBOL_TEST_STRINGS; nString++ )
+	{
+		Shipping_Assert( pTable->AddString( strings[nString] ) == pThreads[0].m_Symbols[nString] );
+	}
+	Shipping_Assert( pTable->GetNumStrings() == SYMBOL_TEST_STRINGS );
+
+	delete[] pThreads;
+}
+
+DEFINE_TESTCASE( SymbolTableMTConcurrentAddString, SymbolTableTestSuite )
+{
+	Msg( "Running CUtlSymbolTableMT concurrent AddString test\n" );
+
+	CSymbolTestStrings strings;
+
+	CUtlSymbolTableMT *pTable = new CUtlSymbolTableMT( 0, 32, true );
+	TestConcurrentAddString< CUtlSymbolTableMT, CUtlSymbol >( pTable, strings );
+	delete pTable;
+
+	CUtlSymbolTableLargeMT_CI *pLargeTable = new CUtlSymbolTableLargeMT_CI;
+	TestConcurrentAddString< CUtlSymbolTableLargeMT_CI, CUtlSymbolLarge >( pLargeTable, strings );
+	delete pLargeTable;
+}
+
+//-----------------------------------------------------------------------------
+// Find on every shard returns the symbol AddString gave, for any case of the
+// string, and nothing for strings that were never added. Lookups racing the
+// adds may miss a string, but must never return a different symbol.
+//-----------------------------------------------------------------------------
+struct SymbolTestFindThread_t
+{
+	CUtlSymbolTableMT			*m_pTable;
+	const CSymbolTestStrings	*m_pStrings;
+	CUtlSymbol					*m_pSymbols;	// filled in by AddStringsOnThreads
+	volatile bool				*m_pDone;
+	int							m_nWrongSymbols;
+};
+
+static uintp SymbolTestFindThreadFunc( void *pParam )
+{
+	SymbolTestFindThread_t *pThread = (SymbolTestFindThread_t *)pParam;
+
+	CUtlVector< CUtlSymbol > found;
+	found.SetCount( SYMBOL_TEST_STRINGS );
+	while ( !*pThread->m_pDone )
+	{
+		for ( int nString = 0; nString < SYMBOL_TEST_STRINGS; nString++ )
+		{
+			CUtlSymbol sym = pThread->m_pTable->Find( ( *pThread->m_pStrings )[nString] );
+			if ( !sym.IsValid() )
+				continue;
+
+			if ( found[nString].IsValid() && found[nString] != sym )
+			{
+				pThread->m_nWrongSymbols++;
+			}
+			found[nString] = sym;
+		}
+	}
+
+	// The adds are done, so everything seen must be the final symbol
+	for ( int nString = 0; nString < SYMBOL_TEST_STRINGS; nString++ )
+	{
+		if ( found[nString].IsValid() && found[nString] != pThread->m_pSymbols[nString] )
+		{
+			pThread->m_nWrongSymbols++;
+		}
+	}
+	return 0;
+}
+
+DEFINE_TESTCASE( SymbolTableMTFindEveryShard, SymbolTableTestSuite )
+{
+	Msg( "Running CUtlSymbolTableMT Find test\n" );
+
+	CSymbolTestStrings strings;
+	CUtlSymbolTableMT *pTable = new CUtlSymbolTableMT( 0, 32, true );
+
+	// Nothing is there yet
+	for ( int nString = 0; nString < SYMBOL_TEST_STRINGS; nString++ )
+	{
+		Shipping_Assert( !pTable->Find( strings[nString] ).IsValid() );
+	}
+
+	volatile bool bDone = false;
+	SymbolTestThread_t< CUtlSymbolTableMT, CUtlSymbol > *pThreads = new SymbolTestThread_t< CUtlSymbolTableMT, CUtlSymbol >[SYMBOL_TEST_THREADS];
+	SymbolTestFindThread_t findThread;
+	findThread.m_pTable = pTable;
+	findThread.m_pStrings = &strings;
+	findThread.m_pSymbols = pThreads[0].m_Symbols;
+	findThread.m_pDone = &bDone;
+	findThread.m_nWrongSymbols = 0;
+	ThreadHandle_t hFindThread = CreateSimpleThread( SymbolTestFindThreadFunc, &findThread );
+
+	AddStringsOnThreads< CUtlSymbolTableMT, CUtlSymbol >( pTable, strings, pThreads );
+
+	bDone = true;
+	ThreadJoin( hFindThread );
+	ReleaseThreadHandle( hFindThread );
+	Shipping_Assert( findThread.m_nWrongSymbols == 0 );
+
+	int nFoundPerShard[CUtlSymbolTableMT::NUM_SHARDS];
+	V_memset( nFoundPerShard, 0, sizeof( nFoundPerShard ) );
+
+	char szString[MAX_PATH];
+	for ( int nString = 0; nString < SYMBOL_TEST_STRINGS; nString++ )
+	{
+		int nShard = CSymbolTestStrings::GetShard( nString );
+		Shipping_Assert( HashStringCaseless( strings[nString] ) % CUtlSymbolTableMT::NUM_SHARDS == (unsigned)nShard );
+
+		CUtlSymbol sym = pThreads[0].m_Symbols[nString];
+		if ( pTable->Find( strings[nString] ) == sym )
+		{
+			nFoundPerShard[nShard]++;
+		}
+
+		// The table is case insensitive, and both cases hash to the same shard
+		V_strncpy( szString, strings[nString], sizeof( szString ) );
+		V_strupr( szString );
+		Shipping_Assert( pTable->Find( szString ) == sym );
+		Shipping_Assert( pTable->HasElement( szString ) );
+
+		// A string that was never added
+		V_strncat( szString, ".missing", sizeof( szString ) );
+		Shipping_Assert( !pTable->Find( szString ).IsValid() );
+	}
+
+	for ( int nShard = 0; nShard < CUtlSymbolTableMT::NUM_SHARDS; nShard++ )
+	{
+		Shipping_Assert( nFoundPerShard[nShard] == SYMBOL_TEST_STRINGS_PER_SHARD );
+	}
+
+	// RemoveAll empties every shard
+	pTable->RemoveAll();
+	Shipping_Assert( pTable->GetNumStrings() == 0 );
+	for ( int nString = 0; nString < SYMBOL_TEST_STRINGS; nString++ )
+	{
+		Shipping_Assert( !pTable->Find( strings[nString] ).IsValid() );
+	}
+
+	delete[] pThreads;
+	delete pTable;
+}
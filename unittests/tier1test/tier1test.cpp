@@ -0,0 +1,21 @@
+//========= Copyright (c) Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Unit tests for tier1
+//
+//=============================================================================//
+
+#include "unitlib/unitlib.h"
+#include "tier1/tier1.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+
+//-----------------------------------------------------------------------------
+// Used to connect/disconnect the DLL
+//-----------------------------------------------------------------------------
+class CTier1TestAppSystem : public CTier1AppSystem< IAppSystem >
+{
+};
+
+USE_UNITTEST_APPSYSTEM( CTier1TestAppSystem )
@@ -13,12 +13,12 @@
 #include "worldsize.h"
 #include "threads.h"
 #include "tier0/dbg.h"
+#include "tier0/threadtools.h"
 
 // doesn't seem to need to be here? -- in threads.h
 //extern int numthreads;
 
-// counters are only bumped when running single threaded,
-// because they are an awefull coherence problem
+// counters are bumped under the winding pool lock
 int	c_active_windings;
 int	c_peak_windings;
 int	c_winding_allocs;
@@ -42,15 +42,12 @@ winding_t *AllocWinding (int points)
 {
 	winding_t	*w;
 
-	if (numthreads == 1)
-	{
-		c_winding_allocs++;
-		c_winding_points += points;
-		c_active_windings++;
-		if (c_active_windings > c_peak_windings)
-			c_peak_windings = c_active_windings;
-	}
 	ThreadLock();
+	c_winding_allocs++;
+	c_winding_points += points;
+	c_active_windings++;
+	if (c_active_windings > c_peak_windings)
+		c_peak_windings = c_active_windings;
 	if (winding_pool[points])
 	{
 		w = winding_pool[points];
@@ -74,6 +71,7 @@ void FreeWinding (winding_t *w)
 		Error ("FreeWinding: freed a freed winding");
 	
 	ThreadLock();
+	c_active_windings--;
 	w->numpoints = 0xdeaddead; // flag as freed
 	w->next = winding_pool[w->maxpoints];
 	winding_pool[w->maxpoints] = w;
@@ -113,8 +111,7 @@ void RemoveColinearPoints (winding_t *w)
 	if (nump == w->numpoints)
 		return;
 
-	if (numthreads == 1)
-		c_removed += w->numpoints - nump;
+	ThreadInterlockedExchangeAdd (&c_removed, w->numpoints - nump);
 	w->numpoints = nump;
 	memcpy (w->p, p, nump*sizeof(p[0]));
 }
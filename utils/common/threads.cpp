@@ -62,7 +62,8 @@ int	GetThreadWork (void)
 		return -1;
 	}
 
-	UpdatePacifier( (float)dispatch / workcount );
+	if ( pacifier )
+		UpdatePacifier( (float)dispatch / workcount );
 
 	r = dispatch;
 	dispatch++;
@@ -98,6 +99,122 @@ void RunThreadsOnIndividual (int workcnt, qboolean showpacifier, ThreadWorkerFn
 }
 
 
+
+/*
+=============
+RunThreadsOnWorkList
+=============
+*/
+struct ThreadWorkQueue_t
+{
+	CRITICAL_SECTION	m_Lock;
+	int					*m_pItems;
+	int					m_nHead;		// next item to hand out
+	int					m_nTail;		// one past the last item
+};
+
+ThreadWorkQueue_t	g_WorkQueues[MAX_THREADS];
+int					g_nWorkQueues;
+volatile LONG		g_nWorkListDone;
+
+static bool PopThreadWorkQueue( ThreadWorkQueue_t *pQueue, int *pWork )
+{
+	bool bFound = false;
+	EnterCriticalSection( &pQueue->m_Lock );
+	if ( pQueue->m_nHead < pQueue->m_nTail )
+	{
+		*pWork = pQueue->m_pItems[pQueue->m_nHead++];
+		bFound = true;
+	}
+	LeaveCriticalSection( &pQueue->m_Lock );
+	return bFound;
+}
+
+int GetThreadWorkListItem( int iThread )
+{
+	int work;
+	if ( PopThreadWorkQueue( &g_WorkQueues[iThread], &work ) )
+		return work;
+
+	// Out of work, steal from whoever has the most left. Take their next item rather
+	// than their last so the list stays roughly in the order the caller asked for.
+	while ( 1 )
+	{
+		int iVictim = -1;
+		int nMostLeft = 0;
+		for ( int i=0; i < g_nWorkQueues; i++ )
+		{
+			int nLeft = g_WorkQueues[i].m_nTail - g_WorkQueues[i].m_nHead;
+			if ( nLeft > nMostLeft )
+			{
+				nMostLeft = nLeft;
+				iVictim = i;
+			}
+		}
+
+		if ( iVictim == -1 )
+			return -1;
+
+		if ( PopThreadWorkQueue( &g_WorkQueues[iVictim], &work ) )
+			return work;
+	}
+}
+
+void ThreadWorkListFunction( int iThread, void *pUserData )
+{
+	int		work;
+
+	while (1)
+	{
+		work = GetThreadWorkListItem( iThread );
+		if (work == -1)
+			break;
+
+		workfunction( iThread, work );
+
+		// Only one thread drives the pacifier, so it doesn't need the lock
+		LONG nDone = InterlockedIncrement( &g_nWorkListDone );
+		if ( pacifier && iThread == 0 )
+			UpdatePacifier( (float)nDone / workcount );
+	}
+}
+
+void RunThreadsOnWorkList( int workcnt, const int *pWorkItems, qboolean showpacifier, ThreadWorkerFn func )
+{
+	if (numthreads == -1)
+		ThreadSetDefault ();
+	if ( numthreads > MAX_TOOL_THREADS )
+		numthreads = MAX_TOOL_THREADS;
+
+	// Deal the items round robin so every thread starts at the front of the list
+	g_nWorkQueues = numthreads;
+	for ( int i=0; i < g_nWorkQueues; i++ )
+	{
+		ThreadWorkQueue_t *pQueue = &g_WorkQueues[i];
+		InitializeCriticalSection( &pQueue->m_Lock );
+		pQueue->m_pItems = (int*)malloc( ( workcnt / g_nWorkQueues + 1 ) * sizeof( int ) );
+		pQueue->m_nHead = 0;
+		pQueue->m_nTail = 0;
+	}
+	for ( int i=0; i < workcnt; i++ )
+	{
+		ThreadWorkQueue_t *pQueue = &g_WorkQueues[i % g_nWorkQueues];
+		pQueue->m_pItems[pQueue->m_nTail++] = pWorkItems ? pWorkItems[i] : i;
+	}
+	g_nWorkListDone = 0;
+
+	workfunction = func;
+	RunThreadsOn (workcnt, showpacifier, ThreadWorkListFunction);
+
+	for ( int i=0; i < g_nWorkQueues; i++ )
+	{
+		DeleteCriticalSection( &g_WorkQueues[i].m_Lock );
+		free( g_WorkQueues[i].m_pItems );
+	}
+	g_nWorkQueues = 0;
+}
+
+
 /*
 ===================================================================
 
@@ -232,8 +349,9 @@ void RunThreadsOn( int workcnt, qboolean showpacifier, RunThreadsFn fn, void *pU
 	start = Plat_FloatTime();
 	dispatch = 0;
 	workcount = workcnt;
-	StartPacifier("");
 	pacifier = showpacifier;
+	if (pacifier)
+		StartPacifier("");
 
 #ifdef _PROFILE
 	threaded = false;
@@ -49,6 +49,13 @@ void RunThreadsOnIndividual ( int workcnt, qboolean showpacifier, ThreadWorkerFn
 
 void RunThreadsOn ( int workcnt, qboolean showpacifier, RunThreadsFn fn, void *pUserData=NULL );
 
+// Like RunThreadsOnIndividual, but fn is called with the values in pWorkItems (or 0..workcnt-1 if it's NULL).
+// The list is dealt out in order to per-thread queues so threads don't fight over one lock,
+// and a thread that runs dry steals the next item from the fullest queue.
+// It runs on the same tool threads as RunThreadsOn, not the vstdlib job pool, so -threads,
+// -low and the pacifier behave as they do for every other tool pass.
+void RunThreadsOnWorkList ( int workcnt, const int *pWorkItems, qboolean showpacifier, ThreadWorkerFn fn );
+
 // This version doesn't track work items - it just runs your function and waits for it to finish.
 void RunThreads_Start( RunThreadsFn fn, void *pUserData, ERunThreadsPriority ePriority=k_eRunThreadsPriority_UseGlobalState );
 void RunThreads_End();
@@ -60,6 +67,7 @@ void ThreadUnlock (void);
 #ifndef NO_THREAD_NAMES
 #define RunThreadsOn(n,p,f) { if (p) printf("%-20s ", #f ":"); RunThreadsOn(n,p,f); }
 #define RunThreadsOnIndividual(n,p,f) { if (p) printf("%-20s ", #f ":"); RunThreadsOnIndividual(n,p,f); }
+#define RunThreadsOnWorkList(n,l,p,f) { if (p) printf("%-20s ", #f ":"); RunThreadsOnWorkList(n,l,p,f); }
 #endif
 
 #endif // THREADS_H
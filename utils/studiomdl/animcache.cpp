@@ -0,0 +1,267 @@
+//========= Copyright  1996-2005, Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Compressed animation cache for incremental compiles
+//
+// $NoKeywords: $
+//
+//=============================================================================//
+
+#include "cmdlib.h"
+#include "studio.h"
+#include "studiomdl.h"
+#include "animcache.h"
+#include "filesystem.h"
+#include "tier0/threadtools.h"
+#include "tier1/generichash.h"
+#include "tier1/utlbuffer.h"
+#include "tier1/utlmap.h"
+
+
+#define ANIMCACHE_ID		(('C'<<24)+('I'<<16)+('N'<<8)+'A')
+#define ANIMCACHE_VERSION	1
+
+// Compressed streams of one animation, numsections * g_numbones * 6 of them
+struct cachedanim_t
+{
+	int		m_nSections;
+	int		m_nSectionFrames;
+	int		m_nFirstCount;		// into s_CachedCounts
+	int		m_nFirstValue;		// into s_CachedValues
+};
+
+static bool s_bCacheEnabled = false;
+static char s_szCacheFile[MAX_PATH];
+static uint64 s_nBoneKey;
+static CUtlVector< uint64 > s_AnimKeys;
+static CUtlMap< uint64, cachedanim_t > s_CachedAnims( DefLessFunc( uint64 ) );
+static CUtlVector< unsigned short > s_CachedCounts;
+static CUtlVector< mstudioanimvalue_t > s_CachedValues;
+static CInterlockedInt s_nReused;
+
+
+static uint64 HashData( uint64 nHash, const void *pData, int nBytes )
+{
+	return HashUint64( nHash ^ MurmurHash64( pData, nBytes, (uint32)nHash ) );
+}
+
+
+//-----------------------------------------------------------------------------
+// Everything about the bones that goes into compressing an animation
+//-----------------------------------------------------------------------------
+static uint64 HashBones()
+{
+	uint64 nHash = ANIMCACHE_VERSION;
+	nHash = HashData( nHash, &g_numbones, sizeof( g_numbones ) );
+	nHash = HashData( nHash, &g_minSectionFrameLimit, sizeof( g_minSectionFrameLimit ) );
+	nHash = HashData( nHash, &g_sectionFrames, sizeof( g_sectionFrames ) );
+	for ( int j = 0; j < g_numbones; j++ )
+	{
+		const s_bonetable_t &bone = g_bonetable[j];
+		int bProcedural = ( bone.flags & BONE_ALWAYS_PROCEDURAL ) ? 1 : 0;
+		nHash = HashData( nHash, bone.pos.Base(), 3 * sizeof( float ) );
+		nHash = HashData( nHash, bone.rot.Base(), 3 * sizeof( float ) );
+		nHash = HashData( nHash, bone.posscale.Base(), 3 * sizeof( float ) );
+		nHash = HashData( nHash, bone.rotscale.Base(), 3 * sizeof( float ) );
+		nHash = HashData( nHash, &bProcedural, sizeof( bProcedural ) );
+	}
+	return nHash;
+}
+
+
+//-----------------------------------------------------------------------------
+// The animation is keyed on its processed frames rather than its source file,
+// those depend on the whole model (bone remapping, motion extraction, ...)
+//-----------------------------------------------------------------------------
+static uint64 HashAnimation( s_animation_t *panim )
+{
+	uint64 nHash = s_nBoneKey;
+	nHash = HashData( nHash, &panim->numframes, sizeof( panim->numframes ) );
+	nHash = HashData( nHash, &panim->flags, sizeof( panim->flags ) );
+	nHash = HashData( nHash, panim->weight, g_numbones * sizeof( panim->weight[0] ) );
+	nHash = HashData( nHash, panim->posweight, g_numbones * sizeof( panim->posweight[0] ) );
+	for ( int n = 0; n < panim->numframes; n++ )
+	{
+		nHash = HashData( nHash, panim->sanim[n], g_numbones * sizeof( s_bone_t ) );
+	}
+	return nHash;
+}
+
+
+/*
+==============
+AnimCache_Load
+==============
+*/
+void AnimCache_Load()
+{
+	s_AnimKeys.SetCount( g_numani );
+	s_CachedAnims.RemoveAll();
+	s_CachedCounts.RemoveAll();
+	s_CachedValues.RemoveAll();
+	s_nReused = 0;
+
+	// -checklengths wants to see every animation compressed
+	s_bCacheEnabled = !g_bNoAnimCache && !g_bCheckLengths && g_numani > 0;
+	if ( !s_bCacheEnabled )
+		return;
+
+	Q_StripExtension( g_fullpath, s_szCacheFile, sizeof( s_szCacheFile ) );
+	Q_strncat( s_szCacheFile, ".anicache", sizeof( s_szCacheFile ), COPY_ALL_CHARACTERS );
+	s_nBoneKey = HashBones();
+
+	CUtlBuffer buf;
+	if ( !g_pFullFileSystem->ReadFile( s_szCacheFile, NULL, buf ) )
+		return;
+
+	if ( buf.GetInt() != ANIMCACHE_ID || buf.GetInt() != ANIMCACHE_VERSION )
+	{
+		MdlWarning( "%s is not an animation cache, ignoring it\n", s_szCacheFile );
+		return;
+	}
+
+	int nBones = buf.GetInt();
+	int nAnims = buf.GetInt();
+	if ( !buf.IsValid() || nAnims < 0 || nAnims > MAXSTUDIOANIMS )
+	{
+		MdlWarning( "%s is corrupt, ignoring it\n", s_szCacheFile );
+		return;
+	}
+
+	// Every key mixes in the bones, none of them can match
+	if ( nBones != g_numbones )
+		return;
+
+	int i;
+	for ( i = 0; i < nAnims && buf.IsValid(); i++ )
+	{
+		uint64 nKey = buf.GetUnsignedInt64();
+
+		cachedanim_t cached;
+		cached.m_nSections = buf.GetInt();
+		cached.m_nSectionFrames = buf.GetInt();
+		cached.m_nFirstCount = s_CachedCounts.Count();
+		cached.m_nFirstValue = s_CachedValues.Count();
+		if ( cached.m_nSections <= 0 || cached.m_nSections > MAXSTUDIOANIMFRAMES )
+			break;
+
+		int nStreams = cached.m_nSections * g_numbones * 6;
+		for ( int k = 0; k < nStreams && buf.IsValid(); k++ )
+		{
+			unsigned short nValues = buf.GetUnsignedShort();
+			s_CachedCounts.AddToTail( nValues );
+			if ( nValues )
+			{
+				int iFirst = s_CachedValues.AddMultipleToTail( nValues );
+				buf.Get( &s_CachedValues[iFirst], nValues * sizeof( mstudioanimvalue_t ) );
+			}
+		}
+
+		s_CachedAnims.InsertOrReplace( nKey, cached );
+	}
+
+	if ( !buf.IsValid() || i != nAnims )
+	{
+		MdlWarning( "%s is corrupt, ignoring it\n", s_szCacheFile );
+		s_CachedAnims.RemoveAll();
+		s_CachedCounts.RemoveAll();
+		s_CachedValues.RemoveAll();
+	}
+}
+
+
+/*
+==============
+AnimCache_Restore
+==============
+*/
+bool AnimCache_Restore( int iAnim )
+{
+	if ( !s_bCacheEnabled )
+		return false;
+
+	s_animation_t *panim = g_panimation[iAnim];
+	s_AnimKeys[iAnim] = HashAnimation( panim );
+
+	int iFound = s_CachedAnims.Find( s_AnimKeys[iAnim] );
+	if ( !s_CachedAnims.IsValidIndex( iFound ) )
+		return false;
+
+	const cachedanim_t &cached = s_CachedAnims[iFound];
+	const unsigned short *pCount = &s_CachedCounts[cached.m_nFirstCount];
+	const mstudioanimvalue_t *pValue = s_CachedValues.Base() + cached.m_nFirstValue;
+
+	panim->numsections = cached.m_nSections;
+	panim->sectionframes = cached.m_nSectionFrames;
+	for ( int w = 0; w < panim->numsections; w++ )
+	{
+		for ( int j = 0; j < g_numbones; j++ )
+		{
+			for ( int k = 0; k < 6; k++, pCount++ )
+			{
+				panim->anim[w][j].num[k] = *pCount;
+				panim->anim[w][j].data[k] = NULL;
+				if ( *pCount )
+				{
+					panim->anim[w][j].data[k] = (mstudioanimvalue_t *)calloc( *pCount, sizeof( mstudioanimvalue_t ) );
+					memcpy( panim->anim[w][j].data[k], pValue, *pCount * sizeof( mstudioanimvalue_t ) );
+					pValue += *pCount;
+				}
+			}
+		}
+	}
+
+	++s_nReused;
+	return true;
+}
+
+
+/*
+==============
+AnimCache_Save
+==============
+*/
+void AnimCache_Save()
+{
+	if ( !s_bCacheEnabled )
+		return;
+
+	if ( !g_quiet )
+	{
+		printf( "Animation cache: reused %d of %d animations\n", (int)s_nReused, g_numani );
+	}
+
+	CUtlBuffer buf;
+	buf.PutInt( ANIMCACHE_ID );
+	buf.PutInt( ANIMCACHE_VERSION );
+	buf.PutInt( g_numbones );
+	buf.PutInt( g_numani );
+
+	for ( int i = 0; i < g_numani; i++ )
+	{
+		s_animation_t *panim = g_panimation[i];
+		buf.PutUnsignedInt64( s_AnimKeys[i] );
+		buf.PutInt( panim->numsections );
+		buf.PutInt( panim->sectionframes );
+
+		for ( int w = 0; w < panim->numsections; w++ )
+		{
+			for ( int j = 0; j < g_numbones; j++ )
+			{
+				for ( int k = 0; k < 6; k++ )
+				{
+					int nValues = panim->anim[w][j].num[k];
+					buf.PutUnsignedShort( nValues );
+					if ( nValues )
+					{
+						buf.Put( panim->anim[w][j].data[k], nValues * sizeof( mstudioanimvalue_t ) );
+					}
+				}
+			}
+		}
+	}
+
+	if ( !WriteFileToDisk( s_szCacheFile, NULL, buf ) )
+	{
+		MdlWarning( "Couldn't write %s\n", s_szCacheFile );
+	}
+}
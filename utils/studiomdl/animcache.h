@@ -0,0 +1,28 @@
+//========= Copyright  1996-2005, Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Compressed animation cache. <qc name>.anicache keeps the compressed
+//			streams of every animation from the last compile, keyed on a hash of
+//			the frames and bone setup they were compressed from, so unchanged
+//			animations skip compression on the next compile.
+//
+//=============================================================================//
+
+#ifndef ANIMCACHE_H
+#define ANIMCACHE_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+
+// Call once the bone scales are known, before compressing. Reads the cache.
+void AnimCache_Load();
+
+// Thread safe. Fills in the compressed streams of the animation if they were
+// compressed from identical data last time, returns false if it has to be compressed.
+bool AnimCache_Restore( int iAnim );
+
+// Writes every animation to the cache, call once they are all compressed.
+void AnimCache_Save();
+
+
+#endif // ANIMCACHE_H
@@ -280,6 +280,28 @@ namespace OptimizedModel
 		CUtlVector<ModelLOD_t> modelLODs;
 	};
 
+	class COptimizedModel;
+
+	//-----------------------------------------------------------------------------
+	// One mesh of one LOD of one model. Meshes don't depend on each other,
+	// so they are stripped in parallel
+	//-----------------------------------------------------------------------------
+
+	struct MeshJob_t
+	{
+		COptimizedModel *pOptimizer;
+		int modelID;
+		int lodID;
+		int meshID;
+		Mesh_t *pMesh;
+		s_model_t *pSrcModel;
+		s_mesh_t *pSrcMesh;
+		s_source_t *pLODSource;
+		mstudiomodel_t *pStudioModel;
+		mstudiomesh_t *pStudioMesh;
+		bool bForceNoFlex;
+	};
+
 	//-----------------------------------------------------------------------------
 	// Main class that does all the dirty work to stripy + groupify
 	//-----------------------------------------------------------------------------
@@ -313,6 +335,9 @@ namespace OptimizedModel
 		void ProcessModel( studiohdr_t *phdr, s_bodypart_t *pSrcBodyParts, TotalMeshStats_t& stats, 
 			bool bForceSoftwareSkin, bool bHWFlex );
 
+		// Builds the face list of a mesh and processes it, on its own matrix state
+		static void ProcessMeshJob( MeshJob_t &job );
+
 		// processes a single mesh within the model
 		void ProcessMesh( Mesh_t *pMesh, studiohdr_t *pStudioHeader, CUtlVector<mstudioiface_t> &srcFaces,
 			mstudiomodel_t *pStudioModel, mstudiomesh_t *pStudioMesh, bool bForceNoFlex, 
@@ -468,6 +493,12 @@ namespace OptimizedModel
 		int	m_MaxBonesPerStrip;
 		bool m_bUsesFixedFunction;
 
+		// per model, valid during ProcessModel
+		studiohdr_t *m_pStudioHdr;
+		bool m_bForceSoftwareSkin;
+		bool m_bHWFlex;
+		bool m_bQuadSubd;
+
 		// stats
 		int m_NumSkinnedAndFlexedVerts;
 
@@ -2476,6 +2507,44 @@ namespace OptimizedModel
 	}
 
 
+	//-----------------------------------------------------------------------------
+	// Runs on the compile thread pool; everything but the matrix state is
+	// shared with the model being optimized, and only read
+	//-----------------------------------------------------------------------------
+	void COptimizedModel::ProcessMeshJob( MeshJob_t &job )
+	{
+		COptimizedModel *pOptimizer = job.pOptimizer;
+
+		COptimizedModel worker;
+		worker.m_NumBones = pOptimizer->m_NumBones;
+		worker.m_VertexCacheSize = pOptimizer->m_VertexCacheSize;
+		worker.m_MaxBonesPerFace = pOptimizer->m_MaxBonesPerFace;
+		worker.m_MaxBonesPerVert = pOptimizer->m_MaxBonesPerVert;
+		worker.m_MaxBonesPerStrip = pOptimizer->m_MaxBonesPerStrip;
+		worker.m_bUsesFixedFunction = pOptimizer->m_bUsesFixedFunction;
+		worker.m_NumSkinnedAndFlexedVerts = 0;
+		worker.m_FileBuffer = NULL;
+
+		// Only one of these will actually get used, depending on topology type (tris or quads)
+		CUtlVector<mstudioiface_t> meshFaceList;
+
+		if ( job.pLODSource )
+		{
+			// map the lod data to faces
+			// uses the original mesh redirected through a mapping table
+			// this expects built per lod-to-root mapping tables to generate faces
+			worker.CreateLODFaceList( job.pSrcModel, job.lodID, job.pLODSource, job.pStudioModel, job.pStudioMesh, meshFaceList, pOptimizer->m_bQuadSubd, false );
+		}
+		else
+		{
+			// build the face list from the unmapped source
+			worker.SourceMeshToFaceList( job.pSrcModel, job.pSrcMesh, meshFaceList );
+		}
+
+		worker.ProcessMesh( job.pMesh, pOptimizer->m_pStudioHdr, meshFaceList, job.pStudioModel, job.pStudioMesh, 
+			job.bForceNoFlex, pOptimizer->m_bForceSoftwareSkin, pOptimizer->m_bHWFlex, pOptimizer->m_bQuadSubd );
+	}
+
 	//-----------------------------------------------------------------------------
 	// Process the entire model, return stats...
 	//-----------------------------------------------------------------------------
@@ -2485,6 +2554,15 @@ namespace OptimizedModel
 		memset( &stats, 0, sizeof(stats) );
 		m_Models.RemoveAll();
 
+		// Process Quad-only meshes in software
+		m_pStudioHdr = pHdr;
+		m_bQuadSubd = ( gflags & STUDIOHDR_FLAGS_SUBDIVISION_SURFACE ) != 0;
+		m_bForceSoftwareSkin = m_bQuadSubd || bForceSoftwareSkin;
+		m_bHWFlex = bHWFlex;
+
+		// Lay out every model first, the meshes mustn't move once they are being processed
+		CUtlVector<MeshJob_t> jobs;
+
 		int bodyPartID, modelID, meshID, lodID;
 		for ( bodyPartID = 0; bodyPartID < pHdr->numbodyparts; bodyPartID++, stats.m_TotalBodyParts++ )
 		{
@@ -2527,7 +2605,6 @@ namespace OptimizedModel
 
 						int i = newLOD.meshes.AddToTail();
 						Assert( i == meshID );
-						Mesh_t& newMesh = newLOD.meshes[i];
 
 						if ( MeshNeedsRemoval( pHdr, pStudioMesh, scriptLOD ) )
 							continue;
@@ -2536,39 +2613,41 @@ namespace OptimizedModel
 						//					int textureSearchID = material_to_texture( pStudioMesh->material );
 						//					const char *pDebugName = pHdr->pTexture( textureSearchID )->pszName( );
 #endif
-						// Process Quad-only meshes in software
-						bool bQuadSubd = ( gflags & STUDIOHDR_FLAGS_SUBDIVISION_SURFACE ) != 0;
-						bForceSoftwareSkin = bQuadSubd || bForceSoftwareSkin;
-
-						// Only one of these will actually get used, depending on topology type (tris or quads)
-						CUtlVector<mstudioiface_t> meshFaceList;
-
-						if ( pLODSource )
-						{
-							// map the lod data to faces
-							// uses the original mesh redirected through a mapping table
-							// this expects built per lod-to-root mapping tables to generate faces
-							CreateLODFaceList( pSrcModel, lodID, pLODSource, pStudioModel, pStudioMesh, meshFaceList, bQuadSubd, false );
-						}
-						else
-						{
-							// build the face list from the unmapped source
-							SourceMeshToFaceList( pSrcModel, pSrcMesh, meshFaceList );
-						}
-
-						ProcessMesh( &newMesh, pHdr, meshFaceList, pStudioModel, pStudioMesh, 
-							!scriptLOD.GetFacialAnimationEnabled(), bForceSoftwareSkin, bHWFlex, bQuadSubd );
-
-						stats.m_TotalVerts += GetTotalVertsForMesh( &newMesh );
-						stats.m_TotalIndices += GetTotalIndicesForMesh( &newMesh );
-						stats.m_TotalTopologyIndices += GetTotalTopologyIndicesForMesh( &newMesh );
-						stats.m_TotalStrips += GetTotalStripsForMesh( &newMesh );
-						stats.m_TotalStripGroups += GetTotalStripGroupsForMesh( &newMesh );
-						stats.m_TotalBoneStateChanges += GetTotalBoneStateChangesForMesh( &newMesh );
+						MeshJob_t &job = jobs[jobs.AddToTail()];
+						job.pOptimizer = this;
+						job.modelID = m_Models.Count() - 1;
+						job.lodID = lodID;
+						job.meshID = meshID;
+						job.pMesh = NULL;
+						job.pSrcModel = pSrcModel;
+						job.pSrcMesh = pSrcMesh;
+						job.pLODSource = pLODSource;
+						job.pStudioModel = pStudioModel;
+						job.pStudioMesh = pStudioMesh;
+						job.bForceNoFlex = !scriptLOD.GetFacialAnimationEnabled();
 					}
 				}
 			}
 		}
+
+		for ( int i = 0; i < jobs.Count(); i++ )
+		{
+			MeshJob_t &job = jobs[i];
+			job.pMesh = &m_Models[job.modelID].modelLODs[job.lodID].meshes[job.meshID];
+		}
+
+		StudioMdl_ParallelProcess( jobs.Base(), jobs.Count(), ProcessMeshJob );
+
+		for ( int i = 0; i < jobs.Count(); i++ )
+		{
+			Mesh_t *pMesh = jobs[i].pMesh;
+			stats.m_TotalVerts += GetTotalVertsForMesh( pMesh );
+			stats.m_TotalIndices += GetTotalIndicesForMesh( pMesh );
+			stats.m_TotalTopologyIndices += GetTotalTopologyIndicesForMesh( pMesh );
+			stats.m_TotalStrips += GetTotalStripsForMesh( pMesh );
+			stats.m_TotalStripGroups += GetTotalStripGroupsForMesh( pMesh );
+			stats.m_TotalBoneStateChanges += GetTotalBoneStateChangesForMesh( pMesh );
+		}
 	}
 
 	//-----------------------------------------------------------------------------
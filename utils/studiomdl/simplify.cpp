@@ -29,6 +29,7 @@
 #include "mathlib/vmatrix.h"
 #include "mdlobjects/dmeboneflexdriver.h"
 #include "tier1/utlspheretree.h"
+#include "animcache.h"
 
 
 class CBoneRenderBounds
@@ -8069,331 +8070,372 @@ static void ProcessIKRules( )
 
 
 //-----------------------------------------------------------------------------
-// CompressAnimations
+// Finds the scales of a bone from every animation
 //-----------------------------------------------------------------------------
 
-static void CompressAnimations( )
+static void CalcBoneScales( int &j )
 {
-	int i, j, k, n, m;
-
-
-	// !!!
-	//g_minSectionFrameLimit = 100000;
-	//g_animblocksize = 0;
-
+	int i, k, n;
 
-	// find scales for all bones
-	for (j = 0; j < g_numbones; j++)
+	// printf("%s : ", g_bonetable[j].name );
+	for (k = 0; k < 6; k++)
 	{
-		// printf("%s : ", g_bonetable[j].name );
-		for (k = 0; k < 6; k++)
-		{
-			float minv, maxv, scale;
-			float total_minv, total_maxv;
+		float minv, maxv, scale;
+		float total_minv, total_maxv;
 
-			if (k < 3) 
-			{
-				minv = -128.0;
-				maxv = 128.0;
-				total_maxv = total_minv = g_bonetable[j].pos[k];
-			}
-			else
-			{
-				minv = -M_PI / 8.0;
-				maxv = M_PI / 8.0;
-				total_maxv = total_minv = g_bonetable[j].rot[k-3];
-			}
+		if (k < 3) 
+		{
+			minv = -128.0;
+			maxv = 128.0;
+			total_maxv = total_minv = g_bonetable[j].pos[k];
+		}
+		else
+		{
+			minv = -M_PI / 8.0;
+			maxv = M_PI / 8.0;
+			total_maxv = total_minv = g_bonetable[j].rot[k-3];
+		}
 
-			for (i = 0; i < g_numani; i++)
+		for (i = 0; i < g_numani; i++)
+		{
+			for (n = 0; n < g_panimation[i]->numframes; n++)
 			{
-				for (n = 0; n < g_panimation[i]->numframes; n++)
+				float v = 0.0f;
+				switch(k)
 				{
-					float v = 0.0f;
-					switch(k)
+				case 0: 
+				case 1: 
+				case 2: 
+					if (g_panimation[i]->flags & STUDIO_DELTA)
 					{
-					case 0: 
-					case 1: 
-					case 2: 
-						if (g_panimation[i]->flags & STUDIO_DELTA)
-						{
-							v = g_panimation[i]->sanim[n][j].pos[k]; 
-						}
-						else
-						{
-							v = ( g_panimation[i]->sanim[n][j].pos[k] - g_bonetable[j].pos[k] ); 
+						v = g_panimation[i]->sanim[n][j].pos[k]; 
+					}
+					else
+					{
+						v = ( g_panimation[i]->sanim[n][j].pos[k] - g_bonetable[j].pos[k] ); 
 
-							if (g_panimation[i]->sanim[n][j].pos[k] < total_minv)
-								total_minv = g_panimation[i]->sanim[n][j].pos[k];
-							if (g_panimation[i]->sanim[n][j].pos[k] > total_maxv)
-								total_maxv = g_panimation[i]->sanim[n][j].pos[k];
-						}
-						break;
-					case 3:
-					case 4:
-					case 5:
-						if (g_panimation[i]->flags & STUDIO_DELTA)
-						{
-							v = g_panimation[i]->sanim[n][j].rot[k-3]; 
-						}
-						else
-						{
-							v = ( g_panimation[i]->sanim[n][j].rot[k-3] - g_bonetable[j].rot[k-3] ); 
-						}
-						while (v >= M_PI)
-							v -= M_PI * 2;
-						while (v < -M_PI)
-							v += M_PI * 2;
-						break;
+						if (g_panimation[i]->sanim[n][j].pos[k] < total_minv)
+							total_minv = g_panimation[i]->sanim[n][j].pos[k];
+						if (g_panimation[i]->sanim[n][j].pos[k] > total_maxv)
+							total_maxv = g_panimation[i]->sanim[n][j].pos[k];
+					}
+					break;
+				case 3:
+				case 4:
+				case 5:
+					if (g_panimation[i]->flags & STUDIO_DELTA)
+					{
+						v = g_panimation[i]->sanim[n][j].rot[k-3]; 
 					}
-					if (v < minv)
-						minv = v;
-					if (v > maxv)
-						maxv = v;
+					else
+					{
+						v = ( g_panimation[i]->sanim[n][j].rot[k-3] - g_bonetable[j].rot[k-3] ); 
+					}
+					while (v >= M_PI)
+						v -= M_PI * 2;
+					while (v < -M_PI)
+						v += M_PI * 2;
+					break;
 				}
+				if (v < minv)
+					minv = v;
+				if (v > maxv)
+					maxv = v;
 			}
-			if (minv < maxv)
+		}
+		if (minv < maxv)
+		{
+			if (-minv> maxv)
 			{
-				if (-minv> maxv)
-				{
-					scale = minv / -32768.0;
-				}
-				else
-				{
-					scale = maxv / 32767;
-				}
+				scale = minv / -32768.0;
 			}
 			else
 			{
-				scale = 1.0 / 32.0;
-			}
-			switch(k)
-			{
-			case 0: 
-			case 1: 
-			case 2: 
-				g_bonetable[j].posscale[k] = scale;
-				g_bonetable[j].posrange[k] = total_maxv - total_minv;
-				break;
-			case 3:
-			case 4:
-			case 5:
-				// printf("(%.1f %.1f)", RAD2DEG(minv), RAD2DEG(maxv) );
-				// printf("(%.1f)", RAD2DEG(maxv-minv) );
-				g_bonetable[j].rotscale[k-3] = scale;
-				break;
+				scale = maxv / 32767;
 			}
-			// printf("%.0f ", 1.0 / scale );
 		}
-		// printf("\n" );
+		else
+		{
+			scale = 1.0 / 32.0;
+		}
+		switch(k)
+		{
+		case 0: 
+		case 1: 
+		case 2: 
+			g_bonetable[j].posscale[k] = scale;
+			g_bonetable[j].posrange[k] = total_maxv - total_minv;
+			break;
+		case 3:
+		case 4:
+		case 5:
+			// printf("(%.1f %.1f)", RAD2DEG(minv), RAD2DEG(maxv) );
+			// printf("(%.1f)", RAD2DEG(maxv-minv) );
+			g_bonetable[j].rotscale[k-3] = scale;
+			break;
+		}
+		// printf("%.0f ", 1.0 / scale );
 	}
+	// printf("\n" );
+}
 
 
-	// reduce animations
-	for (i = 0; i < g_numani; i++)
+//-----------------------------------------------------------------------------
+// Reduces an animation to run length encoded deltas from the default pose
+//-----------------------------------------------------------------------------
+
+static void CompressAnimation( int &i )
+{
+	int j, k, n, m;
+
+	s_animation_t *panim = g_panimation[i];
+	s_source_t *psource = panim->source;
+
+	if (g_bCheckLengths)
 	{
-		s_animation_t *panim = g_panimation[i];
-		s_source_t *psource = panim->source;
+		printf("%s\n", panim->name ); 
+	}
 
-		if (g_bCheckLengths)
-		{
-			printf("%s\n", panim->name ); 
-		}
+	if ( AnimCache_Restore( i ) )
+		return;
 
-		// setup animation interior sections
-		int iSectionFrames = panim->numframes;
-		if ( panim->numframes >= g_minSectionFrameLimit )
-		{
-			iSectionFrames = g_sectionFrames;
-			panim->sectionframes = g_sectionFrames;
-			panim->numsections = (int)(panim->numframes / panim->sectionframes) + 2;
-		}
-		else
-		{
-			panim->sectionframes = 0;
-			panim->numsections = 1;
-		}
+	// setup animation interior sections
+	int iSectionFrames = panim->numframes;
+	if ( panim->numframes >= g_minSectionFrameLimit )
+	{
+		iSectionFrames = g_sectionFrames;
+		panim->sectionframes = g_sectionFrames;
+		panim->numsections = (int)(panim->numframes / panim->sectionframes) + 2;
+	}
+	else
+	{
+		panim->sectionframes = 0;
+		panim->numsections = 1;
+	}
 
-		for (int w = 0; w < panim->numsections; w++)
-		{
-			int iStartFrame = w * iSectionFrames;
-			int iEndFrame = (w + 1) * iSectionFrames;
+	for (int w = 0; w < panim->numsections; w++)
+	{
+		int iStartFrame = w * iSectionFrames;
+		int iEndFrame = (w + 1) * iSectionFrames;
 
-			iStartFrame = MIN( iStartFrame, panim->numframes - 1 );
-			iEndFrame = MIN( iEndFrame, panim->numframes - 1 );
+		iStartFrame = MIN( iStartFrame, panim->numframes - 1 );
+		iEndFrame = MIN( iEndFrame, panim->numframes - 1 );
 
-			// printf("%s : %d %d\n", panim->name, iStartFrame, iEndFrame );
+		// printf("%s : %d %d\n", panim->name, iStartFrame, iEndFrame );
 
-			for (j = 0; j < g_numbones; j++)
+		for (j = 0; j < g_numbones; j++)
+		{
+			for (k = 0; k < 6; k++)
 			{
-				for (k = 0; k < 6; k++)
-				{
-					panim->anim[w][j].num[k] = 0;
-					panim->anim[w][j].data[k] = NULL;
-				}
+				panim->anim[w][j].num[k] = 0;
+				panim->anim[w][j].data[k] = NULL;
+			}
 
-				// skip bones that are always procedural
-				if (g_bonetable[j].flags & BONE_ALWAYS_PROCEDURAL)
-				{
-					// panim->weight[j] = 0.0;
-					continue;
-				}
+			// skip bones that are always procedural
+			if (g_bonetable[j].flags & BONE_ALWAYS_PROCEDURAL)
+			{
+				// panim->weight[j] = 0.0;
+				continue;
+			}
 
-				// skip bones that have no influence
-				if (panim->weight[j] < 0.001)
-					continue;
+			// skip bones that have no influence
+			if (panim->weight[j] < 0.001)
+				continue;
 
-				int checkmin[6], checkmax[6];
-				for (k = 0; k < 6; k++)
-				{
-					checkmin[k] = 32767;
-					checkmax[k] = -32768;
-				}
+			int checkmin[6], checkmax[6];
+			for (k = 0; k < 6; k++)
+			{
+				checkmin[k] = 32767;
+				checkmax[k] = -32768;
+			}
 
-				for (k = 0; k < 6; k++)
-				{
-					mstudioanimvalue_t	*pcount, *pvalue;
-					float v;
-					short value[MAXSTUDIOANIMFRAMES];
-					mstudioanimvalue_t data[MAXSTUDIOANIMFRAMES];
+			for (k = 0; k < 6; k++)
+			{
+				mstudioanimvalue_t	*pcount, *pvalue;
+				float v;
+				short value[MAXSTUDIOANIMFRAMES];
+				mstudioanimvalue_t data[MAXSTUDIOANIMFRAMES];
 
-					// find deltas from default pose
-					for (n = 0; n <= iEndFrame - iStartFrame; n++)
+				// find deltas from default pose
+				for (n = 0; n <= iEndFrame - iStartFrame; n++)
+				{
+					s_bone_t *psrcdata = &panim->sanim[n+iStartFrame][j];
+					switch(k)
 					{
-						s_bone_t *psrcdata = &panim->sanim[n+iStartFrame][j];
-						switch(k)
+					case 0: /* X Position */
+					case 1: /* Y Position */
+					case 2: /* Z Position */
+						if (panim->flags & STUDIO_DELTA)
 						{
-						case 0: /* X Position */
-						case 1: /* Y Position */
-						case 2: /* Z Position */
-							if (panim->flags & STUDIO_DELTA)
-							{
-								value[n] = psrcdata->pos[k] / g_bonetable[j].posscale[k]; 
-								// pre-scale pos delta since format only has room for "overall" weight
-								float r = panim->posweight[j] / panim->weight[j];
-								value[n] *= r;
-							}
-							else
-							{
-								value[n] = ( psrcdata->pos[k] - g_bonetable[j].pos[k] ) / g_bonetable[j].posscale[k]; 
-							}
+							value[n] = psrcdata->pos[k] / g_bonetable[j].posscale[k]; 
+							// pre-scale pos delta since format only has room for "overall" weight
+							float r = panim->posweight[j] / panim->weight[j];
+							value[n] *= r;
+						}
+						else
+						{
+							value[n] = ( psrcdata->pos[k] - g_bonetable[j].pos[k] ) / g_bonetable[j].posscale[k]; 
+						}
 
-							break;
-						case 3: /* X Rotation */
-						case 4: /* Y Rotation */
-						case 5: /* Z Rotation */
-							if (panim->flags & STUDIO_DELTA)
-							{
-								v = psrcdata->rot[k-3]; 
-							}
-							else
-							{
-								v = ( psrcdata->rot[k-3] - g_bonetable[j].rot[k-3] ); 
-							}
+						break;
+					case 3: /* X Rotation */
+					case 4: /* Y Rotation */
+					case 5: /* Z Rotation */
+						if (panim->flags & STUDIO_DELTA)
+						{
+							v = psrcdata->rot[k-3]; 
+						}
+						else
+						{
+							v = ( psrcdata->rot[k-3] - g_bonetable[j].rot[k-3] ); 
+						}
 
-							while (v >= M_PI)
-								v -= M_PI * 2;
-							while (v < -M_PI)
-								v += M_PI * 2;
+						while (v >= M_PI)
+							v -= M_PI * 2;
+						while (v < -M_PI)
+							v += M_PI * 2;
 
-							value[n] = v / g_bonetable[j].rotscale[k-3]; 
-							break;
-						}
-						checkmin[k] = MIN( value[n], checkmin[k] );
-						checkmax[k] = MAX( value[n], checkmax[k] );
+						value[n] = v / g_bonetable[j].rotscale[k-3]; 
+						break;
 					}
-					if (n == 0)
-						MdlError("no animation frames: \"%s\"\n", psource->filename );
+					checkmin[k] = MIN( value[n], checkmin[k] );
+					checkmax[k] = MAX( value[n], checkmax[k] );
+				}
+				if (n == 0)
+					MdlError("no animation frames: \"%s\"\n", psource->filename );
 
-					// FIXME: this compression algorithm needs work
+				// FIXME: this compression algorithm needs work
 
-					// initialize animation RLE block
-					memset( data, 0, sizeof( data ) ); 
-					pcount = data; 
-					pvalue = pcount + 1;
+				// initialize animation RLE block
+				memset( data, 0, sizeof( data ) ); 
+				pcount = data; 
+				pvalue = pcount + 1;
 
-					pcount->num.valid = 1;
-					pcount->num.total = 1;
-					pvalue->value = value[0];
-					pvalue++;
+				pcount->num.valid = 1;
+				pcount->num.total = 1;
+				pvalue->value = value[0];
+				pvalue++;
 
-					// build a RLE of deltas from the default pose
-					for (m = 1; m < n; m++)
+				// build a RLE of deltas from the default pose
+				for (m = 1; m < n; m++)
+				{
+					if (pcount->num.total == 255)
+					{
+						// chain too long, force a new entry
+						pcount = pvalue;
+						pvalue = pcount + 1;
+						pcount->num.valid++;
+						pvalue->value = value[m];
+						pvalue++;
+					} 
+					// insert value if they're not equal, 
+					// or if we're not on a run and the run is less than 3 units
+					else if ((value[m] != value[m-1]) 
+						|| ((pcount->num.total == pcount->num.valid) && ((m < n - 1) && value[m] != value[m+1])))
 					{
-						if (pcount->num.total == 255)
+						if (pcount->num.total != pcount->num.valid)
 						{
-							// chain too long, force a new entry
+							//if (j == 0) printf("%d:%d   ", pcount->num.valid, pcount->num.total ); 
 							pcount = pvalue;
 							pvalue = pcount + 1;
-							pcount->num.valid++;
-							pvalue->value = value[m];
-							pvalue++;
-						} 
-						// insert value if they're not equal, 
-						// or if we're not on a run and the run is less than 3 units
-						else if ((value[m] != value[m-1]) 
-							|| ((pcount->num.total == pcount->num.valid) && ((m < n - 1) && value[m] != value[m+1])))
-						{
-							if (pcount->num.total != pcount->num.valid)
-							{
-								//if (j == 0) printf("%d:%d   ", pcount->num.valid, pcount->num.total ); 
-								pcount = pvalue;
-								pvalue = pcount + 1;
-							}
-							pcount->num.valid++;
-							pvalue->value = value[m];
-							pvalue++;
 						}
-						pcount->num.total++;
+						pcount->num.valid++;
+						pvalue->value = value[m];
+						pvalue++;
 					}
-					//if (j == 0) printf("%d:%d\n", pcount->num.valid, pcount->num.total ); 
+					pcount->num.total++;
+				}
+				//if (j == 0) printf("%d:%d\n", pcount->num.valid, pcount->num.total ); 
 
-					panim->anim[w][j].num[k] = pvalue - data;
-					if (panim->anim[w][j].num[k] == 2 && value[0] == 0)
-					{
-						panim->anim[w][j].num[k] = 0;
-					}
-					else
-					{
-						panim->anim[w][j].data[k] = (mstudioanimvalue_t *)calloc( pvalue - data, sizeof( mstudioanimvalue_t ) );
-						memmove( panim->anim[w][j].data[k], data, (pvalue - data) * sizeof( mstudioanimvalue_t ) );
-					}
-					// printf("%d(%d) ", g_source[i]->panim[q]->numanim[j][k], n );
+				panim->anim[w][j].num[k] = pvalue - data;
+				if (panim->anim[w][j].num[k] == 2 && value[0] == 0)
+				{
+					panim->anim[w][j].num[k] = 0;
 				}
+				else
+				{
+					panim->anim[w][j].data[k] = (mstudioanimvalue_t *)calloc( pvalue - data, sizeof( mstudioanimvalue_t ) );
+					memmove( panim->anim[w][j].data[k], data, (pvalue - data) * sizeof( mstudioanimvalue_t ) );
+				}
+				// printf("%d(%d) ", g_source[i]->panim[q]->numanim[j][k], n );
+			}
 
-				if (g_bCheckLengths)
+			if (g_bCheckLengths)
+			{
+				char *tmp[6] = { "X", "Y", "Z", "XR", "YR", "ZR" };
+				n = 0;
+				float s = 0.0f;
+				for (k = 0; k < 6; k++)
 				{
-					char *tmp[6] = { "X", "Y", "Z", "XR", "YR", "ZR" };
-					n = 0;
-					float s = 0.0f;
-					for (k = 0; k < 6; k++)
+					if (panim->anim[w][j].num[k])
 					{
-						if (panim->anim[w][j].num[k])
-						{
-							if (n == 0)
-								printf("%30s :", g_bonetable[j].name );
-						
-							// printf("%2s (%8.3f: %8.3f %8.3f) ", tmp[k], g_bonetable[j].pos[k], checkmin[k], checkmax[k] );
-							if (k < 3)
-								s = g_bonetable[j].posscale[k]; 
-							else
-								s = g_bonetable[j].rotscale[k-3]; 
+						if (n == 0)
+							printf("%30s :", g_bonetable[j].name );
+					
+						// printf("%2s (%8.3f: %8.3f %8.3f) ", tmp[k], g_bonetable[j].pos[k], checkmin[k], checkmax[k] );
+						if (k < 3)
+							s = g_bonetable[j].posscale[k]; 
+						else
+							s = g_bonetable[j].rotscale[k-3]; 
 
-							// printf("%2s %8.5f (%d %d)  ", tmp[k], checkmax[k] - checkmin[k] );
-							printf("%2s %8.5f  ", tmp[k], (checkmax[k] - checkmin[k]) * s );
-							n = 1;
-						}
+						// printf("%2s %8.5f (%d %d)  ", tmp[k], checkmax[k] - checkmin[k] );
+						printf("%2s %8.5f  ", tmp[k], (checkmax[k] - checkmin[k]) * s );
+						n = 1;
 					}
-					if (n)
-						printf("\n");
 				}
+				if (n)
+					printf("\n");
 			}
 		}
+	}
+
+	if (panim->numsections == 1)
+	{
+		panim->sectionframes = 0;
+	}
+}
+
 
-		if (panim->numsections == 1)
+//-----------------------------------------------------------------------------
+// CompressAnimations
+//-----------------------------------------------------------------------------
+
+static void CompressAnimations( )
+{
+	int i;
+
+	// !!!
+	//g_minSectionFrameLimit = 100000;
+	//g_animblocksize = 0;
+
+	// bones and animations are independent of each other
+	CUtlVector< int > items;
+	items.SetCount( MAX( g_numbones, g_numani ) );
+	for (i = 0; i < items.Count(); i++)
+	{
+		items[i] = i;
+	}
+
+	// find scales for all bones
+	StudioMdl_ParallelProcess( items.Base(), g_numbones, CalcBoneScales );
+
+	AnimCache_Load();
+
+	// reduce animations
+	if (g_bCheckLengths)
+	{
+		// keep the report in order
+		for (i = 0; i < g_numani; i++)
 		{
-			panim->sectionframes = 0;
+			CompressAnimation( i );
 		}
 	}
+	else
+	{
+		StudioMdl_ParallelProcess( items.Base(), g_numani, CompressAnimation );
+	}
+
+	AnimCache_Save();
 }
 
 //-----------------------------------------------------------------------------
@@ -9189,7 +9231,10 @@ void SimplifyModel()
 
 	// have to load the lod sources before remapping bones so that the remap
 	// happens for all LODs.
-	LoadLODSources();
+	{
+		CStudioMdlStageTimer timer( "load LOD sources" );
+		LoadLODSources();
+	}
 
 	RemapBones();
 
@@ -9227,7 +9272,10 @@ void SimplifyModel()
 	
 	// remap lods to root, building aggregate final pools
 	// mark bones used by an lod
-	UnifyLODs();
+	{
+		CStudioMdlStageTimer timer( "unify LODs" );
+		UnifyLODs();
+	}
 	
 	if ( g_bPrintBones )
 	{
@@ -9243,9 +9291,11 @@ void SimplifyModel()
 	}
 	SpewBoneUsageStats();
 
-	RemapAnimations();
-
-	processAnimations();
+	{
+		CStudioMdlStageTimer timer( "process animations" );
+		RemapAnimations();
+		processAnimations();
+	}
 
 	limitBoneRotations();
 
@@ -9281,9 +9331,11 @@ void SimplifyModel()
 
 	ProcessIKRules();
 
-	CompressIKErrors( );
-
-	CompressLocalHierarchy( );
+	{
+		CStudioMdlStageTimer timer( "compress IK errors" );
+		CompressIKErrors( );
+		CompressLocalHierarchy( );
+	}
 
 	CalcPoseParameters();
 
@@ -9293,9 +9345,15 @@ void SimplifyModel()
 
 	SetupHitBoxes();
 
-	CompressAnimations( );
+	{
+		CStudioMdlStageTimer timer( "compress animations" );
+		CompressAnimations( );
+	}
 
-	CalcSequenceBoundingBoxes();
+	{
+		CStudioMdlStageTimer timer( "sequence bounds" );
+		CalcSequenceBoundingBoxes();
+	}
 
 	SetIlluminationPosition();
 
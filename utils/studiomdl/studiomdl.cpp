@@ -74,6 +74,7 @@
 #include "mathlib/dynamictree.h"
 #include "movieobjects/dmemesh.h"
 #include "tier1/fmtstr.h"
+#include "tier0/threadtools.h"
 
 bool g_parseable_completion_output = false;
 bool g_collapse_bones_message = false;
@@ -119,6 +120,10 @@ bool g_bAnimblockLowRes = false;
 int g_nMaxZeroFrames = 3; // clamped from 1..4
 bool g_bZeroFramesHighres = false;
 float g_flMinZeroFramePosDelta = 2.0f;
+int g_nThreads = 0; // 0 uses every core
+bool g_bStageTimes = false;
+bool g_bNoAnimCache = false;
+IThreadPool *g_pStudioMdlThreadPool = NULL;
 bool g_bLocalPhysX  = false;
 int	g_maxVertexLimit = MAXSTUDIOVERTS / 3; // nasty wireframe limit
 int	g_maxVertexClamp = MAXSTUDIOVERTS / 3; // nasty wireframe limit
@@ -301,6 +306,9 @@ void CreateMakefile_OutputMakefile( void )
 
 static bool g_bFirstWarning = true;
 
+// Meshes and animations are compiled on the thread pool, keep their messages whole
+static CThreadMutex s_MdlMessageMutex;
+
 void TokenError( const char *fmt, ... )
 {
 	static char output[1024];
@@ -332,6 +340,8 @@ void MdlError( const char *fmt, ... )
 	char		baseName[MAX_PATH];
 	va_list		args;
 
+	AUTO_LOCK( s_MdlMessageMutex );
+
 	Assert( 0 );
 	if (g_quiet)
 	{
@@ -408,6 +418,8 @@ void MdlWarning( const char *fmt, ... )
 	va_list args;
 	static char output[1024];
 
+	AUTO_LOCK( s_MdlMessageMutex );
+
 	if (g_bNoWarnings || g_maxWarnings == 0)
 		return;
 
@@ -11637,6 +11649,83 @@ bool HandleMdlReport( int &returnValue )
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Compile stage timing
+//-----------------------------------------------------------------------------
+struct stagetime_t
+{
+	const char	*m_pName;
+	int			m_nDepth;
+	double		m_flTime;
+};
+
+static CUtlVector< stagetime_t > s_StageTimes;
+static int s_nStageDepth = 0;
+static int s_nCompileThreads = 1;
+
+CStudioMdlStageTimer::CStudioMdlStageTimer( const char *pStageName )
+{
+	m_nStage = s_StageTimes.AddToTail();
+	s_StageTimes[m_nStage].m_pName = pStageName;
+	s_StageTimes[m_nStage].m_nDepth = s_nStageDepth++;
+	s_StageTimes[m_nStage].m_flTime = 0.0;
+	m_flStartTime = Plat_FloatTime();
+}
+
+CStudioMdlStageTimer::~CStudioMdlStageTimer()
+{
+	s_StageTimes[m_nStage].m_flTime = Plat_FloatTime() - m_flStartTime;
+	--s_nStageDepth;
+}
+
+void PrintStageTimes()
+{
+	printf( "\nStage times (%d thread%s):\n", s_nCompileThreads, s_nCompileThreads > 1 ? "s" : "" );
+	for ( int i = 0; i < s_StageTimes.Count(); i++ )
+	{
+		const stagetime_t &stage = s_StageTimes[i];
+		printf( "%*s%-*s %8.3f s\n", stage.m_nDepth * 2, "", 32 - stage.m_nDepth * 2, stage.m_pName, stage.m_flTime );
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// The pool runs everything but the calling thread, ParallelProcess puts the
+// calling thread to work as well
+//-----------------------------------------------------------------------------
+static void StartThreadPool()
+{
+	int nThreads = g_nThreads;
+	if ( nThreads <= 0 )
+	{
+		nThreads = GetCPUInformation().m_nLogicalProcessors;
+	}
+	if ( nThreads <= 1 )
+		return;
+
+	ThreadPoolStartParams_t startParams;
+	startParams.nThreads = MIN( nThreads - 1, TP_MAX_POOL_THREADS );
+	startParams.fDistribute = TRS_TRUE;
+
+	g_pStudioMdlThreadPool = CreateNewThreadPool();
+	if ( !g_pStudioMdlThreadPool->Start( startParams ) )
+	{
+		DestroyThreadPool( g_pStudioMdlThreadPool );
+		g_pStudioMdlThreadPool = NULL;
+		return;
+	}
+	s_nCompileThreads = g_pStudioMdlThreadPool->NumThreads() + 1;
+}
+
+static void StopThreadPool()
+{
+	if ( g_pStudioMdlThreadPool )
+	{
+		DestroyThreadPool( g_pStudioMdlThreadPool );
+		g_pStudioMdlThreadPool = NULL;
+	}
+}
+
 void UsageAndExit()
 {
 	MdlError( "Bad or missing options\n"
@@ -11688,6 +11777,9 @@ void UsageAndExit()
 		"[-basedir]\n"
 		"[-tempcontent]\n"
 		"[-nop4]\n"
+		"[-threads <n>] - compile on n threads, defaults to one per core\n"
+		"[-stagetimes] - report how long each compile stage took\n"
+		"[-noanimcache] - don't reuse compressed animations from the last compile\n"
 		);
 }
 
@@ -12092,6 +12184,24 @@ bool CStudioMDLApp::ParseArguments()
 			continue;
 		}
 
+		if ( !Q_stricmp( pArgv, "-threads" ) )
+		{
+			g_nThreads = atoi( CommandLine()->GetParm( ++i ) );
+			continue;
+		}
+
+		if ( !Q_stricmp( pArgv, "-stagetimes" ) )
+		{
+			g_bStageTimes = true;
+			continue;
+		}
+
+		if ( !Q_stricmp( pArgv, "-noanimcache" ) )
+		{
+			g_bNoAnimCache = true;
+			continue;
+		}
+
 		if ( pArgv[1] && pArgv[2] == '\0' )
 		{
 			switch( pArgv[1] )
@@ -12396,11 +12506,14 @@ int CStudioMDLApp::Main()
 	}
 	else
 	{
+		CStudioMdlStageTimer timer( "parse" );
 		ParseScript( pExt );
 	}
 
 	if ( !g_bCreateMakefile )
 	{
+		StartThreadPool();
+
 		int nCount = g_numsources;
 		for (int i = 0; i < nCount; i++)
 		{
@@ -12412,16 +12525,27 @@ int CStudioMDLApp::Main()
 	
 		SetSkinValues();
 
-		SimplifyModel();
+		{
+			CStudioMdlStageTimer timer( "simplify" );
+			SimplifyModel();
+		}
 
 		ConsistencyCheckSurfaceProp();
 		ConsistencyCheckContents();
 
-		CollisionModel_Build();
+		{
+			CStudioMdlStageTimer timer( "collision model" );
+			CollisionModel_Build();
+		}
 
 		// ValidateSharedAnimationGroups();
 
-		WriteModelFiles();
+		{
+			CStudioMdlStageTimer timer( "write" );
+			WriteModelFiles();
+		}
+
+		StopThreadPool();
 	}
 
 	if ( g_bCreateMakefile )
@@ -12434,6 +12558,11 @@ int CStudioMDLApp::Main()
 		Main_MakeVsi();
 	}
 
+	if ( g_bStageTimes )
+	{
+		PrintStageTimes();
+	}
+
 	if (!g_quiet)
 	{
 		printf("\nCompleted \"%s\"\n", g_path);
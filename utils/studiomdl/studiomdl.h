@@ -22,6 +22,7 @@
 #include "mathlib/vector.h"
 #include "studio.h"
 #include "datamodel/dmelementhandle.h"
+#include "vstdlib/jobthread.h"
 
 struct LodScriptData_t;
 struct s_flexkey_t;
@@ -1835,6 +1836,29 @@ extern bool g_bAnimblockLowRes;
 extern int g_nMaxZeroFrames;
 extern bool g_bZeroFramesHighres;
 extern float g_flMinZeroFramePosDelta;
+extern int g_nThreads;
+extern bool g_bStageTimes;
+extern bool g_bNoAnimCache;
+
+extern IThreadPool *g_pStudioMdlThreadPool;	// NULL when compiling on a single thread
+
+// Runs pfnProcess on every item, spread over the compile thread pool if there is one
+template < typename ITEM_TYPE >
+inline void StudioMdl_ParallelProcess( ITEM_TYPE *pItems, unsigned nItems, void (*pfnProcess)( ITEM_TYPE & ) )
+{
+	if ( !g_pStudioMdlThreadPool )
+	{
+		for ( unsigned i = 0; i < nItems; i++ )
+		{
+			pfnProcess( pItems[i] );
+		}
+		return;
+	}
+	ParallelProcess( g_pStudioMdlThreadPool, pItems, nItems, pfnProcess );
+}
+
+class CUtlBuffer;
+bool WriteFileToDisk( const char *pFileName, const char *pPath, CUtlBuffer &buf );
 
 extern Vector g_vecMinWorldspace;
 extern Vector g_vecMaxWorldspace;
@@ -1930,4 +1954,22 @@ enum EyelidType_t
 extern s_model_t *g_pCurrentModel;
 
 
+//-----------------------------------------------------------------------------
+// Times a compile stage from construction to destruction. Stages nest, and
+// PrintStageTimes reports them in the order they started. Main thread only.
+//-----------------------------------------------------------------------------
+class CStudioMdlStageTimer
+{
+public:
+	CStudioMdlStageTimer( const char *pStageName );
+	~CStudioMdlStageTimer();
+
+private:
+	int m_nStage;
+	double m_flStartTime;
+};
+
+void PrintStageTimes();
+
+
 #endif // STUDIOMDL_H
\ No newline at end of file
@@ -3770,7 +3770,10 @@ void WriteModelFiles(void)
 		{
 			pBodyParts[i] = g_bodypart[i];
 		}
-		OptimizedModel::WriteOptimizedFiles( phdr, pBodyParts );
+		{
+			CStudioMdlStageTimer timer( "optimize" );
+			OptimizedModel::WriteOptimizedFiles( phdr, pBodyParts );
+		}
 		free( pBodyParts );
 
 		// now have external finalized vtx (windings) and vvd (vertexes)
@@ -7,6 +7,8 @@
 //=============================================================================//
 
 #include "vbsp.h"
+#include "tier0/threadtools.h"
+#include <algorithm>
 
 
 int		c_nodes;
@@ -310,17 +312,15 @@ AllocNode
 */
 node_t *AllocNode (void)
 {
-	static int s_NodeCount = 0;
+	static CInterlockedInt s_NodeCount;
 
 	node_t	*node;
 
 	node = (node_t*)malloc(sizeof(*node));
 	memset (node, 0, sizeof(*node));
-	node->id = s_NodeCount;
+	node->id = s_NodeCount++;
 	node->diskId = -1;
 
-	s_NodeCount++;
-
 	return node;
 }
 
@@ -332,7 +332,7 @@ AllocBrush
 */
 bspbrush_t *AllocBrush (int numsides)
 {
-	static int s_BrushId = 0;
+	static CInterlockedInt s_BrushId;
 
 	bspbrush_t	*bb;
 	int			c;
@@ -341,8 +341,7 @@ bspbrush_t *AllocBrush (int numsides)
 	bb = (bspbrush_t*)malloc(c);
 	memset (bb, 0, c);
 	bb->id = s_BrushId++;
-	if (numthreads == 1)
-		c_active_brushes++;
+	ThreadInterlockedIncrement (&c_active_brushes);
 	return bb;
 }
 
@@ -359,8 +358,7 @@ void FreeBrush (bspbrush_t *brushes)
 		if (brushes->sides[i].winding)
 			FreeWinding(brushes->sides[i].winding);
 	free (brushes);
-	if (numthreads == 1)
-		c_active_brushes--;
+	ThreadInterlockedDecrement (&c_active_brushes);
 }
 
 
@@ -977,8 +975,7 @@ side_t *SelectSplitSide (bspbrush_t *brushes, node_t *node)
 		{
 			if (pass > 0)
 			{
-				if (numthreads == 1)
-					c_nonvis++;
+				ThreadInterlockedIncrement (&c_nonvis);
 			}
 			break;
 		}
@@ -1326,20 +1323,19 @@ void SplitBrushList (bspbrush_t *brushes,
 
 /*
 ================
-BuildTree_r
+PartitionNode
+
+Picks the split plane for the node and divides the brushes and the node
+volume between two new children. Returns false if the node became a leaf.
 ================
 */
-
-
-node_t *BuildTree_r (node_t *node, bspbrush_t *brushes)
+static bool PartitionNode (node_t *node, bspbrush_t *brushes, bspbrush_t **children)
 {
 	node_t		*newnode;
 	side_t		*bestside;
 	int			i;
-	bspbrush_t	*children[2];
 
-	if (numthreads == 1)
-		c_nodes++;
+	ThreadInterlockedIncrement (&c_nodes);
 
 	// find the best plane to use as a splitter
 	bestside = SelectSplitSide (brushes, node);
@@ -1350,7 +1346,7 @@ node_t *BuildTree_r (node_t *node, bspbrush_t *brushes)
 		node->side = NULL;
 		node->planenum = -1;
 		LeafNode (node, brushes);
-		return node;
+		return false;
 	}
 			 
 	// this is a splitplane node
@@ -1371,6 +1367,23 @@ node_t *BuildTree_r (node_t *node, bspbrush_t *brushes)
 	SplitBrush (node->volume, node->planenum, &node->children[0]->volume,
 		&node->children[1]->volume);
 
+	return true;
+}
+
+
+/*
+================
+BuildTree_r
+================
+*/
+node_t *BuildTree_r (node_t *node, bspbrush_t *brushes)
+{
+	int			i;
+	bspbrush_t	*children[2];
+
+	if (!PartitionNode (node, brushes, children))
+		return node;
+
 	// recursively process children
 	for (i=0 ; i<2 ; i++)
 	{
@@ -1379,6 +1392,84 @@ node_t *BuildTree_r (node_t *node, bspbrush_t *brushes)
 
 	return node;
 }
+
+
+/*
+================
+Parallel tree building
+
+A subtree only looks at its own brushes, its own volume and the planes of
+its parents, so once the top of the tree is split the subtrees below are
+independent. They come out exactly as BuildTree_r would have built them,
+whichever thread builds them and in whatever order.
+================
+*/
+
+// Lists smaller than this are never worth handing to another thread
+#define MIN_SUBTREE_BRUSHES		64
+
+struct subtree_t
+{
+	node_t		*node;
+	bspbrush_t	*brushes;
+	int			numbrushes;
+};
+
+static CUtlVector<subtree_t> s_Subtrees;
+
+static bool SubtreeGreater (const subtree_t &a, const subtree_t &b)
+{
+	return a.numbrushes > b.numbrushes;
+}
+
+static void SplitTreeTop_r (node_t *node, bspbrush_t *brushes, int maxsubtreebrushes)
+{
+	int			i;
+	int			numbrushes;
+	bspbrush_t	*children[2];
+
+	numbrushes = CountBrushList (brushes);
+	if (numbrushes <= maxsubtreebrushes)
+	{
+		subtree_t &subtree = s_Subtrees[s_Subtrees.AddToTail()];
+		subtree.node = node;
+		subtree.brushes = brushes;
+		subtree.numbrushes = numbrushes;
+		return;
+	}
+
+	if (!PartitionNode (node, brushes, children))
+		return;
+
+	for (i=0 ; i<2 ; i++)
+	{
+		SplitTreeTop_r (node->children[i], children[i], maxsubtreebrushes);
+	}
+}
+
+static void BuildSubtree_Thread (int threadnum, int subtreenum)
+{
+	subtree_t &subtree = s_Subtrees[subtreenum];
+	BuildTree_r (subtree.node, subtree.brushes);
+}
+
+static void BuildTree (node_t *node, bspbrush_t *brushes, int numbrushes)
+{
+	if (numthreads <= 1 || numbrushes <= MIN_SUBTREE_BRUSHES * 2)
+	{
+		BuildTree_r (node, brushes);
+		return;
+	}
+
+	// Split until there are a few subtrees per thread so one big one doesn't
+	// hold everything up, then start the biggest ones first
+	int maxsubtreebrushes = MAX (numbrushes / (numthreads * 8), MIN_SUBTREE_BRUSHES);
+	SplitTreeTop_r (node, brushes, maxsubtreebrushes);
+	std::sort (s_Subtrees.begin(), s_Subtrees.end(), SubtreeGreater);
+
+	RunThreadsOnIndividual (s_Subtrees.Count(), false, BuildSubtree_Thread);
+	s_Subtrees.Purge();
+}
 	  
 
 //===========================================================
@@ -1447,7 +1538,7 @@ tree_t *BrushBSP (bspbrush_t *brushlist, Vector& mins, Vector& maxs)
 
 	tree->headnode = node;
 
-	node = BuildTree_r (node, brushlist);
+	BuildTree (node, brushlist, c_brushes);
 	qprintf ("%5i visible nodes\n", c_nodes/2 - c_nonvis);
 	qprintf ("%5i nonvis nodes\n", c_nonvis);
 	qprintf ("%5i leafs\n", (c_nodes+1)/2);
@@ -7,6 +7,7 @@
 //=============================================================================//
 
 #include "vbsp.h"
+#include <algorithm>
 
 /*
 
@@ -650,13 +651,13 @@ qboolean BrushGE (bspbrush_t *b1, bspbrush_t *b2)
 
 /*
 =================
-ChopBrushes
+ChopBrushList
 
 Carves any intersecting solid brushes into the minimum number
 of non-intersecting brushes. 
 =================
 */
-bspbrush_t *ChopBrushes (bspbrush_t *head)
+static bspbrush_t *ChopBrushList (bspbrush_t *head)
 {
 	bspbrush_t	*b1, *b2, *next;
 	bspbrush_t	*tail;
@@ -664,13 +665,6 @@ bspbrush_t *ChopBrushes (bspbrush_t *head)
 	bspbrush_t	*sub, *sub2;
 	int			c1, c2;
 
-	qprintf ("---- ChopBrushes ----\n");
-	qprintf ("original brushes: %i\n", CountBrushList (head));
-
-#if DEBUG_BRUSHMODEL
-	if (entity_num == DEBUG_BRUSHMODEL)
-		WriteBrushList ("before.gl", head, false);
-#endif
 	keep = NULL;
 
 newlist:
@@ -767,6 +761,198 @@ newlist:
 		}
 	}
 
+	return keep;
+}
+
+
+/*
+=================
+Chopping in parallel
+
+Brushes whose bounds don't overlap are never chopped against each other,
+and the pieces of a chopped brush stay inside its bounds, so brushes that
+are connected by overlapping bounds form islands that can be chopped on
+their own. Each island comes out the same no matter which thread chops it,
+and the islands are put back together in the order of their first brush.
+That is not the order ChopBrushList leaves the whole list in, and later
+stages depend on the brush order, so the output can differ from a normal
+compile. It only runs with -chopislands.
+=================
+*/
+struct chopisland_t
+{
+	bspbrush_t	*head;
+	bspbrush_t	*tail;
+	int			numbrushes;
+};
+
+static CUtlVector<chopisland_t> s_ChopIslands;
+
+static void ChopIsland_Thread (int threadnum, int islandnum)
+{
+	s_ChopIslands[islandnum].head = ChopBrushList (s_ChopIslands[islandnum].head);
+}
+
+static bool ChopIslandGreater (int a, int b)
+{
+	return s_ChopIslands[a].numbrushes > s_ChopIslands[b].numbrushes;
+}
+
+struct chopbrush_t
+{
+	bspbrush_t	*brush;
+	int			index;
+};
+
+static bool ChopBrushMinsLess (const chopbrush_t &a, const chopbrush_t &b)
+{
+	return a.brush->mins[0] < b.brush->mins[0];
+}
+
+static int FindIsland (CUtlVector<int> &parent, int i)
+{
+	while (parent[i] != i)
+	{
+		parent[i] = parent[parent[i]];
+		i = parent[i];
+	}
+	return i;
+}
+
+/*
+=================
+ChopBrushIslands
+=================
+*/
+static bspbrush_t *ChopBrushIslands (bspbrush_t *head)
+{
+	bspbrush_t	*b;
+	bspbrush_t	*keep;
+	int			i, j;
+
+	CUtlVector<chopbrush_t> sorted;
+	for (b=head ; b ; b=b->next)
+	{
+		chopbrush_t &sortbrush = sorted[sorted.AddToTail()];
+		sortbrush.brush = b;
+		sortbrush.index = sorted.Count() - 1;
+	}
+
+	// Join every pair of brushes with overlapping bounds, sweeping along x.
+	// The root of an island is always its first brush in the list.
+	CUtlVector<int> parent;
+	CUtlVector<bspbrush_t *> brushes;
+	parent.SetCount (sorted.Count());
+	brushes.SetCount (sorted.Count());
+	for (i=0 ; i<sorted.Count() ; i++)
+	{
+		parent[i] = i;
+		brushes[i] = sorted[i].brush;
+	}
+
+	std::sort (sorted.begin(), sorted.end(), ChopBrushMinsLess);
+
+	for (i=0 ; i<sorted.Count() ; i++)
+	{
+		bspbrush_t *b1 = sorted[i].brush;
+		for (j=i+1 ; j<sorted.Count() && sorted[j].brush->mins[0] < b1->maxs[0] ; j++)
+		{
+			bspbrush_t *b2 = sorted[j].brush;
+			if (b1->mins[1] >= b2->maxs[1] || b1->maxs[1] <= b2->mins[1]
+				|| b1->mins[2] >= b2->maxs[2] || b1->maxs[2] <= b2->mins[2])
+				continue;
+
+			int island1 = FindIsland (parent, sorted[i].index);
+			int island2 = FindIsland (parent, sorted[j].index);
+			if (island1 != island2)
+				parent[MAX (island1, island2)] = MIN (island1, island2);
+		}
+	}
+
+	// Relink the brushes into one list per island, keeping their order
+	CUtlVector<int> islandnum;
+	islandnum.SetCount (brushes.Count());
+	for (i=0 ; i<brushes.Count() ; i++)
+	{
+		b = brushes[i];
+		b->next = NULL;
+
+		int root = FindIsland (parent, i);
+		if (root == i)
+		{
+			islandnum[i] = s_ChopIslands.AddToTail();
+			chopisland_t &island = s_ChopIslands[islandnum[i]];
+			island.head = island.tail = b;
+			island.numbrushes = 1;
+		}
+		else
+		{
+			chopisland_t &island = s_ChopIslands[islandnum[root]];
+			island.tail->next = b;
+			island.tail = b;
+			island.numbrushes++;
+		}
+	}
+
+	// Chop the islands that have something to chop, biggest first
+	CUtlVector<int> worklist;
+	for (i=0 ; i<s_ChopIslands.Count() ; i++)
+	{
+		if (s_ChopIslands[i].numbrushes > 1)
+			worklist.AddToTail (i);
+	}
+	std::sort (worklist.begin(), worklist.end(), ChopIslandGreater);
+
+	if (numthreads > 1 && worklist.Count() > 1)
+	{
+		RunThreadsOnWorkList (worklist.Count(), worklist.Base(), false, ChopIsland_Thread);
+	}
+	else
+	{
+		for (i=0 ; i<worklist.Count() ; i++)
+			ChopIsland_Thread (0, worklist[i]);
+	}
+
+	keep = NULL;
+	for (i=s_ChopIslands.Count()-1 ; i>=0 ; i--)
+	{
+		bspbrush_t *island = s_ChopIslands[i].head;
+		if (!island)
+			continue;
+		for (b=island ; b->next ; b=b->next)
+		;
+		b->next = keep;
+		keep = island;
+	}
+	s_ChopIslands.Purge();
+	return keep;
+}
+
+/*
+=================
+ChopBrushes
+=================
+*/
+bspbrush_t *ChopBrushes (bspbrush_t *head)
+{
+	bspbrush_t	*keep;
+
+	qprintf ("---- ChopBrushes ----\n");
+	qprintf ("original brushes: %i\n", CountBrushList (head));
+
+#if DEBUG_BRUSHMODEL
+	if (entity_num == DEBUG_BRUSHMODEL)
+		WriteBrushList ("before.gl", head, false);
+#endif
+
+	if (!head)
+		return NULL;
+
+	if (g_bChopIslands)
+		keep = ChopBrushIslands (head);
+	else
+		keep = ChopBrushList (head);
+
 	qprintf ("output brushes: %i\n", CountBrushList (keep));
 #if DEBUG_BRUSHMODEL
 	if ( entity_num == DEBUG_BRUSHMODEL )
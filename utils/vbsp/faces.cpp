@@ -14,6 +14,7 @@
 #include "mstristrip.h"
 #include "tier1/strtools.h"
 #include "materialpatch.h"
+#include "tier0/threadtools.h"
 /*
 
   some faces will be removed before saving, but still form nodes:
@@ -791,16 +792,15 @@ int		c_faces;
 
 face_t	*AllocFace (void)
 {
-	static int s_FaceId = 0;
+	static CInterlockedInt s_FaceId;
 
 	face_t	*f;
 
 	f = (face_t*)malloc(sizeof(*f));
 	memset (f, 0, sizeof(*f));
-	f->id = s_FaceId;
-	++s_FaceId;
+	f->id = s_FaceId++;
 
-	c_faces++;
+	ThreadInterlockedIncrement (&c_faces);
 
 	return f;
 }
@@ -822,7 +822,7 @@ void FreeFace (face_t *f)
 	if (f->w)
 		FreeWinding (f->w);
 	free (f);
-	c_faces--;
+	ThreadInterlockedDecrement (&c_faces);
 }
 
 
@@ -1107,7 +1107,7 @@ face_t *TryMerge (face_t *f1, face_t *f2, Vector& planenormal)
 	if (!nw)
 		return NULL;
 
-	c_merge++;
+	ThreadInterlockedIncrement (&c_merge);
 	newf = NewFaceFromFace (f1);
 	newf->w = nw;
 
@@ -1230,7 +1230,7 @@ void SubdivideFace (face_t **pFaceList, face_t *f)
 				break;
 			
 		// split it
-			c_subdivide++;
+			ThreadInterlockedIncrement (&c_subdivide);
 			
 			luxelsPerWorldUnit = VectorNormalize (temp);	
 
@@ -1418,6 +1418,9 @@ face_t *FaceFromPortal (portal_t *p, int pside)
 	return f;
 }
 
+// nodes that got faces in MakeFaces_r, in the order it visited them
+static CUtlVector<node_t *> s_FaceNodes;
+
 /*
 ===============
 MakeFaces_r
@@ -1442,11 +1445,8 @@ void MakeFaces_r (node_t *node)
 		MakeFaces_r (node->children[0]);
 		MakeFaces_r (node->children[1]);
 
-		// merge together all visible faces on the node
-		if (!nomerge)
-			MergeFaceList(&node->faces);
-		if (!nosubdiv)
-			SubdivideFaceList(&node->faces);
+		if (node->faces)
+			s_FaceNodes.AddToTail (node);
 
 		return;
 	}
@@ -1814,6 +1814,17 @@ void SplitSubdividedFaces( face_t *pLeafFaceList, node_t *headnode )
 MakeFaces
 ============
 */
+static void MergeNodeFaces_Thread (int threadnum, int nodenum)
+{
+	node_t *node = s_FaceNodes[nodenum];
+
+	// merge together all visible faces on the node
+	if (!nomerge)
+		MergeFaceList(&node->faces);
+	if (!nosubdiv)
+		SubdivideFaceList(&node->faces);
+}
+
 void MakeFaces (node_t *node)
 {
 	qprintf ("--- MakeFaces ---\n");
@@ -1821,8 +1832,22 @@ void MakeFaces (node_t *node)
 	c_subdivide = 0;
 	c_nodefaces = 0;
 
+	// Faces are made on the main thread, making them can add texinfos.
+	// Merging and subdividing only touch the faces of one node, so the
+	// nodes are done in parallel.
 	MakeFaces_r (node);
 
+	if (numthreads > 1 && s_FaceNodes.Count() > 1)
+	{
+		RunThreadsOnIndividual (s_FaceNodes.Count(), false, MergeNodeFaces_Thread);
+	}
+	else
+	{
+		for (int i=0 ; i<s_FaceNodes.Count() ; i++)
+			MergeNodeFaces_Thread (0, i);
+	}
+	s_FaceNodes.Purge();
+
 	qprintf ("%5i makefaces\n", c_nodefaces);
 	qprintf ("%5i merged\n", c_merge);
 	qprintf ("%5i subdivided\n", c_subdivide);
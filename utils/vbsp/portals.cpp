@@ -13,6 +13,7 @@
 #include "csg.h"
 #include "utlmap.h"
 #include "fmtstr.h"
+#include "tier0/threadtools.h"
 
 int		c_active_portals;
 int		c_peak_portals;
@@ -30,10 +31,13 @@ portal_t *AllocPortal (void)
 
 	portal_t	*p;
 	
-	if (numthreads == 1)
-		c_active_portals++;
-	if (c_active_portals > c_peak_portals)
-		c_peak_portals = c_active_portals;
+	int nActive = ThreadInterlockedIncrement (&c_active_portals);
+	int nPeak;
+	while ( nActive > ( nPeak = c_peak_portals ) )
+	{
+		if ( ThreadInterlockedAssignIf( &c_peak_portals, nActive, nPeak ) )
+			break;
+	}
 	
 	p = (portal_t*)malloc (sizeof(portal_t));
 	memset (p, 0, sizeof(portal_t));
@@ -47,8 +51,7 @@ void FreePortal (portal_t *p)
 {
 	if (p->winding)
 		FreeWinding (p->winding);
-	if (numthreads == 1)
-		c_active_portals--;
+	ThreadInterlockedDecrement (&c_active_portals);
 	free (p);
 }
 
@@ -6,6 +6,7 @@
 //
 //=============================================================================//
 #include "vbsp.h"
+#include "tier0/threadtools.h"
 
 extern	int	c_nodes;
 
@@ -90,8 +91,7 @@ void FreeTree_r (node_t *node)
 	if (node->volume)
 		FreeBrush (node->volume);
 
-	if (numthreads == 1)
-		c_nodes--;
+	ThreadInterlockedDecrement (&c_nodes);
 	free (node);
 }
 
@@ -17,6 +17,7 @@
 #include "tools_minidump.h"
 #include "materialsub.h"
 #include "loadcmdline.h"
+#include "pacifier.h"
 #include "byteswap.h"
 #include "worldvertextransitionfixup.h"
 #include "lzma/lzma.h"
@@ -70,6 +71,7 @@ bool		g_bKeepStaleZip = false;
 bool		g_NodrawTriggers = false;
 bool		g_DisableWaterLighting = false;
 bool		g_bAllowDetailCracks = false;
+bool		g_bChopIslands = false;
 bool		g_bNoVirtualMesh = false;
 int			g_nVisGranularityX = 0, g_nVisGranularityY = 0, g_nVisGranularityZ = 0;
 
@@ -283,8 +285,19 @@ void ProcessWorldModel (void)
 	{
 		qprintf ("--------------------------------------------\n");
 
-		RunThreadsOnIndividual ((block_xh-block_xl+1)*(block_yh-block_yl+1),
-			!verbose, ProcessBlock_Thread);
+		// The blocks add planes as they go, so they're done one at a time.
+		// The chop, the tree build and MakeFaces spread out over the threads.
+		int numblocks = (block_xh-block_xl+1)*(block_yh-block_yl+1);
+		if (!verbose)
+			StartPacifier ("ProcessBlock_Thread: ");
+		for (int block = 0 ; block < numblocks ; block++)
+		{
+			ProcessBlock_Thread (0, block);
+			if (!verbose)
+				UpdatePacifier ((float)(block + 1) / numblocks);
+		}
+		if (!verbose)
+			EndPacifier ();
 
 		//
 		// build the division tree
@@ -1452,6 +1465,10 @@ int RunVBSP( int argc, char **argv )
 		{
 			g_bAllowDetailCracks = true;
 		}
+		else if ( !Q_stricmp( argv[i], "-chopislands"))
+		{
+			g_bChopIslands = true;
+		}
 		else if ( !Q_stricmp( argv[i], "-novirtualmesh"))
 		{
 			g_bNoVirtualMesh = true;
@@ -1531,6 +1548,8 @@ int RunVBSP( int argc, char **argv )
 				"  -verboseentities: If -v is on, this disables verbose output for submodels.\n"
 				"  -noweld      : Don't join face vertices together.\n"
 				"  -nocsg       : Don't chop out intersecting brush areas.\n"
+				"  -chopislands : Chop groups of overlapping brushes on separate threads.\n"
+				"                 Faster, but the output can differ from a normal compile.\n"
 				"  -noshare     : Emit unique face edges instead of sharing them.\n"
 				"  -notjunc     : Don't fixup t-junctions.\n"
 				"  -noopt       : By default, vbsp removes the 'outer shell' of the map, which\n"
@@ -1592,7 +1611,6 @@ int RunVBSP( int argc, char **argv )
 	}
 
 	ThreadSetDefault ();
-	numthreads = 1;		// multiple threads aren't helping...
 
 	// Setup the logfile.
 	char logFile[512];
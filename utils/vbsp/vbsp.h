@@ -385,6 +385,7 @@ extern	bool		g_snapAxialPlanes;
 extern	bool		g_NodrawTriggers;
 extern	bool		g_DisableWaterLighting;
 extern	bool		g_bAllowDetailCracks;
+extern	bool		g_bChopIslands;
 extern	bool		g_bNoVirtualMesh;
 extern	char		outbase[32];
 
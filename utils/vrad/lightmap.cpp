@@ -9,6 +9,7 @@
 #include "vrad.h"
 #include "lightmap.h"
 #include "radial.h"
+#include "vradcache.h"
 #include "mathlib/bumpvects.h"
 #include "tier1/utlvector.h"
 #include "vmpi.h"
@@ -2660,6 +2661,30 @@ static int FindOrAllocateLightstyleSamples( dface_t* f, facelight_t	*fl, int lig
 }
 
 
+//-----------------------------------------------------------------------------
+// Puts the direct lighting the lighting cache had for the face back
+//-----------------------------------------------------------------------------
+static void RestoreCachedFacelight( dface_t* f, facelight_t *fl, cachedfacelight_t const& cached, int numnormals )
+{
+	Assert( cached.m_nSamples == fl->numsamples );
+
+	const LightingValue_t *pSrc = cached.m_pLight;
+	for (int k = 0; k < MAXLIGHTMAPS; k++)
+	{
+		if (cached.m_Styles[k] == 255)
+			break;
+
+		f->styles[k] = cached.m_Styles[k];
+		AllocateLightstyleSamples( fl, k, numnormals );
+		for (int n = 0; n < numnormals; ++n)
+		{
+			memcpy( fl->light[k][n], pSrc, fl->numsamples * sizeof(LightingValue_t) );
+			pSrc += fl->numsamples;
+		}
+	}
+}
+
+
 //-----------------------------------------------------------------------------
 // Compute the illumination point + normal for the sample
 //-----------------------------------------------------------------------------
@@ -3451,9 +3476,19 @@ void BuildFacelights (int iThread, int facenum)
 	// Allocate sample positions/normals to SSE
 	int numGroups = ( fl->numsamples & 0x3) ? ( fl->numsamples / 4 ) + 1 : ( fl->numsamples / 4 );
 
-	// always allocate style 0 lightmap
-	f->styles[0] = 0;
-	AllocateLightstyleSamples( fl, 0, sampleInfo.m_NormalCount );
+	// Reuse the last compile's lighting if nothing it depends on changed
+	cachedfacelight_t cached;
+	bool bCached = LightingCache_FindFacelight( facenum, sampleInfo.m_NormalCount, cached );
+	if ( bCached )
+	{
+		RestoreCachedFacelight( f, fl, cached, sampleInfo.m_NormalCount );
+	}
+	else
+	{
+		// always allocate style 0 lightmap
+		f->styles[0] = 0;
+		AllocateLightstyleSamples( fl, 0, sampleInfo.m_NormalCount );
+	}
 
 	// sample the lights at each sample location
 	for ( int grp = 0; grp < numGroups; ++grp )
@@ -3484,7 +3519,10 @@ void BuildFacelights (int iThread, int facenum)
 		}
 
 		// Iterate over all the lights and add their contribution to this group of spots
-		GatherSampleLightAt4Points( sampleInfo, nSample, numSamples );
+		if ( !bCached )
+		{
+			GatherSampleLightAt4Points( sampleInfo, nSample, numSamples );
+		}
 	}
 	
 	// Tell the incremental light manager that we're done with this face.
@@ -3504,7 +3542,7 @@ void BuildFacelights (int iThread, int facenum)
 
 	// Enabling supersampling for displacements (previous revision always disabled do_extra for disp)
 	// improves continuity significantly between disp and brush surfaces, especially when using high frequency alpha shadow materials
-	if ( do_extra ) 
+	if ( do_extra && !bCached ) 
 	{
 		// For each lightstyle, perform a supersampling pass
 		for ( i = 0; i < MAXLIGHTMAPS; ++i )
@@ -3517,6 +3555,9 @@ void BuildFacelights (int iThread, int facenum)
 		}
 	}
 
+	// Keep the direct lighting for the next compile
+	LightingCache_StoreFacelight( facenum, f->styles, fl, sampleInfo.m_NormalCount );
+
 	if (!g_bUseMPI) 
 	{
 		//
@@ -13,6 +13,7 @@
 #include "trace.h"
 #include "Cmodel.h"
 #include "mathlib/vmatrix.h"
+#include "vstdlib/random.h"
 
 
 //=============================================================================
@@ -796,3 +797,78 @@ void AddBrushesForRayTrace( void )
 		}
 	}
 }
+
+
+//-----------------------------------------------------------------------------
+// -benchraytrace: times g_RtEnv with rays like the ones the lighting traces,
+// leaving the patches in random directions over their hemisphere
+//-----------------------------------------------------------------------------
+#define RAYTRACE_BENCH_BATCH	65536
+#define RAYTRACE_BENCH_LENGTH	4096.0f
+
+static int64 s_nRayTraceBenchHits;
+
+static void RayTraceBenchBatch( int iThread, int iBatch )
+{
+	CUniformRandomStream random;
+	random.SetSeed( iBatch + 1 );
+
+	int nHits = 0;
+	for ( int i = 0; i < RAYTRACE_BENCH_BATCH; i += 4 )
+	{
+		Vector vecStart[4], vecDir[4];
+		for ( int j = 0; j < 4; j++ )
+		{
+			CPatch *pPatch = &g_Patches[ random.RandomInt( 0, g_Patches.Count() - 1 ) ];
+			do
+			{
+				vecDir[j].Init( random.RandomFloat( -1.0f, 1.0f ), random.RandomFloat( -1.0f, 1.0f ), random.RandomFloat( -1.0f, 1.0f ) );
+			} while ( vecDir[j].LengthSqr() > 1.0f || vecDir[j].LengthSqr() < 1.0e-4f );
+			VectorNormalize( vecDir[j] );
+			if ( DotProduct( vecDir[j], pPatch->normal ) < 0.0f )
+			{
+				vecDir[j] = -vecDir[j];
+			}
+			vecStart[j] = pPatch->origin + pPatch->normal;
+		}
+
+		FourRays rays;
+		rays.origin.LoadAndSwizzle( vecStart[0], vecStart[1], vecStart[2], vecStart[3] );
+		rays.direction.LoadAndSwizzle( vecDir[0], vecDir[1], vecDir[2], vecDir[3] );
+
+		RayTracingResult result;
+		g_RtEnv.Trace4Rays( rays, Four_Zeros, ReplicateX4( RAYTRACE_BENCH_LENGTH ), &result );
+		for ( int j = 0; j < 4; j++ )
+		{
+			if ( result.HitIds[j] != -1 )
+				++nHits;
+		}
+	}
+
+	ThreadLock();
+	s_nRayTraceBenchHits += nHits;
+	ThreadUnlock();
+}
+
+void RunRayTraceBenchmark( int nMillionRays )
+{
+	if ( !g_Patches.Count() )
+	{
+		Warning( "No patches to trace rays from.\n" );
+		return;
+	}
+
+	// rays are counted in 64 bits, -benchraytrace 2148 and up overflows an int
+	int nBatches = (int)( ( (int64)nMillionRays * 1000000 + RAYTRACE_BENCH_BATCH - 1 ) / RAYTRACE_BENCH_BATCH );
+	int64 nRays = (int64)nBatches * RAYTRACE_BENCH_BATCH;
+	Msg( "Tracing %.2f million rays against %d triangles, %d kd-tree nodes\n", nRays / 1000000.0,
+		g_RtEnv.OptimizedTriangleList.Count(), g_RtEnv.OptimizedKDTree.Count() );
+
+	s_nRayTraceBenchHits = 0;
+	double flStart = Plat_FloatTime();
+	RunThreadsOnIndividual( nBatches, true, RayTraceBenchBatch );
+	double flElapsed = MAX( Plat_FloatTime() - flStart, 1.0e-6 );
+
+	Msg( "%.2f seconds, %.2f million rays/second, %.1f%% hit\n", flElapsed, nRays / flElapsed / 1000000.0,
+		100.0 * s_nRayTraceBenchHits / nRays );
+}
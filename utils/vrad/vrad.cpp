@@ -16,6 +16,7 @@
 #include "macro_texture.h"
 #include "vmpi_tools_shared.h"
 #include "leaf_ambient_lighting.h"
+#include "vradcache.h"
 #include "tools_minidump.h"
 #include "loadcmdline.h"
 #include "byteswap.h"
@@ -62,6 +63,7 @@ bool		bRed2Black = true;
 bool		g_bFastAmbient = false;
 bool        g_bNoSkyRecurse = false;
 bool        g_bFiniteFalloffModel = false;					// whether to use 1/xxx or not
+int			g_nBenchRayTraceRays = 0;						// "-benchraytrace": millions of rays to time the ray tracer with
 
 int			junk;
 
@@ -1958,11 +1960,22 @@ void BuildFacesVisibleToLights( bool bAllVisible )
 
 void MakeAllScales (void)
 {
-	// determine visibility between patches
-	BuildVisMatrix ();
+	// determine visibility between patches, unless the lighting cache still has them
+	if ( LightingCache_RestoreTransfers() )
+	{
+		for ( int i = 0; i < g_Patches.Count(); i++ )
+		{
+			max_transfer = max( max_transfer, g_Patches[i].numtransfers );
+			total_transfer += g_Patches[i].numtransfers;
+		}
+	}
+	else
+	{
+		BuildVisMatrix ();
 	
-	// release visibility matrix
-	FreeVisMatrix ();
+		// release visibility matrix
+		FreeVisMatrix ();
+	}
 
 	Msg("transfers %d, max %d\n", total_transfer, max_transfer );
 
@@ -2169,6 +2182,8 @@ bool RadWorld_Go()
 		
 		// Distribute the lighting data to workers.
 		VMPI_DistributeLightData();
+
+		LightingCache_Save();
 			
 		Msg("FinalLightFace Done\n"); fflush(stdout);
 	}
@@ -2352,6 +2367,9 @@ void VRAD_LoadBSP( char const *pFilename )
 	if ( g_bDumpRtEnv )
 		WriteRTEnv("trace.txt");
 
+	// Hash the occluders while the triangles are still in their original form
+	LightingCache_HashOccluders();
+
 	// Build acceleration structure
 	printf ( "Setting up ray-trace acceleration structure... ");
 	float start = Plat_FloatTime();
@@ -2366,6 +2384,8 @@ void VRAD_LoadBSP( char const *pFilename )
 
 	RadWorld_Start();
 
+	LightingCache_Load();
+
 	// Setup incremental lighting.
 	if( g_pIncremental )
 	{
@@ -2593,6 +2613,27 @@ int ParseCommandLine( int argc, char **argv, bool *onlydetail )
 		{
 			g_bNoSkyRecurse = true;
 		}
+		else if (!Q_stricmp(argv[i],"-nocache"))
+		{
+			g_bNoLightingCache = true;
+		}
+		else if (!Q_stricmp(argv[i],"-benchraytrace"))
+		{
+			if ( ++i < argc )
+			{
+				g_nBenchRayTraceRays = atoi( argv[i] );
+				if ( g_nBenchRayTraceRays <= 0 )
+				{
+					Warning("Error: expected positive value after '-benchraytrace'\n" );
+					return 1;
+				}
+			}
+			else
+			{
+				Warning("Error: expected a value after '-benchraytrace'\n" );
+				return 1;
+			}
+		}
 		else if (!Q_stricmp(argv[i],"-final"))
 		{
 			g_flSkySampleScale = 16.0;
@@ -3002,6 +3043,10 @@ void PrintUsage( int argc, char **argv )
 		"  -textureshadows : Allows texture alpha channels to block light - rays intersecting alpha surfaces will sample the texture\n"
 		"  -noskyboxrecurse : Turn off recursion into 3d skybox (skybox shadows on world)\n"
 		"  -nossprops      : Globally disable self-shadowing on static props\n"
+		"  -nocache        : Don't read or write the <map>.vradcache lighting cache, which\n"
+		"                    lets a recompile skip the faces a change didn't affect.\n"
+		"  -benchraytrace # : Load the map, trace # million rays against it, report\n"
+		"                    the rays/second and quit without lighting it.\n"
 		"\n"
 #if 1 // Disabled for the initial SDK release with VMPI so we can get feedback from selected users.
 		);
@@ -3055,8 +3100,18 @@ int RunVRAD( int argc, char **argv )
 		Plat_ExitProcess( 0 );
 	}
 
+	LightingCache_Init( argc, argv );
+
 	VRAD_LoadBSP( argv[i] );
 
+	if ( g_nBenchRayTraceRays )
+	{
+		RunRayTraceBenchmark( g_nBenchRayTraceRays );
+		DeleteCmdLine( argc, argv );
+		CmdLib_Cleanup();
+		return 0;
+	}
+
 	if ( (! onlydetail) && (! g_bOnlyStaticProps ) )
 	{
 		RadWorld_Go();
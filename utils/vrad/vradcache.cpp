@@ -0,0 +1,798 @@
+//========= Copyright  1996-2005, Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Lighting cache for incremental compiles.
+//
+// Faces are matched by a hash of everything their direct lighting is computed from:
+// the sample points and normals, the lights whose PVS reaches the samples, and the
+// options. That doesn't cover the shadows though, so the occluders are hashed too,
+// bucketed into cells; a cached face is only used if none of the cells that changed
+// since the last compile overlap the space the face's light rays go through.
+//
+// Bounce light depends on every face, so it always reruns, but the transfers it
+// runs on are reused as long as the patches, occluders and vis are unchanged.
+//
+//=============================================================================//
+
+#include "vrad.h"
+#include "lightmap.h"
+#include "vradcache.h"
+#include "vmpi.h"
+#include "filesystem.h"
+#include "tier1/generichash.h"
+#include "tier1/utlbuffer.h"
+#include "tier1/utlmap.h"
+
+
+#define LIGHTINGCACHE_ID		(('C'<<24)+('D'<<16)+('A'<<8)+'R')
+#define LIGHTINGCACHE_VERSION	1
+
+// Occluders are bucketed by their centroid
+#define OCCLUDER_CELL_SIZE		512.0f
+
+// How far past its samples a face's rays can touch something: the 1 unit the
+// sample is pushed off the surface plus the ambient occlusion rays.
+#define FACE_RAY_MARGIN			48.0f
+
+bool g_bNoLightingCache = false;
+
+static bool s_bActive = false;
+static uint64 s_nSettingsHash;
+static char s_szCacheFile[MAX_PATH];
+
+
+//-----------------------------------------------------------------------------
+// Hash accumulator
+//-----------------------------------------------------------------------------
+class CCacheHash
+{
+public:
+	CCacheHash( uint64 nSeed = 0 ) : m_nHash( nSeed ) {}
+
+	void Add( const void *pData, int nBytes )	{ m_nHash = HashUint64( m_nHash ^ MurmurHash64( pData, nBytes, (uint32)m_nHash ) ); }
+	void AddInt( int n )						{ Add( &n, sizeof( n ) ); }
+	void AddFloat( float fl )					{ Add( &fl, sizeof( fl ) ); }
+	void AddVector( const Vector &v )			{ Add( v.Base(), 3 * sizeof( float ) ); }
+	void AddHash( uint64 n )					{ m_nHash = HashUint64( m_nHash ^ n ); }
+	void AddString( const char *pString )		{ Add( pString, V_strlen( pString ) + 1 ); }
+
+	uint64 Get() const							{ return m_nHash; }
+
+private:
+	uint64 m_nHash;
+};
+
+
+//-----------------------------------------------------------------------------
+// Occluder cells
+//-----------------------------------------------------------------------------
+struct occludercell_t
+{
+	uint64	m_nHash;			// sum of the triangle hashes, so the triangle order doesn't matter
+	Vector	m_vecMins;			// of the triangles in the cell, which can stick out of it
+	Vector	m_vecMaxs;
+};
+
+struct changedbox_t
+{
+	Vector	m_vecMins;
+	Vector	m_vecMaxs;
+};
+
+static CUtlMap< uint64, occludercell_t > s_OccluderCells( DefLessFunc( uint64 ) );
+static uint64 s_nOccluderHash;
+static CUtlVector< changedbox_t > s_ChangedBoxes;
+static bool s_bOccludersChanged = true;
+
+
+static uint64 OccluderCellKey( const Vector &vecPoint )
+{
+	uint64 nKey = 0;
+	for ( int i = 0; i < 3; i++ )
+	{
+		int nCell = (int)floor( vecPoint[i] / OCCLUDER_CELL_SIZE );
+		nKey = ( nKey << 21 ) | ( ( nCell + ( 1 << 20 ) ) & 0x1fffff );
+	}
+	return nKey;
+}
+
+
+static void AddBoxToBox( changedbox_t &box, const Vector &vecMins, const Vector &vecMaxs )
+{
+	VectorMin( box.m_vecMins, vecMins, box.m_vecMins );
+	VectorMax( box.m_vecMaxs, vecMaxs, box.m_vecMaxs );
+}
+
+
+static bool BoxTouchesChangedOccluders( const Vector &vecMins, const Vector &vecMaxs )
+{
+	for ( int i = 0; i < s_ChangedBoxes.Count(); i++ )
+	{
+		const changedbox_t &box = s_ChangedBoxes[i];
+		if ( vecMins.x <= box.m_vecMaxs.x && vecMaxs.x >= box.m_vecMins.x &&
+			 vecMins.y <= box.m_vecMaxs.y && vecMaxs.y >= box.m_vecMins.y &&
+			 vecMins.z <= box.m_vecMaxs.z && vecMaxs.z >= box.m_vecMins.z )
+			return true;
+	}
+	return false;
+}
+
+
+//-----------------------------------------------------------------------------
+// Cache file contents
+//-----------------------------------------------------------------------------
+struct cachedfaceheader_t
+{
+	int		m_nSamples;
+	int		m_nNormals;
+	byte	m_Styles[MAXLIGHTMAPS];
+	int		m_nValues;
+	// followed by m_nValues LightingValue_t
+};
+
+struct facerecord_t
+{
+	uint64				m_nHash;
+	cachedfaceheader_t	m_Header;
+	LightingValue_t		*m_pLight;
+};
+
+static CUtlBuffer s_CacheFile;
+static CUtlMap< uint64, int > s_CachedFaces( DefLessFunc( uint64 ) );	// face hash -> offset of its header in s_CacheFile
+static int s_nTransferOffset = -1;
+
+// This compile's faces
+static uint64 *s_pFaceHashes;
+static bool *s_pFaceCacheable;
+static facerecord_t **s_ppFaceRecords;
+
+static int s_nFacesReused;
+static int s_nFacesLit;
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Hashes the options that change the lighting, so a cache made with
+//			-final isn't used for a -fast compile and the other way around
+//-----------------------------------------------------------------------------
+void LightingCache_Init( int argc, char **argv )
+{
+	s_bActive = !g_bNoLightingCache && !g_bUseMPI;
+	if ( !s_bActive )
+		return;
+
+	CCacheHash hash( LIGHTINGCACHE_VERSION );
+	hash.AddInt( g_bHDR ? 1 : 0 );
+
+	// argv[0] is vrad and the last one is the map
+	for ( int i = 1; i < argc - 1; i++ )
+	{
+		if ( !Q_stricmp( argv[i], "-threads" ) )
+		{
+			++i;
+			continue;
+		}
+
+		if ( !Q_stricmp( argv[i], "-low" ) || !Q_stricmp( argv[i], "-v" ) || !Q_stricmp( argv[i], "-verbose" ) ||
+			 !Q_stricmp( argv[i], "-nocache" ) || !Q_stricmp( argv[i], "-novconfig" ) || !Q_stricmp( argv[i], "-stoponexit" ) )
+			continue;
+
+		hash.AddString( argv[i] );
+	}
+	s_nSettingsHash = hash.Get();
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Buckets the ray trace triangles into cells
+//-----------------------------------------------------------------------------
+void LightingCache_HashOccluders()
+{
+	if ( !s_bActive )
+		return;
+
+	s_OccluderCells.RemoveAll();
+	s_nOccluderHash = 0;
+
+	int nTriangles = g_RtEnv.OptimizedTriangleList.Count();
+	for ( int i = 0; i < nTriangles; i++ )
+	{
+		const TriGeometryData_t &tri = g_RtEnv.OptimizedTriangleList[i].m_Data.m_GeometryData;
+
+		// The low bits are indices (of props and patches), which shift whenever
+		// something is added or removed elsewhere
+		CCacheHash hash;
+		hash.AddInt( tri.m_nTriangleID & 0xff000000 );
+		hash.AddInt( tri.m_nFlags );
+		hash.Add( tri.m_VertexCoordData, sizeof( tri.m_VertexCoordData ) );
+		if ( i < g_RtEnv.TriangleColors.Count() )
+		{
+			hash.AddVector( g_RtEnv.TriangleColors[i] );
+		}
+
+		Vector vecMins, vecMaxs;
+		ClearBounds( vecMins, vecMaxs );
+		for ( int j = 0; j < 3; j++ )
+		{
+			Vector vecVert( tri.m_VertexCoordData[j*3], tri.m_VertexCoordData[j*3+1], tri.m_VertexCoordData[j*3+2] );
+			AddPointToBounds( vecVert, vecMins, vecMaxs );
+		}
+
+		uint64 nKey = OccluderCellKey( ( vecMins + vecMaxs ) * 0.5f );
+		int iCell = s_OccluderCells.Find( nKey );
+		if ( !s_OccluderCells.IsValidIndex( iCell ) )
+		{
+			occludercell_t cell;
+			cell.m_nHash = 0;
+			cell.m_vecMins = vecMins;
+			cell.m_vecMaxs = vecMaxs;
+			iCell = s_OccluderCells.Insert( nKey, cell );
+		}
+
+		occludercell_t &cell = s_OccluderCells[iCell];
+		cell.m_nHash += hash.Get();
+		VectorMin( cell.m_vecMins, vecMins, cell.m_vecMins );
+		VectorMax( cell.m_vecMaxs, vecMaxs, cell.m_vecMaxs );
+		s_nOccluderHash += hash.Get();
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: The transfers only depend on the patches, the occluders between
+//			them and vis
+//-----------------------------------------------------------------------------
+static uint64 ComputeTransferKey()
+{
+	CCacheHash hash( s_nSettingsHash );
+	hash.AddHash( s_nOccluderHash );
+	hash.AddInt( visdatasize );
+	hash.Add( dvisdata, visdatasize );
+
+	hash.AddInt( g_Patches.Count() );
+	for ( int i = 0; i < g_Patches.Count(); i++ )
+	{
+		CPatch *pPatch = &g_Patches[i];
+		if ( pPatch->winding )
+		{
+			hash.AddInt( pPatch->winding->numpoints );
+			hash.Add( pPatch->winding->p, pPatch->winding->numpoints * sizeof( Vector ) );
+		}
+		hash.AddVector( pPatch->mins );
+		hash.AddVector( pPatch->maxs );
+		hash.AddVector( pPatch->face_mins );
+		hash.AddVector( pPatch->face_maxs );
+		hash.AddVector( pPatch->origin );
+		hash.AddVector( pPatch->normal );
+		if ( pPatch->plane )
+		{
+			hash.AddVector( pPatch->plane->normal );
+			hash.AddFloat( pPatch->plane->dist );
+		}
+		hash.AddInt( pPatch->normalMajorAxis | ( pPatch->sky << 2 ) | ( pPatch->needsBumpmap << 3 ) );
+		hash.AddFloat( pPatch->planeDist );
+		hash.AddFloat( pPatch->chop );
+		hash.AddFloat( pPatch->luxscale );
+		hash.AddFloat( pPatch->scale[0] );
+		hash.AddFloat( pPatch->scale[1] );
+		hash.AddFloat( pPatch->area );
+		hash.AddVector( pPatch->reflectivity );
+		hash.AddInt( pPatch->faceNumber );
+		hash.AddInt( pPatch->clusterNumber );
+		hash.AddInt( pPatch->parent );
+		hash.AddInt( pPatch->child1 );
+		hash.AddInt( pPatch->child2 );
+		hash.AddInt( pPatch->ndxNext );
+		hash.AddInt( pPatch->ndxNextParent );
+		hash.AddInt( pPatch->ndxNextClusterChild );
+		hash.AddInt( pPatch->staticPropIdx );
+	}
+
+	for ( int i = 0; i < dvis->numclusters; i++ )
+	{
+		hash.AddInt( clusterChildren[i] );
+	}
+	return hash.Get();
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Everything about a light that goes into the lighting
+//-----------------------------------------------------------------------------
+static uint64 HashLight( directlight_t *dl )
+{
+	CCacheHash hash;
+	hash.AddVector( dl->light.origin );
+	hash.AddVector( dl->light.intensity );
+	hash.AddVector( dl->light.normal );
+	hash.AddInt( dl->light.type );
+	hash.AddInt( dl->light.style );
+	hash.AddFloat( dl->light.stopdot );
+	hash.AddFloat( dl->light.stopdot2 );
+	hash.AddFloat( dl->light.exponent );
+	hash.AddFloat( dl->light.radius );
+	hash.AddFloat( dl->light.constant_attn );
+	hash.AddFloat( dl->light.linear_attn );
+	hash.AddFloat( dl->light.quadratic_attn );
+	hash.AddInt( dl->light.flags );
+	hash.AddInt( dl->facenum != -1 ? 1 : 0 );
+	hash.AddFloat( dl->m_flStartFadeDistance );
+	hash.AddFloat( dl->m_flEndFadeDistance );
+	hash.AddFloat( dl->m_flCapDist );
+
+	if ( dl->light.type == emit_skylight || dl->light.type == emit_skyambient )
+	{
+		hash.AddInt( dl->m_bSkyLightIsDirectionalLight ? 1 : 0 );
+		hash.AddFloat( dl->m_flSkyLightSunAngularExtent );
+		hash.AddFloat( g_SunAngularExtent );
+
+		// Sky rays continue into the 3D skybox
+		hash.AddInt( g_bNoSkyRecurse ? 0 : num_sky_cameras );
+		for ( int i = 0; !g_bNoSkyRecurse && i < num_sky_cameras; i++ )
+		{
+			hash.AddVector( sky_cameras[i].origin );
+			hash.AddFloat( sky_cameras[i].world_to_sky );
+		}
+	}
+	return hash.Get();
+}
+
+
+static CUtlVector< uint64 > s_LightHashes;	// in activelights order
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Reads the last compile's cache and finds the occluders that changed
+//-----------------------------------------------------------------------------
+void LightingCache_Load()
+{
+	if ( !s_bActive )
+		return;
+
+	V_StripExtension( source, s_szCacheFile, sizeof( s_szCacheFile ) );
+	V_strncat( s_szCacheFile, g_bHDR ? "_hdr.vradcache" : ".vradcache", sizeof( s_szCacheFile ) );
+
+	s_pFaceHashes = new uint64[numfaces];
+	s_pFaceCacheable = new bool[numfaces];
+	s_ppFaceRecords = new facerecord_t*[numfaces];
+	memset( s_pFaceCacheable, 0, numfaces * sizeof( bool ) );
+	memset( s_ppFaceRecords, 0, numfaces * sizeof( facerecord_t* ) );
+
+	for ( directlight_t *dl = activelights; dl != NULL; dl = dl->next )
+	{
+		s_LightHashes.AddToTail( HashLight( dl ) );
+	}
+
+	if ( !g_pFileSystem->ReadFile( s_szCacheFile, NULL, s_CacheFile ) )
+		return;
+
+	if ( s_CacheFile.GetInt() != LIGHTINGCACHE_ID || s_CacheFile.GetInt() != LIGHTINGCACHE_VERSION )
+	{
+		Warning( "%s is not a lighting cache, ignoring it\n", s_szCacheFile );
+		s_CacheFile.Purge();
+		return;
+	}
+
+	if ( s_CacheFile.GetUnsignedInt64() != s_nSettingsHash )
+	{
+		Msg( "Lighting options changed, not using %s\n", s_szCacheFile );
+		s_CacheFile.Purge();
+		return;
+	}
+
+	// Any cell that isn't exactly the same as last time is a change, whatever was in it before and after
+	s_ChangedBoxes.RemoveAll();
+	CUtlMap< uint64, bool > oldCells( DefLessFunc( uint64 ) );
+	int nOldCells = s_CacheFile.GetInt();
+	for ( int i = 0; i < nOldCells && s_CacheFile.IsValid(); i++ )
+	{
+		uint64 nKey = s_CacheFile.GetUnsignedInt64();
+		uint64 nHash = s_CacheFile.GetUnsignedInt64();
+		changedbox_t box;
+		s_CacheFile.Get( &box, sizeof( box ) );
+		oldCells.Insert( nKey, true );
+
+		int iCell = s_OccluderCells.Find( nKey );
+		if ( s_OccluderCells.IsValidIndex( iCell ) )
+		{
+			if ( s_OccluderCells[iCell].m_nHash == nHash )
+				continue;
+			AddBoxToBox( box, s_OccluderCells[iCell].m_vecMins, s_OccluderCells[iCell].m_vecMaxs );
+		}
+		s_ChangedBoxes.AddToTail( box );
+	}
+
+	for ( int i = s_OccluderCells.FirstInorder(); i != s_OccluderCells.InvalidIndex(); i = s_OccluderCells.NextInorder( i ) )
+	{
+		if ( oldCells.Find( s_OccluderCells.Key( i ) ) != oldCells.InvalidIndex() )
+			continue;
+
+		changedbox_t box;
+		box.m_vecMins = s_OccluderCells[i].m_vecMins;
+		box.m_vecMaxs = s_OccluderCells[i].m_vecMaxs;
+		s_ChangedBoxes.AddToTail( box );
+	}
+	s_bOccludersChanged = ( s_ChangedBoxes.Count() != 0 );
+
+	int nOldFaces = s_CacheFile.GetInt();
+	for ( int i = 0; i < nOldFaces && s_CacheFile.IsValid(); i++ )
+	{
+		uint64 nHash = s_CacheFile.GetUnsignedInt64();
+		int nOffset = s_CacheFile.TellGet();
+
+		cachedfaceheader_t header;
+		s_CacheFile.Get( &header, sizeof( header ) );
+		if ( header.m_nValues < 0 || header.m_nValues > s_CacheFile.TellMaxPut() / (int)sizeof( LightingValue_t ) )
+			break;
+		s_CacheFile.SeekGet( CUtlBuffer::SEEK_CURRENT, header.m_nValues * sizeof( LightingValue_t ) );
+
+		if ( s_CachedFaces.Find( nHash ) == s_CachedFaces.InvalidIndex() )
+		{
+			s_CachedFaces.Insert( nHash, nOffset );
+		}
+	}
+
+	s_nTransferOffset = s_CacheFile.TellGet();
+	if ( !s_CacheFile.IsValid() || s_nTransferOffset > s_CacheFile.TellMaxPut() )
+	{
+		Warning( "%s is corrupt, ignoring it\n", s_szCacheFile );
+		s_CachedFaces.RemoveAll();
+		s_ChangedBoxes.RemoveAll();
+		s_nTransferOffset = -1;
+		s_bOccludersChanged = true;
+		s_CacheFile.Purge();
+		return;
+	}
+
+	Msg( "Lighting cache: %d cached faces, %d of %d occluder cells changed\n", s_CachedFaces.Count(), s_ChangedBoxes.Count(), s_OccluderCells.Count() );
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Restores the transfers of every patch if nothing they depend on changed
+//-----------------------------------------------------------------------------
+bool LightingCache_RestoreTransfers()
+{
+	if ( !s_bActive || s_nTransferOffset < 0 )
+		return false;
+
+	s_CacheFile.SeekGet( CUtlBuffer::SEEK_HEAD, s_nTransferOffset );
+	if ( s_CacheFile.GetInt() == 0 || s_CacheFile.GetUnsignedInt64() != ComputeTransferKey() )
+		return false;
+
+	int nPatches = s_CacheFile.GetInt();
+	if ( !s_CacheFile.IsValid() || nPatches != g_Patches.Count() )
+		return false;
+
+	// Check the whole thing before touching the patches
+	int nStart = s_CacheFile.TellGet();
+	for ( int i = 0; i < nPatches && s_CacheFile.IsValid(); i++ )
+	{
+		int nTransfers = s_CacheFile.GetInt();
+		if ( nTransfers < 0 || nTransfers > s_CacheFile.TellMaxPut() / (int)sizeof( transfer_t ) )
+			return false;
+		s_CacheFile.SeekGet( CUtlBuffer::SEEK_CURRENT, nTransfers * sizeof( transfer_t ) );
+	}
+	if ( !s_CacheFile.IsValid() || s_CacheFile.TellGet() > s_CacheFile.TellMaxPut() )
+		return false;
+
+	s_CacheFile.SeekGet( CUtlBuffer::SEEK_HEAD, nStart );
+	for ( int i = 0; i < nPatches; i++ )
+	{
+		CPatch *pPatch = &g_Patches[i];
+		pPatch->numtransfers = s_CacheFile.GetInt();
+		pPatch->transfers = NULL;
+		if ( pPatch->numtransfers )
+		{
+			pPatch->transfers = ( transfer_t* )malloc( pPatch->numtransfers * sizeof( transfer_t ) );
+			if ( !pPatch->transfers )
+				Error( "Memory allocation failure" );
+			s_CacheFile.Get( pPatch->transfers, pPatch->numtransfers * sizeof( transfer_t ) );
+		}
+	}
+
+	Msg( "Lighting cache: reusing the transfers\n" );
+	return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Finds the face's direct lighting from the last compile. Call after CalcPoints.
+//-----------------------------------------------------------------------------
+bool LightingCache_FindFacelight( int facenum, int normalCount, cachedfacelight_t &cached )
+{
+	if ( !s_bActive )
+		return false;
+
+	facelight_t *fl = &facelight[facenum];
+	dface_t *f = &g_pFaces[facenum];
+	texinfo_t *pTexInfo = &texinfo[f->texinfo];
+
+	CCacheHash hash( s_nSettingsHash );
+	hash.AddInt( normalCount );
+	hash.AddInt( f->numedges );
+	hash.AddInt( pTexInfo->flags );
+	hash.Add( pTexInfo->textureVecsTexelsPerWorldUnits, sizeof( pTexInfo->textureVecsTexelsPerWorldUnits ) );
+	hash.AddVector( face_offset[facenum] );
+	hash.AddVector( dplanes[f->planenum].normal );
+
+	// Phong normals are interpolated from the vertices
+	faceneighbor_t *fn = &faceneighbor[facenum];
+	for ( int j = 0; j < f->numedges; j++ )
+	{
+		int e = dsurfedges[f->firstedge + j];
+		hash.AddVector( dvertexes[ e >= 0 ? dedges[e].v[0] : dedges[-e].v[1] ].point );
+		if ( fn->normal )
+		{
+			hash.AddVector( fn->normal[j] );
+		}
+	}
+
+	// The rays start at the samples, and can reach a little past them
+	Vector vecMins, vecMaxs;
+	ClearBounds( vecMins, vecMaxs );
+	hash.AddInt( fl->numsamples );
+	for ( int i = 0; i < fl->numsamples; i++ )
+	{
+		sample_t *pSample = &fl->sample[i];
+		hash.AddVector( pSample->pos );
+		hash.AddVector( pSample->normal );
+		hash.AddFloat( pSample->area );
+		AddPointToBounds( pSample->pos, vecMins, vecMaxs );
+		if ( pSample->w )
+		{
+			for ( int j = 0; j < pSample->w->numpoints; j++ )
+			{
+				AddPointToBounds( pSample->w->p[j], vecMins, vecMaxs );
+			}
+		}
+	}
+	Vector vecMargin( FACE_RAY_MARGIN, FACE_RAY_MARGIN, FACE_RAY_MARGIN );
+	vecMins -= vecMargin;
+	vecMaxs += vecMargin;
+
+	// Same clusters as GatherSampleLightAt4Points checks the lights against
+	int clusters[64];
+	int nClusters = 0;
+	bool bCacheable = true;
+	for ( int i = 0; i < fl->numsamples && bCacheable; i++ )
+	{
+		int nCluster = ClusterFromPoint( fl->sample[i].pos );
+		int j;
+		for ( j = 0; j < nClusters; j++ )
+		{
+			if ( clusters[j] == nCluster )
+				break;
+		}
+		if ( j == nClusters )
+		{
+			if ( nClusters == ARRAYSIZE( clusters ) )
+			{
+				bCacheable = false;
+				break;
+			}
+			clusters[nClusters++] = nCluster;
+		}
+		hash.AddInt( j );
+	}
+
+	bool bValid = bCacheable;
+	int iLight = 0;
+	for ( directlight_t *dl = activelights; dl != NULL && bCacheable; dl = dl->next, iLight++ )
+	{
+		bool bVisible = false;
+		for ( int j = 0; j < nClusters; j++ )
+		{
+			if ( PVSCheck( dl->pvs, clusters[j] ) )
+			{
+				bVisible = true;
+				hash.AddInt( j );
+			}
+		}
+		if ( !bVisible )
+			continue;
+
+		hash.AddHash( s_LightHashes[iLight] );
+		if ( !bValid || !s_bOccludersChanged )
+			continue;
+
+		// Did anything move into or out of the way of the light?
+		switch ( dl->light.type )
+		{
+		case emit_skyambient:
+			bValid = false;
+			break;
+
+		case emit_skylight:
+			{
+				float flExtent = dl->m_bSkyLightIsDirectionalLight ? dl->m_flSkyLightSunAngularExtent : g_SunAngularExtent;
+				Vector vecSpread( 1.0f, 1.0f, 1.0f );
+				vecSpread *= MAX_TRACE_LENGTH * flExtent + 1.0f;
+				Vector vecDelta = dl->light.normal * -MAX_TRACE_LENGTH;
+
+				Vector vecSweepMins = vecMins, vecSweepMaxs = vecMaxs;
+				AddPointToBounds( vecMins + vecDelta - vecSpread, vecSweepMins, vecSweepMaxs );
+				AddPointToBounds( vecMaxs + vecDelta + vecSpread, vecSweepMins, vecSweepMaxs );
+				AddPointToBounds( vecMins + vecDelta + vecSpread, vecSweepMins, vecSweepMaxs );
+				AddPointToBounds( vecMaxs + vecDelta - vecSpread, vecSweepMins, vecSweepMaxs );
+				if ( BoxTouchesChangedOccluders( vecSweepMins, vecSweepMaxs ) )
+				{
+					bValid = false;
+					break;
+				}
+
+				for ( int i = 0; !g_bNoSkyRecurse && i < num_sky_cameras; i++ )
+				{
+					Vector vecSkyMins = sky_cameras[i].origin + vecMins * sky_cameras[i].world_to_sky;
+					Vector vecSkyMaxs = sky_cameras[i].origin + vecMaxs * sky_cameras[i].world_to_sky;
+					vecSweepMins = vecSkyMins;
+					vecSweepMaxs = vecSkyMaxs;
+					AddPointToBounds( vecSkyMins + vecDelta - vecSpread, vecSweepMins, vecSweepMaxs );
+					AddPointToBounds( vecSkyMaxs + vecDelta + vecSpread, vecSweepMins, vecSweepMaxs );
+					AddPointToBounds( vecSkyMins + vecDelta + vecSpread, vecSweepMins, vecSweepMaxs );
+					AddPointToBounds( vecSkyMaxs + vecDelta - vecSpread, vecSweepMins, vecSweepMaxs );
+					if ( BoxTouchesChangedOccluders( vecSweepMins, vecSweepMaxs ) )
+					{
+						bValid = false;
+						break;
+					}
+				}
+			}
+			break;
+
+		default:
+			{
+				// Attached lights shine from the origin, see GatherSampleStandardLightSSE
+				Vector vecLightMins = vecMins, vecLightMaxs = vecMaxs;
+				AddPointToBounds( dl->light.origin, vecLightMins, vecLightMaxs );
+				if ( dl->facenum != -1 )
+				{
+					AddPointToBounds( vec3_origin, vecLightMins, vecLightMaxs );
+				}
+				if ( BoxTouchesChangedOccluders( vecLightMins, vecLightMaxs ) )
+				{
+					bValid = false;
+				}
+			}
+			break;
+		}
+	}
+
+	s_pFaceHashes[facenum] = hash.Get();
+	s_pFaceCacheable[facenum] = bCacheable;
+
+	int iFound = bValid ? s_CachedFaces.Find( hash.Get() ) : s_CachedFaces.InvalidIndex();
+	if ( iFound != s_CachedFaces.InvalidIndex() )
+	{
+		const cachedfaceheader_t *pHeader = (const cachedfaceheader_t *)( (const byte *)s_CacheFile.Base() + s_CachedFaces[iFound] );
+		int nStyles = 0;
+		while ( nStyles < MAXLIGHTMAPS && pHeader->m_Styles[nStyles] != 255 )
+		{
+			++nStyles;
+		}
+
+		if ( pHeader->m_nSamples == fl->numsamples && pHeader->m_nNormals == normalCount &&
+			 pHeader->m_nValues == nStyles * normalCount * fl->numsamples )
+		{
+			cached.m_nSamples = pHeader->m_nSamples;
+			memcpy( cached.m_Styles, pHeader->m_Styles, sizeof( cached.m_Styles ) );
+			cached.m_pLight = (const LightingValue_t *)( pHeader + 1 );
+
+			ThreadLock();
+			++s_nFacesReused;
+			ThreadUnlock();
+			return true;
+		}
+	}
+
+	ThreadLock();
+	++s_nFacesLit;
+	ThreadUnlock();
+	return false;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Keeps the face's direct lighting for the next compile
+//-----------------------------------------------------------------------------
+void LightingCache_StoreFacelight( int facenum, const byte *pStyles, facelight_t const *fl, int normalCount )
+{
+	if ( !s_bActive || !s_pFaceCacheable[facenum] )
+		return;
+
+	int nStyles = 0;
+	while ( nStyles < MAXLIGHTMAPS && pStyles[nStyles] != 255 )
+	{
+		++nStyles;
+	}
+
+	int nValues = nStyles * normalCount * fl->numsamples;
+	facerecord_t *pRecord = ( facerecord_t* )malloc( sizeof( facerecord_t ) + nValues * sizeof( LightingValue_t ) );
+	if ( !pRecord )
+		Error( "Memory allocation failure" );
+
+	pRecord->m_nHash = s_pFaceHashes[facenum];
+	pRecord->m_Header.m_nSamples = fl->numsamples;
+	pRecord->m_Header.m_nNormals = normalCount;
+	memcpy( pRecord->m_Header.m_Styles, pStyles, sizeof( pRecord->m_Header.m_Styles ) );
+	pRecord->m_Header.m_nValues = nValues;
+	pRecord->m_pLight = (LightingValue_t *)( pRecord + 1 );
+
+	LightingValue_t *pDest = pRecord->m_pLight;
+	for ( int k = 0; k < nStyles; k++ )
+	{
+		for ( int n = 0; n < normalCount; n++ )
+		{
+			memcpy( pDest, fl->light[k][n], fl->numsamples * sizeof( LightingValue_t ) );
+			pDest += fl->numsamples;
+		}
+	}
+
+	s_ppFaceRecords[facenum] = pRecord;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Writes this compile's lighting out for the next one
+//-----------------------------------------------------------------------------
+void LightingCache_Save()
+{
+	if ( !s_bActive )
+		return;
+
+	Msg( "Lighting cache: reused %d faces, lit %d\n", s_nFacesReused, s_nFacesLit );
+
+	CUtlBuffer buf;
+	buf.PutInt( LIGHTINGCACHE_ID );
+	buf.PutInt( LIGHTINGCACHE_VERSION );
+	buf.PutUnsignedInt64( s_nSettingsHash );
+
+	buf.PutInt( s_OccluderCells.Count() );
+	for ( int i = s_OccluderCells.FirstInorder(); i != s_OccluderCells.InvalidIndex(); i = s_OccluderCells.NextInorder( i ) )
+	{
+		buf.PutUnsignedInt64( s_OccluderCells.Key( i ) );
+		buf.PutUnsignedInt64( s_OccluderCells[i].m_nHash );
+		buf.Put( s_OccluderCells[i].m_vecMins.Base(), 3 * sizeof( float ) );
+		buf.Put( s_OccluderCells[i].m_vecMaxs.Base(), 3 * sizeof( float ) );
+	}
+
+	int nFaces = 0;
+	for ( int i = 0; i < numfaces; i++ )
+	{
+		if ( s_ppFaceRecords[i] )
+			++nFaces;
+	}
+
+	buf.PutInt( nFaces );
+	for ( int i = 0; i < numfaces; i++ )
+	{
+		facerecord_t *pRecord = s_ppFaceRecords[i];
+		if ( !pRecord )
+			continue;
+
+		buf.PutUnsignedInt64( pRecord->m_nHash );
+		buf.Put( &pRecord->m_Header, sizeof( pRecord->m_Header ) );
+		buf.Put( pRecord->m_pLight, pRecord->m_Header.m_nValues * sizeof( LightingValue_t ) );
+
+		free( pRecord );
+		s_ppFaceRecords[i] = NULL;
+	}
+
+	// Transfers only exist if there was a bounce
+	bool bHasTransfers = ( numbounce > 0 && g_Patches.Count() > 0 );
+	buf.PutInt( bHasTransfers ? 1 : 0 );
+	if ( bHasTransfers )
+	{
+		buf.PutUnsignedInt64( ComputeTransferKey() );
+		buf.PutInt( g_Patches.Count() );
+		for ( int i = 0; i < g_Patches.Count(); i++ )
+		{
+			CPatch *pPatch = &g_Patches[i];
+			buf.PutInt( pPatch->numtransfers );
+			buf.Put( pPatch->transfers, pPatch->numtransfers * sizeof( transfer_t ) );
+		}
+	}
+
+	if ( !g_pFileSystem->WriteFile( s_szCacheFile, NULL, buf ) )
+	{
+		Warning( "Couldn't write %s\n", s_szCacheFile );
+	}
+}
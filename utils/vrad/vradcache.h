@@ -0,0 +1,54 @@
+//========= Copyright  1996-2005, Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Lighting cache for incremental compiles. <mapname>.vradcache keeps the
+//			patch transfers and the direct lighting of every face from the last
+//			compile, keyed on hashes of their inputs, so a recompile only relights
+//			the faces whose geometry, lights or occluders changed.
+//
+//=============================================================================//
+
+#ifndef VRADCACHE_H
+#define VRADCACHE_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+
+struct facelight_t;
+struct LightingValue_t;
+
+extern bool g_bNoLightingCache;
+
+// Direct lighting of a face, one block of numsamples values per normal per used style.
+struct cachedfacelight_t
+{
+	int						m_nSamples;
+	byte					m_Styles[MAXLIGHTMAPS];
+	const LightingValue_t	*m_pLight;
+};
+
+// Call once the options are parsed. Hashes the options that affect lighting
+// and turns the cache off for MPI and incremental (Hammer) lighting.
+void LightingCache_Init( int argc, char **argv );
+
+// Call before the ray trace environments build their acceleration structures,
+// the triangles are still in their original format then.
+void LightingCache_HashOccluders();
+
+// Call after RadWorld_Start. Reads the cache and works out which occluders changed.
+void LightingCache_Load();
+
+// Fills in the patch transfers if the patches, occluders and vis didn't change.
+bool LightingCache_RestoreTransfers();
+
+// Thread safe. Returns false if the face has to be lit.
+bool LightingCache_FindFacelight( int facenum, int normalCount, cachedfacelight_t &cached );
+
+// Thread safe. Call once the face's direct lighting is done, supersampling included.
+void LightingCache_StoreFacelight( int facenum, const byte *pStyles, facelight_t const *fl, int normalCount );
+
+// Writes the cache, call after the bounce.
+void LightingCache_Save();
+
+
+#endif // VRADCACHE_H
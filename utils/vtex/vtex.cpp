@@ -87,6 +87,8 @@ static char g_ForcedOutputDir[MAX_PATH];
 
 static bool g_bOldCubemapPath = false;
 
+static int g_nBenchDXTMegaPixels = 0;
+
 
 #define MAX_VMT_PARAMS	16
 
@@ -134,6 +136,28 @@ static BitmapFileType_t g_eMode = BITMAP_FILE_TYPE_PSD;
 // NOTE: these must stay in the same order as CubeMapFaceIndex_t.
 static const char *g_CubemapFacingNames[7] = { "rt", "lf", "bk", "ft", "up", "dn", "sph" };
 
+//-----------------------------------------------------------------------------
+// Pool for the float bitmap filtering and DXT block compression of large images
+//-----------------------------------------------------------------------------
+static IThreadPool *StartVTexThreadPool()
+{
+	IThreadPool *pVTexThreadPool = CreateNewThreadPool();
+	ThreadPoolStartParams_t startParams;
+	startParams.fDistribute = TRS_TRUE;
+	pVTexThreadPool->Start( startParams );
+
+	FloatBitMap_t::SetThreadPool( pVTexThreadPool );
+	ImageLoader::SetThreadPool( pVTexThreadPool );
+	return pVTexThreadPool;
+}
+
+static void StopVTexThreadPool( IThreadPool *pVTexThreadPool )
+{
+	FloatBitMap_t::SetThreadPool( NULL );
+	ImageLoader::SetThreadPool( NULL );
+	DestroyThreadPool( pVTexThreadPool );
+}
+
 static void Pause( void )
 {
 	if( !g_NoPause )
@@ -2981,6 +3005,7 @@ void Usage( void )
 		"  -nopsd            : skip .psd files (e.g. use this with \"vtex *.*\")\n"
 		"  -notga            : skip .tga files (e.g. use this with \"vtex *.*\")\n"
 		"  -oldcubepath      : old cubemap method, expects 6 input files, suffixed: 'up', 'dn', 'lf', 'rt', 'ft', 'bk'\n"
+		"  -benchdxt <n>     : check the DXT block decoders, time DXT decoding and encoding of an n megapixel image and quit\n"
 		"\n"
 		"\teg: -vmtparam $ignorez 1 -vmtparam $translucent 1\n"
 		"\n"
@@ -3880,6 +3905,15 @@ int CVTex::VTex( int argc, char **argv )
 			g_bOldCubemapPath = true;
 			i++;
 		}
+		else if ( stricmp( argv[i], "-benchdxt" ) == 0 )
+		{
+			i++;
+			if ( i < argc )
+			{
+				g_nBenchDXTMegaPixels = MAX( atoi( argv[i] ), 1 );
+				i++;
+			}
+		}
 		else if( argv[i][0] == '-' )
 		{
 			// Just assuming that these are valid flags with no args
@@ -3891,6 +3925,19 @@ int CVTex::VTex( int argc, char **argv )
 		}
 	}
 
+	if ( g_nBenchDXTMegaPixels )
+	{
+		IThreadPool *pVTexThreadPool = StartVTexThreadPool();
+		bool bOk = ImageLoader::BenchmarkDXT( g_nBenchDXTMegaPixels );
+		StopVTexThreadPool( pVTexThreadPool );
+
+		if ( g_bUsedAsLaunchableDLL )
+		{
+			LoggingSystem_PopLoggingState();
+		}
+		return bOk ? 0 : 1;
+	}
+
 	// Set the suggest game info directory helper
 	g_suggestGameDirHelper.m_pszInputFiles = argv + i;
 	g_suggestGameDirHelper.m_numInputFiles = argc - i;
@@ -3963,6 +4010,8 @@ int CVTex::VTex( int argc, char **argv )
 		g_p4factory->SetOpenFileChangeList( "VTex Auto Checkout" );
 	}
 
+	IThreadPool *pVTexThreadPool = StartVTexThreadPool();
+
 	// Parse args
 	for( ; i < argc; i++ )
 	{
@@ -4004,6 +4053,8 @@ int CVTex::VTex( int argc, char **argv )
 
 	}
 
+	StopVTexThreadPool( pVTexThreadPool );
+
 	// Shutdown P4
 	if ( g_bUsedAsLaunchableDLL && p4 )
 	{
@@ -4138,12 +4189,7 @@ CDmeTexture *CVTexCompiler::CompileResource( CDmePrecompiledTexture *pPrecompile
 	CDmeTexture *pTexture = pPrecompiledResource->m_pSourceTexture;
 	SetTextureStateFromPrecompiledTexture( pPrecompiledResource, pTexture );
 
-	IThreadPool *pVTexThreadPool = CreateNewThreadPool();
-	ThreadPoolStartParams_t startParams;
-	startParams.fDistribute = TRS_TRUE;
-	pVTexThreadPool->Start( startParams );
-
-	FloatBitMap_t::SetThreadPool( pVTexThreadPool );
+	IThreadPool *pVTexThreadPool = StartVTexThreadPool();
 	int nCount = pPrecompiledResource->m_Processors.Count();
 	for ( int i = 0; i < nCount; ++i )
 	{
@@ -4167,8 +4213,7 @@ CDmeTexture *CVTexCompiler::CompileResource( CDmePrecompiledTexture *pPrecompile
 		pTexture = pDestTexture;
 	}
 
-	FloatBitMap_t::SetThreadPool( NULL );
-	DestroyThreadPool( pVTexThreadPool );
+	StopVTexThreadPool( pVTexThreadPool );
 
 	return pTexture;
 }
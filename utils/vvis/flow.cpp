@@ -707,6 +707,8 @@ void SimpleFlood (portal_t *srcportal, int leafnum)
 BasePortalVis
 ==============
 */
+#define SPHERE_REJECT_MARGIN	0.1f
+
 void BasePortalVis (int iThread, int portalnum)
 {
 	int			j, k;
@@ -740,6 +742,17 @@ void BasePortalVis (int iThread, int portalnum)
 		if (j == portalnum)
 			continue;
 
+		// Bounding sphere rejects for the two point loops below. The spheres contain
+		// every winding point, the margin keeps rounding from rejecting a portal the
+		// exact tests would have kept.
+		d = DotProduct (tp->origin, p->plane.normal) - p->plane.dist;
+		if (d + tp->radius < ON_VIS_EPSILON - SPHERE_REJECT_MARGIN)
+			continue;	// no points on front
+
+		d = DotProduct (p->origin, tp->plane.normal) - tp->plane.dist;
+		if (d - p->radius > -ON_VIS_EPSILON + SPHERE_REJECT_MARGIN)
+			continue;	// no points on front
+
 		//
 		//
 		//
@@ -115,6 +115,10 @@ void BetterPortalVis (int portalnum);
 void PortalFlow (int iThread, int portalnum);
 void WritePortalTrace( const char *source );
 
+// viscache.cpp
+void LoadVisCache( const char *pFilename );
+void SaveVisCache( const char *pFilename );
+
 extern	portal_t	*sorted_portals[MAX_MAP_PORTALS*2];
 extern int g_TraceClusterStart, g_TraceClusterStop;
 
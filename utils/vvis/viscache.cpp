@@ -0,0 +1,325 @@
+//========= Copyright  1996-2005, Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Incremental vis. Keeps the portal flow results of the last compile
+//			so portals whose surroundings didn't change don't have to be flowed again.
+//
+// $NoKeywords: $
+//
+//=============================================================================//
+
+#include "vis.h"
+#include "filesystem.h"
+#include "tier1/checksum_md5.h"
+#include "tier1/utlbuffer.h"
+#include "tier1/utlmap.h"
+
+
+#define VISCACHE_ID			(('C'<<24)+('S'<<16)+('I'<<8)+'V')
+#define VISCACHE_VERSION	1
+
+// Portal indices move around whenever vbsp regenerates the portal file, so portals
+// are matched by hash instead.
+//
+// m_nKey identifies a portal: its winding and plane, and the windings of the portals
+// of the leaf it leads into (that's where the flow out of it continues).
+//
+// m_nDependency is m_nKey plus a hash of every portal in the portal's portalflood.
+// The flow only ever walks portals out of portalflood, so if none of them changed the
+// portal sees exactly what it saw last time.
+struct portalhash_t
+{
+	uint64	m_nKey;
+	uint64	m_nMix;				// what this portal adds to the dependency hash of others
+	uint64	m_nDependency;
+};
+
+static portalhash_t *s_pPortalHashes;
+
+
+static uint64 HashWinding( portal_t *p )
+{
+	MD5Value_t digest;
+	MD5Context_t ctx;
+	MD5Init( &ctx );
+	MD5Update( &ctx, (unsigned char const *)&p->plane, sizeof( p->plane ) );
+	MD5Update( &ctx, (unsigned char const *)&p->winding->numpoints, sizeof( p->winding->numpoints ) );
+	MD5Update( &ctx, (unsigned char const *)p->winding->points, p->winding->numpoints * sizeof( Vector ) );
+	MD5Final( digest.bits, &ctx );
+
+	uint64 nHash;
+	memcpy( &nHash, digest.bits, sizeof( nHash ) );
+	return nHash;
+}
+
+
+static void HashPortals()
+{
+	if ( s_pPortalHashes )
+		return;
+
+	int nPortals = g_numportals * 2;
+	s_pPortalHashes = new portalhash_t[nPortals];
+
+	uint64 *pWindingHashes = new uint64[nPortals];
+	for ( int i = 0; i < nPortals; i++ )
+	{
+		pWindingHashes[i] = HashWinding( &portals[i] );
+	}
+
+	// The leaf signature doesn't depend on the order the portals were written in
+	uint64 *pLeafHashes = new uint64[portalclusters];
+	for ( int i = 0; i < portalclusters; i++ )
+	{
+		pLeafHashes[i] = 0;
+		for ( int j = 0; j < leafs[i].portals.Count(); j++ )
+		{
+			pLeafHashes[i] += pWindingHashes[leafs[i].portals[j] - portals];
+		}
+	}
+
+	for ( int i = 0; i < nPortals; i++ )
+	{
+		MD5Value_t digest;
+		MD5Context_t ctx;
+		MD5Init( &ctx );
+		MD5Update( &ctx, (unsigned char const *)&pWindingHashes[i], sizeof( uint64 ) );
+		MD5Update( &ctx, (unsigned char const *)&pLeafHashes[portals[i].leaf], sizeof( uint64 ) );
+		MD5Final( digest.bits, &ctx );
+
+		memcpy( &s_pPortalHashes[i].m_nKey, digest.bits, sizeof( uint64 ) );
+		memcpy( &s_pPortalHashes[i].m_nMix, digest.bits + sizeof( uint64 ), sizeof( uint64 ) );
+	}
+
+	// Summed so the hash doesn't depend on the portal order either
+	for ( int i = 0; i < nPortals; i++ )
+	{
+		uint64 nDependency = s_pPortalHashes[i].m_nKey;
+		byte *pFlood = portals[i].portalflood;
+		for ( int j = 0; j < portalbytes; j++ )
+		{
+			if ( !pFlood[j] )
+				continue;
+
+			for ( int k = 0; k < 8; k++ )
+			{
+				if ( pFlood[j] & ( 1 << k ) )
+				{
+					nDependency += s_pPortalHashes[( j << 3 ) + k].m_nMix;
+				}
+			}
+		}
+		s_pPortalHashes[i].m_nDependency = nDependency;
+	}
+
+	delete [] pLeafHashes;
+	delete [] pWindingHashes;
+}
+
+
+static void PutVarInt( CUtlBuffer &buf, unsigned int n )
+{
+	while ( n >= 0x80 )
+	{
+		buf.PutUnsignedChar( (unsigned char)( n | 0x80 ) );
+		n >>= 7;
+	}
+	buf.PutUnsignedChar( (unsigned char)n );
+}
+
+
+static unsigned int GetVarInt( CUtlBuffer &buf )
+{
+	unsigned int n = 0;
+	for ( int nShift = 0; nShift < 32 && buf.IsValid(); nShift += 7 )
+	{
+		unsigned char c = buf.GetUnsignedChar();
+		n |= ( c & 0x7f ) << nShift;
+		if ( !( c & 0x80 ) )
+			break;
+	}
+	return n;
+}
+
+
+/*
+==============
+LoadVisCache
+
+Fills in portalvis for every portal the cache has a valid result for and
+marks it stat_done, so CalcPortalVis skips it. Call after BasePortalVis.
+==============
+*/
+void LoadVisCache( const char *pFilename )
+{
+	HashPortals();
+
+	CUtlBuffer buf;
+	if ( !g_pFileSystem->ReadFile( pFilename, NULL, buf ) )
+		return;
+
+	int nPortals = g_numportals * 2;
+	if ( buf.GetInt() != VISCACHE_ID || buf.GetInt() != VISCACHE_VERSION )
+	{
+		Warning( "%s is not a vis cache, ignoring it\n", pFilename );
+		return;
+	}
+
+	int nOldPortals = buf.GetInt();
+	bool bUseRadius = ( buf.GetInt() != 0 );
+	double flVisRadius = buf.GetDouble();
+	if ( !buf.IsValid() || nOldPortals <= 0 || nOldPortals > MAX_PORTALS )
+	{
+		Warning( "%s is corrupt, ignoring it\n", pFilename );
+		return;
+	}
+	if ( bUseRadius != g_bUseRadius || ( bUseRadius && flVisRadius != g_VisRadius ) )
+	{
+		Msg( "Vis radius changed, not using %s\n", pFilename );
+		return;
+	}
+
+	// Match the old portals up with the new ones
+	CUtlMap< uint64, int > newPortals( DefLessFunc( uint64 ) );
+	for ( int i = 0; i < nPortals; i++ )
+	{
+		int iFound = newPortals.Find( s_pPortalHashes[i].m_nKey );
+		if ( newPortals.IsValidIndex( iFound ) )
+		{
+			newPortals[iFound] = -1;	// can't tell these apart
+		}
+		else
+		{
+			newPortals.Insert( s_pPortalHashes[i].m_nKey, i );
+		}
+	}
+
+	int *pOldToNew = new int[nOldPortals];
+	uint64 *pOldDependency = new uint64[nOldPortals];
+	int *pOldVisOffset = new int[nOldPortals];
+	int *pMatches = new int[nPortals];
+	memset( pMatches, 0, nPortals * sizeof( int ) );
+
+	for ( int i = 0; i < nOldPortals && buf.IsValid(); i++ )
+	{
+		uint64 nKey = buf.GetUnsignedInt64();
+		pOldDependency[i] = buf.GetUnsignedInt64();
+		pOldVisOffset[i] = buf.TellGet();
+
+		int nVisible = GetVarInt( buf );
+		for ( int j = 0; j < nVisible && buf.IsValid(); j++ )
+		{
+			GetVarInt( buf );
+		}
+
+		int iFound = newPortals.Find( nKey );
+		pOldToNew[i] = newPortals.IsValidIndex( iFound ) ? newPortals[iFound] : -1;
+		if ( pOldToNew[i] != -1 )
+		{
+			++pMatches[pOldToNew[i]];
+		}
+	}
+
+	int nReused = 0;
+	if ( !buf.IsValid() )
+	{
+		Warning( "%s is corrupt, ignoring it\n", pFilename );
+	}
+	else
+	{
+		for ( int i = 0; i < nOldPortals; i++ )
+		{
+			int iNew = pOldToNew[i];
+			if ( iNew == -1 || pMatches[iNew] != 1 || pOldDependency[i] != s_pPortalHashes[iNew].m_nDependency )
+				continue;
+
+			portal_t *p = &portals[iNew];
+			buf.SeekGet( CUtlBuffer::SEEK_HEAD, pOldVisOffset[i] );
+
+			bool bValid = true;
+			int nVisible = GetVarInt( buf );
+			int iOld = -1;
+			for ( int j = 0; j < nVisible; j++ )
+			{
+				iOld += GetVarInt( buf ) + 1;
+				if ( iOld >= nOldPortals || pOldToNew[iOld] == -1 || pMatches[pOldToNew[iOld]] != 1 )
+				{
+					bValid = false;
+					break;
+				}
+				SetBit( p->portalvis, pOldToNew[iOld] );
+			}
+
+			if ( !bValid )
+			{
+				memset( p->portalvis, 0, portalbytes );
+				continue;
+			}
+
+			p->status = stat_done;
+			++nReused;
+		}
+	}
+
+	int nClustersReused = 0;
+	for ( int i = 0; i < portalclusters; i++ )
+	{
+		int j;
+		for ( j = 0; j < leafs[i].portals.Count(); j++ )
+		{
+			if ( leafs[i].portals[j]->status != stat_done )
+				break;
+		}
+		if ( j == leafs[i].portals.Count() )
+			++nClustersReused;
+	}
+
+	Msg( "Vis cache: reused %i of %i portals, %i of %i clusters unchanged\n", nReused, nPortals, nClustersReused, portalclusters );
+
+	delete [] pMatches;
+	delete [] pOldVisOffset;
+	delete [] pOldDependency;
+	delete [] pOldToNew;
+}
+
+
+/*
+==============
+SaveVisCache
+==============
+*/
+void SaveVisCache( const char *pFilename )
+{
+	HashPortals();
+
+	int nPortals = g_numportals * 2;
+	CUtlBuffer buf;
+	buf.PutInt( VISCACHE_ID );
+	buf.PutInt( VISCACHE_VERSION );
+	buf.PutInt( nPortals );
+	buf.PutInt( g_bUseRadius ? 1 : 0 );
+	buf.PutDouble( g_VisRadius );
+
+	for ( int i = 0; i < nPortals; i++ )
+	{
+		portal_t *p = &portals[i];
+		buf.PutUnsignedInt64( s_pPortalHashes[i].m_nKey );
+		buf.PutUnsignedInt64( s_pPortalHashes[i].m_nDependency );
+
+		// Visible portals as gaps between indices, most of them fit in a byte
+		PutVarInt( buf, CountBits( p->portalvis, nPortals ) );
+		int iLast = -1;
+		for ( int j = 0; j < nPortals; j++ )
+		{
+			if ( CheckBit( p->portalvis, j ) )
+			{
+				PutVarInt( buf, j - iLast - 1 );
+				iLast = j;
+			}
+		}
+	}
+
+	if ( !g_pFileSystem->WriteFile( pFilename, NULL, buf ) )
+	{
+		Warning( "Couldn't write %s\n", pFilename );
+	}
+}
@@ -56,6 +56,9 @@ double		g_VisRadius = 4096.0f * 4096.0f;
 
 bool		g_bLowPriority = false;
 
+bool		g_bNoVisCache = false;
+char		g_szVisCacheFile[1024];		// empty when not caching
+
 //=============================================================================
 
 void PlaneFromWinding (winding_t *w, plane_t *plane)
@@ -308,7 +311,18 @@ void CalcPortalVis (void)
 	}
 	else 
 	{
-		RunThreadsOnIndividual (g_numportals*2, true, PortalFlow);
+		// Keep the sorted order, cheap portals finish first and tighten the flow of the
+		// expensive ones. Portals the vis cache filled in are already done.
+		int *pWork = (int*)malloc( g_numportals*2*sizeof(int) );
+		int nWork = 0;
+		for (i=0 ; i<g_numportals*2 ; i++)
+		{
+			if (sorted_portals[i]->status != stat_done)
+				pWork[nWork++] = i;
+		}
+
+		RunThreadsOnWorkList (nWork, pWork, true, PortalFlow);
+		free( pWork );
 	}
 }
 
@@ -337,13 +351,24 @@ void CalcVis (void)
 	}
 	else 
 	{
-	    RunThreadsOnIndividual (g_numportals*2, true, BasePortalVis);
+	    RunThreadsOnWorkList (g_numportals*2, NULL, true, BasePortalVis);
 	}
 
 	SortPortals ();
 
+	bool bUseVisCache = ( g_szVisCacheFile[0] && !fastvis && !g_bUseMPI );
+	if ( bUseVisCache )
+	{
+		LoadVisCache( g_szVisCacheFile );
+	}
+
 	CalcPortalVis ();
 
+	if ( bUseVisCache )
+	{
+		SaveVisCache( g_szVisCacheFile );
+	}
+
 	//
 	// assemble the leaf vis lists by oring the portal lists
 	//
@@ -953,6 +978,11 @@ int ParseCommandLine( int argc, char **argv )
 		{
 			g_bLowPriority = true;
 		}
+		else if( !Q_stricmp( argv[i], "-nocache" ) )
+		{
+			Msg ("nocache = true\n");
+			g_bNoVisCache = true;
+		}
 		else if ( !Q_stricmp( argv[i], "-FullMinidumps" ) )
 		{
 			EnableFullMinidumps( true );
@@ -1034,6 +1064,8 @@ void PrintUsage( int argc, char **argv )
 		"  -threads        : Control the number of threads vbsp uses (defaults to the #\n"
 		"                    or processors on your machine).\n"
 		"  -nosort         : Don't sort portals (sorting is an optimization).\n"
+		"  -nocache        : Don't reuse or write <mapname>.viscache. By default portals\n"
+		"                    that didn't change since the last compile aren't flowed again.\n"
 		"  -tmpin          : Make portals come from \\tmp\\<mapname>.\n"
 		"  -tmpout         : Make portals come from \\tmp\\<mapname>.\n"
 		"  -trace <start cluster> <end cluster> : Writes a linefile that traces the vis from one cluster to another for debugging map vis.\n"
@@ -1159,6 +1191,11 @@ int RunVVis( int argc, char **argv )
 	Msg ("reading %s\n", portalfile);
 	LoadPortals (portalfile);
 
+	if ( !g_bNoVisCache )
+	{
+		Q_snprintf( g_szVisCacheFile, sizeof( g_szVisCacheFile ), "%s.viscache", source );
+	}
+
 	// don't write out results when simply doing a trace
 	if ( g_TraceClusterStart < 0 )
 	{
@@ -13,6 +13,7 @@
 #include "tier1/utldict.h"
 #include "tier2/fileutils.h"
 #include "tier1/utlbuffer.h"
+#include "tier0/icommandline.h"
 
 #ifdef VPK_ENABLE_SIGNING
 	#include "crypto.h"
@@ -22,6 +23,12 @@
 #ifdef IS_WINDOWS_PC
 #include <windows.h>
 #endif
+#ifdef VPK_ENABLE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 #include "keyvalues.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
@@ -210,6 +217,7 @@ void CPackedStore::Init( void )
 {
 	m_nHighestChunkFileIndex = -1;
 	m_bUseDirFile = false;
+	m_bMemoryMapData = false;
 	m_pszFileBaseName[0] = 0;
 	m_pszFullPathName[0] = 0;
 	memset( m_pExtensionData, 0, sizeof( m_pExtensionData ) );
@@ -276,6 +284,9 @@ CPackedStore::CPackedStore( char const *pFileBasename, char *pszFName, IBaseFile
 	m_pFileSystem = pFS;
 	m_PackedStoreReadCache.m_pPackedStore = this;
 	m_DirectoryData.AddToTail( 0 );
+#ifdef VPK_ENABLE_MMAP
+	m_bMemoryMapData = !bOpenForWrite && CommandLine()->FindParm( "-vpkmmap" );
+#endif
 
 	if ( pFileBasename )
 	{
@@ -469,7 +480,14 @@ CPackedStore::~CPackedStore( void )
 #else
 			m_pFileSystem->Close( m_FileHandles[i].m_hFileHandle );
 #endif
-
+#ifdef VPK_ENABLE_MMAP
+			if ( m_FileHandles[i].m_pMappedData )
+			{
+				// chunk MD5s may still be reading the mapping
+				m_PackedStoreReadCache.CheckMappedMD5Requests( true );
+				munmap( (void *)m_FileHandles[i].m_pMappedData, m_FileHandles[i].m_nMappedSize );
+			}
+#endif
 		}
 	}
 
@@ -821,31 +839,63 @@ CPackedStore::ESignatureCheckResult CPackedStore::CheckSignature( int nSignature
 
 #endif
 
-CPackedStoreReadCache::CPackedStoreReadCache( IBaseFileSystem *pFS ):m_treeCachedVPKRead( CachedVPKRead_t::Less )
+CPackedStoreReadCache::CPackedStoreReadCache( IBaseFileSystem *pFS )
 {
 	m_pPackedStore = NULL;
-	m_cItemsInCache = 0;
 	m_pFileSystem = pFS;
-	m_cubReadFromCache = 0;
-	m_cReadFromCache = 0;
-	m_cDiscardsFromCache = 0;
-	m_cAddedToCache = 0;
-	m_cCacheMiss = 0;
-	m_cubCacheMiss = 0;
+	m_pFileTracker = NULL;
 	m_cFileErrors = 0;
 	m_cFileErrorsCorrected = 0;
 	m_cFileResultsDifferent = 0;
+
+#ifdef DEDICATED
+	// Off by default on dedicated servers. This saves memory and we rely on the OS
+	// disk cache, which is shared by all server processes on the box.
+	const int nDefaultCacheSizeMB = 0;
+#else
+	const int nDefaultCacheSizeMB = k_nDefaultCacheSizeMB;
+#endif
+	m_nCacheLines = MAX( 0, CommandLine()->ParmValue( "-vpkcachesize", nDefaultCacheSizeMB ) );
+	m_nReadAheadLines = MAX( 0, CommandLine()->ParmValue( "-vpkreadahead", 1 ) );
+
+	// Small caches stay in one shard so they keep a true LRU over all their lines
+	int nShards = MIN( MAX( m_nCacheLines / 8, 1 ), (int)k_nCacheShards );
+	m_nLinesPerShard = ( m_nCacheLines + nShards - 1 ) / nShards;
+	for ( int i = 0; i < k_nCacheShards; i++ )
+	{
+		int nLines = ( i < nShards ) ? m_nLinesPerShard : 0;
+		m_Shards[i].m_rgCurrentCacheIndex.EnsureCount( nLines );
+		m_Shards[i].m_rgReferenced.EnsureCount( nLines );
+	}
+}
+
+CPackedStoreReadCache::~CPackedStoreReadCache()
+{
+	for ( int i = 0; i < k_nCacheShards; i++ )
+	{
+		CUtlRBTree<CachedVPKRead_t> &tree = m_Shards[i].m_treeCachedVPKRead;
+		for ( int idx = tree.FirstInorder(); idx != tree.InvalidIndex(); idx = tree.NextInorder( idx ) )
+		{
+			free( tree[idx].m_pubBuffer );
+		}
+	}
+}
+
+// The chunks of a pack file are spread round-robin over the shards in use
+CPackedStoreReadCache::Shard_t &CPackedStoreReadCache::ShardForChunk( int nPackFileNumber, int nFileFraction )
+{
+	int nShards = MIN( MAX( m_nCacheLines / 8, 1 ), (int)k_nCacheShards );
+	unsigned int nChunk = (unsigned int)nFileFraction / k_cubCacheBufferSize;
+	return m_Shards[ ( nChunk + (unsigned int)nPackFileNumber * 7 ) % nShards ];
 }
 
 // check if the read request can be satisfied from the read cache we have in 1MB chunks
 bool CPackedStoreReadCache::BCanSatisfyFromReadCache( uint8 *pOutData, CPackedStoreFileHandle &handle, FileHandleTracker_t &fHandle, int nDesiredPos, int nNumBytes, int &nRead )
 {
-#ifdef DEDICATED
-	// Never use the read cache on dedicated servers. This saves memory. We rely
-	// on the OS disk cache which will be shared by all server processes.
-	return false;
-#else
 	nRead = 0;
+	if ( !m_nCacheLines )
+		return false;
+
 	int nFileFraction = nDesiredPos & k_nCacheBufferMask;
 	int nOffset = nDesiredPos - nFileFraction;
 	int cubReadChunk = nOffset + nNumBytes;
@@ -871,12 +921,11 @@ bool CPackedStoreReadCache::BCanSatisfyFromReadCache( uint8 *pOutData, CPackedSt
 			cubReadChunk = k_cubCacheBufferSize;
 	}
 	return true;
-#endif
 }
 
 
 // read a single line into the cache
-bool CPackedStoreReadCache::ReadCacheLine( FileHandleTracker_t &fHandle, CachedVPKRead_t &cachedVPKRead, int &nRead )
+bool CPackedStoreReadCache::ReadCacheLine( FileHandleTracker_t &fHandle, CachedVPKRead_t &cachedVPKRead, int &nRead, bool bSubmitMD5 )
 {
 #ifdef IS_WINDOWS_PC
 	if ( cachedVPKRead.m_nFileFraction != fHandle.m_nCurOfs )
@@ -885,11 +934,14 @@ bool CPackedStoreReadCache::ReadCacheLine( FileHandleTracker_t &fHandle, CachedV
 	SetFilePointer ( fHandle.m_hFileHandle, fHandle.m_nCurOfs, NULL,  FILE_BEGIN); 
 #else
 	m_pFileSystem->Seek( fHandle.m_hFileHandle, cachedVPKRead.m_nFileFraction, FILESYSTEM_SEEK_HEAD );
-	nRead = m_pFileSystem->Read( cachedVPKRead.m_pubBuffer, 1024*1024, fHandle.m_hFileHandle );
+	nRead = m_pFileSystem->Read( cachedVPKRead.m_pubBuffer, k_cubCacheBufferSize, fHandle.m_hFileHandle );
 	m_pFileSystem->Seek( fHandle.m_hFileHandle, fHandle.m_nCurOfs, FILESYSTEM_SEEK_HEAD );
 #endif
-	cachedVPKRead.m_cubBuffer = nRead;
-	cachedVPKRead.m_hMD5RequestHandle = m_pFileTracker->SubmitThreadedMD5Request( cachedVPKRead.m_pubBuffer, cachedVPKRead.m_cubBuffer, m_pPackedStore->m_PackFileID, cachedVPKRead.m_nPackFileNumber, cachedVPKRead.m_nFileFraction );
+	cachedVPKRead.m_cubBuffer = MAX( nRead, 0 );
+	if ( bSubmitMD5 && m_pFileTracker )
+	{
+		cachedVPKRead.m_hMD5RequestHandle = m_pFileTracker->SubmitThreadedMD5Request( cachedVPKRead.m_pubBuffer, cachedVPKRead.m_cubBuffer, m_pPackedStore->m_PackFileID, cachedVPKRead.m_nPackFileNumber, cachedVPKRead.m_nFileFraction );
+	}
 	return true;
 }
 
@@ -929,25 +981,15 @@ bool CPackedStoreReadCache::CheckMd5Result( CachedVPKRead_t &cachedVPKRead, MD5V
 }
 
 
-int CPackedStoreReadCache::FindBufferToUse()
+// pick the slot in a full shard whose buffer gets reused. Shard must be locked for write.
+int CPackedStoreReadCache::FindBufferToUse( Shard_t &shard )
 {
-	int idxLRU = 0;
-	int idxToRemove = m_treeCachedVPKRead.InvalidIndex();
-	uint32 uTimeLowest = (uint32)~0; // MAXINT
-	// find the oldest item, reuse its buffer
-	for ( int i = 0; i < m_cItemsInCache; i++ )
+	// check if any MD5s are done while we are here
+	for ( int i = 0; i < shard.m_cItemsInCache; i++ )
 	{
-		if ( m_rgLastUsedTime[i] < uTimeLowest )
+		CachedVPKRead_t &cachedVPKRead = shard.m_treeCachedVPKRead[ shard.m_rgCurrentCacheIndex[i] ];
+		if ( cachedVPKRead.m_hMD5RequestHandle )
 		{
-			uTimeLowest = m_rgLastUsedTime[i];
-			idxToRemove = m_rgCurrentCacheIndex[i];
-			idxLRU = i;
-		}
-		int idxCurrent = m_rgCurrentCacheIndex[i];
-		// while we are here check if the MD5 is done
-		if ( m_treeCachedVPKRead[idxCurrent].m_hMD5RequestHandle )
-		{
-			CachedVPKRead_t &cachedVPKRead = m_treeCachedVPKRead[idxCurrent];
 			MD5Value_t md5Value;
 			if ( m_pFileTracker->IsMD5RequestComplete( cachedVPKRead.m_hMD5RequestHandle, &md5Value ) )
 			{
@@ -960,13 +1002,25 @@ int CPackedStoreReadCache::FindBufferToUse()
 		}
 	}
 
+	// clock sweep, giving every recently used line a second chance. This ends within
+	// two trips round the shard since every referenced line we pass gets cleared.
+	int idxLRU;
+	for ( ;; )
+	{
+		idxLRU = shard.m_iClockHand;
+		shard.m_iClockHand = ( shard.m_iClockHand + 1 ) % shard.m_cItemsInCache;
+		if ( !shard.m_rgReferenced[idxLRU] )
+			break;
+		shard.m_rgReferenced[idxLRU] = 0;
+	}
+
 	// if we submitted its MD5 for processing, then wait until that is done
-	if ( m_treeCachedVPKRead[idxToRemove].m_hMD5RequestHandle )
+	CachedVPKRead_t &cachedVPKRead = shard.m_treeCachedVPKRead[ shard.m_rgCurrentCacheIndex[idxLRU] ];
+	if ( cachedVPKRead.m_hMD5RequestHandle )
 	{
-		CachedVPKRead_t &cachedVPKRead = m_treeCachedVPKRead[idxToRemove];
 		MD5Value_t md5Value;
 		m_pFileTracker->BlockUntilMD5RequestComplete( cachedVPKRead.m_hMD5RequestHandle, &md5Value );
-		m_treeCachedVPKRead[idxToRemove].m_hMD5RequestHandle = 0;
+		cachedVPKRead.m_hMD5RequestHandle = 0;
 		// make sure it matches what it is supposed to match
 		CheckMd5Result( cachedVPKRead, md5Value );
 	}
@@ -974,89 +1028,253 @@ int CPackedStoreReadCache::FindBufferToUse()
 }
 
 
+// Read a chunk into a free or reclaimed slot of the shard, which must be locked for write.
+// cachedVPKRead identifies the chunk and carries what we already know about it (e.g. its MD5
+// state if it was cached and evicted before). Returns the tree index now holding it.
+int CPackedStoreReadCache::LoadCacheLine( Shard_t &shard, FileHandleTracker_t &fHandle, CachedVPKRead_t &cachedVPKRead, int &nRead )
+{
+	uint8 *pubBuffer = NULL;
+	int idxLRU;
+	if ( shard.m_cItemsInCache >= m_nLinesPerShard )
+	{
+		idxLRU = FindBufferToUse( shard );
+		CachedVPKRead_t &evicted = shard.m_treeCachedVPKRead[ shard.m_rgCurrentCacheIndex[idxLRU] ];
+		pubBuffer = evicted.m_pubBuffer;
+		evicted.m_pubBuffer = NULL;
+		evicted.m_idxLRU = -1;
+		m_cDiscardsFromCache++;
+	}
+	else
+	{
+		idxLRU = shard.m_cItemsInCache++;
+	}
+	if ( pubBuffer == NULL )
+	{
+		pubBuffer = (uint8 *)malloc( k_cubCacheBufferSize );
+	}
+
+	// chunks come back into the cache after being evicted, but only get hashed the first time
+	int idxTrackedVPKFile = shard.m_treeCachedVPKRead.Find( cachedVPKRead );
+	bool bFirstRead = ( idxTrackedVPKFile == shard.m_treeCachedVPKRead.InvalidIndex() );
+	cachedVPKRead.m_pubBuffer = pubBuffer;
+	cachedVPKRead.m_idxLRU = idxLRU;
+	ReadCacheLine( fHandle, cachedVPKRead, nRead, bFirstRead );
+	if ( bFirstRead )
+	{
+		idxTrackedVPKFile = shard.m_treeCachedVPKRead.Insert( cachedVPKRead );
+	}
+	else
+	{
+		shard.m_treeCachedVPKRead[idxTrackedVPKFile] = cachedVPKRead;
+	}
+	m_cAddedToCache++;
+
+	// this item is in the cache
+	shard.m_rgCurrentCacheIndex[idxLRU] = idxTrackedVPKFile;
+	shard.m_rgReferenced[idxLRU] = 1;
+	return idxTrackedVPKFile;
+}
+
+
 // manage the cache
 bool CPackedStoreReadCache::BCanSatisfyFromReadCacheInternal( uint8 *pOutData, CPackedStoreFileHandle &handle, FileHandleTracker_t &fHandle, int nDesiredPos, int nNumBytes, int &nRead )
 {
 	bool bSuccess = false;
-	m_rwlock.LockForRead();
-	bool bLockedForWrite = false;
+	bool bMissed = false;
 
 	CachedVPKRead_t cachedVPKRead;
 	cachedVPKRead.m_nPackFileNumber = handle.m_nFileNumber;
 	cachedVPKRead.m_nFileFraction = nDesiredPos & k_nCacheBufferMask;
-	int idxTrackedVPKFile = m_treeCachedVPKRead.Find( cachedVPKRead );
-	if ( idxTrackedVPKFile == m_treeCachedVPKRead.InvalidIndex() )
+
+	Shard_t &shard = ShardForChunk( cachedVPKRead.m_nPackFileNumber, cachedVPKRead.m_nFileFraction );
+	shard.m_rwlock.LockForRead();
+	bool bLockedForWrite = false;
+
+	int idxTrackedVPKFile = shard.m_treeCachedVPKRead.Find( cachedVPKRead );
+	if ( idxTrackedVPKFile == shard.m_treeCachedVPKRead.InvalidIndex() || shard.m_treeCachedVPKRead[idxTrackedVPKFile].m_pubBuffer == NULL )
 	{
-		m_rwlock.UnlockRead();
-		m_rwlock.LockForWrite();
+		shard.m_rwlock.UnlockRead();
+		shard.m_rwlock.LockForWrite();
 		bLockedForWrite = true;
 		// if we didnt find it, we had to grab the write lock, it may have been added while we waited
-		idxTrackedVPKFile = m_treeCachedVPKRead.Find( cachedVPKRead );
+		idxTrackedVPKFile = shard.m_treeCachedVPKRead.Find( cachedVPKRead );
 	}
-	if ( idxTrackedVPKFile == m_treeCachedVPKRead.InvalidIndex() )
-	{
-		// if we are over our limit, remove one and reuse the buffer
-		cachedVPKRead.m_pubBuffer = NULL;
-		int idxLRU = -1;
 
-		if ( m_cItemsInCache >= k_nCacheBuffersToKeep )
+	if ( idxTrackedVPKFile == shard.m_treeCachedVPKRead.InvalidIndex() || shard.m_treeCachedVPKRead[idxTrackedVPKFile].m_pubBuffer == NULL )
+	{
+		if ( idxTrackedVPKFile != shard.m_treeCachedVPKRead.InvalidIndex() )
 		{
-			idxLRU = FindBufferToUse();
-			int idxToRemove = m_rgCurrentCacheIndex[idxLRU];
-
-			cachedVPKRead.m_pubBuffer = m_treeCachedVPKRead[idxToRemove].m_pubBuffer;
-			m_treeCachedVPKRead[idxToRemove].m_pubBuffer = NULL;
-			m_cDiscardsFromCache++;
+			// read, MD5ed and LRUd away before, keep what we know about it
+			cachedVPKRead = shard.m_treeCachedVPKRead[idxTrackedVPKFile];
 		}
-		else
+		idxTrackedVPKFile = LoadCacheLine( shard, fHandle, cachedVPKRead, nRead );
+		m_cCacheMiss++;
+		m_cubCacheMiss += nNumBytes;
+		bMissed = true;
+	}
+	else
+	{
+		m_cubReadFromCache += nNumBytes;
+		m_cReadFromCache++;
+		shard.m_rgReferenced[ shard.m_treeCachedVPKRead[idxTrackedVPKFile].m_idxLRU ] = 1;
+	}
+
+	const CachedVPKRead_t &cachedLine = shard.m_treeCachedVPKRead[idxTrackedVPKFile];
+	if ( cachedLine.m_pubBuffer != NULL && cachedLine.m_cubBuffer + cachedLine.m_nFileFraction >= nDesiredPos+nNumBytes )
+	{
+		int nOffset = nDesiredPos - cachedLine.m_nFileFraction;
+		memcpy( pOutData, (uint8 *)&cachedLine.m_pubBuffer[nOffset], nNumBytes );
+		nRead = nNumBytes;
+		bSuccess = true;
+	}
+	bool bFullLine = ( cachedLine.m_cubBuffer == k_cubCacheBufferSize );
+	if ( bLockedForWrite )
+		shard.m_rwlock.UnlockWrite();
+	else
+		shard.m_rwlock.UnlockRead();
+
+	if ( bMissed )
+	{
+		// a miss right after the previous chunk of the same file means it is being read straight through
+		if ( bFullLine && fHandle.m_nLastCachedFraction == cachedVPKRead.m_nFileFraction - k_cubCacheBufferSize )
 		{
-			idxLRU = m_cItemsInCache;
-			m_cItemsInCache++;
+			ReadAhead( handle, fHandle, cachedVPKRead.m_nFileFraction );
 		}
-		if ( cachedVPKRead.m_pubBuffer == NULL )
+		fHandle.m_nLastCachedFraction = cachedVPKRead.m_nFileFraction;
+	}
+
+	return bSuccess;
+}
+
+// Pull in the chunks following nFileFraction that aren't cached yet. Called with the
+// file handle locked and no shard locked, each shard is locked in turn.
+void CPackedStoreReadCache::ReadAhead( CPackedStoreFileHandle &handle, FileHandleTracker_t &fHandle, int nFileFraction )
+{
+	for ( int i = 1; i <= m_nReadAheadLines; i++ )
+	{
+		CachedVPKRead_t cachedVPKRead;
+		cachedVPKRead.m_nPackFileNumber = handle.m_nFileNumber;
+		cachedVPKRead.m_nFileFraction = nFileFraction + i * k_cubCacheBufferSize;
+		if ( cachedVPKRead.m_nFileFraction < 0 || ( cachedVPKRead.m_nFileFraction & ~k_nCacheBufferMask ) )
+			break;
+
+		Shard_t &shard = ShardForChunk( cachedVPKRead.m_nPackFileNumber, cachedVPKRead.m_nFileFraction );
+		shard.m_rwlock.LockForWrite();
+		int idxTrackedVPKFile = shard.m_treeCachedVPKRead.Find( cachedVPKRead );
+		bool bFullLine = true;
+		if ( idxTrackedVPKFile == shard.m_treeCachedVPKRead.InvalidIndex() || shard.m_treeCachedVPKRead[idxTrackedVPKFile].m_pubBuffer == NULL )
 		{
-			cachedVPKRead.m_pubBuffer = (uint8 *)malloc( k_cubCacheBufferSize );
+			if ( idxTrackedVPKFile != shard.m_treeCachedVPKRead.InvalidIndex() )
+			{
+				cachedVPKRead = shard.m_treeCachedVPKRead[idxTrackedVPKFile];
+			}
+			int nRead = 0;
+			idxTrackedVPKFile = LoadCacheLine( shard, fHandle, cachedVPKRead, nRead );
+			bFullLine = ( shard.m_treeCachedVPKRead[idxTrackedVPKFile].m_cubBuffer == k_cubCacheBufferSize );
+			m_cReadAhead++;
+			fHandle.m_nLastCachedFraction = cachedVPKRead.m_nFileFraction;
 		}
-		cachedVPKRead.m_idxLRU = idxLRU;
-		ReadCacheLine( fHandle, cachedVPKRead, nRead );
-		idxTrackedVPKFile = m_treeCachedVPKRead.Insert( cachedVPKRead );
-		m_cAddedToCache++;
+		shard.m_rwlock.UnlockWrite();
 
-		// this item is in the cache
-		m_rgCurrentCacheIndex[idxLRU] = idxTrackedVPKFile;
-		m_rgLastUsedTime[idxLRU] = Plat_MSTime();
+		// hit the end of the file
+		if ( !bFullLine )
+			break;
 	}
-	else
+}
+
+// A read served straight from a mapped data file. The chunks it touches never take a cache
+// line, but the first read of each submits its MD5 on the mapped bytes so corrupt data is
+// tracked the same as for cached reads.
+void CPackedStoreReadCache::TrackMappedRead( FileHandleTracker_t &fHandle, int nPackFileNumber, int nDesiredPos, int nNumBytes )
+{
+	m_cReadFromMapping++;
+	m_cubReadFromMapping += nNumBytes;
+	if ( !m_pFileTracker || nNumBytes <= 0 )
+		return;
+
+	int nLastFraction = ( nDesiredPos + nNumBytes - 1 ) & k_nCacheBufferMask;
+	for ( int nFileFraction = nDesiredPos & k_nCacheBufferMask; nFileFraction <= nLastFraction; nFileFraction += k_cubCacheBufferSize )
 	{
-		cachedVPKRead = m_treeCachedVPKRead[idxTrackedVPKFile];
-		if ( cachedVPKRead.m_pubBuffer == NULL )
+		CachedVPKRead_t cachedVPKRead;
+		cachedVPKRead.m_nPackFileNumber = nPackFileNumber;
+		cachedVPKRead.m_nFileFraction = nFileFraction;
+
+		Shard_t &shard = ShardForChunk( nPackFileNumber, nFileFraction );
+		shard.m_rwlock.LockForRead();
+		bool bTracked = ( shard.m_treeCachedVPKRead.Find( cachedVPKRead ) != shard.m_treeCachedVPKRead.InvalidIndex() );
+		shard.m_rwlock.UnlockRead();
+		if ( bTracked )
+			continue;
+
+		shard.m_rwlock.LockForWrite();
+		bTracked = ( shard.m_treeCachedVPKRead.Find( cachedVPKRead ) != shard.m_treeCachedVPKRead.InvalidIndex() );
+		if ( !bTracked )
 		{
-			// this chunk has been read, MD5ed, and then LRUd away
-			// we will not read it again, we fall back to normal file I/O
-			m_cCacheMiss ++;
-			m_cubCacheMiss += nNumBytes;
-			bSuccess = false;
+			// tracked like a line that was LRUd away, m_pubBuffer stays NULL
+			cachedVPKRead.m_cubBuffer = (int)MIN( (int64)k_cubCacheBufferSize, fHandle.m_nMappedSize - nFileFraction );
+			cachedVPKRead.m_hMD5RequestHandle = m_pFileTracker->SubmitThreadedMD5Request( const_cast<uint8 *>( fHandle.m_pMappedData ) + nFileFraction, cachedVPKRead.m_cubBuffer, m_pPackedStore->m_PackFileID, nPackFileNumber, nFileFraction );
+			shard.m_treeCachedVPKRead.Insert( cachedVPKRead );
 		}
-		else
+		shard.m_rwlock.UnlockWrite();
+
+		if ( !bTracked && cachedVPKRead.m_hMD5RequestHandle )
 		{
-			m_cubReadFromCache += nNumBytes;
-			m_cReadFromCache ++;
-			m_rgLastUsedTime[m_treeCachedVPKRead[idxTrackedVPKFile].m_idxLRU] = Plat_MSTime();
+			AUTO_LOCK( m_MappedMD5Mutex );
+			m_vecMappedMD5Pending.AddToTail( cachedVPKRead );
 		}
 	}
-	if ( cachedVPKRead.m_pubBuffer != NULL && cachedVPKRead.m_cubBuffer + cachedVPKRead.m_nFileFraction >= nDesiredPos+nNumBytes )
+}
+
+// Check the MD5s of mapped chunks that have finished. Without bBlock this gives up straight
+// away when another thread is already checking.
+void CPackedStoreReadCache::CheckMappedMD5Requests( bool bBlock )
+{
+	if ( !m_vecMappedMD5Pending.Count() )
+		return;
+
+	if ( bBlock )
+	{
+		m_MappedMD5Mutex.Lock();
+	}
+	else if ( !m_MappedMD5Mutex.TryLock() )
 	{
-		int nOffset = nDesiredPos - cachedVPKRead.m_nFileFraction;
-		memcpy( pOutData, (uint8 *)&cachedVPKRead.m_pubBuffer[nOffset], nNumBytes );
-		nRead = nNumBytes;
-		bSuccess = true;
+		return;
 	}
-	if ( bLockedForWrite )
-		m_rwlock.UnlockWrite();
-	else
-		m_rwlock.UnlockRead();
 
-	return bSuccess;
+	FOR_EACH_VEC_BACK( m_vecMappedMD5Pending, i )
+	{
+		Shard_t &shard = ShardForChunk( m_vecMappedMD5Pending[i].m_nPackFileNumber, m_vecMappedMD5Pending[i].m_nFileFraction );
+		shard.m_rwlock.LockForWrite();
+		bool bDone = true;
+		int idxTrackedVPKFile = shard.m_treeCachedVPKRead.Find( m_vecMappedMD5Pending[i] );
+		if ( idxTrackedVPKFile != shard.m_treeCachedVPKRead.InvalidIndex() && shard.m_treeCachedVPKRead[idxTrackedVPKFile].m_hMD5RequestHandle )
+		{
+			CachedVPKRead_t &cachedVPKRead = shard.m_treeCachedVPKRead[idxTrackedVPKFile];
+			MD5Value_t md5Value;
+			if ( bBlock )
+			{
+				m_pFileTracker->BlockUntilMD5RequestComplete( cachedVPKRead.m_hMD5RequestHandle, &md5Value );
+			}
+			else
+			{
+				bDone = m_pFileTracker->IsMD5RequestComplete( cachedVPKRead.m_hMD5RequestHandle, &md5Value );
+			}
+
+			if ( bDone )
+			{
+				cachedVPKRead.m_hMD5RequestHandle = 0;
+				CheckMd5Result( cachedVPKRead, md5Value );
+			}
+		}
+		shard.m_rwlock.UnlockWrite();
+
+		if ( bDone )
+		{
+			m_vecMappedMD5Pending.FastRemove( i );
+		}
+	}
+
+	m_MappedMD5Mutex.Unlock();
 }
 
 // Reread the bad cache line - takes the fHandle lock
@@ -1070,21 +1288,20 @@ void CPackedStoreReadCache::RereadBadCacheLine( CachedVPKRead_t &cachedVPKRead )
 	fHandle.m_Mutex.Unlock();
 }
 
-// Recheck the MD5 of the cache line - takes the cache lock
+// Recheck the MD5 of the cache line - takes the failed list lock
 void CPackedStoreReadCache::RecheckBadCacheLine( CachedVPKRead_t &cachedVPKRead )
 {
-	m_rwlock.LockForWrite();
-	ChunkHashFraction_t chunkHashFraction;
-	m_pPackedStore->FindFileHashFraction( cachedVPKRead.m_nPackFileNumber, cachedVPKRead.m_nFileFraction, chunkHashFraction );
-
 	MD5Value_t md5ValueSecondTry;
 	m_pFileTracker->BlockUntilMD5RequestComplete( cachedVPKRead.m_hMD5RequestHandle, &md5ValueSecondTry );
 	cachedVPKRead.m_hMD5RequestHandle = 0;
+
+	AUTO_LOCK( m_FailedMutex );
 	CheckMd5Result( cachedVPKRead, md5ValueSecondTry );
+	// the buffer was only allocated for the retry, it isn't part of the cache
+	free( cachedVPKRead.m_pubBuffer );
 	cachedVPKRead.m_pubBuffer = NULL;
 	// m_listCachedVPKReadsFailed contains all the data about failed reads - for error or OGS reporting
 	m_listCachedVPKReadsFailed.AddToTail( cachedVPKRead );
-	m_rwlock.UnlockWrite();
 }
 
 // try reloading anything that failed its md5 check
@@ -1144,6 +1361,11 @@ void CPackedStore::GetPackFileLoadErrorSummaryKV( KeyValues *pKV )
 	pKV->SetInt( "DiscardsFromCache" ,		m_PackedStoreReadCache.m_cDiscardsFromCache );
 	pKV->SetInt( "AddedToCache" ,			m_PackedStoreReadCache.m_cAddedToCache );
 	pKV->SetInt( "CacheMisses" ,			m_PackedStoreReadCache.m_cCacheMiss );
+	pKV->SetInt( "BytesCacheMissed" ,		m_PackedStoreReadCache.m_cubCacheMiss );
+	pKV->SetInt( "ReadAheadLines" ,			m_PackedStoreReadCache.m_cReadAhead );
+	pKV->SetInt( "BytesReadFromMapping" ,	m_PackedStoreReadCache.m_cubReadFromMapping );
+	pKV->SetInt( "ItemsReadFromMapping" ,	m_PackedStoreReadCache.m_cReadFromMapping );
+	pKV->SetInt( "CacheSizeMB" ,			m_PackedStoreReadCache.GetCacheSizeMB() );
 	pKV->SetInt( "FileErrorCount" ,			m_PackedStoreReadCache.m_cFileErrors );
 	pKV->SetInt( "FileErrorsCorrected" ,	m_PackedStoreReadCache.m_cFileErrorsCorrected );
 	pKV->SetInt( "FileResultsDifferent" ,	m_PackedStoreReadCache.m_cFileResultsDifferent );
@@ -1204,13 +1426,25 @@ int CPackedStore::ReadData( CPackedStoreFileHandle &handle, void *pOutData, int
 			FileHandleTracker_t &fHandle = GetFileHandle( handle.m_nFileNumber );
 			int nDesiredPos = handle.m_nFileOffset + handle.m_nCurrentFileOffset - handle.m_nMetaDataSize;
 			int nRead;
-			fHandle.m_Mutex.Lock();
 			if ( handle.m_nFileNumber == VPKFILENUMBER_EMBEDDED_IN_DIR_FILE )
 			{
 				// for file data in the directory header, all offsets are relative to the size of the dir header.
 				nDesiredPos += m_nDirectoryDataSize + sizeof( VPKDirHeader_t );
 			}
 
+			if ( fHandle.m_pMappedData && nDesiredPos + nNumBytes <= fHandle.m_nMappedSize )
+			{
+				// mapped data files don't need the handle or the read cache, the page cache has it all.
+				// The chunks still get their MD5 checked like cached ones.
+				memcpy( pOutData, fHandle.m_pMappedData + nDesiredPos, nNumBytes );
+				handle.m_nCurrentFileOffset += nNumBytes;
+				m_PackedStoreReadCache.TrackMappedRead( fHandle, handle.m_nFileNumber, nDesiredPos, nNumBytes );
+				m_PackedStoreReadCache.CheckMappedMD5Requests( false );
+				m_PackedStoreReadCache.RetryAllBadCacheLines();
+				return nRet + nNumBytes;
+			}
+
+			fHandle.m_Mutex.Lock();
 			if ( m_PackedStoreReadCache.BCanSatisfyFromReadCache( (uint8 *)pOutData, handle, fHandle, nDesiredPos, nNumBytes, nRead ) )
 			{
 				handle.m_nCurrentFileOffset += nRead;
@@ -1237,6 +1471,27 @@ int CPackedStore::ReadData( CPackedStoreFileHandle &handle, void *pOutData, int
 	return nRet;
 }
 
+void const *CPackedStore::GetDataPointer( CPackedStoreFileHandle &handle )
+{
+	// the start of the file is in the directory, so it isn't contiguous with the rest
+	if ( !m_bMemoryMapData || handle.m_nMetaDataSize )
+		return NULL;
+
+	FileHandleTracker_t &fHandle = GetFileHandle( handle.m_nFileNumber );
+	int64 nDataPos = handle.m_nFileOffset;
+	if ( handle.m_nFileNumber == VPKFILENUMBER_EMBEDDED_IN_DIR_FILE )
+	{
+		nDataPos += m_nDirectoryDataSize + sizeof( VPKDirHeader_t );
+	}
+	if ( !fHandle.m_pMappedData || nDataPos + handle.m_nFileSize > fHandle.m_nMappedSize )
+		return NULL;
+
+	// the caller reads all of it, check it the same as a read
+	m_PackedStoreReadCache.TrackMappedRead( fHandle, handle.m_nFileNumber, (int)nDataPos, handle.m_nFileSize );
+	m_PackedStoreReadCache.CheckMappedMD5Requests( false );
+	return fHandle.m_pMappedData + nDataPos;
+}
+
 bool CPackedStore::HashEntirePackFile( CPackedStoreFileHandle &handle, int64 &nFileSize, int nFileFraction, int nFractionSize, FileHash_t &fileHash )
 {
 #define	CRC_CHUNK_SIZE	(32*1024)
@@ -1485,6 +1740,10 @@ FileHandleTracker_t & CPackedStore::GetFileHandle( int nFileNumber )
 		if ( m_FileHandles[nFileHandleIdx].m_hFileHandle != FILESYSTEM_INVALID_HANDLE )
 		{
 			m_FileHandles[nFileHandleIdx].m_nFileNumber = nFileNumber;
+			if ( m_bMemoryMapData )
+			{
+				MapDataFile( m_FileHandles[nFileHandleIdx], pszDataFileName );
+			}
 		}
 #endif
 		return m_FileHandles[nFileHandleIdx];
@@ -1499,6 +1758,29 @@ FileHandleTracker_t & CPackedStore::GetFileHandle( int nFileNumber )
 	return invalid;
 }
 
+// Map the whole data file read-only. Failing is harmless, reads just go through the handle.
+void CPackedStore::MapDataFile( FileHandleTracker_t &fHandle, char const *pszDataFileName )
+{
+#ifdef VPK_ENABLE_MMAP
+	int fd = open( pszDataFileName, O_RDONLY );
+	if ( fd < 0 )
+		return;
+
+	struct stat statBuf;
+	if ( fstat( fd, &statBuf ) == 0 && statBuf.st_size > 0 )
+	{
+		void *pMapped = mmap( NULL, statBuf.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+		if ( pMapped != MAP_FAILED )
+		{
+			fHandle.m_pMappedData = (uint8 const *)pMapped;
+			fHandle.m_nMappedSize = statBuf.st_size;
+		}
+	}
+	// the mapping keeps its own reference to the file
+	close( fd );
+#endif
+}
+
 bool CPackedStore::RemoveFileFromDirectory( const char *pszName )
 {
 	// Remove it without building hash tables
@@ -89,6 +89,7 @@ public:
 	virtual const ConVar	*FindVar ( const char *var_name ) const;
 	virtual ConCommand		*FindCommand( const char *name );
 	virtual const ConCommand *FindCommand( const char *name ) const;
+	virtual int				GetRegistrationGeneration() const { return m_nRegistrationGeneration; }
 	virtual void			InstallGlobalChangeCallback( FnChangeCallback_t callback );
 	virtual void			RemoveGlobalChangeCallback( FnChangeCallback_t callback );
 	virtual void			CallGlobalChangeCallbacks( ConVar *var, const char *pOldString, float flOldValue );
@@ -135,6 +136,7 @@ private:
 
 	ConCommandBase						*m_pConCommandList;
 	CConCommandHash						m_CommandHash;
+	int									m_nRegistrationGeneration;
 
 	// temporary console area so we can store prints before console display funs are installed
 	mutable CUtlBuffer					m_TempConsoleBuffer;
@@ -271,6 +273,7 @@ CCvar::CCvar() : m_TempConsoleBuffer( 0, 1024 ), m_SplitScreenAddedConVarsMap( 0
 {
 	m_nNextDLLIdentifier = 0;
 	m_pConCommandList = NULL;
+	m_nRegistrationGeneration = 0;
 	m_nMaxSplitScreenSlots = 1;
 	m_bMaterialSystemThreadSetAllowed = false;
 	m_CommandHash.Init();
@@ -458,6 +461,7 @@ void CCvar::RegisterConCommand( ConCommandBase *variable )
 	AssertMsg1(FindCommandBase(variable->GetName()) == NULL, "Console command %s added twice!",
 		variable->GetName());
 	m_CommandHash.Insert(variable);
+	m_nRegistrationGeneration++;
 }
 
 void CCvar::AddSplitScreenConVars()
@@ -574,6 +578,7 @@ void CCvar::UnregisterConCommand( ConCommandBase *pCommandToRemove )
 		}
 		pCommand->m_pNext = NULL;
 		m_CommandHash.Remove(m_CommandHash.Find(pCommand));
+		m_nRegistrationGeneration++;
 		break;
 	}
 }
@@ -585,6 +590,7 @@ void CCvar::UnregisterConCommands( CVarDLLIdentifier_t id )
 
 	pNewList = NULL;
 
+	m_nRegistrationGeneration++;
 	m_CommandHash.Purge( true );
 	pCommand = m_pConCommandList;
 	while ( pCommand )